@@ -0,0 +1,194 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <algorithm>
+
+// Runs ZipExtract --headless over every archive in a corpus directory and
+// reports the median of several runs. Throughput and phase timings come from
+// the app's own summary; peak RSS and syscall counts come from the process
+// section it adds on Linux.
+
+namespace {
+
+struct RunResult {
+    qint64 processMs = 0;
+    QJsonObject summary;
+};
+
+bool runOnce(const QString &app, const QString &archive, int threads, RunResult &result, QString &error)
+{
+    QTemporaryDir scratch;
+    if (!scratch.isValid()) {
+        error = "Cannot create a scratch directory";
+        return false;
+    }
+
+    QProcess process;
+    process.setProcessChannelMode(QProcess::SeparateChannels);
+
+    QElapsedTimer timer;
+    timer.start();
+    process.start(app, { "--headless", "-o", scratch.path(), "-j", QString::number(threads), archive });
+    if (!process.waitForFinished(-1)) {
+        error = process.errorString();
+        return false;
+    }
+    result.processMs = timer.elapsed();
+
+    const QJsonDocument document = QJsonDocument::fromJson(process.readAllStandardOutput());
+    if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0 || !document.isObject()) {
+        error = QString::fromLocal8Bit(process.readAllStandardError()).trimmed();
+        if (error.isEmpty()) {
+            error = QString("Exit code %1").arg(process.exitCode());
+        }
+        return false;
+    }
+
+    result.summary = document.object();
+    return true;
+}
+
+double median(QList<double> values)
+{
+    if (values.isEmpty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    const qsizetype middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+double processValue(const RunResult &run, const char *key)
+{
+    return run.summary["process"].toObject()[key].toDouble();
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("zipextract-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks ZipExtract headless extraction over a corpus directory.");
+    parser.addHelpOption();
+    parser.addOption({ "app", "ZipExtract executable.", "path", ZIPEXTRACT_APP_PATH });
+    parser.addOption({ "runs", "Measured runs per archive.", "n", "3" });
+    parser.addOption({ "warmup", "Unmeasured runs per archive, to warm the page cache.", "n", "1" });
+    parser.addOption({ { "j", "threads" }, "Worker thread count passed to ZipExtract.", "count", "0" });
+    parser.addOption({ "json", "Also write the results as JSON.", "path" });
+    parser.addPositionalArgument("corpus", "Directory produced by zipextract-corpus.");
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 1) {
+        err << "Expected exactly one corpus directory\n";
+        return 2;
+    }
+
+    const int runs = qMax(1, parser.value("runs").toInt());
+    const int warmup = qMax(0, parser.value("warmup").toInt());
+    const int threads = qMax(0, parser.value("threads").toInt());
+    const QString appPath = parser.value("app");
+
+    const QDir corpus(positional.first());
+    const QStringList archives = corpus.entryList({ "*.zip" }, QDir::Files, QDir::Name);
+    if (archives.isEmpty()) {
+        err << "No archives in " << corpus.path() << "\n";
+        return 1;
+    }
+
+    out << QString("%1 %2 %3 %4 %5 %6 %7\n")
+               .arg("archive", -28)
+               .arg("entries", 8)
+               .arg("wall ms", 9)
+               .arg("MB/s", 9)
+               .arg("peak RSS KB", 12)
+               .arg("read calls", 11)
+               .arg("write calls", 12);
+    out.flush();
+
+    QJsonArray results;
+    bool failed = false;
+    for (const QString &name : archives) {
+        const QString archive = corpus.filePath(name);
+        QList<RunResult> measured;
+        QString error;
+
+        for (int i = 0; i < warmup + runs && error.isEmpty(); ++i) {
+            RunResult run;
+            if (runOnce(appPath, archive, threads, run, error) && i >= warmup) {
+                measured.append(run);
+            }
+        }
+        if (!error.isEmpty()) {
+            err << name << ": " << error << "\n";
+            failed = true;
+            continue;
+        }
+
+        QList<double> wall;
+        QList<double> throughput;
+        QList<double> readCalls;
+        QList<double> writeCalls;
+        double peakRss = 0;
+        for (const RunResult &run : std::as_const(measured)) {
+            wall.append(run.summary["wallMs"].toDouble());
+            throughput.append(run.summary["mbPerSecond"].toDouble());
+            readCalls.append(processValue(run, "readSyscalls"));
+            writeCalls.append(processValue(run, "writeSyscalls"));
+            peakRss = qMax(peakRss, processValue(run, "peakRssKb"));
+        }
+
+        const qint64 entries = measured.first().summary["entries"].toInteger();
+        out << QString("%1 %2 %3 %4 %5 %6 %7\n")
+                   .arg(name, -28)
+                   .arg(entries, 8)
+                   .arg(median(wall), 9, 'f', 0)
+                   .arg(median(throughput), 9, 'f', 1)
+                   .arg(peakRss, 12, 'f', 0)
+                   .arg(median(readCalls), 11, 'f', 0)
+                   .arg(median(writeCalls), 12, 'f', 0);
+        out.flush();
+
+        QJsonObject result;
+        result["archive"] = name;
+        result["entries"] = entries;
+        result["runs"] = runs;
+        result["wallMs"] = median(wall);
+        result["mbPerSecond"] = median(throughput);
+        result["peakRssKb"] = peakRss;
+        result["readSyscalls"] = median(readCalls);
+        result["writeSyscalls"] = median(writeCalls);
+        result["processMs"] = median([&measured]() {
+            QList<double> values;
+            for (const RunResult &run : std::as_const(measured)) {
+                values.append(run.processMs);
+            }
+            return values;
+        }());
+        results.append(result);
+    }
+
+    if (parser.isSet("json")) {
+        QFile file(parser.value("json"));
+        if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(results).toJson()) < 0) {
+            err << "Cannot write " << file.fileName() << "\n";
+            return 1;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,321 @@
+#include "corpuszipwriter.h"
+#include <QBuffer>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <cstring>
+#include <functional>
+
+// Writes the synthetic archives the benchmark harness extracts. The output
+// depends only on the seed and scale, so corpora generated on different
+// machines are byte-identical.
+
+namespace {
+
+constexpr qint64 ChunkSize = 1024 * 1024;
+
+// xorshift64*, fast and good enough for filler data
+class Random
+{
+public:
+    explicit Random(quint64 seed) : m_state(seed ? seed : 0x9e3779b97f4a7c15ULL) {}
+
+    quint64 next()
+    {
+        m_state ^= m_state >> 12;
+        m_state ^= m_state << 25;
+        m_state ^= m_state >> 27;
+        return m_state * 0x2545f4914f6cdd1dULL;
+    }
+
+    int bounded(int limit) { return int(next() % quint64(limit)); }
+
+private:
+    quint64 m_state;
+};
+
+enum class Content {
+    Text,
+    Random,
+    Zeros
+};
+
+void fill(QByteArray &out, qint64 size, Content content, Random &random)
+{
+    static const char *const words[] = {
+        "archive", "extract", "central", "directory", "deflate", "stream",
+        "header", "entry", "buffer", "window", "literal", "length",
+        "distance", "block", "huffman", "symbol", "the", "of", "and", "a"
+    };
+    constexpr int wordCount = int(sizeof(words) / sizeof(words[0]));
+
+    out.resize(size);
+    char *data = out.data();
+    switch (content) {
+    case Content::Zeros:
+        memset(data, 0, size);
+        break;
+    case Content::Random:
+        for (qint64 i = 0; i + 8 <= size; i += 8) {
+            const quint64 value = random.next();
+            memcpy(data + i, &value, 8);
+        }
+        for (qint64 i = size & ~qint64(7); i < size; ++i) {
+            data[i] = char(random.next());
+        }
+        break;
+    case Content::Text: {
+        qint64 pos = 0;
+        while (pos < size) {
+            const char *word = words[random.bounded(wordCount)];
+            for (const char *c = word; *c && pos < size; ++c) {
+                data[pos++] = *c;
+            }
+            if (pos < size) {
+                data[pos++] = random.bounded(12) == 0 ? '\n' : ' ';
+            }
+        }
+        break;
+    }
+    }
+}
+
+CorpusZipWriter::Producer producer(qint64 size, Content content, Random &random)
+{
+    return [size, content, &random, remaining = size](QByteArray &chunk) mutable {
+        const qint64 length = qMin(remaining, ChunkSize);
+        fill(chunk, length, content, random);
+        remaining -= length;
+        return remaining > 0;
+    };
+}
+
+bool writeArchive(const QString &path, const std::function<bool(CorpusZipWriter &)> &body, bool zip64 = false)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    CorpusZipWriter writer(&file, zip64);
+    return body(writer) && writer.finish();
+}
+
+bool tinyFiles(const QString &path, int scale, Random &random)
+{
+    // Stays below the 65535 entry limit of the 32-bit format
+    const int count = qMin(20000 * scale, 60000);
+    return writeArchive(path, [&](CorpusZipWriter &writer) {
+        QByteArray data;
+        for (int i = 0; i < count; ++i) {
+            if (i % 100 == 0 && !writer.addDirectory(QByteArray("dir") + QByteArray::number(i / 100))) {
+                return false;
+            }
+            fill(data, 64 + random.bounded(960), Content::Text, random);
+            const QByteArray name = "dir" + QByteArray::number(i / 100) + "/file" + QByteArray::number(i) + ".txt";
+            if (!writer.addFile(name, CorpusZipWriter::Deflated, data)) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+bool zip64Entries(const QString &path, int scale, Random &random)
+{
+    // Past the 65535 entries a classic end of central directory can count
+    const int count = 70000 * scale;
+    return writeArchive(path, [&](CorpusZipWriter &writer) {
+        QByteArray data;
+        for (int i = 0; i < count; ++i) {
+            fill(data, 16 + random.bounded(112), Content::Text, random);
+            const QByteArray name = "d" + QByteArray::number(i / 1000) + "/e" + QByteArray::number(i) + ".txt";
+            if (!writer.addFile(name, CorpusZipWriter::Deflated, data)) {
+                return false;
+            }
+        }
+        return true;
+    }, true);
+}
+
+bool hugeFiles(const QString &path, int scale, Random &random)
+{
+    // Keeps the whole archive under 4 GiB
+    const qint64 size = qMin<qint64>(128LL * 1024 * 1024 * scale, 1024LL * 1024 * 1024);
+    return writeArchive(path, [&](CorpusZipWriter &writer) {
+        return writer.addFile("compressible.txt", CorpusZipWriter::Deflated, producer(size, Content::Text, random))
+            && writer.addFile("incompressible.bin", CorpusZipWriter::Deflated, producer(size, Content::Random, random))
+            && writer.addFile("zeros.bin", CorpusZipWriter::Deflated, producer(size, Content::Zeros, random));
+    });
+}
+
+bool mediumFiles(const QString &path, int scale, Content content, CorpusZipWriter::Method method, Random &random)
+{
+    const int count = 64 * scale;
+    return writeArchive(path, [&](CorpusZipWriter &writer) {
+        for (int i = 0; i < count; ++i) {
+            const QByteArray name = "file" + QByteArray::number(i) + ".bin";
+            if (!writer.addFile(name, method, producer(ChunkSize, content, random))) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+bool deepTree(const QString &path, int scale, Random &random)
+{
+    return writeArchive(path, [&](CorpusZipWriter &writer) {
+        QByteArray data;
+
+        // One long chain of nested directories with a file at every level
+        QByteArray chain;
+        for (int depth = 0; depth < 48; ++depth) {
+            chain += "level" + QByteArray::number(depth) + "/";
+            fill(data, 256, Content::Text, random);
+            if (!writer.addFile(chain + "file.txt", CorpusZipWriter::Deflated, data)) {
+                return false;
+            }
+        }
+
+        // A bushy tree, 4 children per directory, files only in the leaves
+        const int levels = 5 + (scale > 1 ? 1 : 0);
+        int leaves = 1;
+        for (int i = 0; i < levels; ++i) {
+            leaves *= 4;
+        }
+        for (int leaf = 0; leaf < leaves; ++leaf) {
+            QByteArray dir = "tree/";
+            for (int level = levels - 1, rest = leaf; level >= 0; --level) {
+                int divisor = 1;
+                for (int i = 0; i < level; ++i) {
+                    divisor *= 4;
+                }
+                dir += "n" + QByteArray::number(rest / divisor) + "/";
+                rest %= divisor;
+            }
+            for (int file = 0; file < 2; ++file) {
+                fill(data, 128 + random.bounded(512), Content::Text, random);
+                if (!writer.addFile(dir + "f" + QByteArray::number(file) + ".txt", CorpusZipWriter::Deflated, data)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    });
+}
+
+bool buildNested(QIODevice *device, int level, int scale, Random &random)
+{
+    CorpusZipWriter writer(device);
+    QByteArray data;
+
+    if (level == 0) {
+        for (int i = 0; i < 64 * scale; ++i) {
+            fill(data, 512 + random.bounded(4096), Content::Text, random);
+            if (!writer.addFile("file" + QByteArray::number(i) + ".txt", CorpusZipWriter::Deflated, data)) {
+                return false;
+            }
+        }
+        return writer.finish();
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        QByteArray inner;
+        QBuffer buffer(&inner);
+        if (!buffer.open(QIODevice::ReadWrite) || !buildNested(&buffer, level - 1, scale, random)) {
+            return false;
+        }
+        const QByteArray name = "level" + QByteArray::number(level) + "-" + QByteArray::number(i) + ".zip";
+        if (!writer.addFile(name, CorpusZipWriter::Deflated, inner)) {
+            return false;
+        }
+    }
+    fill(data, 4096, Content::Text, random);
+    return writer.addFile("readme.txt", CorpusZipWriter::Deflated, data) && writer.finish();
+}
+
+bool nestedArchives(const QString &path, int scale, Random &random)
+{
+    // outer.zip -> level2-*.zip -> level1-*.zip -> files, three archive levels
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && buildNested(&file, 2, scale, random);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("zipextract-corpus");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Generates the synthetic ZipExtract benchmark corpus.");
+    parser.addHelpOption();
+    parser.addOption({ "scale", "Multiplies entry counts and sizes.", "n", "1" });
+    parser.addOption({ "seed", "Seed for the generated content.", "n", "1" });
+    parser.addPositionalArgument("directory", "Where the archives are written.");
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 1) {
+        err << "Expected exactly one output directory\n";
+        return 2;
+    }
+
+    bool scaleOk = false;
+    bool seedOk = false;
+    const int scale = parser.value("scale").toInt(&scaleOk);
+    const quint64 seed = parser.value("seed").toULongLong(&seedOk);
+    if (!scaleOk || scale < 1 || !seedOk) {
+        err << "Invalid --scale or --seed\n";
+        return 2;
+    }
+
+    const QDir dir(positional.first());
+    if (!QDir().mkpath(dir.path())) {
+        err << "Cannot create " << dir.path() << "\n";
+        return 1;
+    }
+
+    struct Set {
+        const char *name;
+        std::function<bool(const QString &, Random &)> generate;
+    };
+
+    const QList<Set> sets = {
+        { "tiny-files.zip", [scale](const QString &path, Random &random) { return tinyFiles(path, scale, random); } },
+        { "huge-files.zip", [scale](const QString &path, Random &random) { return hugeFiles(path, scale, random); } },
+        { "compressible-deflated.zip", [scale](const QString &path, Random &random) { return mediumFiles(path, scale, Content::Text, CorpusZipWriter::Deflated, random); } },
+        { "compressible-stored.zip", [scale](const QString &path, Random &random) { return mediumFiles(path, scale, Content::Text, CorpusZipWriter::Stored, random); } },
+        { "incompressible-deflated.zip", [scale](const QString &path, Random &random) { return mediumFiles(path, scale, Content::Random, CorpusZipWriter::Deflated, random); } },
+        { "incompressible-stored.zip", [scale](const QString &path, Random &random) { return mediumFiles(path, scale, Content::Random, CorpusZipWriter::Stored, random); } },
+        { "deep-tree.zip", [scale](const QString &path, Random &random) { return deepTree(path, scale, random); } },
+        { "nested-3-level.zip", [scale](const QString &path, Random &random) { return nestedArchives(path, scale, random); } },
+        { "zip64-many-entries.zip", [scale](const QString &path, Random &random) { return zip64Entries(path, scale, random); } },
+    };
+
+    for (qsizetype i = 0; i < sets.size(); ++i) {
+        // Each set gets its own stream, new sets go last so existing ones keep
+        // their content
+        Random random(seed * 0x100000001b3ULL + quint64(i));
+        const QString path = dir.filePath(sets[i].name);
+
+        QElapsedTimer timer;
+        timer.start();
+        if (!sets[i].generate(path, random)) {
+            err << "Failed to write " << path << "\n";
+            return 1;
+        }
+        out << sets[i].name << "  " << QFileInfo(path).size() << " bytes  " << timer.elapsed() << " ms\n";
+        out.flush();
+    }
+
+    return 0;
+}
@@ -0,0 +1,248 @@
+#include "corpuszipwriter.h"
+#include <QtEndian>
+#include <zlib.h>
+
+namespace {
+
+constexpr quint32 LocalHeaderSignature = 0x04034b50;
+constexpr quint32 CentralHeaderSignature = 0x02014b50;
+constexpr quint32 EndOfCentralDirSignature = 0x06054b50;
+constexpr quint32 Zip64EndOfCentralDirSignature = 0x06064b50;
+constexpr quint32 Zip64LocatorSignature = 0x07064b50;
+
+constexpr quint16 VersionNeeded = 20;
+constexpr quint16 VersionNeededZip64 = 45;
+constexpr quint16 FlagUtf8 = 0x0800;
+constexpr quint16 Zip64ExtraId = 0x0001;
+
+// 1980-01-01 00:00, the earliest DOS timestamp, keeps the corpus reproducible
+constexpr quint16 DosTime = 0;
+constexpr quint16 DosDate = (0 << 9) | (1 << 5) | 1;
+
+void appendU16(QByteArray &out, quint16 value)
+{
+    char bytes[2];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, 2);
+}
+
+void appendU32(QByteArray &out, quint32 value)
+{
+    char bytes[4];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, 4);
+}
+
+void appendU64(QByteArray &out, quint64 value)
+{
+    char bytes[8];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, 8);
+}
+
+}
+
+CorpusZipWriter::CorpusZipWriter(QIODevice *device, bool zip64)
+    : m_device(device)
+    , m_zip64(zip64)
+{
+}
+
+bool CorpusZipWriter::addDirectory(const QByteArray &name)
+{
+    Entry entry;
+    entry.name = name.endsWith('/') ? name : name + '/';
+    entry.localHeaderOffset = quint64(m_device->pos());
+    if (!writeLocalHeader(entry)) {
+        return false;
+    }
+    m_entries.append(entry);
+    return true;
+}
+
+bool CorpusZipWriter::addFile(const QByteArray &name, Method method, const QByteArray &data)
+{
+    bool done = false;
+    return addFile(name, method, [&data, &done](QByteArray &chunk) {
+        if (done) {
+            return false;
+        }
+        chunk = data;
+        done = true;
+        return true;
+    });
+}
+
+bool CorpusZipWriter::addFile(const QByteArray &name, Method method, const Producer &producer)
+{
+    Entry entry;
+    entry.name = name;
+    entry.method = method;
+    entry.localHeaderOffset = quint64(m_device->pos());
+
+    // Write a placeholder header, then patch CRC and sizes after the data
+    if (!writeLocalHeader(entry) || !writeData(entry, producer)) {
+        return false;
+    }
+
+    const qint64 end = m_device->pos();
+    if (!m_device->seek(entry.localHeaderOffset) || !writeLocalHeader(entry) || !m_device->seek(end)) {
+        return false;
+    }
+
+    m_entries.append(entry);
+    return true;
+}
+
+bool CorpusZipWriter::writeLocalHeader(const Entry &entry)
+{
+    QByteArray header;
+    header.reserve(30 + entry.name.size() + 20);
+    appendU32(header, LocalHeaderSignature);
+    appendU16(header, m_zip64 ? VersionNeededZip64 : VersionNeeded);
+    appendU16(header, FlagUtf8);
+    appendU16(header, entry.method);
+    appendU16(header, DosTime);
+    appendU16(header, DosDate);
+    appendU32(header, entry.crc);
+    appendU32(header, m_zip64 ? 0xffffffff : quint32(entry.compressedSize));
+    appendU32(header, m_zip64 ? 0xffffffff : quint32(entry.uncompressedSize));
+    appendU16(header, quint16(entry.name.size()));
+    appendU16(header, m_zip64 ? 20 : 0);
+    header.append(entry.name);
+
+    // Fixed-size extra field, so patching the sizes never moves the data
+    if (m_zip64) {
+        appendU16(header, Zip64ExtraId);
+        appendU16(header, 16);
+        appendU64(header, entry.uncompressedSize);
+        appendU64(header, entry.compressedSize);
+    }
+    return m_device->write(header) == header.size();
+}
+
+bool CorpusZipWriter::writeData(Entry &entry, const Producer &producer)
+{
+    const qint64 start = m_device->pos();
+    uLong crc = ::crc32(0, nullptr, 0);
+    qint64 uncompressed = 0;
+
+    z_stream stream = {};
+    if (entry.method == Deflated && deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+
+    QByteArray chunk;
+    QByteArray output(256 * 1024, Qt::Uninitialized);
+    bool more = true;
+    bool ok = true;
+    while (ok && more) {
+        chunk.clear();
+        more = producer(chunk);
+        crc = ::crc32(crc, reinterpret_cast<const Bytef *>(chunk.constData()), uInt(chunk.size()));
+        uncompressed += chunk.size();
+
+        if (entry.method == Stored) {
+            ok = m_device->write(chunk) == chunk.size();
+            continue;
+        }
+
+        stream.next_in = reinterpret_cast<Bytef *>(chunk.data());
+        stream.avail_in = uInt(chunk.size());
+        const int flush = more ? Z_NO_FLUSH : Z_FINISH;
+        do {
+            stream.next_out = reinterpret_cast<Bytef *>(output.data());
+            stream.avail_out = uInt(output.size());
+            const int status = deflate(&stream, flush);
+            if (status == Z_STREAM_ERROR) {
+                ok = false;
+                break;
+            }
+            const qint64 produced = output.size() - stream.avail_out;
+            if (m_device->write(output.constData(), produced) != produced) {
+                ok = false;
+                break;
+            }
+        } while (stream.avail_out == 0);
+    }
+
+    if (entry.method == Deflated) {
+        deflateEnd(&stream);
+    }
+
+    entry.crc = quint32(crc);
+    entry.uncompressedSize = quint64(uncompressed);
+    entry.compressedSize = quint64(m_device->pos() - start);
+
+    // Without Zip64 every size and offset has to fit 32 bits
+    return ok && (m_zip64 || (uncompressed <= 0xffffffffLL && m_device->pos() <= 0xffffffffLL));
+}
+
+bool CorpusZipWriter::finish()
+{
+    const quint64 directoryOffset = quint64(m_device->pos());
+
+    QByteArray directory;
+    for (const Entry &entry : std::as_const(m_entries)) {
+        appendU32(directory, CentralHeaderSignature);
+        appendU16(directory, m_zip64 ? VersionNeededZip64 : VersionNeeded);
+        appendU16(directory, m_zip64 ? VersionNeededZip64 : VersionNeeded);
+        appendU16(directory, FlagUtf8);
+        appendU16(directory, entry.method);
+        appendU16(directory, DosTime);
+        appendU16(directory, DosDate);
+        appendU32(directory, entry.crc);
+        appendU32(directory, m_zip64 ? 0xffffffff : quint32(entry.compressedSize));
+        appendU32(directory, m_zip64 ? 0xffffffff : quint32(entry.uncompressedSize));
+        appendU16(directory, quint16(entry.name.size()));
+        appendU16(directory, m_zip64 ? 28 : 0);
+        appendU16(directory, 0);
+        appendU16(directory, 0);
+        appendU16(directory, 0);
+        appendU32(directory, entry.name.endsWith('/') ? 0x10 : 0);
+        appendU32(directory, m_zip64 ? 0xffffffff : quint32(entry.localHeaderOffset));
+        directory.append(entry.name);
+        if (m_zip64) {
+            appendU16(directory, Zip64ExtraId);
+            appendU16(directory, 24);
+            appendU64(directory, entry.uncompressedSize);
+            appendU64(directory, entry.compressedSize);
+            appendU64(directory, entry.localHeaderOffset);
+        }
+    }
+
+    const quint64 directorySize = quint64(directory.size());
+    const quint64 entryCount = quint64(m_entries.size());
+
+    if (m_zip64) {
+        const quint64 recordOffset = directoryOffset + directorySize;
+        appendU32(directory, Zip64EndOfCentralDirSignature);
+        appendU64(directory, 44);
+        appendU16(directory, VersionNeededZip64);
+        appendU16(directory, VersionNeededZip64);
+        appendU32(directory, 0);
+        appendU32(directory, 0);
+        appendU64(directory, entryCount);
+        appendU64(directory, entryCount);
+        appendU64(directory, directorySize);
+        appendU64(directory, directoryOffset);
+
+        appendU32(directory, Zip64LocatorSignature);
+        appendU32(directory, 0);
+        appendU64(directory, recordOffset);
+        appendU32(directory, 1);
+    } else if (entryCount > 0xffff || directoryOffset > 0xffffffff) {
+        return false;
+    }
+
+    appendU32(directory, EndOfCentralDirSignature);
+    appendU16(directory, 0);
+    appendU16(directory, 0);
+    appendU16(directory, m_zip64 ? 0xffff : quint16(entryCount));
+    appendU16(directory, m_zip64 ? 0xffff : quint16(entryCount));
+    appendU32(directory, m_zip64 ? 0xffffffff : quint32(directorySize));
+    appendU32(directory, m_zip64 ? 0xffffffff : quint32(directoryOffset));
+    appendU16(directory, 0);
+
+    return m_device->write(directory) == directory.size();
+}
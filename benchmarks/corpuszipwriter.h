@@ -0,0 +1,50 @@
+#ifndef CORPUSZIPWRITER_H
+#define CORPUSZIPWRITER_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QList>
+#include <functional>
+
+// Minimal ZIP writer for the benchmark corpus. Entry data is produced in
+// chunks by a callback so huge entries never sit in memory; the local header
+// is patched in place once the CRC and sizes are known, so the target device
+// must be seekable. In Zip64 mode every entry carries 64-bit sizes and the
+// archive ends with Zip64 records, whatever the actual sizes.
+class CorpusZipWriter
+{
+public:
+    enum Method : quint16 {
+        Stored = 0,
+        Deflated = 8
+    };
+
+    // Fills the buffer with the next chunk and returns false once done
+    using Producer = std::function<bool(QByteArray &chunk)>;
+
+    explicit CorpusZipWriter(QIODevice *device, bool zip64 = false);
+
+    bool addDirectory(const QByteArray &name);
+    bool addFile(const QByteArray &name, Method method, const Producer &producer);
+    bool addFile(const QByteArray &name, Method method, const QByteArray &data);
+    bool finish();
+
+private:
+    struct Entry {
+        QByteArray name;
+        quint16 method = Stored;
+        quint32 crc = 0;
+        quint64 compressedSize = 0;
+        quint64 uncompressedSize = 0;
+        quint64 localHeaderOffset = 0;
+    };
+
+    bool writeLocalHeader(const Entry &entry);
+    bool writeData(Entry &entry, const Producer &producer);
+
+    QIODevice *m_device;
+    bool m_zip64;
+    QList<Entry> m_entries;
+};
+
+#endif // CORPUSZIPWRITER_H
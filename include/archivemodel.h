@@ -0,0 +1,159 @@
+#ifndef ARCHIVEMODEL_H
+#define ARCHIVEMODEL_H
+
+#include <QAbstractItemModel>
+#include <QList>
+#include <QQmlEngine>
+#include <QString>
+#include <QThread>
+#include <atomic>
+#include <memory>
+#include "ziparchive.h"
+
+class EntryFilter;
+
+// Tree of an archive's entries for the browser view. A background thread
+// indexes the central directory and groups the entries by directory, handing
+// them over in small batches, so the first rows show up while a large archive
+// is still being scanned. A directory's rows are only laid out (and sorted)
+// once it is expanded, which keeps a million-entry archive as cheap as the
+// part of it on screen. Setting searchText switches to a flat list of the
+// matching entries, collected by another background pass.
+class ArchiveModel : public QAbstractItemModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+
+    Q_PROPERTY(QString source READ source WRITE setSource NOTIFY sourceChanged)
+    Q_PROPERTY(bool loading READ loading NOTIFY loadingChanged)
+    Q_PROPERTY(qint64 entryCount READ entryCount NOTIFY entryCountChanged)
+    Q_PROPERTY(QString errorString READ errorString NOTIFY errorStringChanged)
+    Q_PROPERTY(QString searchText READ searchText WRITE setSearchText NOTIFY searchTextChanged)
+    Q_PROPERTY(bool searching READ searching NOTIFY searchingChanged)
+    Q_PROPERTY(bool encrypted READ encrypted NOTIFY encryptedChanged)
+
+public:
+    enum Role {
+        NameRole = Qt::UserRole + 1,
+        PathRole,
+        IsDirRole,
+        SizeRole,
+        CompressedSizeRole,
+        MethodRole,
+        ModifiedRole,
+        EncryptionRole
+    };
+
+    explicit ArchiveModel(QObject *parent = nullptr);
+    ~ArchiveModel();
+
+    QString source() const { return m_source; }
+    void setSource(const QString &source);
+    bool loading() const { return m_loading; }
+    qint64 entryCount() const { return m_entryCount; }
+    QString errorString() const { return m_error; }
+    QString searchText() const { return m_searchText; }
+    // Plain text matches anywhere in the path, ignoring case; text with glob
+    // syntax or a "re:" prefix is an EntryFilter pattern
+    void setSearchText(const QString &text);
+    bool searching() const { return m_searching; }
+    bool encrypted() const { return m_encrypted; }
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    // Extracts the given rows with ZipExtractor, directories with everything
+    // below them, or the whole archive when there are none
+    Q_INVOKABLE bool extract(const QModelIndexList &indexes, const QString &destPath = QString());
+
+signals:
+    void sourceChanged();
+    void loadingChanged();
+    void entryCountChanged();
+    void errorStringChanged();
+    void searchTextChanged();
+    void searchingChanged();
+    void encryptedChanged();
+
+private:
+    struct Directory
+    {
+        QString name;
+        int parent = -1;
+        // Position among the parent's subdirectories
+        int row = 0;
+        // The archive's own entry for the directory, -1 when only implied
+        qsizetype entry = -1;
+        QList<int> directories;
+        QList<qsizetype> files;
+        bool fetched = false;
+    };
+
+    struct NewDirectory
+    {
+        int parent;
+        QString name;
+    };
+
+    // What one scan batch adds: directories get the next free ids in order
+    struct ScanBatch
+    {
+        QList<NewDirectory> directories;
+        QList<QPair<int, qsizetype>> files;
+        QList<QPair<int, qsizetype>> directoryEntries;
+        qint64 scanned = 0;
+        bool encrypted = false;
+    };
+
+    void stopWorkers();
+    void scan(const QString &path, int generation);
+    void search(const std::shared_ptr<const ZipArchive> &archive, const QString &text, const EntryFilter &filter,
+                int generation);
+    void startSearch();
+    void applyOpened(const std::shared_ptr<const ZipArchive> &archive, const QString &error, int generation);
+    void applyBatch(const ScanBatch &batch, int generation);
+    void applyScanFinished(int generation);
+    void applyResults(const QList<qsizetype> &results, bool last, int generation);
+
+    void sortDirectory(int id);
+    void sortFetchedDirectories();
+    QModelIndex directoryIndex(int id) const;
+    // Directory an index stands for, -1 for files and search results
+    int directoryId(const QModelIndex &index) const;
+    bool isShown(int id) const;
+    int childCount(int id) const;
+    QString directoryPath(int id) const;
+    void setLoading(bool loading);
+    void setSearching(bool searching);
+
+    QString m_source;
+    QString m_searchText;
+    QString m_error;
+    bool m_loading = false;
+    bool m_searching = false;
+    bool m_encrypted = false;
+    qint64 m_entryCount = 0;
+
+    // Read-only once opened, the workers and the view share it
+    std::shared_ptr<const ZipArchive> m_archive;
+    QList<Directory> m_directories;
+    QList<qsizetype> m_results;
+    bool m_searchMode = false;
+
+    // Results of a stale source or search are dropped on arrival
+    int m_generation = 0;
+    int m_searchGeneration = 0;
+    std::atomic<bool> m_stop = false;
+    std::atomic<bool> m_stopSearch = false;
+    std::unique_ptr<QThread> m_scanThread;
+    std::unique_ptr<QThread> m_searchThread;
+};
+
+#endif // ARCHIVEMODEL_H
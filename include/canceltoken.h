@@ -0,0 +1,45 @@
+#ifndef CANCELTOKEN_H
+#define CANCELTOKEN_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+
+// Cooperative cancel and pause shared by everything working on one run.
+// Workers call checkpoint() between chunks of inflate and write work, so a
+// request takes effect within one buffer's worth of work on every thread.
+// While running a checkpoint is a single atomic load; a paused worker sleeps
+// on a wait condition until it is resumed or cancelled.
+class CancelToken
+{
+public:
+    void reset();
+    void cancel();
+    void pause();
+    void resume();
+
+    bool isCancelled() const { return m_state.load(std::memory_order_acquire) & Cancelled; }
+    bool isPaused() const { return m_state.load(std::memory_order_acquire) & Paused; }
+
+    // Blocks while paused, false once cancelled
+    bool checkpoint() const
+    {
+        const int state = m_state.load(std::memory_order_acquire);
+        if (state == 0) {
+            return true;
+        }
+        return !(state & Cancelled) && waitWhilePaused();
+    }
+
+private:
+    bool waitWhilePaused() const;
+
+    static constexpr int Paused = 0x1;
+    static constexpr int Cancelled = 0x2;
+
+    std::atomic<int> m_state{0};
+    mutable QMutex m_mutex;
+    mutable QWaitCondition m_changed;
+};
+
+#endif // CANCELTOKEN_H
@@ -0,0 +1,22 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <QtGlobal>
+
+// CRC-32 as used by ZIP (reflected 0xEDB88320). The implementation is picked
+// once at startup: carry-less multiply folding on x86 with PCLMULQDQ, the CRC
+// instructions on ARMv8, zlib's table-driven code everywhere else.
+class Crc32
+{
+public:
+    // Continues a running CRC, start with 0
+    static quint32 update(quint32 crc, const uchar *data, qsizetype size);
+
+    // CRC of two pieces back to back, from the CRC of each and the size of
+    // the second, so blocks checksummed apart can be joined in order
+    static quint32 combine(quint32 first, quint32 second, qint64 secondSize);
+
+    static const char *implementation();
+};
+
+#endif // CHECKSUM_H
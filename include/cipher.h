@@ -0,0 +1,75 @@
+#ifndef CIPHER_H
+#define CIPHER_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QtGlobal>
+
+// AES in counter mode as WinZip AES uses it: the counter is a 128-bit
+// little-endian integer starting at 1 and there is no nonce. Like the CRC,
+// the implementation is picked once at startup: AES-NI on x86, the ARMv8
+// crypto extension on ARM, a table-driven fallback everywhere else. Only
+// encryption rounds are needed, CTR decrypts by encrypting the counter.
+class AesCtr
+{
+public:
+    // 16, 24 or 32 byte keys; false for any other length
+    bool setKey(const uchar *key, int size);
+
+    // XORs the key stream into size bytes from in to out, which may be the
+    // same buffer; calls continue where the last one stopped
+    void apply(const uchar *in, uchar *out, qsizetype size);
+
+    static const char *implementation();
+
+private:
+    void refillKeyStream();
+
+    alignas(16) uchar m_roundKeys[15 * 16] = {};
+    int m_rounds = 0;
+    quint64 m_counter = 1;
+    // Key stream of the last partial block, from m_keyStreamPos on unused
+    uchar m_keyStream[16] = {};
+    int m_keyStreamPos = 16;
+};
+
+// HMAC-SHA1, incremental so the MAC of an entry is computed over each slice
+// as it is decrypted. SHA-1 uses the SHA extensions on x86 and the ARMv8
+// crypto extension where available.
+class HmacSha1
+{
+public:
+    static constexpr int DigestSize = 20;
+
+    void setKey(QByteArrayView key);
+    // Starts a new message under the same key
+    void reset();
+    void addData(const uchar *data, qsizetype size);
+    void result(uchar digest[DigestSize]);
+
+    // PBKDF2 with HMAC-SHA1 (RFC 8018)
+    static QByteArray pbkdf2(QByteArrayView password, QByteArrayView salt, int iterations, int size);
+
+    static const char *implementation();
+
+private:
+    struct Sha1
+    {
+        quint32 state[5];
+        quint64 length;
+        uchar block[64];
+        int used;
+
+        void init();
+        void addData(const uchar *data, qsizetype size);
+        void finish(uchar digest[DigestSize]);
+    };
+
+    // Hash states after the padded key blocks, so a message costs no key
+    // processing
+    Sha1 m_innerKeyed = {};
+    Sha1 m_outerKeyed = {};
+    Sha1 m_inner = {};
+};
+
+#endif // CIPHER_H
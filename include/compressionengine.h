@@ -0,0 +1,135 @@
+#ifndef COMPRESSIONENGINE_H
+#define COMPRESSIONENGINE_H
+
+#include <QFileInfo>
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include "canceltoken.h"
+#include "taskscheduler.h"
+#include "zipwriter.h"
+
+// Builds an archive from files and directories, pigz-style: every entry is
+// cut into blocks that workers of a work-stealing scheduler read and compress
+// in parallel, while one writer thread lays the results out in archive order
+// with their local headers and finishes with the central directory. Only a
+// window of blocks ahead of the writer is in flight, so memory stays bounded
+// whatever the size of the inputs. Progress is kept in atomic counters, like
+// ExtractionEngine's, and cancel and pause use the same token.
+class CompressionEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Progress
+    {
+        qint64 completedFiles = 0;
+        qint64 totalFiles = 0;
+        qint64 completedBytes = 0;
+        qint64 totalBytes = 0;
+        qint64 writtenBytes = 0;
+        QString currentFile;
+    };
+
+    explicit CompressionEngine(QObject *parent = nullptr);
+    ~CompressionEngine();
+
+    void setThreadCount(int count) { m_scheduler.setThreadCount(count); }
+    int threadCount() const { return m_scheduler.threadCount(); }
+
+    // Method id (0 stored, 8 Deflate, 93 Zstandard) and level, -1 for the
+    // method's default; false when this build cannot compress with it
+    bool setMethod(quint16 method);
+    quint16 method() const { return m_method; }
+    void setLevel(int level) { m_level = level; }
+    int level() const { return m_level; }
+
+    // Entries larger than this are split into blocks of this size
+    void setBlockSize(qint64 bytes) { m_blockSize = qMax(MinBlockSize, bytes); }
+    qint64 blockSize() const { return m_blockSize; }
+
+    // Sources are stored under their own name, directories with everything
+    // below them. The archive only replaces zipPath once it is complete.
+    void start(const QStringList &sources, const QString &zipPath);
+    void cancel();
+    void pause();
+    void resume();
+    bool isPaused() const { return m_token.isPaused(); }
+    void waitForDone();
+
+    Progress progress() const;
+    QString errorString() const;
+
+    // Time spent listing the sources, the rest of the run is compression
+    qint64 scanMs() const { return m_scanMs; }
+
+signals:
+    // success is false when the run failed or was cancelled
+    void finished(bool success, bool cancelled);
+
+private:
+    struct Source
+    {
+        QString path;
+        ZipWriter::Entry entry;
+    };
+
+    // One block of one entry, owned by the writer's window until written
+    struct Block
+    {
+        qsizetype source = 0;
+        qint64 offset = 0;
+        qint64 size = 0;
+        bool last = false;
+        quint16 method = 0;
+        quint32 crc = 0;
+        QByteArray output;
+        QString error;
+        std::atomic<bool> done{false};
+    };
+
+    void run(const QStringList &sources, const QString &zipPath);
+    bool scan(const QStringList &sources, const QString &zipPath);
+    void addSource(const QFileInfo &info, const QString &name);
+    bool writeArchive(QFileDevice *device);
+    bool writeEntry(ZipWriter &writer, qsizetype index, std::deque<std::shared_ptr<Block>> &window,
+                    qsizetype &nextSource, qint64 &nextOffset);
+    void fillWindow(std::deque<std::shared_ptr<Block>> &window, qsizetype &nextSource, qint64 &nextOffset);
+    void compressBlock(Block &block);
+    bool fail(const QString &error);
+
+    static constexpr qint64 MinBlockSize = 64 * 1024;
+    static constexpr qint64 DefaultBlockSize = 1024 * 1024;
+    // Blocks in flight per worker, enough to keep every core busy while the
+    // writer waits on the oldest one
+    static constexpr int WindowPerThread = 4;
+
+    TaskScheduler m_scheduler;
+    std::unique_ptr<QThread> m_thread;
+    CancelToken m_token;
+    quint16 m_method = 8;
+    int m_level = -1;
+    qint64 m_blockSize = DefaultBlockSize;
+    qint64 m_scanMs = 0;
+
+    QList<Source> m_sources;
+
+    QMutex m_blockMutex;
+    QWaitCondition m_blockDone;
+
+    std::atomic<qint64> m_totalFiles{0};
+    std::atomic<qint64> m_completedFiles{0};
+    std::atomic<qint64> m_totalBytes{0};
+    std::atomic<qint64> m_completedBytes{0};
+    std::atomic<qint64> m_writtenBytes{0};
+    mutable QMutex m_stateMutex;
+    QString m_currentFile;
+    QString m_error;
+};
+
+#endif // COMPRESSIONENGINE_H
@@ -0,0 +1,77 @@
+#ifndef DEFLATE64DECODER_H
+#define DEFLATE64DECODER_H
+
+#include "entrydecoder.h"
+
+// Decoder for Deflate64 (method 9), PKWARE's "enhanced deflate": a 64 KiB
+// window, length code 285 with 16 extra bits and two more distance codes.
+// No common library implements it, so this is a small table-driven
+// inflater. The caller's buffer doubles as the sliding window, which is why
+// it must be a power of two of at least 64 KiB. Plain deflate streams decode
+// too when constructed with deflate64 = false.
+class Deflate64Decoder : public EntryDecoder
+{
+public:
+    explicit Deflate64Decoder(bool deflate64 = true);
+
+    bool decode(EntryInput &input, qint64 outputSize, quint16 flags, QByteArray &buffer,
+                const Sink &sink) override;
+
+private:
+    static constexpr int MaxCodeBits = 15;
+    static constexpr int FastBits = 10;
+    static constexpr int MaxSymbols = 288;
+
+    struct Huffman
+    {
+        // Indexed by the next FastBits input bits, symbol << 4 | length, or
+        // 0 when the code is longer and has to be walked bit by bit
+        quint16 fast[1 << FastBits];
+        quint16 counts[MaxCodeBits + 1];
+        quint16 symbols[MaxSymbols];
+    };
+
+    bool buildHuffman(Huffman &huffman, const quint8 *lengths, int count);
+    bool decodeBlock(const Huffman &literals, const Huffman &distances);
+    bool readDynamicTables();
+    void buildFixedTables();
+    bool copyStoredBlock();
+
+    // Bit input
+    bool nextSlice();
+    bool refill();
+    quint32 peekBits(int count);
+    void dropBits(int count);
+    bool readBits(int count, quint32 &value);
+    int decodeSymbol(const Huffman &huffman);
+    int decodeSlow(const Huffman &huffman);
+
+    // Window output
+    bool put(uchar byte);
+    bool flush();
+
+    bool m_deflate64;
+
+    // The current slice of the input, m_sliceStart is its offset in it
+    EntryInput *m_source = nullptr;
+    const uchar *m_input = nullptr;
+    qint64 m_inputSize = 0;
+    qint64 m_inputPos = 0;
+    qint64 m_sliceStart = 0;
+    quint64 m_bitBuffer = 0;
+    int m_bitCount = 0;
+    qint64 m_reported = 0;
+
+    uchar *m_window = nullptr;
+    qint64 m_mask = 0;
+    qint64 m_written = 0;
+    qint64 m_flushed = 0;
+    const Sink *m_sink = nullptr;
+
+    std::unique_ptr<Huffman> m_literals;
+    std::unique_ptr<Huffman> m_distances;
+    std::unique_ptr<Huffman> m_fixedLiterals;
+    std::unique_ptr<Huffman> m_fixedDistances;
+};
+
+#endif // DEFLATE64DECODER_H
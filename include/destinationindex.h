@@ -0,0 +1,41 @@
+#ifndef DESTINATIONINDEX_H
+#define DESTINATIONINDEX_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+
+class ZipArchive;
+
+// Remembers what one extraction has already done to the destination tree.
+// Every directory an archive needs is created exactly once, parents first,
+// before any file data is written; directory listings used to pick unique
+// names are read once per directory and then kept up to date in memory.
+class DestinationIndex
+{
+public:
+    void clear();
+
+    // Creates the destination root and every directory the archive needs, or
+    // only the ones the selected entries need when a selection is given
+    void prepare(const ZipArchive &archive, const QString &rootPath, const QList<qsizetype> *selection = nullptr);
+
+    void ensureDirectory(const QString &path);
+
+    // Returns "base (n).ext" (or "base (n)" without extension) that is free
+    // in directory and reserves it
+    QString uniqueName(const QString &directory, const QString &baseName, const QString &extension);
+
+private:
+    bool createDirectoryLocked(const QString &path);
+    QSet<QString> &namesInLocked(const QString &directory);
+
+    QMutex m_mutex;
+    QSet<QString> m_createdDirectories;
+    QHash<QString, QSet<QString>> m_takenNames;
+    QHash<QString, int> m_nextCounters;
+};
+
+#endif // DESTINATIONINDEX_H
@@ -0,0 +1,92 @@
+#ifndef ENTRYDECODER_H
+#define ENTRYDECODER_H
+
+#include <QByteArray>
+#include <QString>
+#include <functional>
+#include <memory>
+
+// Compressed bytes of one entry, handed to a decoder a slice at a time. The
+// base class slices the archive mapping directly; inputs that have to turn
+// the stored bytes into compressed data first, such as decryption, override
+// next() and fill each slice just before it is decoded.
+class EntryInput
+{
+public:
+    EntryInput(const uchar *data, qint64 size)
+        : m_data(data)
+        , m_size(size)
+    {
+    }
+    virtual ~EntryInput() = default;
+
+    qint64 size() const { return m_size; }
+    qint64 remaining() const { return m_size - m_position; }
+
+    // The next slice of at most maxSize bytes, valid until the next call;
+    // false once the input is used up. Only the last slice is shorter than
+    // maxSize unless an override caps it.
+    virtual bool next(qint64 maxSize, const uchar *&slice, qint64 &sliceSize)
+    {
+        if (m_position >= m_size) {
+            return false;
+        }
+        sliceSize = qMin(maxSize, m_size - m_position);
+        slice = m_data + m_position;
+        m_position += sliceSize;
+        return true;
+    }
+
+protected:
+    const uchar *m_data;
+    qint64 m_size;
+    qint64 m_position = 0;
+};
+
+// Streaming decoder for one ZIP compression method. Compressed data is pulled
+// from an EntryInput; output is produced through the caller's buffer and
+// handed to a sink chunk by chunk, so CRC checks, progress and writing are
+// shared by every method.
+//
+// The dispatch table in create() lists every method this build can decode;
+// optional libraries add their methods when CMake found them.
+class EntryDecoder
+{
+public:
+    // Receives each decoded chunk with the compressed bytes consumed for it.
+    // Returning false aborts the entry.
+    using Sink = std::function<bool(const char *data, qint64 size, qint64 consumed)>;
+
+    virtual ~EntryDecoder() = default;
+
+    // flags are the entry's general purpose flags, some methods need them
+    virtual bool decode(EntryInput &input, qint64 outputSize, quint16 flags, QByteArray &buffer,
+                        const Sink &sink) = 0;
+
+    // Working memory decode() will allocate for this entry, read from its
+    // stream header in the first inputSize bytes of the compressed data;
+    // buffers reused across entries are not included
+    virtual qint64 memoryEstimate(const uchar *input, qint64 inputSize) const
+    {
+        Q_UNUSED(input)
+        Q_UNUSED(inputSize)
+        return 0;
+    }
+
+    QString errorString() const { return m_error; }
+
+    // nullptr when the method is unknown or its library was not built in
+    static std::unique_ptr<EntryDecoder> create(quint16 method);
+    static QString methodName(quint16 method);
+
+protected:
+    bool fail(const QString &error)
+    {
+        m_error = error;
+        return false;
+    }
+
+    QString m_error;
+};
+
+#endif // ENTRYDECODER_H
@@ -0,0 +1,99 @@
+#ifndef ENTRYDECRYPTOR_H
+#define ENTRYDECRYPTOR_H
+
+#include <QByteArray>
+#include <QString>
+#include "cipher.h"
+#include "entrydecoder.h"
+
+class ZipArchive;
+
+// Decryption of password-protected entries: PKWARE's traditional encryption
+// ("ZipCrypto", APPNOTE 6.1) and WinZip AES in both its AE-1 and AE-2
+// flavours. begin() reads the encryption header in front of the data and
+// checks the password against it, the payload is then decrypted front to
+// back, and finish() checks the authentication code AES entries end with.
+// A decryptor is reused for many entries.
+class EntryDecryptor
+{
+public:
+    // The general purpose flag marking an entry as encrypted
+    static constexpr quint16 EncryptedFlag = 0x1;
+
+    // Password as the archiver hashed it, UTF-8 for anything written recently
+    void setPassword(const QByteArray &password) { m_password = password; }
+    bool hasPassword() const { return !m_password.isEmpty(); }
+
+    // False on a wrong password or an encryption this does not support,
+    // errorString() tells which
+    bool begin(const ZipArchive &archive, qsizetype index);
+
+    // The compressed data and the method it was compressed with, which for
+    // AES entries is recorded in their extra field
+    const uchar *payload() const { return m_payload; }
+    qint64 payloadSize() const { return m_payloadSize; }
+    quint16 method() const { return m_method; }
+
+    // AE-2 leaves the CRC field empty and relies on the authentication code
+    bool checksCrc() const { return m_checksCrc; }
+
+    // Bytes of the entry that are encryption headers and trailers
+    qint64 overhead() const { return m_overhead; }
+
+    // Decrypts the next size bytes of the payload, in may equal out
+    void decrypt(const uchar *in, uchar *out, qint64 size);
+
+    // The first size bytes of the payload in plain text, without moving on
+    QByteArray peek(qint64 size) const;
+
+    // Authenticates the whole payload, including what the decoder did not
+    // need to read
+    bool finish();
+
+    QString errorString() const { return m_error; }
+
+    // Name of the entry's encryption for listings, empty when there is none
+    static QString schemeName(const ZipArchive &archive, qsizetype index);
+    // Compression method of the entry, looking through AES encryption
+    static quint16 compressionMethod(const ZipArchive &archive, qsizetype index);
+
+private:
+    bool beginZipCrypto(const ZipArchive &archive, qsizetype index, const uchar *data, qint64 size);
+    bool beginAes(const ZipArchive &archive, qsizetype index, const uchar *data, qint64 size);
+    void updateKeys(uchar plain);
+    bool fail(const QString &error);
+
+    enum Scheme { ZipCrypto, WinZipAes };
+
+    QByteArray m_password;
+    Scheme m_scheme = ZipCrypto;
+    const uchar *m_payload = nullptr;
+    qint64 m_payloadSize = 0;
+    qint64 m_decrypted = 0;
+    qint64 m_overhead = 0;
+    quint16 m_method = 0;
+    bool m_checksCrc = true;
+
+    quint32 m_keys[3] = {};
+    AesCtr m_aes;
+    HmacSha1 m_hmac;
+
+    QString m_error;
+};
+
+// Entry input that decrypts the payload a slice at a time into the caller's
+// buffer, just before the decoder reads it, so decryption, authentication,
+// decoding and the CRC all work on data that is still in cache
+class DecryptingInput : public EntryInput
+{
+public:
+    DecryptingInput(EntryDecryptor &decryptor, QByteArray &buffer);
+
+    bool next(qint64 maxSize, const uchar *&slice, qint64 &sliceSize) override;
+
+private:
+    EntryDecryptor &m_decryptor;
+    QByteArray &m_buffer;
+};
+
+#endif // ENTRYDECRYPTOR_H
@@ -0,0 +1,44 @@
+#ifndef ENTRYENCODER_H
+#define ENTRYENCODER_H
+
+#include <QByteArray>
+#include <QString>
+#include <memory>
+
+// Block compressor for one ZIP compression method, the counterpart of
+// EntryDecoder. Entries are cut into blocks that are compressed on their own,
+// in parallel, and whose outputs simply concatenate into the entry's data:
+// Deflate blocks end on a sync flush and only the last one is final, Zstandard
+// blocks are independent frames. Deflate primes each block with the input in
+// front of it, so splitting costs almost nothing in ratio.
+class EntryEncoder
+{
+public:
+    // Input before a block that Deflate can refer back to
+    static constexpr qint64 DictionarySize = 32 * 1024;
+
+    virtual ~EntryEncoder() = default;
+
+    // Compresses size bytes at data into out, replacing its contents. The
+    // dictionarySize bytes in front of data are the end of the previous
+    // block; last ends the entry's stream.
+    virtual bool encode(const uchar *data, qint64 size, qint64 dictionarySize, bool last, QByteArray &out) = 0;
+
+    QString errorString() const { return m_error; }
+
+    // Method ids as in EntryDecoder; level -1 picks the method's default.
+    // nullptr when this build cannot compress with the method.
+    static std::unique_ptr<EntryEncoder> create(quint16 method, int level);
+    static bool isSupported(quint16 method);
+
+protected:
+    bool fail(const QString &error)
+    {
+        m_error = error;
+        return false;
+    }
+
+    QString m_error;
+};
+
+#endif // ENTRYENCODER_H
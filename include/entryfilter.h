@@ -0,0 +1,62 @@
+#ifndef ENTRYFILTER_H
+#define ENTRYFILTER_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include <QRegularExpression>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+class ZipArchive;
+
+// Selects archive entries by name, straight from the central directory index.
+// Patterns are globs matched against the raw entry names: "*" and "?" stay
+// within one path component, "**" crosses them, "[...]" is a byte class and
+// a pattern without "/" matches the file name in any directory. "dir/" takes
+// a whole subtree and a "re:" prefix switches to a regular expression. Plain
+// names, suffixes such as "*.cfg" and subtrees are compared without running
+// the glob matcher, which keeps selection linear over very large archives.
+class EntryFilter
+{
+public:
+    // False when a pattern cannot be compiled, error then says which one
+    bool set(const QStringList &includes, const QStringList &excludes, const QStringList &entries,
+             QString *error = nullptr);
+    bool addInclude(const QString &pattern, QString *error = nullptr);
+    bool addExclude(const QString &pattern, QString *error = nullptr);
+    void addEntry(const QString &name);
+    void clear();
+
+    // An empty filter selects every entry
+    bool isEmpty() const;
+
+    // Selected when named explicitly or matching an include (or when there are
+    // neither), and not matching any exclude
+    bool matches(const ZipArchive &archive, qsizetype index) const;
+
+    // Indices of the selected entries, in archive order
+    QList<qsizetype> select(const ZipArchive &archive) const;
+
+private:
+    struct Pattern
+    {
+        enum Kind { Exact, Prefix, Suffix, Glob, Regex };
+        Kind kind = Exact;
+        bool nameOnly = false;
+        QByteArray text;
+        QRegularExpression regex;
+    };
+
+    static bool compile(const QString &pattern, Pattern &compiled, QString *error);
+    static bool matchesAny(const QList<Pattern> &patterns, QByteArrayView path, const ZipArchive &archive, qsizetype index);
+    static bool globMatch(const char *pattern, const char *patternEnd, const char *text, const char *textEnd);
+    static bool classMatch(const char *&pattern, const char *patternEnd, char c);
+
+    QList<Pattern> m_includes;
+    QList<Pattern> m_excludes;
+    QSet<QByteArray> m_entries;
+};
+
+#endif // ENTRYFILTER_H
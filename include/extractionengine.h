@@ -0,0 +1,259 @@
+#ifndef EXTRACTIONENGINE_H
+#define EXTRACTIONENGINE_H
+
+#include <QBitArray>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QMutex>
+#include <QTemporaryFile>
+#include <QThread>
+#include <atomic>
+#include <memory>
+#include "canceltoken.h"
+#include "destinationindex.h"
+#include "entryfilter.h"
+#include "extractionjournal.h"
+#include "filecloner.h"
+#include "memorygovernor.h"
+#include "outputfile.h"
+#include "taskscheduler.h"
+#include "ziparchive.h"
+#include "zipentrystream.h"
+#include "zipstreamreader.h"
+
+// One archive to extract: the top-level one or a nested zip found inside it.
+// Nested archives are held in memory, larger ones are spilled to a temporary
+// file outside the destination, so inner zips that are only containers never
+// land there.
+struct ArchiveJob
+{
+    QString name;
+    QString destinationPath;
+    std::shared_ptr<const ZipArchive> archive;
+    std::shared_ptr<QTemporaryFile> spillFile;
+    MemoryGrant memory;
+
+    // Entries to extract, in archive order, when only part of it is selected
+    bool selective = false;
+    QList<qsizetype> selection;
+
+    // Entries with the same contents as an earlier one, keyed by that first
+    // copy, and a bit per entry that is one of those later copies
+    QHash<qsizetype, QList<qsizetype>> duplicates;
+    QBitArray copies;
+
+    // The same entries sorted by local header offset, when the directory lists
+    // them in another order, so workers sweep the archive front to back
+    QList<qsizetype> readOrder;
+
+    // Consumed compressed data is evicted from the page cache
+    bool dropBehind = false;
+
+    // Where the entry started, for archives read from a stream
+    qint64 streamOffset = -1;
+
+    qsizetype entryCount() const { return selective ? selection.size() : archive->entryCount(); }
+    qsizetype entryAt(qsizetype position) const
+    {
+        if (!readOrder.isEmpty()) {
+            return readOrder[position];
+        }
+        return selective ? selection[position] : position;
+    }
+};
+
+// Extracts an archive and every nested archive inside it on a work-stealing
+// scheduler. Entry ranges split themselves in half until they are small, and
+// nested archives are submitted as new tasks as soon as they are found, so
+// inner zips of very different sizes keep all workers busy. Progress is kept
+// in atomic counters that the owner samples at its own refresh rate.
+class ExtractionEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Progress
+    {
+        qint64 completedFiles = 0;
+        qint64 totalFiles = 0;
+        qint64 failedFiles = 0;
+        qint64 skippedFiles = 0;
+        qint64 reflinkedFiles = 0;
+        qint64 hardlinkedFiles = 0;
+        qint64 copiedFiles = 0;
+        qint64 dedupedBytes = 0;
+        qint64 sparseBytes = 0;
+        qint64 completedBytes = 0;
+        qint64 totalBytes = 0;
+        qint64 completedCompressedBytes = 0;
+        qint64 totalCompressedBytes = 0;
+        QString currentFile;
+    };
+
+    explicit ExtractionEngine(QObject *parent = nullptr);
+    ~ExtractionEngine();
+
+    void setThreadCount(int count);
+    int threadCount() const;
+
+    // When disabled, nested zips are written out as plain files
+    void setExtractNested(bool extract) { m_extractNested = extract; }
+    bool extractNested() const { return m_extractNested; }
+
+    // Restricts the top-level archive to the entries the filter selects; the
+    // selection is resolved from the index when the archive is opened, so
+    // nothing else is read. Nested archives that are selected come out whole.
+    void setFilter(const EntryFilter &filter) { m_filter = filter; }
+    const EntryFilter &filter() const { return m_filter; }
+
+    // Incremental runs skip entries whose file in the destination still
+    // matches; every run journals its progress and resumes an interrupted one
+    void setIncremental(bool incremental) { m_incremental = incremental; }
+    bool incremental() const { return m_incremental; }
+    bool resumed() const { return m_journal.resumed(); }
+
+    // Entries whose central directory record and compressed bytes match an
+    // earlier one are not inflated again but cloned from its output
+    void setDeduplicate(bool deduplicate) { m_deduplicate = deduplicate; }
+    bool deduplicate() const { return m_deduplicate; }
+
+    // When written files are forced to disk; with SyncAtEnd the run only
+    // finishes once the destination's filesystem has been synced
+    void setDurability(OutputFile::Durability durability) { m_durability = durability; }
+    OutputFile::Durability durability() const { return m_durability; }
+
+    // Password for encrypted entries, ZipCrypto and WinZip AES alike, set
+    // before a run starts. Entries it does not open fail on their own; the
+    // rest of the archive goes on.
+    void setPassword(const QString &password) { m_password = password.toUtf8(); }
+    bool hasPassword() const { return !m_password.isEmpty(); }
+
+    // Byte budget for the engine's own allocations, 0 for none. Worker
+    // threads are reduced until their fixed buffers fit in a quarter of it.
+    void setMemoryBudget(qint64 bytes) { m_governor.setBudget(bytes); }
+    qint64 memoryBudget() const { return m_governor.budget(); }
+    qint64 peakMemory() const { return m_governor.peak(); }
+
+    bool open(const QString &zipPath);
+    void close();
+    const ZipArchive &archive() const { return *m_archive; }
+    qsizetype selectedCount() const { return m_filter.isEmpty() ? m_archive->entryCount() : m_selection.size(); }
+
+    // Cancel and pause reach into entries being written: workers check them
+    // between chunks, so a cancel takes effect within milliseconds, partial
+    // files are removed and the journal is kept for a later resume
+    void start(const QString &destPath);
+
+    // Extracts an archive read front to back from input on a thread of its
+    // own, each entry as soon as its data has arrived; the central directory
+    // at the end of the stream is then checked against what was extracted.
+    // input must stay valid until finished().
+    void startStream(QIODevice *input, const QString &destPath);
+    void cancel();
+    void pause();
+    void resume();
+    bool isPaused() const { return m_token.isPaused(); }
+    void waitForDone();
+    bool isRunning() const { return m_outstandingTasks.load() > 0; }
+
+    // Lock-free snapshot of the counters, cheap enough to poll on a timer
+    Progress progress() const;
+
+    // "entry: reason" for every entry that could not be extracted; damaged
+    // entries are reported here and their partial output is removed
+    QStringList failures() const;
+
+signals:
+    void finished(bool cancelled);
+
+private:
+    // What a range defers to its end: journal records, and file metadata
+    // that is restored once the files are closed
+    struct RangeOutput
+    {
+        QByteArray journal;
+        MetadataBatch metadata;
+    };
+
+    void beginRun(const QString &destPath);
+    void readStream(QIODevice *input, const QString &destPath);
+    void reconcileStream(const ZipStreamReader &reader, const QSet<qint64> &extracted);
+    void addTotals(const ArchiveJob &job);
+    void submitArchive(const std::shared_ptr<ArchiveJob> &job);
+    void submitRange(const std::shared_ptr<ArchiveJob> &job, qsizetype first, qsizetype last);
+    void runRange(const std::shared_ptr<ArchiveJob> &job, qsizetype first, qsizetype last);
+    static void orderReads(ArchiveJob &job);
+    bool extractEntry(const ArchiveJob &job, qsizetype index, ZipEntryStream &stream, RangeOutput &output);
+    bool finishFile(const ArchiveJob &job, qsizetype index, const QByteArray &key,
+                    const ExtractionJournal::Record &record, OutputFile &outFile, RangeOutput &output);
+    bool skipUnchanged(const ZipArchive &archive, qsizetype index, const QByteArray &key,
+                       const ExtractionJournal::Record &record, const QString &fullPath, QByteArray &journalBatch);
+    void findDuplicates(ArchiveJob &job) const;
+    void cloneDuplicates(const ArchiveJob &job, qsizetype index, bool written, ZipEntryStream &stream, RangeOutput &output);
+    bool cloneEntry(const ArchiveJob &job, qsizetype index, const QString &source, RangeOutput &output);
+    bool extractNestedCandidate(const ArchiveJob &job, qsizetype index, const QString &fullPath, ZipEntryStream &stream,
+                                RangeOutput &output);
+    void keepNestedFile(const ArchiveJob &job, qsizetype index, const QString &fullPath, QIODevice *data,
+                        RangeOutput &output);
+    QString nestedDestination(const ArchiveJob &job, const QString &fullPath);
+    void reportFailure(const ArchiveJob &job, qsizetype index, const QString &reason);
+    void reportFailure(const QString &name, const QString &reason);
+    void finishTask();
+    static QByteArray journalKey(const ArchiveJob &job, const QString &filePath);
+    static ExtractionJournal::Record journalRecord(const ZipArchive &archive, qsizetype index);
+
+    static constexpr qsizetype BatchSize = 16;
+    // Compressed data requested ahead of the entry being read; runs of small
+    // entries turn into one sequential read of this size
+    static constexpr qint64 ReadAheadBytes = 4 * 1024 * 1024;
+    // Archives at least this large do not keep what has been read cached
+    static constexpr qint64 DropBehindThreshold = qint64(1) << 30;
+    static constexpr qint64 InMemoryNestedLimit = 64 * 1024 * 1024;
+    // Output buffer and inflate state every worker keeps
+    static constexpr qint64 WorkerBaselineBytes = 512 * 1024;
+
+    TaskScheduler m_scheduler;
+    std::unique_ptr<QThread> m_streamThread;
+    int m_requestedThreads = 0;
+    MemoryGovernor m_governor;
+    MemoryGrant m_baselineMemory;
+    std::shared_ptr<ZipArchive> m_archive;
+    EntryFilter m_filter;
+    QList<qsizetype> m_selection;
+
+    std::atomic<qint64> m_totalFiles{0};
+    std::atomic<qint64> m_completedFiles{0};
+    std::atomic<qint64> m_failedFiles{0};
+    std::atomic<qint64> m_skippedFiles{0};
+    std::atomic<qint64> m_dedupedFiles[FileCloner::Failed] = {};
+    std::atomic<qint64> m_dedupedBytes{0};
+    std::atomic<qint64> m_sparseBytes{0};
+    std::atomic<qint64> m_totalBytes{0};
+    std::atomic<qint64> m_completedBytes{0};
+    std::atomic<qint64> m_totalCompressedBytes{0};
+    std::atomic<qint64> m_completedCompressedBytes{0};
+    std::atomic<int> m_outstandingTasks{0};
+    CancelToken m_token;
+    bool m_extractNested = true;
+    bool m_incremental = false;
+    bool m_deduplicate = false;
+    OutputFile::Durability m_durability = OutputFile::NoSync;
+    QByteArray m_password;
+    QString m_rootPath;
+
+    ExtractionJournal m_journal;
+    FileCloner m_cloner;
+    DestinationIndex m_destinations;
+    mutable QMutex m_currentFileMutex;
+    QString m_currentFile;
+    mutable QMutex m_failureMutex;
+
+    // Files written for streamed entries by their offset in the stream, the
+    // only ones reconciling with the central directory may remove
+    QHash<qint64, QString> m_streamFiles;
+    QMutex m_streamFilesMutex;
+    QStringList m_failures;
+};
+
+#endif // EXTRACTIONENGINE_H
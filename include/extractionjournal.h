@@ -0,0 +1,74 @@
+#ifndef EXTRACTIONJOURNAL_H
+#define EXTRACTIONJOURNAL_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+class ZipArchive;
+
+// Append-only record of the entries one extraction has finished, kept next to
+// the destination as "<destination>.zipextract-journal". Each record holds
+// the entry name with the CRC, size and modification time it was written
+// with, and is only appended once the file is complete, so a run that is
+// cancelled or killed leaves a journal the next run over the same archive
+// resumes from. Incremental runs read any earlier journal, whatever archive
+// wrote it, and skip entries whose file still matches. A torn record at the
+// end is ignored, and every file is checked against its size and mtime on
+// disk before it is trusted. Records of a run whose files were not synced
+// before they were written may name data a crash lost, so those files are
+// checksummed again as well.
+class ExtractionJournal
+{
+public:
+    struct Record
+    {
+        quint32 crc = 0;
+        qint64 size = 0;
+        qint64 modified = -1;
+    };
+
+    ~ExtractionJournal();
+
+    // Loads what an earlier run left for this destination, then starts a new
+    // journal in its place that carries over the records still valid. With
+    // synced, every file is on disk before its record is committed, and each
+    // commit is synced in turn.
+    bool open(const QString &destinationPath, const ZipArchive &archive, bool incremental, bool synced,
+              QString *error = nullptr);
+
+    // A complete journal is removed, or kept as the manifest for the next
+    // incremental run; an incomplete one stays for the next run to resume.
+    // synced marks every recorded file as on disk, after a filesystem sync.
+    void close(bool complete, bool synced);
+    bool isOpen() const { return m_file.isOpen(); }
+    bool resumed() const { return m_resumed; }
+
+    // True when path still holds the entry as an earlier run wrote it. Files
+    // without a record, or with one from a run that did not sync, are
+    // checksummed, but only when their size and mtime already match.
+    bool isUpToDate(const QByteArray &key, const Record &entry, const QString &path) const;
+
+    // Records are encoded into a per-worker batch and committed together
+    static void append(QByteArray &batch, const QByteArray &key, const Record &entry);
+    void commit(QByteArray &batch);
+
+    static QString journalPath(const QString &destinationPath);
+
+private:
+    bool load(const QString &path, const QByteArray &identity);
+    static QByteArray identityOf(const ZipArchive &archive);
+    static quint32 fileCrc(const QString &path, qint64 size);
+
+    QFile m_file;
+    QMutex m_mutex;
+    QHash<QByteArray, Record> m_previous;
+    bool m_incremental = false;
+    bool m_resumed = false;
+    bool m_synced = false;
+    bool m_previousSynced = false;
+};
+
+#endif // EXTRACTIONJOURNAL_H
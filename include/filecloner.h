@@ -0,0 +1,31 @@
+#ifndef FILECLONER_H
+#define FILECLONER_H
+
+#include <QString>
+#include <atomic>
+
+// Produces a second copy of a file as cheaply as the destination allows: a
+// reflink (FICLONE) that shares extents copy-on-write, then a hardlink, then
+// a plain copy. A method that fails once is not tried again by the same
+// cloner, so a filesystem without reflinks costs one probe, not one per file.
+class FileCloner
+{
+public:
+    enum Method { Reflink, Hardlink, Copy, Failed };
+
+    void reset();
+
+    // Replaces target with the contents of source; target is only touched
+    // once the clone exists
+    Method clone(const QString &source, const QString &target);
+
+private:
+    static bool replace(const QString &from, const QString &to);
+    bool reflink(const QByteArray &source, const QByteArray &target);
+    bool hardlink(const QString &source, const QString &target);
+
+    std::atomic<bool> m_reflinkSupported{true};
+    std::atomic<bool> m_hardlinkSupported{true};
+};
+
+#endif // FILECLONER_H
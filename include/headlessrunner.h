@@ -0,0 +1,61 @@
+#ifndef HEADLESSRUNNER_H
+#define HEADLESSRUNNER_H
+
+#include <QJsonObject>
+#include <QObject>
+#include <QStringList>
+#include "entryfilter.h"
+
+class QSocketNotifier;
+
+// Drives ZipExtractor without any QML for command-line and CI use, then
+// prints a JSON summary of the run on stdout and quits the application.
+// With --list it prints the (filtered) central directory instead, with
+// --create it builds an archive through ZipCreator. SIGINT and SIGTERM
+// cancel the run, SIGUSR1 and SIGUSR2 pause and resume it.
+class HeadlessRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HeadlessRunner(QObject *parent = nullptr);
+
+    // Parses the command line, returns false and prints usage on error
+    bool parse(const QStringList &arguments);
+    void start();
+
+    static bool isHeadless(int argc, char *argv[]);
+
+private slots:
+    void onExtractionFinished(bool success, const QString &message);
+    void onCreationFinished(bool success, const QString &message);
+    void onSignal();
+
+private:
+    static QJsonObject processStats();
+    bool listArchive();
+    void startCreation();
+    void printSummary(QJsonObject summary, bool success, const QString &message);
+    void installSignalHandlers();
+
+    QString m_zipPath;
+    QString m_destinationPath;
+    QString m_tracePath;
+    int m_threadCount = 0;
+    bool m_extractNested = true;
+    bool m_incremental = false;
+    bool m_deduplicate = false;
+    qint64 m_maxMemory = 0;
+    QString m_durability;
+    QString m_password;
+    bool m_listOnly = false;
+    QString m_createPath;
+    QStringList m_sources;
+    QString m_method;
+    int m_level = -1;
+    qint64 m_blockSize = 0;
+    EntryFilter m_filter;
+    QSocketNotifier *m_signalNotifier = nullptr;
+};
+
+#endif // HEADLESSRUNNER_H
@@ -0,0 +1,26 @@
+#ifndef INFLATEBACKEND_H
+#define INFLATEBACKEND_H
+
+#include <QtGlobal>
+#include <memory>
+
+// Whole-buffer raw DEFLATE decoder. Entries whose uncompressed size is known
+// and small go through here in one call instead of zlib's streaming state
+// machine; libdeflate is used when the build found it, zlib otherwise.
+// Instances are not thread-safe, each ZipEntryStream owns one.
+class InflateBackend
+{
+public:
+    virtual ~InflateBackend() = default;
+
+    virtual const char *name() const = 0;
+
+    // Decodes a complete stream that must produce exactly outputSize bytes
+    virtual bool inflateWhole(const uchar *input, qint64 inputSize, uchar *output, qint64 outputSize) = 0;
+
+    // The fastest backend available in this build
+    static std::unique_ptr<InflateBackend> create();
+    static const char *preferredName();
+};
+
+#endif // INFLATEBACKEND_H
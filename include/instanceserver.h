@@ -0,0 +1,36 @@
+#ifndef INSTANCESERVER_H
+#define INSTANCESERVER_H
+
+#include <QObject>
+#include <QStringList>
+
+class QLocalServer;
+
+// Keeps a single extracting process per user. Later invocations hand their
+// archive paths to the running process over a local socket and exit, so the
+// QML engine starts once and archives share one extraction queue.
+class InstanceServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit InstanceServer(QObject *parent = nullptr);
+
+    // Returns true when a running instance accepted the paths
+    static bool sendToRunningInstance(const QStringList &paths);
+
+    bool listen();
+
+signals:
+    void archivesReceived(const QStringList &paths);
+
+private slots:
+    void onNewConnection();
+
+private:
+    static QString serverName();
+
+    QLocalServer *m_server;
+};
+
+#endif // INSTANCESERVER_H
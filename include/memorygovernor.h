@@ -0,0 +1,101 @@
+#ifndef MEMORYGOVERNOR_H
+#define MEMORYGOVERNOR_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+
+class CancelToken;
+class MemoryGrant;
+
+// Keeps what one extraction allocates for itself under a byte budget. Whole
+// entry buffers come from a pool that is charged while it holds them, nested
+// archives and decoder dictionaries take grants, and a worker whose request
+// does not fit waits until another one releases memory. Requests that can be
+// refused instead, such as whole-entry buffers and in-memory nested archives,
+// never wait: their callers fall back to streaming or to a spill file.
+// Without a budget nothing waits and the governor only tracks the peak.
+class MemoryGovernor
+{
+public:
+    // 0 lifts the limit
+    void setBudget(qint64 bytes);
+    qint64 budget() const { return m_budget; }
+
+    qint64 inUse() const { return m_inUse.load(std::memory_order_relaxed); }
+    qint64 peak() const { return m_peak.load(std::memory_order_relaxed); }
+    void resetPeak();
+
+    // Takes the bytes only if they fit right now
+    bool tryAcquire(qint64 bytes);
+
+    // Waits until the bytes fit, returns how much was granted or -1 once the
+    // token is cancelled. Requests above what the forced charges leave of the
+    // budget are cut down to that, so they still run, alone, once everything
+    // else has drained.
+    qint64 acquire(qint64 bytes, const CancelToken *token);
+
+    // Charged whatever the budget says, for the fixed per-worker buffers,
+    // until the grant is released
+    MemoryGrant force(qint64 bytes);
+    void release(qint64 bytes);
+
+    // A pooled buffer of at least size bytes, or a null array when the budget
+    // cannot cover one; returned buffers stay pooled, and charged, for reuse
+    QByteArray takeBuffer(qint64 size);
+    void returnBuffer(QByteArray &buffer);
+
+    // Frees every pooled buffer
+    void trimPool();
+
+private:
+    friend class MemoryGrant;
+
+    bool tryCharge(qint64 bytes);
+    void releaseForced(qint64 bytes);
+    void updatePeak(qint64 used);
+
+    static constexpr qint64 BufferGranularity = 64 * 1024;
+    static constexpr qint64 UnlimitedPoolBytes = 64 * 1024 * 1024;
+
+    qint64 m_budget = 0;
+    std::atomic<qint64> m_inUse{0};
+    std::atomic<qint64> m_peak{0};
+    std::atomic<qint64> m_forced{0};
+
+    QMutex m_mutex;
+    QWaitCondition m_released;
+    QList<QByteArray> m_pool;
+    qint64 m_pooledBytes = 0;
+};
+
+// Releases a governor charge when it goes out of scope
+class MemoryGrant
+{
+public:
+    MemoryGrant() = default;
+    MemoryGrant(MemoryGovernor *governor, qint64 bytes) : m_governor(governor), m_bytes(bytes) {}
+    MemoryGrant(MemoryGrant &&other) noexcept;
+    MemoryGrant &operator=(MemoryGrant &&other) noexcept;
+    ~MemoryGrant() { reset(); }
+
+    MemoryGrant(const MemoryGrant &) = delete;
+    MemoryGrant &operator=(const MemoryGrant &) = delete;
+
+    void reset();
+    qint64 bytes() const { return m_bytes; }
+
+    // Takes over bytes acquired from the same governor
+    void add(qint64 bytes) { m_bytes += bytes; }
+
+private:
+    friend class MemoryGovernor;
+
+    MemoryGovernor *m_governor = nullptr;
+    qint64 m_bytes = 0;
+    bool m_forced = false;
+};
+
+#endif // MEMORYGOVERNOR_H
@@ -0,0 +1,86 @@
+#ifndef OUTPUTFILE_H
+#define OUTPUTFILE_H
+
+#include <QFile>
+#include <QIODevice>
+#include <QList>
+
+// Output side of one extracted file. Entries are decoded into large chunks,
+// so the file is written unbuffered; files of at least SparseThreshold bytes
+// are preallocated to their final size and long runs of zeros in them are
+// left as holes instead of being written, which keeps disk images sparse.
+// The device is sequential: it only ever appends.
+class OutputFile : public QIODevice
+{
+public:
+    // When extracted data is forced to disk
+    enum Durability { NoSync, SyncEachFile, SyncAtEnd };
+
+    explicit OutputFile(const QString &path);
+    ~OutputFile() override;
+
+    // Creates the file as a new one, replacing rather than truncating an
+    // existing file so hardlinks to it are left alone
+    bool create(qint64 size);
+
+    // Closes the file, syncing it first with SyncEachFile; false when the
+    // data may not have reached the disk
+    bool finish(Durability durability);
+
+    // Closes and deletes a file that must not be left behind
+    void discard();
+
+    QString fileName() const { return m_file.fileName(); }
+
+    // Bytes left as holes instead of being written
+    qint64 holeBytes() const { return m_holeBytes; }
+
+    bool isSequential() const override { return true; }
+
+    // Flushes everything written under path's filesystem, for SyncAtEnd
+    static bool syncFileSystem(const QString &path);
+
+    // Flushes an open file and forces it to disk
+    static bool sync(QFile &file);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 length) override;
+
+private:
+    bool writeRange(const char *data, qint64 length);
+    bool skipRange(qint64 length);
+    void preallocate(qint64 size);
+
+    static constexpr qint64 SparseThreshold = 1024 * 1024;
+    static constexpr qint64 ZeroBlockSize = 4096;
+    static constexpr qint64 HoleBytes = 64 * 1024;
+
+    QFile m_file;
+    qint64 m_offset = 0;
+    qint64 m_holeBytes = 0;
+    bool m_sparse = false;
+    bool m_preallocated = false;
+};
+
+// File timestamps and permissions restored together once a batch of files
+// is closed, instead of one open, set and close per file while writing
+class MetadataBatch
+{
+public:
+    // modified in milliseconds since the epoch, -1 to keep; mode 0 to keep
+    void add(const QString &path, qint64 modified, quint16 mode);
+    void apply();
+
+private:
+    struct Entry
+    {
+        QString path;
+        qint64 modified;
+        quint16 mode;
+    };
+
+    QList<Entry> m_entries;
+};
+
+#endif // OUTPUTFILE_H
@@ -0,0 +1,30 @@
+#ifndef PROGRESSMETER_H
+#define PROGRESSMETER_H
+
+#include <QString>
+
+// Smoothed rates for progress reporting. Samples are taken at a fixed
+// interval and folded into exponentially weighted averages, so a burst of
+// tiny files or one huge entry does not make the estimate jump around.
+class ProgressMeter
+{
+public:
+    void reset();
+    void sample(qint64 elapsedMs, qint64 completedWork, qint64 completedBytes);
+
+    double bytesPerSecond() const { return m_byteRate; }
+    double workPerSecond() const { return m_workRate; }
+
+    QString eta(qint64 remainingWork) const;
+
+private:
+    static constexpr double SmoothingSeconds = 3.0;
+
+    qint64 m_lastElapsed = -1;
+    qint64 m_lastWork = 0;
+    qint64 m_lastBytes = 0;
+    double m_workRate = 0.0;
+    double m_byteRate = 0.0;
+};
+
+#endif // PROGRESSMETER_H
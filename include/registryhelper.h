@@ -3,6 +3,7 @@
 
 #include <QObject>
 #include <QQmlEngine>
+#include <QStringList>
 
 class RegistryHelper : public QObject
 {
@@ -35,6 +36,8 @@ private:
 
     static RegistryHelper* s_instance;
     static const QString MENU_TEXT;
+    static const QString COMPRESS_MENU_TEXT;
+    static const QStringList COMPRESS_KEYS;
 };
 
 #endif // REGISTRYHELPER_H
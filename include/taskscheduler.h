@@ -0,0 +1,57 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+
+// Work-stealing thread pool. Every worker owns a deque: tasks submitted from
+// a worker go to the front of its own deque and are run newest first, idle
+// workers steal the oldest task from the back of a sibling. Tasks that split
+// themselves keep the large halves stealable, so uneven work spreads out.
+class TaskScheduler
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit TaskScheduler(int threadCount = 0);
+    ~TaskScheduler();
+
+    // Only takes effect while no task is pending
+    void setThreadCount(int count);
+    int threadCount() const { return int(m_workers.size()); }
+
+    void submit(Task task);
+    void waitForDone();
+
+private:
+    struct Worker
+    {
+        QMutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void startThreads(int count);
+    void stopThreads();
+    void run(int index);
+    bool popLocal(int index, Task &task);
+    bool steal(int index, Task &task);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    QList<QThread *> m_threads;
+
+    QMutex m_sleepMutex;
+    QWaitCondition m_wakeCondition;
+    QWaitCondition m_doneCondition;
+    std::atomic<int> m_queued{0};
+    std::atomic<int> m_pending{0};
+    std::atomic<unsigned> m_nextWorker{0};
+    bool m_stopping = false;
+};
+
+#endif // TASKSCHEDULER_H
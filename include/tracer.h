@@ -0,0 +1,141 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QVariantMap>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+enum class TracePhase : quint8 {
+    Index,
+    Directories,
+    Entry,
+    Open,
+    Inflate,
+    Decrypt,
+    Compress,
+    Write,
+    Nested,
+    Finalize,
+    Count
+};
+
+// Hot-path instrumentation for extractions. Spans are appended to a ring
+// buffer owned by the recording thread, so recording never takes a lock;
+// each thread also folds its spans into per-phase latency histograms. When
+// tracing is off a span costs one relaxed atomic load. A thread that exits
+// leaves its buffer to the next thread that starts recording, which shows
+// up in the trace as the same thread.
+//
+// Buffers and histograms are read by summary() and exportChromeTrace(),
+// which are meant to run once the extraction is done.
+class Tracer
+{
+public:
+    static Tracer &instance();
+
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static qint64 nowNs();
+
+    // Enabling also clears whatever the previous run recorded
+    void setEnabled(bool enabled);
+    void reset();
+
+    void record(TracePhase phase, qint64 startNs, qint64 endNs, qint64 bytes, qint64 detail);
+
+    // Per phase: count, total time and bytes, approximate latency percentiles
+    // and the log2 microsecond histogram
+    QVariantMap summary() const;
+
+    // Chrome trace event format, loadable in chrome://tracing and Perfetto
+    bool exportChromeTrace(const QString &path, QString *error = nullptr) const;
+
+    static const char *phaseName(TracePhase phase);
+
+private:
+    static constexpr int RingCapacity = 1 << 16;
+    static constexpr int HistogramBuckets = 32;
+    static constexpr int PhaseCount = int(TracePhase::Count);
+
+    struct Event
+    {
+        qint64 startNs;
+        qint64 durationNs;
+        qint64 bytes;
+        qint64 detail;
+        TracePhase phase;
+    };
+
+    // Written only by its owning thread, counters are atomics so a reader
+    // never sees torn values
+    struct PhaseStats
+    {
+        std::atomic<qint64> count{0};
+        std::atomic<qint64> totalNs{0};
+        std::atomic<qint64> maxNs{0};
+        std::atomic<qint64> bytes{0};
+        std::atomic<qint64> buckets[HistogramBuckets] = {};
+    };
+
+    struct ThreadBuffer
+    {
+        int threadId = 0;
+        std::vector<Event> events;
+        std::atomic<quint64> head{0};
+        PhaseStats phases[PhaseCount];
+    };
+
+    // Hands the thread's buffer back when the thread exits
+    struct ThreadSlot
+    {
+        ThreadBuffer *buffer = nullptr;
+        ~ThreadSlot();
+    };
+
+    Tracer() = default;
+    ThreadBuffer *threadBuffer();
+
+    static std::atomic<bool> s_enabled;
+    static thread_local ThreadSlot s_threadSlot;
+
+    mutable QMutex m_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+    // Buffers of finished threads, taken over by the next new thread
+    std::vector<ThreadBuffer *> m_freeBuffers;
+    qint64 m_epochNs = 0;
+};
+
+// Records the enclosing scope as one span of the given phase
+class TraceSpan
+{
+public:
+    explicit TraceSpan(TracePhase phase, qint64 detail = -1)
+        : m_start(Tracer::isEnabled() ? Tracer::nowNs() : -1)
+        , m_detail(detail)
+        , m_phase(phase)
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if (m_start >= 0) {
+            Tracer::instance().record(m_phase, m_start, Tracer::nowNs(), m_bytes, m_detail);
+        }
+    }
+
+    void addBytes(qint64 bytes) { m_bytes += bytes; }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    qint64 m_start;
+    qint64 m_bytes = 0;
+    qint64 m_detail;
+    TracePhase m_phase;
+};
+
+#endif // TRACER_H
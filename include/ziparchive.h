@@ -0,0 +1,107 @@
+#ifndef ZIPARCHIVE_H
+#define ZIPARCHIVE_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QDateTime>
+#include <QFile>
+#include <QList>
+#include <QString>
+
+// Read-only view of a ZIP archive. The file is memory-mapped and the central
+// directory is parsed in place into a struct-of-arrays index: names are kept
+// as offsets into the mapped directory, so opening an archive costs one pass
+// and a handful of allocations regardless of the entry count. Archives held
+// in memory, such as decompressed nested zips, are indexed the same way.
+// Zip64 archives are read through their 64-bit records and extra fields, so
+// neither the entry count nor any size or offset is limited to 32 bits.
+class ZipArchive
+{
+public:
+    ZipArchive() = default;
+    ~ZipArchive();
+
+    bool open(const QString &path);
+    bool open(const QByteArray &data);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+
+    QString fileName() const { return m_file.fileName(); }
+    qint64 size() const { return m_size; }
+    qsizetype entryCount() const { return m_localHeaderOffsets.size(); }
+
+    QByteArrayView rawName(qsizetype index) const;
+    QString name(qsizetype index) const;
+    bool isDir(qsizetype index) const;
+
+    // The entry name as a path below the destination, see safePath()
+    QString safeName(qsizetype index) const { return safePath(name(index)); }
+
+    // Turns an entry name into a relative path that stays inside the
+    // destination: backslashes become slashes, drive letters and leading
+    // slashes are dropped and "." and ".." are resolved. Empty when the name
+    // still points outside, such names must not be extracted.
+    static QString safePath(const QString &name);
+
+    quint16 method(qsizetype index) const { return m_methods[index]; }
+    quint16 flags(qsizetype index) const { return m_flags[index]; }
+    quint32 crc(qsizetype index) const { return m_crcs[index]; }
+    qint64 compressedSize(qsizetype index) const { return m_compressedSizes[index]; }
+    qint64 uncompressedSize(qsizetype index) const { return m_uncompressedSizes[index]; }
+    qint64 localHeaderOffset(qsizetype index) const { return m_localHeaderOffsets[index]; }
+
+    // Permission bits recorded by a Unix archiver, 0 for other hosts
+    quint16 unixMode(qsizetype index) const;
+
+    // DOS timestamp of the entry in local time, invalid when the field does
+    // not hold a real date and time (such as the all-zero field)
+    QDateTime lastModified(qsizetype index) const;
+    // The same timestamp as stored, time in the low and date in the high half
+    quint32 dosTime(qsizetype index) const { return m_modTimes[index]; }
+
+    // Payload of the central header's extra field with the given id, empty
+    // when the entry has none
+    QByteArrayView extraField(qsizetype index, quint16 id) const;
+
+    // True when the data starts like a ZIP archive (local header or empty archive)
+    static bool hasSignature(QByteArrayView head);
+
+    // Replaces the fields saturated at 0xffffffff with their values from a
+    // Zip64 extra field; false when the field is missing or too short
+    static bool readZip64Extra(const uchar *extra, quint16 length, quint64 &uncompressedSize,
+                               quint64 &compressedSize, quint64 &localHeaderOffset);
+
+    // Start of the entry data, resolved through the local header, or nullptr
+    // when the header is damaged or the data runs past the end of the archive
+    const uchar *entryData(qsizetype index) const;
+
+    // Offset just past the entry data, or -1 where entryData() fails
+    qint64 dataEnd(qsizetype index) const;
+
+    // Page cache hints for archives read from a file, no-ops for archives in
+    // memory and on platforms without them. willNeed() starts reading a range
+    // in the background, dropBehind() evicts one that has been consumed.
+    void willNeed(qint64 offset, qint64 length) const;
+    void dropBehind(qint64 offset, qint64 length) const;
+
+private:
+    bool parseCentralDirectory();
+
+    QFile m_file;
+    QByteArray m_buffer;
+    const uchar *m_data = nullptr;
+    qint64 m_size = 0;
+    const uchar *m_centralDirectory = nullptr;
+
+    QList<qint64> m_nameOffsets;
+    QList<quint16> m_nameLengths;
+    QList<quint16> m_methods;
+    QList<quint16> m_flags;
+    QList<quint32> m_crcs;
+    QList<quint32> m_modTimes;
+    QList<qint64> m_compressedSizes;
+    QList<qint64> m_uncompressedSizes;
+    QList<qint64> m_localHeaderOffsets;
+};
+
+#endif // ZIPARCHIVE_H
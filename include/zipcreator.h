@@ -0,0 +1,123 @@
+#ifndef ZIPCREATOR_H
+#define ZIPCREATOR_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QQmlEngine>
+#include <QTimer>
+#include <QVariantMap>
+#include "compressionengine.h"
+#include "progressmeter.h"
+
+// Counterpart of ZipExtractor for building archives: the same progress, ETA,
+// throughput, pause and cancel surface, driven by a CompressionEngine
+class ZipCreator : public QObject
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_SINGLETON
+
+    Q_PROPERTY(qint64 currentFile READ currentFile NOTIFY currentFileChanged)
+    Q_PROPERTY(qint64 totalFiles READ totalFiles NOTIFY totalFilesChanged)
+    Q_PROPERTY(QString currentFileName READ currentFileName NOTIFY currentFileNameChanged)
+    Q_PROPERTY(double progress READ progress NOTIFY progressChanged)
+    Q_PROPERTY(QString eta READ eta NOTIFY etaChanged)
+    Q_PROPERTY(double throughput READ throughput NOTIFY throughputChanged)
+    Q_PROPERTY(bool isCreating READ isCreating NOTIFY isCreatingChanged)
+    Q_PROPERTY(bool isPaused READ isPaused NOTIFY isPausedChanged)
+    Q_PROPERTY(QString currentArchive READ currentArchive NOTIFY isCreatingChanged)
+    Q_PROPERTY(QString method READ method WRITE setMethod NOTIFY methodChanged)
+    Q_PROPERTY(int level READ level WRITE setLevel NOTIFY levelChanged)
+
+public:
+    static ZipCreator* create(QQmlEngine *qmlEngine, QJSEngine *jsEngine);
+    static ZipCreator* instance();
+
+    // Archives the sources into zipPath; an empty path puts the archive next
+    // to the first source, named after it. False while another one is running.
+    Q_INVOKABLE bool startCreation(const QStringList &sources, const QString &zipPath = "");
+    Q_INVOKABLE void cancelCreation();
+    Q_INVOKABLE void pauseCreation();
+    Q_INVOKABLE void resumeCreation();
+
+    // Summary of the last archive: entries, bytes in and out, ratio, wall
+    // time, throughput and phase timings
+    Q_INVOKABLE QVariantMap stats() const;
+
+    // Where an archive of these sources goes when no path is given
+    static QString defaultArchivePath(const QStringList &sources);
+
+    void setThreadCount(int count) { m_engine->setThreadCount(count); }
+    void setBlockSize(qint64 bytes) { m_engine->setBlockSize(bytes); }
+
+    // Property getters
+    qint64 currentFile() const { return m_currentFile; }
+    qint64 totalFiles() const { return m_totalFiles; }
+    QString currentFileName() const { return m_currentFileName; }
+    double progress() const { return m_progress; }
+    QString eta() const { return m_eta; }
+    double throughput() const { return m_throughput; }
+    bool isCreating() const { return m_isCreating; }
+    bool isPaused() const { return m_isPaused; }
+    QString currentArchive() const { return m_zipPath; }
+    // "store", "deflate" or "zstd" when this build has it; other values are ignored
+    QString method() const;
+    void setMethod(const QString &method);
+    // -1 for the method's default
+    int level() const { return m_engine->level(); }
+    void setLevel(int level);
+
+signals:
+    void currentFileChanged();
+    void totalFilesChanged();
+    void currentFileNameChanged();
+    void progressChanged();
+    void etaChanged();
+    void throughputChanged();
+    void isCreatingChanged();
+    void isPausedChanged();
+    void methodChanged();
+    void levelChanged();
+    void creationFinished(bool success, const QString &message);
+
+private slots:
+    void refreshProgress();
+    void onEngineFinished(bool success, bool cancelled);
+    void updateETA();
+
+private:
+    explicit ZipCreator(QObject *parent = nullptr);
+    void resetProgress();
+    void finishCreation(bool success, const QString &message);
+    void setPaused(bool paused);
+
+    static ZipCreator* s_instance;
+
+    qint64 m_currentFile = 0;
+    qint64 m_totalFiles = 0;
+    QString m_currentFileName;
+    double m_progress = 0.0;
+    QString m_eta = "Calculating...";
+    double m_throughput = 0.0;
+    bool m_isCreating = false;
+    bool m_isPaused = false;
+
+    CompressionEngine *m_engine;
+    QTimer *m_refreshTimer;
+    QTimer *m_etaTimer;
+    ProgressMeter m_meter;
+    qint64 m_remainingWork = 0;
+    QStringList m_sources;
+    QString m_zipPath;
+    QElapsedTimer m_elapsedTimer;
+
+    // Last run, kept for stats()
+    qint64 m_wallMs = 0;
+    CompressionEngine::Progress m_finalProgress;
+    QString m_error;
+    QElapsedTimer m_pauseTimer;
+    qint64 m_pausedMs = 0;
+    qint64 m_cancelLatencyMs = -1;
+};
+
+#endif // ZIPCREATOR_H
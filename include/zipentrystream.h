@@ -0,0 +1,80 @@
+#ifndef ZIPENTRYSTREAM_H
+#define ZIPENTRYSTREAM_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QString>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include "canceltoken.h"
+#include "entrydecoder.h"
+#include "entrydecryptor.h"
+#include "inflatebackend.h"
+#include "memorygovernor.h"
+#include "ziparchive.h"
+
+// Decompresses single archive entries into an output device. Small deflated
+// entries are decoded in one call into a pooled buffer and written once;
+// everything else streams through a fixed-size buffer via the EntryDecoder
+// for its method, so memory use does not depend on the entry size.
+// Compressed data is consumed straight from the archive mapping and the
+// CRC-32 of the output is checked as it is produced.
+// Encrypted entries are decrypted slice by slice in front of the decoder.
+// One stream is meant to be reused for many entries.
+class ZipEntryStream
+{
+public:
+    ZipEntryStream();
+    ~ZipEntryStream();
+
+    // Compressed bytes consumed and bytes produced are added to these as each
+    // chunk completes, so progress moves inside large entries too
+    void setCounters(std::atomic<qint64> *inputBytes, std::atomic<qint64> *outputBytes);
+
+    // Checked before every chunk is written; a cancel fails the entry
+    void setToken(const CancelToken *token) { m_token = token; }
+
+    // Whole-entry buffers come from the governor's pool and decoders charge
+    // their working memory to it; an entry whose buffer does not fit the
+    // budget is streamed instead
+    void setGovernor(MemoryGovernor *governor) { m_governor = governor; }
+
+    // For encrypted entries, which fail without one
+    void setPassword(const QByteArray &password) { m_decryptor.setPassword(password); }
+
+    // False when the entry cannot be decoded, fails its CRC or cannot be
+    // written; errorString() then says why and the output must be discarded
+    bool extract(const ZipArchive &archive, qsizetype index, QIODevice *out);
+    QString errorString() const { return m_error; }
+
+private:
+    bool copyStored(EntryInput &input, QIODevice *out);
+    bool reserveWholeBuffer(qint64 size);
+    bool inflateWhole(const uchar *data, qint64 compressedSize, qint64 uncompressedSize, QIODevice *out);
+    bool decodeStreaming(EntryDecoder &decoder, EntryInput &input, qint64 uncompressedSize, quint16 flags,
+                         QIODevice *out);
+    EntryDecoder *decoderFor(quint16 method);
+    bool writeChunk(QIODevice *out, const char *data, qint64 size);
+
+    static constexpr qsizetype OutputBufferSize = 256 * 1024;
+    static constexpr qint64 WholeBufferLimit = 4 * 1024 * 1024;
+    // Enough of a stream header for every decoder's memoryEstimate()
+    static constexpr qint64 EstimateHeadSize = 4096;
+
+    QByteArray m_output;
+    QByteArray m_wholeBuffer;
+    QByteArray m_decrypted;
+    EntryDecryptor m_decryptor;
+    std::unique_ptr<InflateBackend> m_backend;
+    std::unordered_map<quint16, std::unique_ptr<EntryDecoder>> m_decoders;
+    quint32 m_crc = 0;
+    qint64 m_produced = 0;
+    QString m_error;
+    std::atomic<qint64> *m_inputBytes = nullptr;
+    std::atomic<qint64> *m_outputBytes = nullptr;
+    const CancelToken *m_token = nullptr;
+    MemoryGovernor *m_governor = nullptr;
+};
+
+#endif // ZIPENTRYSTREAM_H
@@ -4,8 +4,12 @@
 #include <QObject>
 #include <QTimer>
 #include <QElapsedTimer>
+#include <QFile>
+#include <QVariantList>
+#include <QVariantMap>
 #include <QQmlEngine>
-#include <private/qzipreader_p.h>
+#include "extractionengine.h"
+#include "progressmeter.h"
 
 class ZipExtractor : public QObject
 {
@@ -13,27 +17,95 @@ class ZipExtractor : public QObject
     QML_ELEMENT
     QML_SINGLETON
 
-    Q_PROPERTY(int currentFile READ currentFile NOTIFY currentFileChanged)
-    Q_PROPERTY(int totalFiles READ totalFiles NOTIFY totalFilesChanged)
+    Q_PROPERTY(qint64 currentFile READ currentFile NOTIFY currentFileChanged)
+    Q_PROPERTY(qint64 totalFiles READ totalFiles NOTIFY totalFilesChanged)
     Q_PROPERTY(QString currentFileName READ currentFileName NOTIFY currentFileNameChanged)
     Q_PROPERTY(double progress READ progress NOTIFY progressChanged)
     Q_PROPERTY(QString eta READ eta NOTIFY etaChanged)
+    Q_PROPERTY(double throughput READ throughput NOTIFY throughputChanged)
     Q_PROPERTY(bool isExtracting READ isExtracting NOTIFY isExtractingChanged)
+    Q_PROPERTY(bool isPaused READ isPaused NOTIFY isPausedChanged)
+    Q_PROPERTY(QString currentArchive READ currentArchive NOTIFY isExtractingChanged)
+    Q_PROPERTY(int totalArchives READ totalArchives NOTIFY queueChanged)
+    Q_PROPERTY(int completedArchives READ completedArchives NOTIFY queueChanged)
+    Q_PROPERTY(int queuedArchives READ queuedArchives NOTIFY queueChanged)
+    Q_PROPERTY(double overallProgress READ overallProgress NOTIFY overallProgressChanged)
+    Q_PROPERTY(bool tracing READ tracing WRITE setTracing NOTIFY tracingChanged)
+    Q_PROPERTY(bool incremental READ incremental WRITE setIncremental NOTIFY incrementalChanged)
+    Q_PROPERTY(bool deduplicate READ deduplicate WRITE setDeduplicate NOTIFY deduplicateChanged)
+    Q_PROPERTY(qint64 maxMemory READ maxMemory WRITE setMaxMemory NOTIFY maxMemoryChanged)
+    Q_PROPERTY(QString durability READ durability WRITE setDurability NOTIFY durabilityChanged)
+    Q_PROPERTY(QString password READ password WRITE setPassword NOTIFY passwordChanged)
 
 public:
     static ZipExtractor* create(QQmlEngine *qmlEngine, QJSEngine *jsEngine);
     static ZipExtractor* instance();
 
+    // Starts right away when idle, otherwise the archive is queued
     Q_INVOKABLE void startExtraction(const QString &zipPath, const QString &destPath = "");
+    Q_INVOKABLE void enqueueExtractions(const QStringList &zipPaths);
+
+    // Extracts only the entries named in entries or matching includes (every
+    // entry when both are empty), minus those matching excludes. See
+    // EntryFilter for the pattern syntax; false when a pattern is invalid.
+    Q_INVOKABLE bool startSelectiveExtraction(const QString &zipPath, const QString &destPath,
+                                              const QStringList &includes, const QStringList &excludes = {},
+                                              const QStringList &entries = {});
+    void startExtraction(const QString &zipPath, const QString &destPath, const EntryFilter &filter);
+
+    // Central directory of an archive, filtered the same way, without
+    // extracting anything: name, isDir, size, compressedSize, method, crc and
+    // for encrypted entries encryption
+    Q_INVOKABLE QVariantList listEntries(const QString &zipPath, const QStringList &includes = {},
+                                         const QStringList &excludes = {}) const;
+
+    // True when any entry of the archive needs a password
+    Q_INVOKABLE bool isEncrypted(const QString &zipPath) const;
     Q_INVOKABLE void cancelExtraction();
 
+    // Pausing parks every worker at its next chunk, without closing anything
+    Q_INVOKABLE void pauseExtraction();
+    Q_INVOKABLE void resumeExtraction();
+
+    // Summary of the last extraction: entries, bytes, wall time, throughput and phase timings
+    Q_INVOKABLE QVariantMap stats() const;
+
+    // Span histograms of the last extraction, and its spans as a Chrome trace
+    Q_INVOKABLE QVariantMap traceSummary() const;
+    Q_INVOKABLE bool exportTrace(const QString &path);
+
+    void setThreadCount(int count) { m_engine->setThreadCount(count); }
+    void setExtractNested(bool extract) { m_engine->setExtractNested(extract); }
+
     // Property getters
-    int currentFile() const { return m_currentFile; }
-    int totalFiles() const { return m_totalFiles; }
+    qint64 currentFile() const { return m_currentFile; }
+    qint64 totalFiles() const { return m_totalFiles; }
     QString currentFileName() const { return m_currentFileName; }
     double progress() const { return m_progress; }
     QString eta() const { return m_eta; }
+    double throughput() const { return m_throughput; }
     bool isExtracting() const { return m_isExtracting; }
+    bool isPaused() const { return m_isPaused; }
+    QString currentArchive() const { return m_currentZipPath; }
+    int totalArchives() const { return m_totalArchives; }
+    int completedArchives() const { return m_completedArchives; }
+    int queuedArchives() const { return m_queue.size(); }
+    double overallProgress() const { return m_overallProgress; }
+    bool tracing() const;
+    void setTracing(bool tracing);
+    bool incremental() const { return m_engine->incremental(); }
+    void setIncremental(bool incremental);
+    bool deduplicate() const { return m_engine->deduplicate(); }
+    void setDeduplicate(bool deduplicate);
+    qint64 maxMemory() const { return m_engine->memoryBudget(); }
+    void setMaxMemory(qint64 bytes);
+    // "none", "file" (fsync each file) or "end" (one filesystem sync), other
+    // values are ignored
+    QString durability() const;
+    void setDurability(const QString &durability);
+    // Used for every encrypted entry of the archives extracted from now on
+    QString password() const { return m_password; }
+    void setPassword(const QString &password);
 
 signals:
     void currentFileChanged();
@@ -41,37 +113,86 @@ signals:
     void currentFileNameChanged();
     void progressChanged();
     void etaChanged();
+    void throughputChanged();
     void isExtractingChanged();
+    void isPausedChanged();
+    void queueChanged();
+    void overallProgressChanged();
+    void tracingChanged();
+    void incrementalChanged();
+    void deduplicateChanged();
+    void maxMemoryChanged();
+    void durabilityChanged();
+    void passwordChanged();
     void extractionFinished(bool success, const QString &message);
+    void allExtractionsFinished();
 
 private slots:
-    void processNextFile();
+    void refreshProgress();
+    void onEngineFinished(bool cancelled);
     void updateETA();
+    void startNextArchive();
 
 private:
+    struct QueuedArchive
+    {
+        QString zipPath;
+        QString destPath;
+        EntryFilter filter;
+        qint64 size = 0;
+    };
+
     explicit ZipExtractor(QObject *parent = nullptr);
     void resetProgress();
-    bool shouldExtractRecursively(const QString &zipPath) const;
-    QString getUniqueFileName(const QString &directory, const QString &baseName, const QString &extension) const;
-    void extractNestedZip(const QString &zipPath);
+    void enqueueArchive(const QString &zipPath, const QString &destPath, const EntryFilter &filter = EntryFilter());
+    void beginExtraction(const QString &zipPath, const QString &destPath, const EntryFilter &filter);
+    void finishArchive(bool success, const QString &message);
+    void setPaused(bool paused);
+    void beginStreamExtraction(const QString &destPath, const EntryFilter &filter);
 
     static ZipExtractor* s_instance;
 
-    int m_currentFile = 0;
-    int m_totalFiles = 0;
+    qint64 m_currentFile = 0;
+    qint64 m_totalFiles = 0;
     QString m_currentFileName;
     double m_progress = 0.0;
     QString m_eta = "Calculating...";
+    double m_throughput = 0.0;
     bool m_isExtracting = false;
+    bool m_isPaused = false;
 
-    QZipReader *m_zipReader = nullptr;
-    QTimer *m_extractTimer;
+    ExtractionEngine *m_engine;
+    QTimer *m_refreshTimer;
     QTimer *m_etaTimer;
-    QList<QZipReader::FileInfo> m_fileList;
+    ProgressMeter m_meter;
+    qint64 m_remainingWork = 0;
     QString m_destinationPath;
     QString m_currentZipPath;  // Added to track current zip file path
+    QString m_password;
+    QFile m_stdin;
     QElapsedTimer m_elapsedTimer;
-    QStringList m_nestedZipsToExtract;
+
+    // Archives waiting for the engine, with batch-wide progress
+    QList<QueuedArchive> m_queue;
+    int m_totalArchives = 0;
+    int m_completedArchives = 0;
+    qint64 m_batchTotalBytes = 0;
+    qint64 m_batchCompletedBytes = 0;
+    qint64 m_currentArchiveSize = 0;
+    double m_overallProgress = 0.0;
+
+    // Last run, kept for stats()
+    QElapsedTimer m_wallTimer;
+    qint64 m_wallMs = 0;
+    qint64 m_indexMs = 0;
+    qint64 m_extractMs = 0;
+    qint64 m_finalizeMs = 0;
+    ExtractionEngine::Progress m_finalProgress;
+    QStringList m_failures;
+    bool m_resumed = false;
+    QElapsedTimer m_pauseTimer;
+    qint64 m_pausedMs = 0;
+    qint64 m_cancelLatencyMs = -1;
 };
 
 #endif // ZIPEXTRACTOR_H
@@ -0,0 +1,132 @@
+#ifndef ZIPSTREAMREADER_H
+#define ZIPSTREAMREADER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QIODevice>
+#include <QList>
+#include <QString>
+#include <QTemporaryFile>
+#include <memory>
+#include "memorygovernor.h"
+#include "ziparchive.h"
+
+class CancelToken;
+
+// Reads a ZIP archive front to back from a device that cannot seek, such as
+// stdin or a pipe. Entries are taken from their local headers; when a header
+// leaves its sizes to a data descriptor, the data ends where a descriptor
+// whose size matches is followed by the next header. Each entry comes back
+// as a one-entry archive of its own, in memory or spilled to a temporary
+// file, so it is extracted like any other archive while the rest of the
+// stream is still arriving. The central directory at the end is then read
+// back and compared with what was streamed.
+//
+// The device is read from whichever thread calls next() and must block in
+// read() until data arrives; a read that returns nothing ends the stream.
+class ZipStreamReader
+{
+public:
+    struct Entry
+    {
+        // Offset of the local header in the stream
+        qint64 offset = 0;
+        std::shared_ptr<ZipArchive> archive;
+        std::shared_ptr<QTemporaryFile> spillFile;
+        MemoryGrant memory;
+    };
+
+    // Disagreement between the central directory and the streamed entries
+    struct Mismatch
+    {
+        enum Kind {
+            // Listed, but no local header for it came through the stream
+            Missing,
+            // Streamed with another CRC or other sizes than listed
+            Changed,
+            // Streamed but not listed: the archive was updated in place and
+            // the entry is no longer part of it
+            Unlisted
+        };
+
+        Kind kind;
+        qint64 offset;
+        QString name;
+    };
+
+    // Permissions the central directory records for a streamed entry
+    struct Mode
+    {
+        qint64 offset;
+        QString name;
+        quint16 mode;
+    };
+
+    explicit ZipStreamReader(QIODevice *input);
+
+    void setToken(const CancelToken *token) { m_token = token; }
+    // In-memory entries are charged here, entries that do not fit are spilled
+    void setGovernor(MemoryGovernor *governor) { m_governor = governor; }
+
+    // False at the central directory or on an error, errorString() tells
+    bool next(Entry &entry);
+
+    // Reads the central directory after next() has stopped at it
+    bool readCentralDirectory();
+    QList<Mismatch> mismatches() const { return m_mismatches; }
+    QList<Mode> modes() const { return m_modes; }
+
+    QString errorString() const { return m_error; }
+
+private:
+    struct Streamed
+    {
+        QString name;
+        quint32 crc;
+        qint64 compressedSize;
+        qint64 uncompressedSize;
+    };
+
+    bool fill(qint64 bytes);
+    qint64 available() const { return m_buffer.size() - m_pos; }
+    const uchar *head() const { return reinterpret_cast<const uchar *>(m_buffer.constData()) + m_pos; }
+    void consume(qint64 bytes);
+
+    bool copyData(qint64 size);
+    bool scanData(quint32 &crc, qint64 &compressedSize, qint64 &uncompressedSize);
+    bool skipDescriptor(bool zip64, quint32 &crc, qint64 &uncompressedSize);
+
+    void beginEntry();
+    bool write(const char *data, qint64 size);
+    bool spill();
+    bool finishEntry(const QByteArray &localHeader, quint32 crc, qint64 compressedSize,
+                     qint64 uncompressedSize, Entry &entry);
+    bool fail(const QString &error);
+
+    static constexpr qint64 ReadChunkSize = 1024 * 1024;
+    static constexpr qint64 InMemoryLimit = 64 * 1024 * 1024;
+
+    QIODevice *m_input;
+    const CancelToken *m_token = nullptr;
+    MemoryGovernor *m_governor = nullptr;
+
+    // Lookahead: bytes from m_pos on have been read but not consumed, m_offset
+    // is the stream offset of the buffer's first byte
+    QByteArray m_buffer;
+    qint64 m_pos = 0;
+    qint64 m_offset = 0;
+    bool m_eof = false;
+
+    // The entry being assembled
+    QByteArray m_entryBuffer;
+    std::shared_ptr<QTemporaryFile> m_spillFile;
+    MemoryGrant m_entryMemory;
+    qint64 m_entrySize = 0;
+
+    QHash<qint64, Streamed> m_streamed;
+    QList<Mismatch> m_mismatches;
+    QList<Mode> m_modes;
+    QString m_error;
+};
+
+#endif // ZIPSTREAMREADER_H
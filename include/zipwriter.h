@@ -0,0 +1,67 @@
+#ifndef ZIPWRITER_H
+#define ZIPWRITER_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QFileDevice>
+#include <QList>
+#include <QString>
+
+// Writes the ZIP container around data compressed elsewhere: local headers,
+// then the central directory with Zip64 records wherever a size, offset or
+// the entry count does not fit the classic fields. Entries whose CRC and
+// sizes are known up front are written in one go; for the others the local
+// header is patched in place once they are, so the device must be seekable.
+class ZipWriter
+{
+public:
+    struct Entry
+    {
+        QByteArray name;
+        quint16 method = 0;
+        quint32 crc = 0;
+        qint64 compressedSize = 0;
+        qint64 uncompressedSize = 0;
+        // Time in the low half, date in the high half, as in the archive
+        quint32 dosTime = 0;
+        // st_mode style type and permission bits, 0 when unknown
+        quint32 unixMode = 0;
+        bool isDir = false;
+    };
+
+    explicit ZipWriter(QFileDevice *device);
+
+    // The local header, with whatever CRC and sizes entry holds so far
+    bool beginEntry(const Entry &entry);
+    bool writeData(const char *data, qint64 size);
+    // Final CRC and sizes; the local header is rewritten if they changed
+    bool finishEntry(const Entry &entry);
+
+    // Writes the central directory, the device is left for the caller to close
+    bool finish();
+
+    qint64 position() const { return m_position; }
+    QString errorString() const { return m_error; }
+
+    // DOS date and time of a local time, clamped to what the format holds
+    static quint32 dosTime(const QDateTime &time);
+
+private:
+    struct Record
+    {
+        Entry entry;
+        qint64 localHeaderOffset = 0;
+        bool zip64Header = false;
+    };
+
+    QByteArray localHeader(const Record &record) const;
+    bool write(const QByteArray &data);
+    bool fail(const QString &error);
+
+    QFileDevice *m_device;
+    qint64 m_position = 0;
+    QList<Record> m_records;
+    QString m_error;
+};
+
+#endif // ZIPWRITER_H
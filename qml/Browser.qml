@@ -0,0 +1,201 @@
+import QtQuick
+import QtQuick.Controls.Universal
+import QtQuick.Layouts
+import QtQml.Models
+
+ApplicationWindow {
+    id: root
+    visible: true
+    width: 700
+    height: 550
+    title: "ZipExtract"
+    Universal.theme: Universal.System
+    Universal.accent: palette.highlight
+
+    property string statusMessage: ""
+    property bool statusFailed: false
+
+    function formatSize(bytes) {
+        if (bytes === undefined) {
+            return ""
+        }
+        const units = ["B", "KB", "MB", "GB", "TB"]
+        let value = bytes
+        let unit = 0
+        while (value >= 1024 && unit < units.length - 1) {
+            value /= 1024
+            ++unit
+        }
+        return (unit === 0 ? value : value.toFixed(1)) + " " + units[unit]
+    }
+
+    function extract(indexes) {
+        if (passwordRow.visible) {
+            ZipExtractor.password = passwordField.text
+        }
+        root.statusFailed = false
+        root.statusMessage = ""
+        if (!archiveModel.extract(indexes)) {
+            root.statusFailed = true
+            root.statusMessage = "Nothing to extract"
+        }
+    }
+
+    ArchiveModel {
+        id: archiveModel
+        source: initialZipPath
+    }
+
+    ColumnLayout {
+        anchors.fill: parent
+        spacing: 10
+        anchors.margins: 10
+
+        Label {
+            text: initialZipPath
+            Layout.fillWidth: true
+            elide: Text.ElideMiddle
+            font.bold: true
+        }
+
+        TextField {
+            id: searchField
+            Layout.fillWidth: true
+            placeholderText: "Search (text, *.ext or re:pattern)"
+            onTextChanged: searchTimer.restart()
+            onAccepted: {
+                searchTimer.stop()
+                archiveModel.searchText = text
+            }
+
+            // Typing restarts the search at most once per pause
+            Timer {
+                id: searchTimer
+                interval: 250
+                onTriggered: archiveModel.searchText = searchField.text
+            }
+        }
+
+        TreeView {
+            id: tree
+            Layout.fillWidth: true
+            Layout.fillHeight: true
+            clip: true
+            model: archiveModel
+            selectionModel: ItemSelectionModel {}
+            ScrollBar.vertical: ScrollBar {}
+
+            delegate: TreeViewDelegate {
+                id: entryDelegate
+                implicitWidth: tree.width
+
+                contentItem: RowLayout {
+                    spacing: 10
+
+                    Label {
+                        text: archiveModel.searchText === "" ? model.name : model.path
+                        Layout.fillWidth: true
+                        elide: Text.ElideMiddle
+                        font.bold: model.isDir
+                    }
+
+                    Label {
+                        text: model.encryption || ""
+                        visible: text !== ""
+                        opacity: 0.7
+                    }
+
+                    Label {
+                        text: model.isDir ? "" : root.formatSize(model.size)
+                        opacity: 0.7
+                    }
+                }
+
+                TapHandler {
+                    acceptedModifiers: Qt.NoModifier
+                    onTapped: tree.selectionModel.select(tree.index(entryDelegate.row, 0),
+                                                         ItemSelectionModel.ClearAndSelect | ItemSelectionModel.Rows)
+                }
+
+                TapHandler {
+                    acceptedModifiers: Qt.ControlModifier
+                    onTapped: tree.selectionModel.select(tree.index(entryDelegate.row, 0),
+                                                         ItemSelectionModel.Toggle | ItemSelectionModel.Rows)
+                }
+            }
+        }
+
+        RowLayout {
+            id: passwordRow
+            Layout.fillWidth: true
+            visible: archiveModel.encrypted && ZipExtractor.password === ""
+
+            TextField {
+                id: passwordField
+                Layout.fillWidth: true
+                placeholderText: "Password"
+                echoMode: TextInput.Password
+            }
+        }
+
+        ProgressBar {
+            Layout.fillWidth: true
+            value: ZipExtractor.progress / 100.0
+            visible: ZipExtractor.isExtracting
+        }
+
+        RowLayout {
+            Layout.fillWidth: true
+
+            Label {
+                Layout.fillWidth: true
+                elide: Text.ElideRight
+                color: root.statusFailed || archiveModel.errorString !== "" ? "red" : palette.windowText
+                text: {
+                    if (archiveModel.errorString !== "") {
+                        return archiveModel.errorString
+                    }
+                    if (root.statusMessage !== "") {
+                        return root.statusMessage
+                    }
+                    if (ZipExtractor.isExtracting) {
+                        return ZipExtractor.currentFile + " / " + ZipExtractor.totalFiles + "  " + ZipExtractor.eta
+                    }
+                    if (archiveModel.searching) {
+                        return "Searching..."
+                    }
+                    if (archiveModel.searchText !== "") {
+                        return tree.rows + " matches"
+                    }
+                    return archiveModel.entryCount + " entries" + (archiveModel.loading ? "..." : "")
+                }
+            }
+
+            Button {
+                text: "Extract selected"
+                enabled: tree.selectionModel.hasSelection && !ZipExtractor.isExtracting
+                onClicked: root.extract(tree.selectionModel.selectedIndexes)
+            }
+
+            Button {
+                text: "Extract all"
+                enabled: archiveModel.entryCount > 0 && !ZipExtractor.isExtracting
+                onClicked: root.extract([])
+            }
+
+            Button {
+                text: "Cancel"
+                visible: ZipExtractor.isExtracting
+                onClicked: ZipExtractor.cancelExtraction()
+            }
+        }
+    }
+
+    Connections {
+        target: ZipExtractor
+        function onExtractionFinished(success, message) {
+            root.statusFailed = !success
+            root.statusMessage = message
+        }
+    }
+}
@@ -0,0 +1,105 @@
+import QtQuick
+import QtQuick.Controls.Universal
+import QtQuick.Layouts
+
+ApplicationWindow {
+    id: root
+    visible: true
+    width: 500
+    height: mainLyt.implicitHeight + 20
+    title: "ZipExtract"
+    Universal.theme: Universal.System
+    Universal.accent: palette.highlight
+
+    property string errorMessage: ""
+    property bool cancelRequested: false
+
+    Component.onCompleted: {
+        if (initialSources.length > 0) {
+            ZipCreator.startCreation(initialSources)
+        }
+    }
+
+    ColumnLayout {
+        id: mainLyt
+        anchors.fill: parent
+        spacing: 10
+        anchors.margins: 10
+
+        Label {
+            text: ZipCreator.currentArchive
+            Layout.fillWidth: true
+            elide: Text.ElideMiddle
+            font.bold: true
+        }
+
+        ProgressBar {
+            Layout.fillWidth: true
+            value: ZipCreator.progress / 100.0
+            visible: ZipCreator.totalFiles > 0
+        }
+
+        GridLayout {
+            columns: 2
+            visible: ZipCreator.isCreating || ZipCreator.totalFiles > 0
+
+            Label { text: "Current file:" }
+            Label {
+                text: ZipCreator.currentFileName
+                Layout.fillWidth: true
+                elide: Text.ElideMiddle
+            }
+
+            Label { text: "Progress:" }
+            Label { text: ZipCreator.currentFile + " / " + ZipCreator.totalFiles }
+
+            Label { text: "Speed:" }
+            Label { text: ZipCreator.throughput.toFixed(1) + " MB/s" }
+
+            Label { text: "ETA:" }
+            Label { text: ZipCreator.isPaused ? "Paused" : ZipCreator.eta }
+        }
+
+        Label {
+            text: root.errorMessage
+            visible: root.errorMessage !== ""
+            color: "red"
+            wrapMode: Text.WordWrap
+            Layout.fillWidth: true
+        }
+
+        RowLayout {
+            Layout.alignment: Qt.AlignRight
+
+            Button {
+                text: ZipCreator.isPaused ? "Resume" : "Pause"
+                visible: ZipCreator.isCreating
+                onClicked: ZipCreator.isPaused ? ZipCreator.resumeCreation() : ZipCreator.pauseCreation()
+            }
+
+            Button {
+                text: ZipCreator.isCreating ? "Cancel" : "Close"
+                onClicked: {
+                    if (ZipCreator.isCreating) {
+                        root.cancelRequested = true
+                        ZipCreator.cancelCreation()
+                    } else {
+                        Qt.quit()
+                    }
+                }
+            }
+        }
+    }
+
+    Connections {
+        target: ZipCreator
+        function onCreationFinished(success, message) {
+            // Failures stay on screen, the user has to see why
+            if (success || root.cancelRequested) {
+                Qt.quit()
+            } else {
+                root.errorMessage = message
+            }
+        }
+    }
+}
@@ -11,9 +11,16 @@ ApplicationWindow {
     Universal.theme: Universal.System
     Universal.accent: palette.highlight
 
+    // Encrypted archives wait for a password before anything is extracted
+    property bool needsPassword: false
+
     Component.onCompleted: {
         if (initialZipPath !== "") {
-            ZipExtractor.startExtraction(initialZipPath)
+            if (ZipExtractor.password === "" && ZipExtractor.isEncrypted(initialZipPath)) {
+                needsPassword = true
+            } else {
+                ZipExtractor.startExtraction(initialZipPath)
+            }
         }
     }
 
@@ -24,18 +31,49 @@ ApplicationWindow {
         anchors.margins: 10
 
         Label {
-            text: initialZipPath || ""
+            text: ZipExtractor.currentArchive || initialZipPath || ""
             Layout.fillWidth: true
             elide: Text.ElideMiddle
             font.bold: true
         }
 
+        RowLayout {
+            Layout.fillWidth: true
+            visible: root.needsPassword
+
+            TextField {
+                id: passwordField
+                Layout.fillWidth: true
+                placeholderText: "Password"
+                echoMode: TextInput.Password
+                focus: true
+                onAccepted: if (text !== "") extractButton.clicked()
+            }
+
+            Button {
+                id: extractButton
+                text: "Extract"
+                enabled: passwordField.text !== ""
+                onClicked: {
+                    ZipExtractor.password = passwordField.text
+                    root.needsPassword = false
+                    ZipExtractor.startExtraction(initialZipPath)
+                }
+            }
+        }
+
         ProgressBar {
             Layout.fillWidth: true
             value: ZipExtractor.progress / 100.0
             visible: ZipExtractor.totalFiles > 0
         }
 
+        ProgressBar {
+            Layout.fillWidth: true
+            value: ZipExtractor.overallProgress / 100.0
+            visible: ZipExtractor.totalArchives > 1
+        }
+
         GridLayout {
             columns: 2
             visible: ZipExtractor.isExtracting || ZipExtractor.totalFiles > 0
@@ -47,18 +85,49 @@ ApplicationWindow {
                 elide: Text.ElideMiddle
             }
 
+            Label {
+                text: "Archives:"
+                visible: ZipExtractor.totalArchives > 1
+            }
+            Label {
+                text: (ZipExtractor.completedArchives + 1) + " / " + ZipExtractor.totalArchives
+                visible: ZipExtractor.totalArchives > 1
+            }
+
             Label { text: "Progress:" }
             Label { text: ZipExtractor.currentFile + " / " + ZipExtractor.totalFiles }
 
+            Label { text: "Speed:" }
+            Label { text: ZipExtractor.throughput.toFixed(1) + " MB/s" }
+
             Label { text: "ETA:" }
-            Label { text: ZipExtractor.eta }
+            Label { text: ZipExtractor.isPaused ? "Paused" : ZipExtractor.eta }
+        }
+
+        RowLayout {
+            Layout.alignment: Qt.AlignRight
+            visible: ZipExtractor.isExtracting
+
+            Button {
+                text: ZipExtractor.isPaused ? "Resume" : "Pause"
+                onClicked: ZipExtractor.isPaused ? ZipExtractor.resumeExtraction() : ZipExtractor.pauseExtraction()
+            }
+
+            Button {
+                text: "Cancel"
+                onClicked: ZipExtractor.cancelExtraction()
+            }
         }
     }
 
     Connections {
         target: ZipExtractor
-        function onExtractionFinished(success, message) {
-            Qt.quit()
+        function onAllExtractionsFinished() {
+            // The other archives can drain while the first one still waits
+            // for its password; the window stays until that one has run
+            if (!root.needsPassword) {
+                Qt.quit()
+            }
         }
     }
 }
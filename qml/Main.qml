@@ -35,7 +35,7 @@ ApplicationWindow {
         }
 
         Label {
-            text: "Add 'Extract Here' to right-click menu for ZIP files.\nThis allows you to right-click any ZIP file and extract it."
+            text: "Add 'Extract Here' to right-click menu for ZIP files, and 'Compress to ZIP' for other files and folders."
             color: "gray"
             wrapMode: Text.WordWrap
             Layout.preferredWidth: 350
@@ -0,0 +1,766 @@
+#include "archivemodel.h"
+#include "entrydecoder.h"
+#include "entrydecryptor.h"
+#include "entryfilter.h"
+#include "zipextractor.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+constexpr quint16 FlagUtf8 = 0x0800;
+
+// Rows for searches and the root
+constexpr quintptr SearchRow = ~quintptr(0);
+constexpr int RootDirectory = 0;
+
+// Batches are handed to the view this often; the first ones are also cut
+// short by size so the top of the tree shows up right away
+constexpr qint64 BatchIntervalMs = 20;
+constexpr qsizetype FirstBatchSize = 256;
+constexpr qsizetype MaxBatchSize = 64 * 1024;
+
+bool hasPatternSyntax(const QString &text)
+{
+    return text.startsWith("re:") || text.contains('*') || text.contains('?') || text.contains('[');
+}
+
+bool isAscii(QByteArrayView text)
+{
+    for (const char c : text) {
+        if (uchar(c) >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QByteArrayView trimmedName(QByteArrayView raw)
+{
+    while (raw.endsWith('/') || raw.endsWith('\\')) {
+        raw.chop(1);
+    }
+    return raw;
+}
+
+QStringView trimmedName(QStringView path)
+{
+    while (path.endsWith('/') || path.endsWith('\\')) {
+        path.chop(1);
+    }
+    return path;
+}
+
+QString leafName(const QString &path)
+{
+    const QStringView trimmed = trimmedName(QStringView(path));
+    return trimmed.sliced(trimmed.lastIndexOf('/') + 1).toString();
+}
+
+// Directory paths become subtree patterns, glob syntax in them taken literally
+QString subtreePattern(QStringView path)
+{
+    QString pattern = "/";
+    for (const QChar c : path) {
+        if (c == '*' || c == '?' || c == '[' || c == '\\') {
+            pattern += '\\';
+        }
+        pattern += c;
+    }
+    return pattern + "/";
+}
+
+}
+
+ArchiveModel::ArchiveModel(QObject *parent)
+    : QAbstractItemModel(parent)
+{
+    Directory root;
+    root.fetched = true;
+    m_directories.append(root);
+}
+
+ArchiveModel::~ArchiveModel()
+{
+    stopWorkers();
+}
+
+void ArchiveModel::stopWorkers()
+{
+    m_stop = true;
+    m_stopSearch = true;
+    if (m_scanThread) {
+        m_scanThread->wait();
+        m_scanThread.reset();
+    }
+    if (m_searchThread) {
+        m_searchThread->wait();
+        m_searchThread.reset();
+    }
+}
+
+void ArchiveModel::setSource(const QString &source)
+{
+    if (source == m_source) {
+        return;
+    }
+    stopWorkers();
+
+    beginResetModel();
+    m_source = source;
+    m_archive.reset();
+    m_directories.clear();
+    Directory root;
+    root.fetched = true;
+    m_directories.append(root);
+    m_results.clear();
+    m_searchMode = !m_searchText.isEmpty();
+    endResetModel();
+
+    // The old search may already have queued results, they must not land in
+    // the new tree, and nothing restarts it when there is no new archive
+    const int generation = ++m_generation;
+    ++m_searchGeneration;
+    setSearching(false);
+    m_entryCount = 0;
+    m_error.clear();
+    m_encrypted = false;
+    emit sourceChanged();
+    emit entryCountChanged();
+    emit errorStringChanged();
+    emit encryptedChanged();
+
+    if (source.isEmpty()) {
+        setLoading(false);
+        return;
+    }
+    setLoading(true);
+    m_stop = false;
+    m_scanThread.reset(QThread::create([this, source, generation]() { scan(source, generation); }));
+    m_scanThread->start();
+}
+
+void ArchiveModel::setSearchText(const QString &text)
+{
+    if (text == m_searchText) {
+        return;
+    }
+    m_searchText = text;
+    emit searchTextChanged();
+    startSearch();
+}
+
+void ArchiveModel::scan(const QString &path, int generation)
+{
+    auto archive = std::make_shared<ZipArchive>();
+    if (!archive->open(path)) {
+        QMetaObject::invokeMethod(this, [this, path, generation]() {
+            applyOpened(nullptr, "Cannot open " + path, generation);
+        }, Qt::QueuedConnection);
+        return;
+    }
+    const std::shared_ptr<const ZipArchive> opened = archive;
+    QMetaObject::invokeMethod(this, [this, opened, generation]() {
+        applyOpened(opened, QString(), generation);
+    }, Qt::QueuedConnection);
+
+    // Directory ids by raw path, only this thread touches it
+    QHash<QByteArray, int> ids;
+    int nextId = RootDirectory + 1;
+    ScanBatch batch;
+    qsizetype pending = 0;
+    qsizetype batchSize = FirstBatchSize;
+    QElapsedTimer timer;
+    timer.start();
+
+    const auto post = [&]() {
+        QMetaObject::invokeMethod(this, [this, batch, generation]() {
+            applyBatch(batch, generation);
+        }, Qt::QueuedConnection);
+        batch = ScanBatch();
+        pending = 0;
+        batchSize = qMin(batchSize * 2, MaxBatchSize);
+        timer.restart();
+    };
+
+    // Id of a directory path, creating it and any missing ancestor
+    const auto directory = [&](QByteArrayView prefix, qsizetype index) {
+        QList<qsizetype> missing;
+        qsizetype length = prefix.size();
+        int id = RootDirectory;
+        while (length > 0) {
+            const auto found = ids.constFind(QByteArray::fromRawData(prefix.data(), length));
+            if (found != ids.constEnd()) {
+                id = *found;
+                break;
+            }
+            missing.append(length);
+            length = qMax<qsizetype>(prefix.first(length).lastIndexOf('/'), 0);
+        }
+
+        const bool utf8 = archive->flags(index) & FlagUtf8;
+        qsizetype start = length;
+        for (qsizetype i = missing.size() - 1; i >= 0; --i) {
+            const qsizetype end = missing[i];
+            const QByteArrayView component = prefix.sliced(start, end - start).sliced(start > 0 ? 1 : 0);
+            const QString name = utf8 || isAscii(component) ? QString::fromUtf8(component)
+                                                             : QString::fromLocal8Bit(component);
+            batch.directories.append({id, name});
+            id = nextId++;
+            ids.insert(prefix.first(end).toByteArray(), id);
+            start = end;
+        }
+        return id;
+    };
+
+    const qsizetype count = archive->entryCount();
+    for (qsizetype i = 0; i < count; ++i) {
+        if (m_stop) {
+            return;
+        }
+        batch.encrypted = batch.encrypted || (archive->flags(i) & EntryDecryptor::EncryptedFlag);
+        batch.scanned = i + 1;
+
+        const QByteArrayView name = trimmedName(archive->rawName(i));
+        if (!name.isEmpty()) {
+            if (archive->isDir(i)) {
+                batch.directoryEntries.append({directory(name, i), i});
+            } else {
+                const qsizetype slash = name.lastIndexOf('/');
+                batch.files.append({slash < 0 ? RootDirectory : directory(name.first(slash), i), i});
+            }
+        }
+
+        if (++pending >= batchSize || (pending % 1024 == 0 && timer.elapsed() >= BatchIntervalMs)) {
+            post();
+        }
+    }
+    post();
+
+    QMetaObject::invokeMethod(this, [this, generation]() { applyScanFinished(generation); }, Qt::QueuedConnection);
+}
+
+void ArchiveModel::applyOpened(const std::shared_ptr<const ZipArchive> &archive, const QString &error, int generation)
+{
+    if (generation != m_generation) {
+        return;
+    }
+    if (!archive) {
+        m_error = error;
+        emit errorStringChanged();
+        setLoading(false);
+        return;
+    }
+    m_archive = archive;
+    if (m_searchMode) {
+        startSearch();
+    }
+}
+
+void ArchiveModel::applyBatch(const ScanBatch &batch, int generation)
+{
+    if (generation != m_generation) {
+        return;
+    }
+
+    // Grouped by parent, so a shown directory gets one insertion per batch
+    QMap<int, QList<int>> newDirectories;
+    for (const NewDirectory &created : batch.directories) {
+        Directory directory;
+        directory.name = created.name;
+        directory.parent = created.parent;
+        newDirectories[created.parent].append(m_directories.size());
+        m_directories.append(directory);
+    }
+    QMap<int, QList<qsizetype>> newFiles;
+    for (const auto &[parent, entry] : batch.files) {
+        newFiles[parent].append(entry);
+    }
+    for (const auto &[id, entry] : batch.directoryEntries) {
+        m_directories[id].entry = entry;
+    }
+
+    QSet<int> filled;
+    for (auto it = newDirectories.cbegin(); it != newDirectories.cend(); ++it) {
+        Directory &parent = m_directories[it.key()];
+        const bool shown = !m_searchMode && parent.fetched;
+        const int first = int(parent.directories.size());
+        if (childCount(it.key()) == 0) {
+            filled.insert(it.key());
+        }
+        if (shown) {
+            beginInsertRows(directoryIndex(it.key()), first, first + int(it->size()) - 1);
+        }
+        for (const int child : *it) {
+            m_directories[child].row = int(parent.directories.size());
+            parent.directories.append(child);
+        }
+        if (shown) {
+            endInsertRows();
+        }
+    }
+    for (auto it = newFiles.cbegin(); it != newFiles.cend(); ++it) {
+        Directory &parent = m_directories[it.key()];
+        const bool shown = !m_searchMode && parent.fetched;
+        const int first = childCount(it.key());
+        if (first == 0) {
+            filled.insert(it.key());
+        }
+        if (shown) {
+            beginInsertRows(directoryIndex(it.key()), first, first + int(it->size()) - 1);
+        }
+        parent.files.append(*it);
+        if (shown) {
+            endInsertRows();
+        }
+    }
+
+    // Collapsed directories that just got their first child can now expand
+    if (!m_searchMode) {
+        for (const int id : std::as_const(filled)) {
+            if (id != RootDirectory && isShown(m_directories[id].parent)) {
+                const QModelIndex index = directoryIndex(id);
+                emit dataChanged(index, index);
+            }
+        }
+    }
+
+    m_entryCount = batch.scanned;
+    emit entryCountChanged();
+    if (batch.encrypted && !m_encrypted) {
+        m_encrypted = true;
+        emit encryptedChanged();
+    }
+}
+
+void ArchiveModel::applyScanFinished(int generation)
+{
+    if (generation != m_generation) {
+        return;
+    }
+    // Rows shown while scanning are in archive order until now
+    sortFetchedDirectories();
+    setLoading(false);
+}
+
+void ArchiveModel::startSearch()
+{
+    m_stopSearch = true;
+    if (m_searchThread) {
+        m_searchThread->wait();
+        m_searchThread.reset();
+    }
+
+    const int generation = ++m_searchGeneration;
+    beginResetModel();
+    m_searchMode = !m_searchText.isEmpty();
+    m_results.clear();
+    endResetModel();
+
+    if (!m_searchMode || !m_archive) {
+        setSearching(false);
+        return;
+    }
+
+    EntryFilter filter;
+    if (hasPatternSyntax(m_searchText)) {
+        QString error;
+        if (!filter.addInclude(m_searchText, &error)) {
+            m_error = error;
+            emit errorStringChanged();
+            setSearching(false);
+            return;
+        }
+    }
+    if (!m_error.isEmpty()) {
+        m_error.clear();
+        emit errorStringChanged();
+    }
+
+    setSearching(true);
+    m_stopSearch = false;
+    const std::shared_ptr<const ZipArchive> archive = m_archive;
+    const QString text = m_searchText;
+    m_searchThread.reset(QThread::create([this, archive, text, filter, generation]() {
+        search(archive, text, filter, generation);
+    }));
+    m_searchThread->start();
+}
+
+void ArchiveModel::search(const std::shared_ptr<const ZipArchive> &archive, const QString &text, const EntryFilter &filter,
+                          int generation)
+{
+    // An ASCII needle is compared on the raw bytes: case folding never maps
+    // the bytes of a multi-byte character onto ASCII, so no name is decoded
+    const bool plain = filter.isEmpty();
+    const QByteArray needle = text.toUtf8();
+    const bool ascii = plain && isAscii(needle);
+
+    QList<qsizetype> results;
+    qsizetype batchSize = FirstBatchSize;
+    QElapsedTimer timer;
+    timer.start();
+
+    const qsizetype count = archive->entryCount();
+    for (qsizetype i = 0; i < count; ++i) {
+        if (m_stopSearch) {
+            return;
+        }
+
+        bool matched;
+        if (!plain) {
+            matched = filter.matches(*archive, i);
+        } else if (ascii) {
+            const QByteArrayView name = archive->rawName(i);
+            matched = QLatin1StringView(name.data(), name.size()).contains(QLatin1StringView(needle), Qt::CaseInsensitive);
+        } else {
+            matched = archive->name(i).contains(text, Qt::CaseInsensitive);
+        }
+        if (matched) {
+            results.append(i);
+        }
+
+        if (results.size() >= batchSize || (i % 4096 == 0 && !results.isEmpty() && timer.elapsed() >= BatchIntervalMs)) {
+            QMetaObject::invokeMethod(this, [this, results, generation]() {
+                applyResults(results, false, generation);
+            }, Qt::QueuedConnection);
+            results.clear();
+            batchSize = qMin(batchSize * 2, MaxBatchSize);
+            timer.restart();
+        }
+    }
+
+    QMetaObject::invokeMethod(this, [this, results, generation]() {
+        applyResults(results, true, generation);
+    }, Qt::QueuedConnection);
+}
+
+void ArchiveModel::applyResults(const QList<qsizetype> &results, bool last, int generation)
+{
+    if (generation != m_searchGeneration || !m_searchMode) {
+        return;
+    }
+    if (!results.isEmpty()) {
+        const int first = int(m_results.size());
+        beginInsertRows(QModelIndex(), first, first + int(results.size()) - 1);
+        m_results.append(results);
+        endInsertRows();
+    }
+    if (last) {
+        setSearching(false);
+    }
+}
+
+void ArchiveModel::sortDirectory(int id)
+{
+    if (!m_archive) {
+        return;
+    }
+    Directory &directory = m_directories[id];
+
+    std::sort(directory.directories.begin(), directory.directories.end(), [this](int a, int b) {
+        return m_directories[a].name.compare(m_directories[b].name, Qt::CaseInsensitive) < 0;
+    });
+    for (qsizetype row = 0; row < directory.directories.size(); ++row) {
+        m_directories[directory.directories[row]].row = int(row);
+    }
+
+    // Names are decoded once up front rather than on every comparison
+    QList<QPair<QString, qsizetype>> files;
+    files.reserve(directory.files.size());
+    for (const qsizetype entry : std::as_const(directory.files)) {
+        files.append({leafName(m_archive->name(entry)), entry});
+    }
+    std::sort(files.begin(), files.end(), [](const auto &a, const auto &b) {
+        return a.first.compare(b.first, Qt::CaseInsensitive) < 0;
+    });
+    for (qsizetype row = 0; row < files.size(); ++row) {
+        directory.files[row] = files[row].second;
+    }
+}
+
+void ArchiveModel::sortFetchedDirectories()
+{
+    if (m_searchMode) {
+        for (int id = 0; id < m_directories.size(); ++id) {
+            if (m_directories[id].fetched) {
+                sortDirectory(id);
+            }
+        }
+        return;
+    }
+
+    emit layoutAboutToBeChanged();
+
+    // Persistent rows are remembered by what they show, not where
+    const QModelIndexList before = persistentIndexList();
+    QList<QPair<int, qsizetype>> targets;
+    targets.reserve(before.size());
+    for (const QModelIndex &index : before) {
+        const int parent = int(index.internalId());
+        const int directory = directoryId(index);
+        if (directory >= 0) {
+            targets.append({parent, -1 - directory});
+        } else {
+            const Directory &files = m_directories[parent];
+            targets.append({parent, files.files[index.row() - files.directories.size()]});
+        }
+    }
+
+    for (int id = 0; id < m_directories.size(); ++id) {
+        if (m_directories[id].fetched) {
+            sortDirectory(id);
+        }
+    }
+
+    QModelIndexList after;
+    after.reserve(before.size());
+    for (qsizetype i = 0; i < before.size(); ++i) {
+        const auto &[parent, target] = targets[i];
+        const Directory &directory = m_directories[parent];
+        const int row = target < 0 ? m_directories[-1 - target].row
+                                   : int(directory.directories.size() + directory.files.indexOf(target));
+        after.append(createIndex(row, before[i].column(), quintptr(parent)));
+    }
+    changePersistentIndexList(before, after);
+
+    emit layoutChanged();
+}
+
+QModelIndex ArchiveModel::directoryIndex(int id) const
+{
+    if (id == RootDirectory) {
+        return QModelIndex();
+    }
+    const Directory &directory = m_directories[id];
+    return createIndex(directory.row, 0, quintptr(directory.parent));
+}
+
+int ArchiveModel::directoryId(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return RootDirectory;
+    }
+    if (index.internalId() == SearchRow) {
+        return -1;
+    }
+    const Directory &parent = m_directories[int(index.internalId())];
+    return index.row() < parent.directories.size() ? parent.directories[index.row()] : -1;
+}
+
+bool ArchiveModel::isShown(int id) const
+{
+    return m_directories[id].fetched;
+}
+
+int ArchiveModel::childCount(int id) const
+{
+    const Directory &directory = m_directories[id];
+    return int(directory.directories.size() + directory.files.size());
+}
+
+QString ArchiveModel::directoryPath(int id) const
+{
+    QStringList parts;
+    for (; id != RootDirectory; id = m_directories[id].parent) {
+        parts.prepend(m_directories[id].name);
+    }
+    return parts.join('/');
+}
+
+QModelIndex ArchiveModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (!hasIndex(row, column, parent)) {
+        return QModelIndex();
+    }
+    if (m_searchMode) {
+        return createIndex(row, column, SearchRow);
+    }
+    return createIndex(row, column, quintptr(directoryId(parent)));
+}
+
+QModelIndex ArchiveModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid() || child.internalId() == SearchRow) {
+        return QModelIndex();
+    }
+    return directoryIndex(int(child.internalId()));
+}
+
+int ArchiveModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0) {
+        return 0;
+    }
+    if (m_searchMode) {
+        return parent.isValid() ? 0 : int(m_results.size());
+    }
+    const int id = directoryId(parent);
+    return id >= 0 && m_directories[id].fetched ? childCount(id) : 0;
+}
+
+int ArchiveModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent)
+    return 1;
+}
+
+bool ArchiveModel::hasChildren(const QModelIndex &parent) const
+{
+    if (!parent.isValid()) {
+        return rowCount() > 0;
+    }
+    if (m_searchMode || parent.column() > 0) {
+        return false;
+    }
+    const int id = directoryId(parent);
+    return id >= 0 && childCount(id) > 0;
+}
+
+bool ArchiveModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (m_searchMode || parent.column() > 0) {
+        return false;
+    }
+    const int id = directoryId(parent);
+    return id >= 0 && !m_directories[id].fetched;
+}
+
+void ArchiveModel::fetchMore(const QModelIndex &parent)
+{
+    const int id = directoryId(parent);
+    if (m_searchMode || id < 0 || m_directories[id].fetched) {
+        return;
+    }
+
+    // Until the scan is done rows arrive in archive order, sorting waits for it
+    if (!m_loading) {
+        sortDirectory(id);
+    }
+    const int count = childCount(id);
+    if (count == 0) {
+        m_directories[id].fetched = true;
+        return;
+    }
+    beginInsertRows(parent, 0, count - 1);
+    m_directories[id].fetched = true;
+    endInsertRows();
+}
+
+QVariant ArchiveModel::data(const QModelIndex &index, int role) const
+{
+    if (!checkIndex(index, CheckIndexOption::IndexIsValid) || !m_archive) {
+        return QVariant();
+    }
+
+    qsizetype entry = -1;
+    int directory = -1;
+    if (index.internalId() == SearchRow) {
+        entry = m_results[index.row()];
+    } else {
+        directory = directoryId(index);
+        if (directory >= 0) {
+            entry = m_directories[directory].entry;
+        } else {
+            const Directory &parent = m_directories[int(index.internalId())];
+            entry = parent.files[index.row() - parent.directories.size()];
+        }
+    }
+
+    switch (role) {
+    case Qt::DisplayRole:
+    case NameRole:
+        return directory >= 0 ? m_directories[directory].name : leafName(m_archive->name(entry));
+    case PathRole:
+        return directory >= 0 ? directoryPath(directory) + "/" : m_archive->name(entry);
+    case IsDirRole:
+        return directory >= 0 || m_archive->isDir(entry);
+    }
+
+    // Directories the archive only implies have nothing more to show
+    if (entry < 0) {
+        return QVariant();
+    }
+    switch (role) {
+    case SizeRole:
+        return m_archive->uncompressedSize(entry);
+    case CompressedSizeRole:
+        return m_archive->compressedSize(entry);
+    case MethodRole:
+        return EntryDecoder::methodName(EntryDecryptor::compressionMethod(*m_archive, entry));
+    case ModifiedRole:
+        return m_archive->lastModified(entry);
+    case EncryptionRole:
+        if (m_archive->flags(entry) & EntryDecryptor::EncryptedFlag) {
+            return EntryDecryptor::schemeName(*m_archive, entry);
+        }
+        return QString();
+    }
+    return QVariant();
+}
+
+QHash<int, QByteArray> ArchiveModel::roleNames() const
+{
+    return {
+        {Qt::DisplayRole, "display"},
+        {NameRole, "name"},
+        {PathRole, "path"},
+        {IsDirRole, "isDir"},
+        {SizeRole, "size"},
+        {CompressedSizeRole, "compressedSize"},
+        {MethodRole, "method"},
+        {ModifiedRole, "modified"},
+        {EncryptionRole, "encryption"},
+    };
+}
+
+bool ArchiveModel::extract(const QModelIndexList &indexes, const QString &destPath)
+{
+    if (m_source.isEmpty() || !m_archive) {
+        return false;
+    }
+    if (indexes.isEmpty()) {
+        ZipExtractor::instance()->startExtraction(m_source, destPath);
+        return true;
+    }
+
+    // Files go by name and directories as anchored subtrees, so whatever the
+    // scan has not reached yet is still taken along
+    QStringList includes;
+    QStringList entries;
+    for (const QModelIndex &index : indexes) {
+        if (!index.isValid() || index.model() != this || index.column() != 0) {
+            continue;
+        }
+        const QString path = data(index, PathRole).toString();
+        if (data(index, IsDirRole).toBool()) {
+            includes.append(subtreePattern(trimmedName(QStringView(path))));
+        } else {
+            entries.append(path);
+        }
+    }
+    if (includes.isEmpty() && entries.isEmpty()) {
+        return false;
+    }
+    return ZipExtractor::instance()->startSelectiveExtraction(m_source, destPath, includes, {}, entries);
+}
+
+void ArchiveModel::setLoading(bool loading)
+{
+    if (loading != m_loading) {
+        m_loading = loading;
+        emit loadingChanged();
+    }
+}
+
+void ArchiveModel::setSearching(bool searching)
+{
+    if (searching != m_searching) {
+        m_searching = searching;
+        emit searchingChanged();
+    }
+}
@@ -0,0 +1,39 @@
+#include "canceltoken.h"
+#include <QMutexLocker>
+
+void CancelToken::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    m_state = 0;
+    m_changed.wakeAll();
+}
+
+void CancelToken::cancel()
+{
+    // Flags change under the mutex so a worker about to sleep cannot miss it
+    QMutexLocker locker(&m_mutex);
+    m_state.fetch_or(Cancelled);
+    m_changed.wakeAll();
+}
+
+void CancelToken::pause()
+{
+    QMutexLocker locker(&m_mutex);
+    m_state.fetch_or(Paused);
+}
+
+void CancelToken::resume()
+{
+    QMutexLocker locker(&m_mutex);
+    m_state.fetch_and(~Paused);
+    m_changed.wakeAll();
+}
+
+bool CancelToken::waitWhilePaused() const
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_state.load() == Paused) {
+        m_changed.wait(&m_mutex);
+    }
+    return !(m_state.load() & Cancelled);
+}
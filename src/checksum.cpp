@@ -0,0 +1,253 @@
+#include "checksum.h"
+#include <zlib.h>
+#include <cstring>
+
+#if defined(Q_PROCESSOR_X86_64) || defined(Q_PROCESSOR_X86_32)
+#define ZIPEXTRACT_CRC_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(Q_PROCESSOR_ARM_64)
+#define ZIPEXTRACT_CRC_ARM
+#include <arm_acle.h>
+#if defined(Q_OS_LINUX) || defined(Q_OS_ANDROID)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#elif defined(Q_OS_WIN)
+#include <windows.h>
+#endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define ZIPEXTRACT_TARGET(features)
+#else
+#define ZIPEXTRACT_TARGET(features) __attribute__((target(features)))
+#endif
+
+namespace {
+
+using UpdateFunction = quint32 (*)(quint32, const uchar *, qsizetype);
+
+quint32 updateZlib(quint32 crc, const uchar *data, qsizetype size)
+{
+    // zlib takes 32-bit lengths
+    while (size > 0) {
+        const uInt chunk = uInt(qMin<qsizetype>(size, 1 << 30));
+        crc = quint32(::crc32(crc, data, chunk));
+        data += chunk;
+        size -= chunk;
+    }
+    return crc;
+}
+
+#ifdef ZIPEXTRACT_CRC_X86
+
+// Folds 64-byte blocks with carry-less multiplies, then Barrett-reduces the
+// remaining 128 bits. Takes and returns the CRC in its inverted form and
+// needs at least 64 bytes, a multiple of 16. Constants are from Intel's
+// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ".
+ZIPEXTRACT_TARGET("sse4.1,pclmul")
+quint32 foldPclmul(const uchar *data, qsizetype size, quint32 crc)
+{
+    alignas(16) static const quint64 k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+    alignas(16) static const quint64 k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+    alignas(16) static const quint64 k5k0[] = { 0x0163cd6124, 0x0000000000 };
+    alignas(16) static const quint64 poly[] = { 0x01db710641, 0x01f7011641 };
+
+    __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00));
+    __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10));
+    __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20));
+    __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(int(crc)));
+
+    __m128i x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+    data += 64;
+    size -= 64;
+
+    // Four independent folds per iteration keep the multiplier busy
+    while (size >= 64) {
+        const __m128i x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        const __m128i x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        const __m128i x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        const __m128i x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30)));
+
+        data += 64;
+        size -= 64;
+    }
+
+    // Fold the four lanes into one
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+    for (const __m128i next : { x2, x3, x4 }) {
+        const __m128i x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, next), x5);
+    }
+
+    while (size >= 16) {
+        const __m128i x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data))), x5);
+        data += 16;
+        size -= 16;
+    }
+
+    // 128 to 64 bits
+    const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), x0, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return quint32(_mm_extract_epi32(x1, 1));
+}
+
+quint32 updatePclmul(quint32 crc, const uchar *data, qsizetype size)
+{
+    if (size >= 64) {
+        const qsizetype folded = size & ~qsizetype(15);
+        crc = ~foldPclmul(data, folded, ~crc);
+        data += folded;
+        size -= folded;
+    }
+    return size > 0 ? updateZlib(crc, data, size) : crc;
+}
+
+bool hasPclmul()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    const bool sse41 = info[2] & (1 << 19);
+    const bool pclmul = info[2] & (1 << 1);
+    return sse41 && pclmul;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("pclmul");
+#endif
+}
+
+#endif // ZIPEXTRACT_CRC_X86
+
+#ifdef ZIPEXTRACT_CRC_ARM
+
+ZIPEXTRACT_TARGET("+crc")
+quint32 updateArmCrc(quint32 crc, const uchar *data, qsizetype size)
+{
+    crc = ~crc;
+    while (size >= 8) {
+        quint64 word;
+        memcpy(&word, data, 8);
+        crc = __crc32d(crc, word);
+        data += 8;
+        size -= 8;
+    }
+    while (size > 0) {
+        crc = __crc32b(crc, *data++);
+        --size;
+    }
+    return ~crc;
+}
+
+bool hasArmCrc()
+{
+#if defined(Q_OS_LINUX) || defined(Q_OS_ANDROID)
+    return getauxval(AT_HWCAP) & HWCAP_CRC32;
+#elif defined(Q_OS_WIN)
+    return IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE);
+#elif defined(Q_OS_DARWIN)
+    return true;
+#else
+    return false;
+#endif
+}
+
+#endif // ZIPEXTRACT_CRC_ARM
+
+struct Dispatch
+{
+    UpdateFunction update = updateZlib;
+    const char *name = "zlib";
+
+    Dispatch()
+    {
+#ifdef ZIPEXTRACT_CRC_X86
+        if (hasPclmul()) {
+            update = updatePclmul;
+            name = "pclmul";
+        }
+#endif
+#ifdef ZIPEXTRACT_CRC_ARM
+        if (hasArmCrc()) {
+            update = updateArmCrc;
+            name = "armv8-crc";
+        }
+#endif
+    }
+};
+
+const Dispatch &dispatch()
+{
+    static const Dispatch instance;
+    return instance;
+}
+
+// Product of two polynomials modulo the CRC polynomial, in the reflected
+// bit order where x^0 is the top bit
+quint32 multiplyModP(quint32 a, quint32 b)
+{
+    quint32 product = 0;
+    for (quint32 bit = 0x80000000; bit != 0; bit >>= 1) {
+        if (a & bit) {
+            product ^= b;
+        }
+        b = (b & 1) ? (b >> 1) ^ 0xEDB88320 : b >> 1;
+    }
+    return product;
+}
+
+}
+
+quint32 Crc32::update(quint32 crc, const uchar *data, qsizetype size)
+{
+    return dispatch().update(crc, data, size);
+}
+
+quint32 Crc32::combine(quint32 first, quint32 second, qint64 secondSize)
+{
+    // Appending n bytes multiplies the first CRC by x^(8n); the power is
+    // built by squaring, one step per bit of n
+    quint32 factor = 0x80000000;
+    quint32 power = 0x00800000;
+    for (quint64 n = quint64(secondSize); n != 0; n >>= 1) {
+        if (n & 1) {
+            factor = multiplyModP(power, factor);
+        }
+        power = multiplyModP(power, power);
+    }
+    return multiplyModP(factor, first) ^ second;
+}
+
+const char *Crc32::implementation()
+{
+    return dispatch().name;
+}
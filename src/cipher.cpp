@@ -0,0 +1,688 @@
+#include "cipher.h"
+#include <QtEndian>
+#include <cstring>
+#include <utility>
+
+// ZIPEXTRACT_CIPHER_PORTABLE leaves out the CPU detection so the tests can
+// check the fallbacks on any machine
+#if defined(ZIPEXTRACT_CIPHER_PORTABLE)
+#elif defined(Q_PROCESSOR_X86_64) || defined(Q_PROCESSOR_X86_32)
+#define ZIPEXTRACT_CIPHER_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(Q_PROCESSOR_ARM_64)
+#define ZIPEXTRACT_CIPHER_ARM
+#include <arm_neon.h>
+#if defined(Q_OS_LINUX) || defined(Q_OS_ANDROID)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#elif defined(Q_OS_WIN)
+#include <windows.h>
+#endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define ZIPEXTRACT_TARGET(features)
+#else
+#define ZIPEXTRACT_TARGET(features) __attribute__((target(features)))
+#endif
+
+namespace {
+
+// Whole blocks of counter mode: out = in ^ E(counter), E(counter + 1), ...
+using CtrFunction = void (*)(const uchar *roundKeys, int rounds, quint64 counter, const uchar *in, uchar *out,
+                             qsizetype blocks);
+// SHA-1 compression of whole 64-byte blocks
+using CompressFunction = void (*)(quint32 state[5], const uchar *data, qsizetype blocks);
+
+quint32 rotl(quint32 value, int count)
+{
+    return (value << count) | (value >> (32 - count));
+}
+
+uchar xtime(uchar value)
+{
+    return uchar((value << 1) ^ ((value & 0x80) ? 0x1b : 0));
+}
+
+// The S-box is derived rather than spelled out: walking the multiplicative
+// group with generator 3 gives each element and its inverse together
+struct AesTables
+{
+    uchar sbox[256];
+    // MixColumns of a substituted byte in row 0, little-endian by row
+    quint32 te[256];
+
+    AesTables()
+    {
+        uchar p = 1;
+        uchar q = 1;
+        do {
+            p = uchar(p ^ xtime(p));
+            q ^= uchar(q << 1);
+            q ^= uchar(q << 2);
+            q ^= uchar(q << 4);
+            if (q & 0x80) {
+                q ^= 0x09;
+            }
+            const uchar rotated = uchar(q ^ (q << 1 | q >> 7) ^ (q << 2 | q >> 6) ^ (q << 3 | q >> 5) ^ (q << 4 | q >> 4));
+            sbox[p] = rotated ^ 0x63;
+        } while (p != 1);
+        sbox[0] = 0x63;
+
+        for (int i = 0; i < 256; ++i) {
+            const uchar s = sbox[i];
+            const uchar s2 = xtime(s);
+            te[i] = quint32(s2) | quint32(s) << 8 | quint32(s) << 16 | quint32(s2 ^ s) << 24;
+        }
+    }
+};
+
+const AesTables &aesTables()
+{
+    static const AesTables tables;
+    return tables;
+}
+
+// Table-driven rounds on little-endian column words. Lookups depend on the
+// data, so this leaks timing through the cache; it only runs on CPUs
+// without AES instructions.
+void encryptBlockTables(const uchar *roundKeys, int rounds, const uchar *in, uchar *out)
+{
+    const AesTables &tables = aesTables();
+    quint32 s[4];
+    quint32 t[4];
+    for (int c = 0; c < 4; ++c) {
+        s[c] = qFromLittleEndian<quint32>(in + 4 * c) ^ qFromLittleEndian<quint32>(roundKeys + 4 * c);
+    }
+
+    for (int round = 1; round < rounds; ++round) {
+        const uchar *key = roundKeys + 16 * round;
+        for (int c = 0; c < 4; ++c) {
+            t[c] = tables.te[s[c] & 0xff] ^ rotl(tables.te[(s[(c + 1) & 3] >> 8) & 0xff], 8)
+                ^ rotl(tables.te[(s[(c + 2) & 3] >> 16) & 0xff], 16) ^ rotl(tables.te[s[(c + 3) & 3] >> 24], 24)
+                ^ qFromLittleEndian<quint32>(key + 4 * c);
+        }
+        std::memcpy(s, t, sizeof(s));
+    }
+
+    const uchar *key = roundKeys + 16 * rounds;
+    for (int c = 0; c < 4; ++c) {
+        const quint32 word = quint32(tables.sbox[s[c] & 0xff]) | quint32(tables.sbox[(s[(c + 1) & 3] >> 8) & 0xff]) << 8
+            | quint32(tables.sbox[(s[(c + 2) & 3] >> 16) & 0xff]) << 16 | quint32(tables.sbox[s[(c + 3) & 3] >> 24]) << 24;
+        qToLittleEndian<quint32>(word ^ qFromLittleEndian<quint32>(key + 4 * c), out + 4 * c);
+    }
+}
+
+void ctrTables(const uchar *roundKeys, int rounds, quint64 counter, const uchar *in, uchar *out, qsizetype blocks)
+{
+    uchar block[16] = {};
+    uchar keyStream[16];
+    for (qsizetype i = 0; i < blocks; ++i) {
+        qToLittleEndian<quint64>(counter++, block);
+        encryptBlockTables(roundKeys, rounds, block, keyStream);
+        for (int j = 0; j < 16; ++j) {
+            out[j] = in[j] ^ keyStream[j];
+        }
+        in += 16;
+        out += 16;
+    }
+}
+
+void compressPortable(quint32 state[5], const uchar *data, qsizetype blocks)
+{
+    quint32 w[80];
+    while (blocks-- > 0) {
+        for (int i = 0; i < 16; ++i) {
+            w[i] = qFromBigEndian<quint32>(data + 4 * i);
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        quint32 a = state[0];
+        quint32 b = state[1];
+        quint32 c = state[2];
+        quint32 d = state[3];
+        quint32 e = state[4];
+        // One loop per round function keeps the selection out of the rounds
+        const auto round = [&](int i, quint32 f, quint32 k) {
+            const quint32 next = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = next;
+        };
+        for (int i = 0; i < 20; ++i) {
+            round(i, (b & c) | (~b & d), 0x5a827999);
+        }
+        for (int i = 20; i < 40; ++i) {
+            round(i, b ^ c ^ d, 0x6ed9eba1);
+        }
+        for (int i = 40; i < 60; ++i) {
+            round(i, (b & c) | (b & d) | (c & d), 0x8f1bbcdc);
+        }
+        for (int i = 60; i < 80; ++i) {
+            round(i, b ^ c ^ d, 0xca62c1d6);
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        data += 64;
+    }
+}
+
+#ifdef ZIPEXTRACT_CIPHER_X86
+
+// Eight blocks in flight hide the latency of each AESENC; the lanes are
+// spelled out so they stay in registers without relying on the unroller
+ZIPEXTRACT_TARGET("aes,sse2")
+inline void aesRound8(__m128i b[8], __m128i key)
+{
+    b[0] = _mm_aesenc_si128(b[0], key);
+    b[1] = _mm_aesenc_si128(b[1], key);
+    b[2] = _mm_aesenc_si128(b[2], key);
+    b[3] = _mm_aesenc_si128(b[3], key);
+    b[4] = _mm_aesenc_si128(b[4], key);
+    b[5] = _mm_aesenc_si128(b[5], key);
+    b[6] = _mm_aesenc_si128(b[6], key);
+    b[7] = _mm_aesenc_si128(b[7], key);
+}
+
+ZIPEXTRACT_TARGET("aes,sse2")
+void ctrAesNi(const uchar *roundKeys, int rounds, quint64 counter, const uchar *in, uchar *out, qsizetype blocks)
+{
+    __m128i keys[15];
+    for (int i = 0; i <= rounds; ++i) {
+        keys[i] = _mm_load_si128(reinterpret_cast<const __m128i *>(roundKeys + 16 * i));
+    }
+
+    while (blocks >= 8) {
+        __m128i b[8];
+        for (int i = 0; i < 8; ++i) {
+            b[i] = _mm_xor_si128(_mm_set_epi64x(0, qint64(counter + quint64(i))), keys[0]);
+        }
+        for (int round = 1; round < rounds; ++round) {
+            aesRound8(b, keys[round]);
+        }
+        for (int i = 0; i < 8; ++i) {
+            b[i] = _mm_aesenclast_si128(b[i], keys[rounds]);
+            const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16 * i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16 * i), _mm_xor_si128(data, b[i]));
+        }
+        counter += 8;
+        in += 128;
+        out += 128;
+        blocks -= 8;
+    }
+
+    while (blocks-- > 0) {
+        __m128i b = _mm_xor_si128(_mm_set_epi64x(0, qint64(counter++)), keys[0]);
+        for (int round = 1; round < rounds; ++round) {
+            b = _mm_aesenc_si128(b, keys[round]);
+        }
+        b = _mm_aesenclast_si128(b, keys[rounds]);
+        const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_xor_si128(data, b));
+        in += 16;
+        out += 16;
+    }
+}
+
+// Intel's SHA extensions run four rounds per SHA1RNDS4. Group G works on
+// message words 4G to 4G + 3, held in msg[G % 4], while the schedule for
+// the following groups is computed alongside. The groups are instantiated
+// one by one since the round function has to be an immediate.
+template<int G>
+ZIPEXTRACT_TARGET("sha,sse4.1")
+inline void shaNiGroup(__m128i &abcd, __m128i &e, __m128i &previous, __m128i msg[4])
+{
+    if constexpr (G > 0) {
+        e = _mm_sha1nexte_epu32(previous, msg[G & 3]);
+        previous = abcd;
+    }
+    if constexpr (G >= 3 && G <= 18) {
+        msg[(G + 1) & 3] = _mm_sha1msg2_epu32(msg[(G + 1) & 3], msg[G & 3]);
+    }
+    abcd = _mm_sha1rnds4_epu32(abcd, e, G / 5);
+    if constexpr (G >= 1 && G <= 16) {
+        msg[(G - 1) & 3] = _mm_sha1msg1_epu32(msg[(G - 1) & 3], msg[G & 3]);
+    }
+    if constexpr (G >= 2 && G <= 17) {
+        msg[(G - 2) & 3] = _mm_xor_si128(msg[(G - 2) & 3], msg[G & 3]);
+    }
+}
+
+template<int... G>
+ZIPEXTRACT_TARGET("sha,sse4.1")
+inline void shaNiGroups(std::integer_sequence<int, G...>, __m128i &abcd, __m128i &e, __m128i &previous, __m128i msg[4])
+{
+    (shaNiGroup<G>(abcd, e, previous, msg), ...);
+}
+
+ZIPEXTRACT_TARGET("sha,sse4.1")
+void compressShaNi(quint32 state[5], const uchar *data, qsizetype blocks)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0x1b);
+    __m128i e0 = _mm_set_epi32(int(state[4]), 0, 0, 0);
+
+    while (blocks-- > 0) {
+        const __m128i abcdSaved = abcd;
+        const __m128i eSaved = e0;
+
+        __m128i msg[4];
+        for (int i = 0; i < 4; ++i) {
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * i)), byteSwap);
+        }
+
+        __m128i previous = abcd;
+        __m128i e = _mm_add_epi32(e0, msg[0]);
+        shaNiGroups(std::make_integer_sequence<int, 20>(), abcd, e, previous, msg);
+
+        e0 = _mm_sha1nexte_epu32(previous, eSaved);
+        abcd = _mm_add_epi32(abcd, abcdSaved);
+        data += 64;
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = quint32(_mm_extract_epi32(e0, 3));
+}
+
+void cpuid(int info[4], int leaf)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    __cpuidex(info, leaf, 0);
+#else
+    __cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+#endif
+}
+
+bool hasAesNi()
+{
+    int info[4];
+    cpuid(info, 1);
+    return info[2] & (1 << 25);
+}
+
+bool hasShaNi()
+{
+    int info[4];
+    cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    cpuid(info, 1);
+    const bool sse41 = info[2] & (1 << 19);
+    cpuid(info, 7);
+    return sse41 && (info[1] & (1 << 29));
+}
+
+#endif // ZIPEXTRACT_CIPHER_X86
+
+#ifdef ZIPEXTRACT_CIPHER_ARM
+
+// AESE does AddRoundKey first, so the last key is XORed on its own
+ZIPEXTRACT_TARGET("+crypto")
+void ctrArmAes(const uchar *roundKeys, int rounds, quint64 counter, const uchar *in, uchar *out, qsizetype blocks)
+{
+    uint8x16_t keys[15];
+    for (int i = 0; i <= rounds; ++i) {
+        keys[i] = vld1q_u8(roundKeys + 16 * i);
+    }
+
+    while (blocks > 0) {
+        const int count = blocks >= 4 ? 4 : 1;
+        uint8x16_t b[4];
+        for (int i = 0; i < count; ++i) {
+            b[i] = vreinterpretq_u8_u64(vcombine_u64(vcreate_u64(counter + quint64(i)), vcreate_u64(0)));
+        }
+        for (int round = 0; round < rounds - 1; ++round) {
+            for (int i = 0; i < count; ++i) {
+                b[i] = vaesmcq_u8(vaeseq_u8(b[i], keys[round]));
+            }
+        }
+        for (int i = 0; i < count; ++i) {
+            b[i] = veorq_u8(vaeseq_u8(b[i], keys[rounds - 1]), keys[rounds]);
+            vst1q_u8(out + 16 * i, veorq_u8(vld1q_u8(in + 16 * i), b[i]));
+        }
+        counter += quint64(count);
+        in += 16 * count;
+        out += 16 * count;
+        blocks -= count;
+    }
+}
+
+// Group g works on message words 4g to 4g + 3, held in msg[g % 4]; the
+// words for group g + 4 replace them once they are used
+ZIPEXTRACT_TARGET("+crypto")
+void compressArmSha(quint32 state[5], const uchar *data, qsizetype blocks)
+{
+    static const quint32 constants[] = { 0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6 };
+    uint32x4_t abcd = vld1q_u32(state);
+    quint32 e0 = state[4];
+
+    while (blocks-- > 0) {
+        const uint32x4_t abcdSaved = abcd;
+        const quint32 eSaved = e0;
+
+        uint32x4_t msg[4];
+        for (int i = 0; i < 4; ++i) {
+            msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+        }
+
+        quint32 e = e0;
+        for (int g = 0; g < 20; ++g) {
+            const uint32x4_t words = vaddq_u32(msg[g & 3], vdupq_n_u32(constants[g / 5]));
+            const quint32 next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+            if (g < 5) {
+                abcd = vsha1cq_u32(abcd, e, words);
+            } else if (g < 10 || g >= 15) {
+                abcd = vsha1pq_u32(abcd, e, words);
+            } else {
+                abcd = vsha1mq_u32(abcd, e, words);
+            }
+            e = next;
+            if (g < 16) {
+                msg[g & 3] = vsha1su1q_u32(vsha1su0q_u32(msg[g & 3], msg[(g + 1) & 3], msg[(g + 2) & 3]), msg[(g + 3) & 3]);
+            }
+        }
+
+        e0 = e + eSaved;
+        abcd = vaddq_u32(abcd, abcdSaved);
+        data += 64;
+    }
+
+    vst1q_u32(state, abcd);
+    state[4] = e0;
+}
+
+bool hasArmAes()
+{
+#if defined(Q_OS_LINUX) || defined(Q_OS_ANDROID)
+    return getauxval(AT_HWCAP) & HWCAP_AES;
+#elif defined(Q_OS_WIN)
+    return IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE);
+#elif defined(Q_OS_DARWIN)
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool hasArmSha()
+{
+#if defined(Q_OS_LINUX) || defined(Q_OS_ANDROID)
+    return getauxval(AT_HWCAP) & HWCAP_SHA1;
+#elif defined(Q_OS_WIN)
+    return IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE);
+#elif defined(Q_OS_DARWIN)
+    return true;
+#else
+    return false;
+#endif
+}
+
+#endif // ZIPEXTRACT_CIPHER_ARM
+
+struct Dispatch
+{
+    CtrFunction ctr = ctrTables;
+    CompressFunction compress = compressPortable;
+    const char *aesName = "tables";
+    const char *shaName = "portable";
+
+    Dispatch()
+    {
+#ifdef ZIPEXTRACT_CIPHER_X86
+        if (hasAesNi()) {
+            ctr = ctrAesNi;
+            aesName = "aes-ni";
+        }
+        if (hasShaNi()) {
+            compress = compressShaNi;
+            shaName = "sha-ni";
+        }
+#endif
+#ifdef ZIPEXTRACT_CIPHER_ARM
+        if (hasArmAes()) {
+            ctr = ctrArmAes;
+            aesName = "armv8-aes";
+        }
+        if (hasArmSha()) {
+            compress = compressArmSha;
+            shaName = "armv8-sha1";
+        }
+#endif
+    }
+};
+
+const Dispatch &dispatch()
+{
+    static const Dispatch instance;
+    return instance;
+}
+
+}
+
+bool AesCtr::setKey(const uchar *key, int size)
+{
+    if (size != 16 && size != 24 && size != 32) {
+        return false;
+    }
+
+    // FIPS-197 key expansion in bytes, which is also the layout the AES
+    // instructions take their round keys in
+    const AesTables &tables = aesTables();
+    const int keyWords = size / 4;
+    m_rounds = keyWords + 6;
+    std::memcpy(m_roundKeys, key, size_t(size));
+
+    uchar rcon = 1;
+    for (int i = keyWords; i < 4 * (m_rounds + 1); ++i) {
+        uchar word[4];
+        std::memcpy(word, m_roundKeys + 4 * (i - 1), 4);
+        if (i % keyWords == 0) {
+            const uchar first = word[0];
+            word[0] = tables.sbox[word[1]] ^ rcon;
+            word[1] = tables.sbox[word[2]];
+            word[2] = tables.sbox[word[3]];
+            word[3] = tables.sbox[first];
+            rcon = xtime(rcon);
+        } else if (keyWords > 6 && i % keyWords == 4) {
+            for (uchar &byte : word) {
+                byte = tables.sbox[byte];
+            }
+        }
+        for (int j = 0; j < 4; ++j) {
+            m_roundKeys[4 * i + j] = m_roundKeys[4 * (i - keyWords) + j] ^ word[j];
+        }
+    }
+
+    m_counter = 1;
+    m_keyStreamPos = 16;
+    return true;
+}
+
+void AesCtr::apply(const uchar *in, uchar *out, qsizetype size)
+{
+    while (size > 0 && m_keyStreamPos < 16) {
+        *out++ = *in++ ^ m_keyStream[m_keyStreamPos++];
+        --size;
+    }
+
+    const qsizetype blocks = size / 16;
+    if (blocks > 0) {
+        dispatch().ctr(m_roundKeys, m_rounds, m_counter, in, out, blocks);
+        m_counter += quint64(blocks);
+        in += 16 * blocks;
+        out += 16 * blocks;
+        size -= 16 * blocks;
+    }
+
+    if (size > 0) {
+        refillKeyStream();
+        while (size-- > 0) {
+            *out++ = *in++ ^ m_keyStream[m_keyStreamPos++];
+        }
+    }
+}
+
+void AesCtr::refillKeyStream()
+{
+    static const uchar zeros[16] = {};
+    dispatch().ctr(m_roundKeys, m_rounds, m_counter++, zeros, m_keyStream, 1);
+    m_keyStreamPos = 0;
+}
+
+const char *AesCtr::implementation()
+{
+    return dispatch().aesName;
+}
+
+void HmacSha1::Sha1::init()
+{
+    state[0] = 0x67452301;
+    state[1] = 0xefcdab89;
+    state[2] = 0x98badcfe;
+    state[3] = 0x10325476;
+    state[4] = 0xc3d2e1f0;
+    length = 0;
+    used = 0;
+}
+
+void HmacSha1::Sha1::addData(const uchar *data, qsizetype size)
+{
+    length += quint64(size);
+    if (used > 0) {
+        const qsizetype chunk = qMin<qsizetype>(size, 64 - used);
+        std::memcpy(block + used, data, size_t(chunk));
+        used += int(chunk);
+        data += chunk;
+        size -= chunk;
+        if (used < 64) {
+            return;
+        }
+        dispatch().compress(state, block, 1);
+        used = 0;
+    }
+
+    // Whole blocks straight from the caller's buffer
+    const qsizetype blocks = size / 64;
+    if (blocks > 0) {
+        dispatch().compress(state, data, blocks);
+        data += 64 * blocks;
+        size -= 64 * blocks;
+    }
+    std::memcpy(block, data, size_t(size));
+    used = int(size);
+}
+
+void HmacSha1::Sha1::finish(uchar digest[DigestSize])
+{
+    const quint64 bits = length * 8;
+    block[used++] = 0x80;
+    if (used > 56) {
+        std::memset(block + used, 0, size_t(64 - used));
+        dispatch().compress(state, block, 1);
+        used = 0;
+    }
+    std::memset(block + used, 0, size_t(56 - used));
+    qToBigEndian<quint64>(bits, block + 56);
+    dispatch().compress(state, block, 1);
+
+    for (int i = 0; i < 5; ++i) {
+        qToBigEndian<quint32>(state[i], digest + 4 * i);
+    }
+}
+
+void HmacSha1::setKey(QByteArrayView key)
+{
+    // Keys longer than a block are hashed first (RFC 2104)
+    uchar padded[64] = {};
+    if (key.size() > 64) {
+        Sha1 hash;
+        hash.init();
+        hash.addData(reinterpret_cast<const uchar *>(key.data()), key.size());
+        hash.finish(padded);
+    } else if (!key.isEmpty()) {
+        std::memcpy(padded, key.data(), size_t(key.size()));
+    }
+
+    uchar pad[64];
+    for (int i = 0; i < 64; ++i) {
+        pad[i] = padded[i] ^ 0x36;
+    }
+    m_innerKeyed.init();
+    m_innerKeyed.addData(pad, 64);
+    for (int i = 0; i < 64; ++i) {
+        pad[i] = padded[i] ^ 0x5c;
+    }
+    m_outerKeyed.init();
+    m_outerKeyed.addData(pad, 64);
+
+    reset();
+}
+
+void HmacSha1::reset()
+{
+    m_inner = m_innerKeyed;
+}
+
+void HmacSha1::addData(const uchar *data, qsizetype size)
+{
+    m_inner.addData(data, size);
+}
+
+void HmacSha1::result(uchar digest[DigestSize])
+{
+    uchar innerDigest[DigestSize];
+    m_inner.finish(innerDigest);
+    Sha1 outer = m_outerKeyed;
+    outer.addData(innerDigest, DigestSize);
+    outer.finish(digest);
+}
+
+QByteArray HmacSha1::pbkdf2(QByteArrayView password, QByteArrayView salt, int iterations, int size)
+{
+    HmacSha1 hmac;
+    hmac.setKey(password);
+
+    QByteArray key(size, Qt::Uninitialized);
+    for (int offset = 0, block = 1; offset < size; offset += DigestSize, ++block) {
+        uchar index[4];
+        qToBigEndian<quint32>(quint32(block), index);
+
+        uchar u[DigestSize];
+        hmac.reset();
+        hmac.addData(reinterpret_cast<const uchar *>(salt.data()), salt.size());
+        hmac.addData(index, sizeof(index));
+        hmac.result(u);
+
+        uchar t[DigestSize];
+        std::memcpy(t, u, DigestSize);
+        for (int i = 1; i < iterations; ++i) {
+            hmac.reset();
+            hmac.addData(u, DigestSize);
+            hmac.result(u);
+            for (int j = 0; j < DigestSize; ++j) {
+                t[j] ^= u[j];
+            }
+        }
+        std::memcpy(key.data() + offset, t, size_t(qMin(DigestSize, size - offset)));
+    }
+    return key;
+}
+
+const char *HmacSha1::implementation()
+{
+    return dispatch().shaName;
+}
@@ -0,0 +1,423 @@
+#include "compressionengine.h"
+#include "checksum.h"
+#include "entryencoder.h"
+#include "tracer.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+namespace {
+
+constexpr quint16 MethodStored = 0;
+constexpr quint16 MethodDeflated = 8;
+
+// Each worker keeps the encoder of the last block it compressed
+struct WorkerEncoder
+{
+    std::unique_ptr<EntryEncoder> encoder;
+    quint16 method = 0;
+    int level = 0;
+};
+
+thread_local WorkerEncoder t_encoder;
+
+quint32 unixMode(const QFileInfo &info)
+{
+#ifdef Q_OS_UNIX
+    static constexpr struct {
+        QFile::Permission permission;
+        quint32 bit;
+    } Bits[] = {
+        { QFile::ReadOwner, 0400 }, { QFile::WriteOwner, 0200 }, { QFile::ExeOwner, 0100 },
+        { QFile::ReadGroup, 040 }, { QFile::WriteGroup, 020 }, { QFile::ExeGroup, 010 },
+        { QFile::ReadOther, 04 }, { QFile::WriteOther, 02 }, { QFile::ExeOther, 01 },
+    };
+    quint32 mode = info.isDir() ? 040000 : 0100000;
+    const QFile::Permissions permissions = info.permissions();
+    for (const auto &bit : Bits) {
+        if (permissions & bit.permission) {
+            mode |= bit.bit;
+        }
+    }
+    return mode;
+#else
+    Q_UNUSED(info)
+    return 0;
+#endif
+}
+
+}
+
+CompressionEngine::CompressionEngine(QObject *parent)
+    : QObject(parent)
+{
+}
+
+CompressionEngine::~CompressionEngine()
+{
+    cancel();
+    waitForDone();
+}
+
+bool CompressionEngine::setMethod(quint16 method)
+{
+    if (method != MethodStored && !EntryEncoder::isSupported(method)) {
+        return false;
+    }
+    m_method = method;
+    return true;
+}
+
+void CompressionEngine::start(const QStringList &sources, const QString &zipPath)
+{
+    waitForDone();
+
+    m_totalFiles = 0;
+    m_completedFiles = 0;
+    m_totalBytes = 0;
+    m_completedBytes = 0;
+    m_writtenBytes = 0;
+    m_scanMs = 0;
+    m_sources.clear();
+    m_token.reset();
+    {
+        QMutexLocker locker(&m_stateMutex);
+        m_currentFile.clear();
+        m_error.clear();
+    }
+
+    // The writer gets its own thread, it blocks on the workers and the disk
+    m_thread.reset(QThread::create([this, sources, zipPath]() { run(sources, zipPath); }));
+    m_thread->start();
+}
+
+void CompressionEngine::run(const QStringList &sources, const QString &zipPath)
+{
+    bool ok;
+    {
+        TraceSpan span(TracePhase::Index);
+        QElapsedTimer timer;
+        timer.start();
+        ok = scan(sources, zipPath);
+        m_scanMs = timer.elapsed();
+    }
+
+    // The previous archive, if any, is only replaced by a complete one
+    if (ok) {
+        QDir().mkpath(QFileInfo(zipPath).absolutePath());
+        QSaveFile file(zipPath);
+        if (!file.open(QIODevice::WriteOnly)) {
+            ok = fail("Cannot create " + zipPath + ": " + file.errorString());
+        } else if (writeArchive(&file) && !m_token.isCancelled()) {
+            TraceSpan span(TracePhase::Finalize);
+            ok = file.commit() || fail("Cannot write " + zipPath + ": " + file.errorString());
+        } else {
+            file.cancelWriting();
+            ok = false;
+        }
+    }
+
+    // A failed writer can leave blocks in flight, they reference the sources
+    m_scheduler.waitForDone();
+    const bool cancelled = m_token.isCancelled();
+    emit finished(ok && !cancelled, cancelled);
+}
+
+bool CompressionEngine::scan(const QStringList &sources, const QString &zipPath)
+{
+    // The archive may well be written inside a directory being archived
+    const QString archivePath = QFileInfo(zipPath).absoluteFilePath();
+
+    for (const QString &path : sources) {
+        const QFileInfo info(path);
+        if (!info.exists()) {
+            return fail("No such file or directory: " + path);
+        }
+        if (info.absoluteFilePath() == archivePath) {
+            continue;
+        }
+
+        // Entries are named from the source itself down, a root has no name
+        const QString root = info.absoluteFilePath();
+        const QString base = info.isRoot() ? QString() : info.fileName();
+        addSource(info, base);
+        if (!info.isDir()) {
+            continue;
+        }
+
+        // Sorted, so the same tree always gives the same archive
+        QStringList names;
+        QDirIterator it(root, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System,
+                        QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            const QString file = it.next();
+            if (file == archivePath || file.startsWith(archivePath + ".")) {
+                continue;
+            }
+            names.append(file.mid(root.size() + (root.endsWith('/') ? 0 : 1)));
+            if (names.size() % 1024 == 0 && !m_token.checkpoint()) {
+                return false;
+            }
+        }
+        names.sort();
+        for (const QString &name : std::as_const(names)) {
+            addSource(QFileInfo(QDir(root).filePath(name)), base.isEmpty() ? name : base + "/" + name);
+        }
+    }
+    return m_token.checkpoint();
+}
+
+void CompressionEngine::addSource(const QFileInfo &info, const QString &name)
+{
+    if (name.isEmpty()) {
+        return;
+    }
+
+    Source source;
+    source.path = info.absoluteFilePath();
+    ZipWriter::Entry &entry = source.entry;
+    entry.isDir = info.isDir();
+    entry.name = (entry.isDir ? name + "/" : name).toUtf8();
+    entry.uncompressedSize = entry.isDir ? 0 : info.size();
+    entry.method = entry.uncompressedSize > 0 ? m_method : MethodStored;
+    entry.dosTime = ZipWriter::dosTime(info.lastModified());
+    entry.unixMode = unixMode(info);
+    m_sources.append(source);
+
+    m_totalFiles.fetch_add(1, std::memory_order_relaxed);
+    m_totalBytes.fetch_add(entry.uncompressedSize, std::memory_order_relaxed);
+}
+
+bool CompressionEngine::writeArchive(QFileDevice *device)
+{
+    ZipWriter writer(device);
+    std::deque<std::shared_ptr<Block>> window;
+    qsizetype nextSource = 0;
+    qint64 nextOffset = 0;
+
+    for (qsizetype i = 0; i < m_sources.size(); ++i) {
+        if (!m_token.checkpoint()) {
+            return false;
+        }
+        {
+            QMutexLocker locker(&m_stateMutex);
+            m_currentFile = QString::fromUtf8(m_sources[i].entry.name);
+        }
+        if (!writeEntry(writer, i, window, nextSource, nextOffset)) {
+            return false;
+        }
+        m_completedFiles.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (!writer.finish()) {
+        return fail(writer.errorString());
+    }
+    m_writtenBytes.store(writer.position(), std::memory_order_relaxed);
+    return true;
+}
+
+bool CompressionEngine::writeEntry(ZipWriter &writer, qsizetype index, std::deque<std::shared_ptr<Block>> &window,
+                                   qsizetype &nextSource, qint64 &nextOffset)
+{
+    ZipWriter::Entry entry = m_sources[index].entry;
+    if (entry.uncompressedSize == 0) {
+        return writer.beginEntry(entry) || fail(writer.errorString());
+    }
+
+    // The entry's blocks are next in the window, in order
+    quint32 crc = 0;
+    qint64 compressedSize = 0;
+    qint64 read = 0;
+    for (;;) {
+        fillWindow(window, nextSource, nextOffset);
+        const std::shared_ptr<Block> block = window.front();
+        {
+            QMutexLocker locker(&m_blockMutex);
+            while (!block->done.load(std::memory_order_acquire)) {
+                m_blockDone.wait(&m_blockMutex);
+            }
+        }
+        window.pop_front();
+        fillWindow(window, nextSource, nextOffset);
+
+        if (m_token.isCancelled()) {
+            return false;
+        }
+        if (!block->error.isEmpty()) {
+            return fail(m_sources[index].path + ": " + block->error);
+        }
+
+        // Entries of one block are complete, their header never needs a patch
+        if (read == 0) {
+            entry.method = block->method;
+            if (block->last) {
+                entry.crc = block->crc;
+                entry.compressedSize = block->output.size();
+            }
+            if (!writer.beginEntry(entry)) {
+                return fail(writer.errorString());
+            }
+        }
+
+        {
+            TraceSpan span(TracePhase::Write, index);
+            span.addBytes(block->output.size());
+            if (!writer.writeData(block->output.constData(), block->output.size())) {
+                return fail(writer.errorString());
+            }
+        }
+
+        // Block CRCs are combined in order, nobody reads the entry twice
+        crc = read == 0 ? block->crc : Crc32::combine(crc, block->crc, block->size);
+        compressedSize += block->output.size();
+        read += block->size;
+        m_completedBytes.fetch_add(block->size, std::memory_order_relaxed);
+        m_writtenBytes.store(writer.position(), std::memory_order_relaxed);
+        if (block->last) {
+            break;
+        }
+    }
+
+    entry.crc = crc;
+    entry.compressedSize = compressedSize;
+    return writer.finishEntry(entry) || fail(writer.errorString());
+}
+
+void CompressionEngine::fillWindow(std::deque<std::shared_ptr<Block>> &window, qsizetype &nextSource, qint64 &nextOffset)
+{
+    const qsizetype capacity = qsizetype(m_scheduler.threadCount()) * WindowPerThread;
+    while (qsizetype(window.size()) < capacity && nextSource < m_sources.size()) {
+        const ZipWriter::Entry &entry = m_sources[nextSource].entry;
+        if (entry.uncompressedSize == 0) {
+            ++nextSource;
+            continue;
+        }
+
+        auto block = std::make_shared<Block>();
+        block->source = nextSource;
+        block->offset = nextOffset;
+        block->size = qMin(m_blockSize, entry.uncompressedSize - nextOffset);
+        block->last = nextOffset + block->size == entry.uncompressedSize;
+        block->method = entry.method;
+        nextOffset += block->size;
+        if (block->last) {
+            ++nextSource;
+            nextOffset = 0;
+        }
+
+        window.push_back(block);
+        m_scheduler.submit([this, block]() {
+            compressBlock(*block);
+            {
+                QMutexLocker locker(&m_blockMutex);
+                block->done.store(true, std::memory_order_release);
+            }
+            m_blockDone.wakeAll();
+        });
+    }
+}
+
+void CompressionEngine::compressBlock(Block &block)
+{
+    if (!m_token.checkpoint()) {
+        block.error = "Cancelled";
+        return;
+    }
+
+    TraceSpan span(TracePhase::Compress, block.source);
+    span.addBytes(block.size);
+
+    const Source &source = m_sources[block.source];
+    QFile file(source.path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        block.error = "Cannot read: " + file.errorString();
+        return;
+    }
+
+    // Deflate blocks read the end of the previous block again as dictionary
+    const qint64 dictionarySize = block.method == MethodDeflated ? qMin(block.offset, EntryEncoder::DictionarySize) : 0;
+    QByteArray input(dictionarySize + block.size, Qt::Uninitialized);
+    if (!file.seek(block.offset - dictionarySize) || file.read(input.data(), input.size()) != input.size()
+        || (block.last && file.size() != source.entry.uncompressedSize)) {
+        block.error = "Changed while it was read";
+        return;
+    }
+    const uchar *data = reinterpret_cast<const uchar *>(input.constData()) + dictionarySize;
+    block.crc = Crc32::update(0, data, block.size);
+
+    if (block.method == MethodStored) {
+        block.output = std::move(input);
+        return;
+    }
+
+    if (!t_encoder.encoder || t_encoder.method != block.method || t_encoder.level != m_level) {
+        t_encoder.encoder = EntryEncoder::create(block.method, m_level);
+        t_encoder.method = block.method;
+        t_encoder.level = m_level;
+    }
+    if (!t_encoder.encoder->encode(data, block.size, dictionarySize, block.last, block.output)) {
+        block.error = t_encoder.encoder->errorString();
+        return;
+    }
+
+    // Entries of one block that do not shrink are stored instead
+    if (block.offset == 0 && block.last && block.output.size() >= block.size) {
+        block.method = MethodStored;
+        block.output = std::move(input);
+    }
+}
+
+void CompressionEngine::cancel()
+{
+    m_token.cancel();
+}
+
+void CompressionEngine::pause()
+{
+    m_token.pause();
+}
+
+void CompressionEngine::resume()
+{
+    m_token.resume();
+}
+
+void CompressionEngine::waitForDone()
+{
+    if (m_thread) {
+        m_thread->wait();
+        m_thread.reset();
+    }
+    m_scheduler.waitForDone();
+}
+
+CompressionEngine::Progress CompressionEngine::progress() const
+{
+    Progress progress;
+    progress.completedFiles = m_completedFiles.load(std::memory_order_relaxed);
+    progress.totalFiles = m_totalFiles.load(std::memory_order_relaxed);
+    progress.completedBytes = m_completedBytes.load(std::memory_order_relaxed);
+    progress.totalBytes = m_totalBytes.load(std::memory_order_relaxed);
+    progress.writtenBytes = m_writtenBytes.load(std::memory_order_relaxed);
+
+    QMutexLocker locker(&m_stateMutex);
+    progress.currentFile = m_currentFile;
+    return progress;
+}
+
+QString CompressionEngine::errorString() const
+{
+    QMutexLocker locker(&m_stateMutex);
+    return m_error;
+}
+
+bool CompressionEngine::fail(const QString &error)
+{
+    QMutexLocker locker(&m_stateMutex);
+    m_error = error;
+    return false;
+}
@@ -0,0 +1,480 @@
+#include "deflate64decoder.h"
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+constexpr quint16 LengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+constexpr quint8 LengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+constexpr quint32 DistanceBase[32] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+    32769, 49153
+};
+constexpr quint8 DistanceExtra[32] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+    14, 14
+};
+constexpr quint8 CodeLengthOrder[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+constexpr int EndOfBlock = 256;
+constexpr qint64 MinimumWindow = 64 * 1024;
+constexpr qint64 MaxInputSlice = 1 << 30;
+
+}
+
+Deflate64Decoder::Deflate64Decoder(bool deflate64)
+    : m_deflate64(deflate64)
+    , m_literals(std::make_unique<Huffman>())
+    , m_distances(std::make_unique<Huffman>())
+{
+}
+
+bool Deflate64Decoder::decode(EntryInput &input, qint64 outputSize, quint16 flags, QByteArray &buffer,
+                              const Sink &sink)
+{
+    Q_UNUSED(outputSize)
+    Q_UNUSED(flags)
+
+    const qint64 windowSize = buffer.size();
+    if (windowSize < MinimumWindow || (windowSize & (windowSize - 1)) != 0) {
+        return fail("Deflate64 needs a power of two window of at least 64 KiB");
+    }
+
+    m_source = &input;
+    m_input = nullptr;
+    m_inputSize = 0;
+    m_inputPos = 0;
+    m_sliceStart = 0;
+    m_bitBuffer = 0;
+    m_bitCount = 0;
+    m_reported = 0;
+    m_window = reinterpret_cast<uchar *>(buffer.data());
+    m_mask = windowSize - 1;
+    m_written = 0;
+    m_flushed = 0;
+    m_sink = &sink;
+    m_error.clear();
+
+    quint32 final = 0;
+    do {
+        quint32 type = 0;
+        if (!readBits(1, final) || !readBits(2, type)) {
+            return fail("Truncated compressed data");
+        }
+
+        bool ok = false;
+        switch (type) {
+        case 0:
+            ok = copyStoredBlock();
+            break;
+        case 1:
+            buildFixedTables();
+            ok = decodeBlock(*m_fixedLiterals, *m_fixedDistances);
+            break;
+        case 2:
+            ok = readDynamicTables() && decodeBlock(*m_literals, *m_distances);
+            break;
+        default:
+            return fail("Invalid block type");
+        }
+        if (!ok) {
+            return false;
+        }
+    } while (!final);
+
+    return flush();
+}
+
+bool Deflate64Decoder::nextSlice()
+{
+    const uchar *slice = nullptr;
+    qint64 size = 0;
+    if (!m_source->next(MaxInputSlice, slice, size)) {
+        return false;
+    }
+    m_sliceStart += m_inputSize;
+    m_input = slice;
+    m_inputSize = size;
+    m_inputPos = 0;
+    return true;
+}
+
+bool Deflate64Decoder::refill()
+{
+    if (m_inputPos == m_inputSize) {
+        nextSlice();
+    }
+
+    // Whole words while there is room, bytes near the end of a slice
+    if (m_bitCount <= 56 && m_inputSize - m_inputPos >= 8) {
+        const int bytes = (63 - m_bitCount) >> 3;
+        const quint64 word = qFromLittleEndian<quint64>(m_input + m_inputPos);
+        m_bitBuffer |= (word & ((quint64(1) << (bytes * 8)) - 1)) << m_bitCount;
+        m_bitCount += bytes * 8;
+        m_inputPos += bytes;
+        return true;
+    }
+    while (m_bitCount <= 56 && (m_inputPos < m_inputSize || nextSlice())) {
+        m_bitBuffer |= quint64(m_input[m_inputPos++]) << m_bitCount;
+        m_bitCount += 8;
+    }
+    return m_bitCount > 0;
+}
+
+quint32 Deflate64Decoder::peekBits(int count)
+{
+    if (m_bitCount < count) {
+        refill();
+    }
+    return quint32(m_bitBuffer & ((quint64(1) << count) - 1));
+}
+
+void Deflate64Decoder::dropBits(int count)
+{
+    m_bitBuffer >>= count;
+    m_bitCount -= count;
+}
+
+bool Deflate64Decoder::readBits(int count, quint32 &value)
+{
+    if (count == 0) {
+        value = 0;
+        return true;
+    }
+    if (m_bitCount < count) {
+        refill();
+        if (m_bitCount < count) {
+            return false;
+        }
+    }
+    value = peekBits(count);
+    dropBits(count);
+    return true;
+}
+
+int Deflate64Decoder::decodeSymbol(const Huffman &huffman)
+{
+    const quint16 entry = huffman.fast[peekBits(FastBits)];
+    const int length = entry & 0xf;
+
+    // Past the end of the input the missing bits read as zeros, they must
+    // not be consumed
+    if (length == 0 || length > m_bitCount) {
+        return decodeSlow(huffman);
+    }
+    dropBits(length);
+    return entry >> 4;
+}
+
+int Deflate64Decoder::decodeSlow(const Huffman &huffman)
+{
+    // Canonical decoding one bit at a time, only for codes over FastBits
+    if (m_bitCount < MaxCodeBits) {
+        refill();
+    }
+
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int length = 1; length <= MaxCodeBits && length <= m_bitCount; ++length) {
+        code |= int((m_bitBuffer >> (length - 1)) & 1);
+        const int count = huffman.counts[length];
+        if (code - first < count) {
+            dropBits(length);
+            return huffman.symbols[index + code - first];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+bool Deflate64Decoder::buildHuffman(Huffman &huffman, const quint8 *lengths, int count)
+{
+    memset(huffman.counts, 0, sizeof(huffman.counts));
+    for (int i = 0; i < count; ++i) {
+        huffman.counts[lengths[i]]++;
+    }
+    huffman.counts[0] = 0;
+
+    // Canonical codes: each length starts where the previous one ended
+    int offsets[MaxCodeBits + 2] = {};
+    int nextCode[MaxCodeBits + 1] = {};
+    int code = 0;
+    int left = 1;
+    for (int bits = 1; bits <= MaxCodeBits; ++bits) {
+        left = (left << 1) - huffman.counts[bits];
+        if (left < 0) {
+            return false;
+        }
+        nextCode[bits] = code;
+        code = (code + huffman.counts[bits]) << 1;
+        offsets[bits + 1] = offsets[bits] + huffman.counts[bits];
+    }
+
+    memset(huffman.fast, 0, sizeof(huffman.fast));
+    for (int symbol = 0; symbol < count; ++symbol) {
+        const int length = lengths[symbol];
+        if (length == 0) {
+            continue;
+        }
+        huffman.symbols[offsets[length]++] = quint16(symbol);
+        if (length > FastBits) {
+            nextCode[length]++;
+            continue;
+        }
+
+        // Codes are sent most significant bit first into an LSB-first stream
+        int reversed = 0;
+        for (int bit = 0, value = nextCode[length]++; bit < length; ++bit) {
+            reversed = (reversed << 1) | ((value >> bit) & 1);
+        }
+
+        const quint16 entry = quint16(symbol << 4 | length);
+        for (int index = reversed; index < (1 << FastBits); index += 1 << length) {
+            huffman.fast[index] = entry;
+        }
+    }
+    return true;
+}
+
+void Deflate64Decoder::buildFixedTables()
+{
+    if (m_fixedLiterals) {
+        return;
+    }
+
+    quint8 lengths[288];
+    memset(lengths, 8, 144);
+    memset(lengths + 144, 9, 112);
+    memset(lengths + 256, 7, 24);
+    memset(lengths + 280, 8, 8);
+    m_fixedLiterals = std::make_unique<Huffman>();
+    buildHuffman(*m_fixedLiterals, lengths, 288);
+
+    memset(lengths, 5, 32);
+    m_fixedDistances = std::make_unique<Huffman>();
+    buildHuffman(*m_fixedDistances, lengths, 32);
+}
+
+bool Deflate64Decoder::readDynamicTables()
+{
+    quint32 literalCount = 0;
+    quint32 distanceCount = 0;
+    quint32 codeLengthCount = 0;
+    if (!readBits(5, literalCount) || !readBits(5, distanceCount) || !readBits(4, codeLengthCount)) {
+        return fail("Truncated compressed data");
+    }
+    literalCount += 257;
+    distanceCount += 1;
+    codeLengthCount += 4;
+    if (literalCount > 286 || distanceCount > 32) {
+        return fail("Invalid code counts");
+    }
+
+    quint8 codeLengths[19] = {};
+    for (quint32 i = 0; i < codeLengthCount; ++i) {
+        quint32 length = 0;
+        if (!readBits(3, length)) {
+            return fail("Truncated compressed data");
+        }
+        codeLengths[CodeLengthOrder[i]] = quint8(length);
+    }
+    if (!buildHuffman(*m_literals, codeLengths, 19)) {
+        return fail("Invalid code length code");
+    }
+
+    quint8 lengths[286 + 32] = {};
+    const quint32 total = literalCount + distanceCount;
+    quint32 index = 0;
+    while (index < total) {
+        const int symbol = decodeSymbol(*m_literals);
+        if (symbol < 0) {
+            return fail("Invalid code length");
+        }
+        if (symbol < 16) {
+            lengths[index++] = quint8(symbol);
+            continue;
+        }
+
+        quint32 repeat = 0;
+        quint8 value = 0;
+        bool ok = false;
+        if (symbol == 16) {
+            if (index == 0) {
+                return fail("Repeat without a previous length");
+            }
+            value = lengths[index - 1];
+            ok = readBits(2, repeat);
+            repeat += 3;
+        } else if (symbol == 17) {
+            ok = readBits(3, repeat);
+            repeat += 3;
+        } else {
+            ok = readBits(7, repeat);
+            repeat += 11;
+        }
+        if (!ok || index + repeat > total) {
+            return fail("Invalid code length repeat");
+        }
+        memset(lengths + index, value, repeat);
+        index += repeat;
+    }
+
+    if (lengths[EndOfBlock] == 0) {
+        return fail("Missing end of block code");
+    }
+    if (!buildHuffman(*m_literals, lengths, int(literalCount))
+        || !buildHuffman(*m_distances, lengths + literalCount, int(distanceCount))) {
+        return fail("Invalid Huffman code");
+    }
+    return true;
+}
+
+bool Deflate64Decoder::copyStoredBlock()
+{
+    // Stored blocks start on a byte boundary
+    dropBits(m_bitCount & 7);
+
+    quint32 length = 0;
+    quint32 complement = 0;
+    if (!readBits(16, length) || !readBits(16, complement)) {
+        return fail("Truncated compressed data");
+    }
+    if ((length ^ 0xffff) != complement) {
+        return fail("Stored block length mismatch");
+    }
+
+    // Whole bytes still sitting in the bit buffer come first
+    while (length > 0 && m_bitCount >= 8) {
+        if (!put(uchar(m_bitBuffer & 0xff))) {
+            return false;
+        }
+        dropBits(8);
+        --length;
+    }
+    while (length > 0) {
+        if (m_inputPos == m_inputSize && !nextSlice()) {
+            return fail("Truncated compressed data");
+        }
+        if (!put(m_input[m_inputPos++])) {
+            return false;
+        }
+        --length;
+    }
+    return true;
+}
+
+bool Deflate64Decoder::decodeBlock(const Huffman &literals, const Huffman &distances)
+{
+    // Plain deflate stops at distance code 29
+    const int distanceSymbols = m_deflate64 ? 32 : 30;
+
+    for (;;) {
+        const int symbol = decodeSymbol(literals);
+        if (symbol < 0) {
+            return fail("Invalid literal/length code");
+        }
+        if (symbol < 256) {
+            if (!put(uchar(symbol))) {
+                return false;
+            }
+            continue;
+        }
+        if (symbol == EndOfBlock) {
+            return true;
+        }
+
+        const int lengthCode = symbol - 257;
+        if (lengthCode >= 29) {
+            return fail("Invalid length code");
+        }
+
+        // Deflate64 turns the fixed 258 of code 285 into 3 + 16 extra bits
+        quint32 length = LengthBase[lengthCode];
+        int extra = LengthExtra[lengthCode];
+        if (m_deflate64 && lengthCode == 28) {
+            length = 3;
+            extra = 16;
+        }
+        quint32 extraValue = 0;
+        if (!readBits(extra, extraValue)) {
+            return fail("Truncated compressed data");
+        }
+        length += extraValue;
+
+        const int distanceCode = decodeSymbol(distances);
+        if (distanceCode < 0 || distanceCode >= distanceSymbols) {
+            return fail("Invalid distance code");
+        }
+        if (!readBits(DistanceExtra[distanceCode], extraValue)) {
+            return fail("Truncated compressed data");
+        }
+        const qint64 distance = DistanceBase[distanceCode] + extraValue;
+        if (distance > m_written || distance > m_mask + 1) {
+            return fail("Distance too far back");
+        }
+
+        // Byte by byte, overlapping copies repeat the most recent bytes. When
+        // neither side wraps around the window the copy skips the per-byte
+        // flush check.
+        const qint64 to = m_written & m_mask;
+        const qint64 from = (m_written - distance) & m_mask;
+        if (to + length <= m_mask + 1 && from + length <= m_mask + 1) {
+            uchar *out = m_window + to;
+            const uchar *in = m_window + from;
+            for (quint32 i = 0; i < length; ++i) {
+                out[i] = in[i];
+            }
+            m_written += length;
+            if ((m_written & m_mask) == 0 && !flush()) {
+                return false;
+            }
+            continue;
+        }
+        for (quint32 i = 0; i < length; ++i) {
+            if (!put(m_window[(m_written - distance) & m_mask])) {
+                return false;
+            }
+        }
+    }
+}
+
+bool Deflate64Decoder::put(uchar byte)
+{
+    m_window[m_written & m_mask] = byte;
+    ++m_written;
+
+    // A full window is handed out before its first byte is overwritten
+    if ((m_written & m_mask) == 0) {
+        return flush();
+    }
+    return true;
+}
+
+bool Deflate64Decoder::flush()
+{
+    const qint64 size = m_written - m_flushed;
+    if (size == 0) {
+        return true;
+    }
+
+    const qint64 consumed = m_sliceStart + m_inputPos - m_bitCount / 8;
+    const char *data = reinterpret_cast<const char *>(m_window + (m_flushed & m_mask));
+    m_flushed = m_written;
+
+    const bool ok = (*m_sink)(data, size, consumed - m_reported);
+    m_reported = consumed;
+    return ok || fail(QString());
+}
@@ -0,0 +1,102 @@
+#include "destinationindex.h"
+#include "ziparchive.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+void DestinationIndex::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_createdDirectories.clear();
+    m_takenNames.clear();
+    m_nextCounters.clear();
+}
+
+void DestinationIndex::prepare(const ZipArchive &archive, const QString &rootPath, const QList<qsizetype> *selection)
+{
+    // Collect every directory the entries live in, walking up only until a
+    // parent that is already known
+    QSet<QString> relativeDirectories;
+    const qsizetype count = selection ? selection->size() : archive.entryCount();
+    for (qsizetype position = 0; position < count; ++position) {
+        const qsizetype i = selection ? selection->at(position) : position;
+        // Names that would leave the root are never extracted, see safePath()
+        QString directory = archive.safeName(i);
+        if (directory.isEmpty()) {
+            continue;
+        }
+        if (!archive.isDir(i)) {
+            directory.truncate(qMax(0, int(directory.lastIndexOf('/'))));
+        }
+
+        while (!directory.isEmpty() && !relativeDirectories.contains(directory)) {
+            relativeDirectories.insert(directory);
+            directory.truncate(qMax(0, int(directory.lastIndexOf('/'))));
+        }
+    }
+
+    // Sorted order puts every parent before its children, so a single mkdir
+    // per directory is enough
+    QStringList sorted(relativeDirectories.cbegin(), relativeDirectories.cend());
+    sorted.sort();
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_createdDirectories.contains(rootPath)) {
+        QDir().mkpath(rootPath);
+        m_createdDirectories.insert(rootPath);
+    }
+    for (const QString &relative : std::as_const(sorted)) {
+        createDirectoryLocked(rootPath + "/" + relative);
+    }
+}
+
+void DestinationIndex::ensureDirectory(const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_createdDirectories.contains(path)) {
+        QDir().mkpath(path);
+        m_createdDirectories.insert(path);
+    }
+}
+
+QString DestinationIndex::uniqueName(const QString &directory, const QString &baseName, const QString &extension)
+{
+    QMutexLocker locker(&m_mutex);
+    QSet<QString> &taken = namesInLocked(directory);
+
+    // Counters continue where the last lookup for the same name stopped
+    const QString counterKey = directory + "/" + baseName + "." + extension;
+    int counter = m_nextCounters.value(counterKey, 1);
+
+    QString fileName;
+    do {
+        fileName = extension.isEmpty()
+            ? QString("%1 (%2)").arg(baseName).arg(counter)
+            : QString("%1 (%2).%3").arg(baseName).arg(counter).arg(extension);
+        counter++;
+    } while (taken.contains(fileName));
+
+    m_nextCounters.insert(counterKey, counter);
+    taken.insert(fileName);
+    return fileName;
+}
+
+bool DestinationIndex::createDirectoryLocked(const QString &path)
+{
+    if (m_createdDirectories.contains(path)) {
+        return true;
+    }
+
+    m_createdDirectories.insert(path);
+    return QDir().mkdir(path) || QFileInfo(path).isDir();
+}
+
+QSet<QString> &DestinationIndex::namesInLocked(const QString &directory)
+{
+    auto it = m_takenNames.find(directory);
+    if (it == m_takenNames.end()) {
+        const QStringList existing = QDir(directory).entryList(QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
+        it = m_takenNames.insert(directory, QSet<QString>(existing.cbegin(), existing.cend()));
+    }
+    return it.value();
+}
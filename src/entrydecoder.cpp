@@ -0,0 +1,501 @@
+#include "entrydecoder.h"
+#include "deflate64decoder.h"
+#include <zlib.h>
+#include <cstring>
+
+#ifdef ZIPEXTRACT_HAVE_BZIP2
+#include <bzlib.h>
+#endif
+#ifdef ZIPEXTRACT_HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef ZIPEXTRACT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// zlib and bzip2 count in 32-bit units, larger inputs are fed in slices
+constexpr qint64 MaxInputSlice = 1 << 30;
+
+// Dictionary sizes are read from the archive, this bounds what a hostile
+// one can make the decoders allocate
+constexpr quint64 DecoderMemoryLimit = quint64(1) << 30;
+
+class DeflateDecoder : public EntryDecoder
+{
+public:
+    ~DeflateDecoder() override
+    {
+        if (m_initialized) {
+            inflateEnd(&m_stream);
+        }
+    }
+
+    bool decode(EntryInput &input, qint64 outputSize, quint16 flags, QByteArray &buffer,
+                const Sink &sink) override
+    {
+        Q_UNUSED(outputSize)
+        Q_UNUSED(flags)
+
+        // One z_stream per decoder, reset between entries
+        if (!m_initialized) {
+            if (inflateInit2(&m_stream, -MAX_WBITS) != Z_OK) {
+                return fail("Cannot initialize zlib");
+            }
+            m_initialized = true;
+        } else {
+            inflateReset(&m_stream);
+        }
+        // inflateReset keeps the input pointers, which may still point into
+        // the previous entry's buffers when it stopped early
+        m_stream.next_in = nullptr;
+        m_stream.avail_in = 0;
+
+        int status = Z_OK;
+        while (status != Z_STREAM_END) {
+            if (m_stream.avail_in == 0) {
+                const uchar *slice = nullptr;
+                qint64 sliceSize = 0;
+                if (!input.next(MaxInputSlice, slice, sliceSize)) {
+                    return fail("Truncated compressed data");
+                }
+                m_stream.next_in = const_cast<Bytef *>(slice);
+                m_stream.avail_in = uInt(sliceSize);
+            }
+
+            m_stream.next_out = reinterpret_cast<Bytef *>(buffer.data());
+            m_stream.avail_out = uInt(buffer.size());
+            const uInt availableIn = m_stream.avail_in;
+
+            status = inflate(&m_stream, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END) {
+                return fail("Damaged compressed data");
+            }
+
+            const qint64 produced = buffer.size() - m_stream.avail_out;
+            if (!sink(buffer.constData(), produced, availableIn - m_stream.avail_in)) {
+                return fail(QString());
+            }
+        }
+        return true;
+    }
+
+private:
+    z_stream m_stream = {};
+    bool m_initialized = false;
+};
+
+#ifdef ZIPEXTRACT_HAVE_BZIP2
+
+class Bzip2Decoder : public EntryDecoder
+{
+public:
+    qint64 memoryEstimate(const uchar *input, qint64 inputSize) const override
+    {
+        // "BZh1" to "BZh9": 100 kB blocks, four bytes per block byte to decode
+        const int level = inputSize >= 4 && input[3] >= '1' && input[3] <= '9' ? input[3] - '0' : 9;
+        return 100000 + 4 * 100000 * qint64(level);
+    }
+
+    bool decode(EntryInput &input, qint64 outputSize, quint16 flags, QByteArray &buffer,
+                const Sink &sink) override
+    {
+        Q_UNUSED(outputSize)
+        Q_UNUSED(flags)
+
+        bz_stream stream = {};
+        if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK) {
+            return fail("Cannot initialize bzip2");
+        }
+
+        int status = BZ_OK;
+        bool ok = true;
+        while (ok && status != BZ_STREAM_END) {
+            if (stream.avail_in == 0) {
+                const uchar *slice = nullptr;
+                qint64 sliceSize = 0;
+                if (!input.next(MaxInputSlice, slice, sliceSize)) {
+                    ok = fail("Truncated compressed data");
+                    break;
+                }
+                stream.next_in = reinterpret_cast<char *>(const_cast<uchar *>(slice));
+                stream.avail_in = unsigned(sliceSize);
+            }
+
+            stream.next_out = buffer.data();
+            stream.avail_out = unsigned(buffer.size());
+            const unsigned availableIn = stream.avail_in;
+
+            status = BZ2_bzDecompress(&stream);
+            if (status != BZ_OK && status != BZ_STREAM_END) {
+                ok = fail("Damaged compressed data");
+                break;
+            }
+
+            const qint64 produced = buffer.size() - stream.avail_out;
+            if (!sink(buffer.constData(), produced, availableIn - stream.avail_in)) {
+                ok = fail(QString());
+            }
+        }
+
+        BZ2_bzDecompressEnd(&stream);
+        return ok;
+    }
+};
+
+#endif // ZIPEXTRACT_HAVE_BZIP2
+
+#ifdef ZIPEXTRACT_HAVE_LZMA
+
+// Decoder state besides the dictionary, and what an XZ stream whose headers
+// cannot be read is assumed to need (the dictionary of preset 9)
+constexpr qint64 LzmaStateBytes = 64 * 1024;
+constexpr qint64 XzFallbackBytes = 64 * 1024 * 1024 + LzmaStateBytes;
+
+qint64 lzmaDictionarySize(const uchar *data)
+{
+    return qint64(data[0]) | qint64(data[1]) << 8 | qint64(data[2]) << 16 | qint64(data[3]) << 24;
+}
+
+// XZ variable-length integer, seven bits per byte
+bool readVli(const uchar *&pos, const uchar *end, quint64 &value)
+{
+    value = 0;
+    for (int shift = 0; pos < end && shift < 63; shift += 7) {
+        const uchar byte = *pos++;
+        value |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Shared loop for liblzma decoders once their stream is set up; input the
+// stream already holds is decoded before the next slice is taken
+bool runLzma(lzma_stream &stream, EntryInput &input, QByteArray &buffer, const EntryDecoder::Sink &sink,
+             QString &error)
+{
+    lzma_ret status = LZMA_OK;
+    while (status != LZMA_STREAM_END) {
+        if (stream.avail_in == 0) {
+            const uchar *slice = nullptr;
+            qint64 sliceSize = 0;
+            if (input.next(MaxInputSlice, slice, sliceSize)) {
+                stream.next_in = slice;
+                stream.avail_in = size_t(sliceSize);
+            }
+        }
+
+        stream.next_out = reinterpret_cast<uint8_t *>(buffer.data());
+        stream.avail_out = size_t(buffer.size());
+        const size_t availableIn = stream.avail_in;
+
+        status = lzma_code(&stream, stream.avail_in == 0 ? LZMA_FINISH : LZMA_RUN);
+        if (status != LZMA_OK && status != LZMA_STREAM_END) {
+            error = status == LZMA_MEMLIMIT_ERROR ? "Dictionary exceeds the memory limit" : "Damaged compressed data";
+            return false;
+        }
+
+        const qint64 produced = buffer.size() - qint64(stream.avail_out);
+        if (!sink(buffer.constData(), produced, qint64(availableIn - stream.avail_in))) {
+            error.clear();
+            return false;
+        }
+        if (status == LZMA_OK && produced == 0 && availableIn == stream.avail_in) {
+            error = "Truncated compressed data";
+            return false;
+        }
+    }
+    return true;
+}
+
+// ZIP stores LZMA as a 4 byte version/size header, the 5 byte properties and
+// the raw LZMA1 stream. Rebuilding the classic .lzma header in front of it
+// lets liblzma's "alone" decoder handle both the known-size and the
+// end-marker (flag bit 1) variants.
+class LzmaDecoder : public EntryDecoder
+{
+public:
+    qint64 memoryEstimate(const uchar *input, qint64 inputSize) const override
+    {
+        if (inputSize < 9) {
+            return 0;
+        }
+        // Dictionary plus the probability tables, which grow with lc + lp
+        const int lc = input[4] % 9;
+        const int lp = (input[4] / 9) % 5;
+        return lzmaDictionarySize(input + 5) + (qint64(0x300) << (lc + lp)) * 2 + LzmaStateBytes;
+    }
+
+    bool decode(EntryInput &input, qint64 outputSize, quint16 flags, QByteArray &buffer,
+                const Sink &sink) override
+    {
+        // Slices are far larger than the header, so it comes in one piece
+        const uchar *first = nullptr;
+        qint64 firstSize = 0;
+        if (!input.next(MaxInputSlice, first, firstSize) || firstSize < 9 || first[2] != 5 || first[3] != 0) {
+            return fail("Invalid LZMA properties");
+        }
+
+        uchar header[13];
+        memcpy(header, first + 4, 5);
+        const quint64 size = (flags & 0x2) ? ~quint64(0) : quint64(outputSize);
+        for (int i = 0; i < 8; ++i) {
+            header[5 + i] = uchar(size >> (8 * i));
+        }
+
+        lzma_stream stream = LZMA_STREAM_INIT;
+        if (lzma_alone_decoder(&stream, DecoderMemoryLimit) != LZMA_OK) {
+            return fail("Cannot initialize LZMA");
+        }
+
+        // The rebuilt header is parsed without producing output, the raw
+        // stream follows in the main loop
+        stream.next_in = header;
+        stream.avail_in = sizeof(header);
+        stream.next_out = reinterpret_cast<uint8_t *>(buffer.data());
+        stream.avail_out = size_t(buffer.size());
+        const lzma_ret status = lzma_code(&stream, LZMA_RUN);
+
+        QString error = status == LZMA_MEMLIMIT_ERROR ? "Dictionary exceeds the memory limit" : "Invalid LZMA properties";
+        const bool parsed = status == LZMA_OK && stream.avail_in == 0;
+        stream.next_in = first + 9;
+        stream.avail_in = size_t(firstSize - 9);
+        const bool ok = parsed
+            && runLzma(stream, input, buffer, [&sink, headerBytes = qint64(9)](const char *data, qint64 size, qint64 consumed) mutable {
+                   // The ZIP header counts as consumed with the first chunk
+                   consumed += headerBytes;
+                   headerBytes = 0;
+                   return sink(data, size, consumed);
+               }, error);
+        lzma_end(&stream);
+
+        if (!ok) {
+            m_error = error;
+        }
+        return ok;
+    }
+};
+
+class XzDecoder : public EntryDecoder
+{
+public:
+    qint64 memoryEstimate(const uchar *input, qint64 inputSize) const override
+    {
+        // Stream header, then the first block header and its filter chain;
+        // the LZMA2 filter carries the dictionary size in one byte
+        constexpr qint64 StreamHeaderSize = 12;
+        if (inputSize < StreamHeaderSize + 2) {
+            return XzFallbackBytes;
+        }
+        const uchar *block = input + StreamHeaderSize;
+        const qint64 blockSize = (qint64(block[0]) + 1) * 4;
+        if (block[0] == 0 || StreamHeaderSize + blockSize > inputSize) {
+            return XzFallbackBytes;
+        }
+
+        const uchar *end = block + blockSize;
+        const uchar *pos = block + 2;
+        const int filters = (block[1] & 0x3) + 1;
+        quint64 value = 0;
+        if (((block[1] & 0x40) && !readVli(pos, end, value)) || ((block[1] & 0x80) && !readVli(pos, end, value))) {
+            return XzFallbackBytes;
+        }
+        for (int i = 0; i < filters; ++i) {
+            quint64 id = 0;
+            quint64 size = 0;
+            if (!readVli(pos, end, id) || !readVli(pos, end, size) || quint64(end - pos) < size) {
+                return XzFallbackBytes;
+            }
+            if (id == 0x21 && size == 1 && pos[0] <= 40) {
+                const quint64 dictionary = pos[0] == 40 ? 0xffffffffu : (quint64(2) | (pos[0] & 1)) << (pos[0] / 2 + 11);
+                return qint64(dictionary) + LzmaStateBytes;
+            }
+            pos += size;
+        }
+        return XzFallbackBytes;
+    }
+
+    bool decode(EntryInput &input, qint64 outputSize, quint16 flags, QByteArray &buffer,
+                const Sink &sink) override
+    {
+        Q_UNUSED(outputSize)
+        Q_UNUSED(flags)
+
+        lzma_stream stream = LZMA_STREAM_INIT;
+        if (lzma_stream_decoder(&stream, DecoderMemoryLimit, LZMA_CONCATENATED) != LZMA_OK) {
+            return fail("Cannot initialize XZ");
+        }
+
+        QString error;
+        const bool ok = runLzma(stream, input, buffer, sink, error);
+        lzma_end(&stream);
+
+        if (!ok) {
+            m_error = error;
+        }
+        return ok;
+    }
+};
+
+#endif // ZIPEXTRACT_HAVE_LZMA
+
+#ifdef ZIPEXTRACT_HAVE_ZSTD
+
+class ZstdDecoder : public EntryDecoder
+{
+public:
+    qint64 memoryEstimate(const uchar *input, qint64 inputSize) const override
+    {
+        // Window size from the first frame header, plus the context with its
+        // block buffers, measured at just under 480 KiB for any window size
+        constexpr qint64 BlockBytes = 512 * 1024;
+        if (inputSize < 6 || input[0] != 0x28 || input[1] != 0xb5 || input[2] != 0x2f || input[3] != 0xfd) {
+            return BlockBytes;
+        }
+        const uchar descriptor = input[4];
+        const bool singleSegment = descriptor & 0x20;
+        if (!singleSegment) {
+            const int exponent = input[5] >> 3;
+            const qint64 base = qint64(1) << (10 + exponent);
+            const qint64 window = base + base / 8 * (input[5] & 0x7);
+            return qMin<qint64>(window, qint64(DecoderMemoryLimit)) + BlockBytes;
+        }
+
+        // A single segment frame decodes into a window of its content size
+        static constexpr int DictionaryIdSizes[] = { 0, 1, 2, 4 };
+        static constexpr int ContentSizeSizes[] = { 1, 2, 4, 8 };
+        const qint64 offset = 5 + DictionaryIdSizes[descriptor & 0x3];
+        const int fieldSize = ContentSizeSizes[descriptor >> 6];
+        if (offset + fieldSize > inputSize) {
+            return BlockBytes;
+        }
+        quint64 contentSize = 0;
+        for (int i = fieldSize - 1; i >= 0; --i) {
+            contentSize = (contentSize << 8) | input[offset + i];
+        }
+        if (fieldSize == 2) {
+            contentSize += 256;
+        }
+        return qint64(qMin<quint64>(contentSize, DecoderMemoryLimit)) + BlockBytes;
+    }
+
+    bool decode(EntryInput &input, qint64 outputSize, quint16 flags, QByteArray &buffer,
+                const Sink &sink) override
+    {
+        Q_UNUSED(outputSize)
+        Q_UNUSED(flags)
+
+        // The context lives for one entry only: its window is what the
+        // entry's memory grant pays for, and a cached one would outlive it
+        const std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)> stream(ZSTD_createDStream(), ZSTD_freeDStream);
+        if (!stream) {
+            return fail("Cannot initialize Zstandard");
+        }
+        // Refuse frames asking for windows past the memory limit
+        ZSTD_DCtx_setParameter(stream.get(), ZSTD_d_windowLogMax, 30);
+
+        ZSTD_inBuffer in = { nullptr, 0, 0 };
+        for (;;) {
+            if (in.pos == in.size) {
+                const uchar *slice = nullptr;
+                qint64 sliceSize = 0;
+                if (input.next(MaxInputSlice, slice, sliceSize)) {
+                    in = { slice, size_t(sliceSize), 0 };
+                }
+            }
+
+            ZSTD_outBuffer out = { buffer.data(), size_t(buffer.size()), 0 };
+            const size_t before = in.pos;
+
+            // Zero means a frame just ended and everything is flushed
+            const size_t status = ZSTD_decompressStream(stream.get(), &out, &in);
+            if (ZSTD_isError(status)) {
+                return fail(QString("Damaged compressed data: %1").arg(ZSTD_getErrorName(status)));
+            }
+            if (!sink(buffer.constData(), qint64(out.pos), qint64(in.pos - before))) {
+                return fail(QString());
+            }
+
+            const bool drained = in.pos == in.size && input.remaining() == 0;
+            if (status == 0 && drained) {
+                return true;
+            }
+            if (drained && out.pos < out.size) {
+                return fail("Truncated compressed data");
+            }
+        }
+    }
+};
+
+#endif // ZIPEXTRACT_HAVE_ZSTD
+
+struct Method
+{
+    quint16 id;
+    const char *name;
+    std::unique_ptr<EntryDecoder> (*create)();
+};
+
+template<typename Decoder>
+std::unique_ptr<EntryDecoder> make()
+{
+    return std::make_unique<Decoder>();
+}
+
+std::unique_ptr<EntryDecoder> makeDeflate64()
+{
+    return std::make_unique<Deflate64Decoder>(true);
+}
+
+// Method ids from PKWARE's APPNOTE 4.4.5
+const Method Methods[] = {
+    { 8, "Deflate", make<DeflateDecoder> },
+    { 9, "Deflate64", makeDeflate64 },
+#ifdef ZIPEXTRACT_HAVE_BZIP2
+    { 12, "bzip2", make<Bzip2Decoder> },
+#else
+    { 12, "bzip2", nullptr },
+#endif
+#ifdef ZIPEXTRACT_HAVE_LZMA
+    { 14, "LZMA", make<LzmaDecoder> },
+    { 95, "XZ", make<XzDecoder> },
+#else
+    { 14, "LZMA", nullptr },
+    { 95, "XZ", nullptr },
+#endif
+#ifdef ZIPEXTRACT_HAVE_ZSTD
+    { 93, "Zstandard", make<ZstdDecoder> },
+#else
+    { 93, "Zstandard", nullptr },
+#endif
+};
+
+const Method *findMethod(quint16 id)
+{
+    for (const Method &method : Methods) {
+        if (method.id == id) {
+            return &method;
+        }
+    }
+    return nullptr;
+}
+
+}
+
+std::unique_ptr<EntryDecoder> EntryDecoder::create(quint16 method)
+{
+    const Method *entry = findMethod(method);
+    return entry && entry->create ? entry->create() : nullptr;
+}
+
+QString EntryDecoder::methodName(quint16 method)
+{
+    if (method == 0) {
+        return "Stored";
+    }
+    const Method *entry = findMethod(method);
+    return entry ? QString(entry->name) : QString("method %1").arg(method);
+}
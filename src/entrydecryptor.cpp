@@ -0,0 +1,249 @@
+#include "entrydecryptor.h"
+#include "tracer.h"
+#include "ziparchive.h"
+#include <QtEndian>
+#include <array>
+#include <cstring>
+
+namespace {
+
+constexpr quint16 FlagDataDescriptor = 0x0008;
+constexpr quint16 FlagStrongEncryption = 0x0040;
+
+constexpr quint16 MethodAes = 99;
+constexpr quint16 AesExtraId = 0x9901;
+
+constexpr int ZipCryptoHeaderSize = 12;
+constexpr int AesVerifierSize = 2;
+constexpr int AesMacSize = 10;
+constexpr int AesIterations = 1000;
+
+// The CRC-32 byte step the traditional cipher mixes its keys with
+const std::array<quint32, 256> &crcTable()
+{
+    static const std::array<quint32, 256> table = []() {
+        std::array<quint32, 256> entries;
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+            }
+            entries[i] = crc;
+        }
+        return entries;
+    }();
+    return table;
+}
+
+quint32 crcStep(quint32 crc, uchar byte)
+{
+    return crcTable()[(crc ^ byte) & 0xff] ^ (crc >> 8);
+}
+
+}
+
+bool EntryDecryptor::begin(const ZipArchive &archive, qsizetype index)
+{
+    m_error.clear();
+    m_payload = nullptr;
+    m_payloadSize = 0;
+    m_decrypted = 0;
+
+    if (m_password.isEmpty()) {
+        return fail("Password required");
+    }
+    if (archive.flags(index) & FlagStrongEncryption) {
+        return fail("Unsupported encryption: PKWARE strong encryption");
+    }
+
+    const uchar *data = archive.entryData(index);
+    if (!data) {
+        return fail("Damaged local header");
+    }
+    const qint64 size = archive.compressedSize(index);
+    if (archive.method(index) == MethodAes) {
+        return beginAes(archive, index, data, size);
+    }
+    return beginZipCrypto(archive, index, data, size);
+}
+
+bool EntryDecryptor::beginZipCrypto(const ZipArchive &archive, qsizetype index, const uchar *data, qint64 size)
+{
+    if (size < ZipCryptoHeaderSize) {
+        return fail("Damaged encryption header");
+    }
+
+    m_scheme = ZipCrypto;
+    m_keys[0] = 0x12345678;
+    m_keys[1] = 0x23456789;
+    m_keys[2] = 0x34567890;
+    for (const char byte : std::as_const(m_password)) {
+        updateKeys(uchar(byte));
+    }
+
+    // The last header byte repeats the top byte of the CRC, or of the DOS
+    // time when the CRC follows in a data descriptor. Archivers disagree on
+    // which one streamed entries use, so either is accepted for those.
+    uchar header[ZipCryptoHeaderSize];
+    m_payload = data;
+    m_payloadSize = ZipCryptoHeaderSize;
+    decrypt(data, header, ZipCryptoHeaderSize);
+    const uchar check = header[ZipCryptoHeaderSize - 1];
+    const bool crcMatches = check == uchar(archive.crc(index) >> 24);
+    const bool timeMatches = check == uchar(archive.dosTime(index) >> 8);
+    if (!crcMatches && !((archive.flags(index) & FlagDataDescriptor) && timeMatches)) {
+        return fail("Wrong password");
+    }
+
+    m_payload = data + ZipCryptoHeaderSize;
+    m_payloadSize = size - ZipCryptoHeaderSize;
+    m_decrypted = 0;
+    m_overhead = ZipCryptoHeaderSize;
+    m_method = archive.method(index);
+    m_checksCrc = true;
+    return true;
+}
+
+bool EntryDecryptor::beginAes(const ZipArchive &archive, qsizetype index, const uchar *data, qint64 size)
+{
+    // Vendor version, "AE", key strength and the actual compression method
+    const QByteArrayView extra = archive.extraField(index, AesExtraId);
+    if (extra.size() < 7 || extra.sliced(2, 2) != "AE") {
+        return fail("Damaged AES extra field");
+    }
+    const auto *field = reinterpret_cast<const uchar *>(extra.data());
+    const quint16 version = qFromLittleEndian<quint16>(field);
+    const int strength = field[4];
+    if (strength < 1 || strength > 3) {
+        return fail("Unsupported AES key strength");
+    }
+
+    // Salt, password verifier, the data and the truncated HMAC
+    const int keySize = 8 + 8 * strength;
+    const int saltSize = 4 + 4 * strength;
+    if (size < saltSize + AesVerifierSize + AesMacSize) {
+        return fail("Damaged encryption header");
+    }
+
+    // One derivation yields the AES key, the HMAC key and the verifier
+    const QByteArray keys = HmacSha1::pbkdf2(m_password, QByteArrayView(data, saltSize), AesIterations,
+                                             2 * keySize + AesVerifierSize);
+    if (std::memcmp(keys.constData() + 2 * keySize, data + saltSize, AesVerifierSize) != 0) {
+        return fail("Wrong password");
+    }
+
+    m_scheme = WinZipAes;
+    m_aes.setKey(reinterpret_cast<const uchar *>(keys.constData()), keySize);
+    m_hmac.setKey(QByteArrayView(keys).sliced(keySize, keySize));
+
+    m_overhead = saltSize + AesVerifierSize + AesMacSize;
+    m_payload = data + saltSize + AesVerifierSize;
+    m_payloadSize = size - m_overhead;
+    m_method = qFromLittleEndian<quint16>(field + 5);
+    m_checksCrc = version != 2;
+    return true;
+}
+
+void EntryDecryptor::updateKeys(uchar plain)
+{
+    m_keys[0] = crcStep(m_keys[0], plain);
+    m_keys[1] = (m_keys[1] + (m_keys[0] & 0xff)) * 134775813 + 1;
+    m_keys[2] = crcStep(m_keys[2], uchar(m_keys[1] >> 24));
+}
+
+void EntryDecryptor::decrypt(const uchar *in, uchar *out, qint64 size)
+{
+    m_decrypted += size;
+    if (m_scheme == WinZipAes) {
+        // The MAC covers the cipher text, so it is taken before in is overwritten
+        m_hmac.addData(in, size);
+        m_aes.apply(in, out, size);
+        return;
+    }
+
+    // Each key stream byte depends on the plain text before it, this cipher
+    // cannot go faster than a byte at a time
+    for (qint64 i = 0; i < size; ++i) {
+        const quint32 temp = (m_keys[2] & 0xffff) | 2;
+        const uchar plain = in[i] ^ uchar((temp * (temp ^ 1)) >> 8);
+        updateKeys(plain);
+        out[i] = plain;
+    }
+}
+
+QByteArray EntryDecryptor::peek(qint64 size) const
+{
+    EntryDecryptor copy = *this;
+    QByteArray plain(qMin(size, m_payloadSize - m_decrypted), Qt::Uninitialized);
+    copy.decrypt(m_payload + m_decrypted, reinterpret_cast<uchar *>(plain.data()), plain.size());
+    return plain;
+}
+
+bool EntryDecryptor::finish()
+{
+    if (m_scheme != WinZipAes) {
+        return true;
+    }
+
+    m_hmac.addData(m_payload + m_decrypted, m_payloadSize - m_decrypted);
+    m_decrypted = m_payloadSize;
+    uchar digest[HmacSha1::DigestSize];
+    m_hmac.result(digest);
+    if (std::memcmp(digest, m_payload + m_payloadSize, AesMacSize) != 0) {
+        return fail("Authentication failed, the encrypted data was modified");
+    }
+    return true;
+}
+
+QString EntryDecryptor::schemeName(const ZipArchive &archive, qsizetype index)
+{
+    if (!(archive.flags(index) & EncryptedFlag)) {
+        return QString();
+    }
+    if (archive.flags(index) & FlagStrongEncryption) {
+        return "PKWARE strong encryption";
+    }
+    if (archive.method(index) != MethodAes) {
+        return "ZipCrypto";
+    }
+    const QByteArrayView extra = archive.extraField(index, AesExtraId);
+    const int strength = extra.size() >= 7 ? uchar(extra[4]) : 0;
+    return strength >= 1 && strength <= 3 ? QString("AES-%1").arg(64 + 64 * strength) : QString("AES");
+}
+
+quint16 EntryDecryptor::compressionMethod(const ZipArchive &archive, qsizetype index)
+{
+    if (archive.method(index) != MethodAes) {
+        return archive.method(index);
+    }
+    const QByteArrayView extra = archive.extraField(index, AesExtraId);
+    return extra.size() >= 7 ? qFromLittleEndian<quint16>(extra.data() + 5) : archive.method(index);
+}
+
+bool EntryDecryptor::fail(const QString &error)
+{
+    m_error = error;
+    return false;
+}
+
+DecryptingInput::DecryptingInput(EntryDecryptor &decryptor, QByteArray &buffer)
+    : EntryInput(decryptor.payload(), decryptor.payloadSize())
+    , m_decryptor(decryptor)
+    , m_buffer(buffer)
+{
+}
+
+bool DecryptingInput::next(qint64 maxSize, const uchar *&slice, qint64 &sliceSize)
+{
+    const uchar *cipherText = nullptr;
+    if (!EntryInput::next(qMin<qint64>(maxSize, m_buffer.size()), cipherText, sliceSize)) {
+        return false;
+    }
+
+    TraceSpan span(TracePhase::Decrypt);
+    uchar *plainText = reinterpret_cast<uchar *>(m_buffer.data());
+    m_decryptor.decrypt(cipherText, plainText, sliceSize);
+    span.addBytes(sliceSize);
+    slice = plainText;
+    return true;
+}
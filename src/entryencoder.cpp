@@ -0,0 +1,137 @@
+#include "entryencoder.h"
+#include <zlib.h>
+
+#ifdef ZIPEXTRACT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+constexpr quint16 MethodDeflated = 8;
+constexpr quint16 MethodZstd = 93;
+
+class DeflateEncoder : public EntryEncoder
+{
+public:
+    explicit DeflateEncoder(int level)
+        : m_level(level)
+    {
+    }
+
+    ~DeflateEncoder() override
+    {
+        if (m_initialized) {
+            deflateEnd(&m_stream);
+        }
+    }
+
+    bool encode(const uchar *data, qint64 size, qint64 dictionarySize, bool last, QByteArray &out) override
+    {
+        // One z_stream per encoder, reset between blocks
+        if (!m_initialized) {
+            if (deflateInit2(&m_stream, m_level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                return fail("Cannot initialize zlib");
+            }
+            m_initialized = true;
+        } else {
+            deflateReset(&m_stream);
+        }
+        if (dictionarySize > 0 && deflateSetDictionary(&m_stream, data - dictionarySize, uInt(dictionarySize)) != Z_OK) {
+            return fail("Cannot set the Deflate dictionary");
+        }
+
+        // A sync flush ends the block on a byte boundary without marking the
+        // stream final, so the next block's output can follow it directly
+        out.resize(qsizetype(deflateBound(&m_stream, uLong(size))) + 16);
+        m_stream.next_in = const_cast<Bytef *>(data);
+        m_stream.avail_in = uInt(size);
+        m_stream.next_out = reinterpret_cast<Bytef *>(out.data());
+        m_stream.avail_out = uInt(out.size());
+        const int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+        for (;;) {
+            const int status = deflate(&m_stream, flush);
+            if (status == Z_STREAM_ERROR) {
+                return fail("Deflate failed");
+            }
+            if (m_stream.avail_out > 0 && (last ? status == Z_STREAM_END : m_stream.avail_in == 0)) {
+                break;
+            }
+            const qsizetype used = out.size() - m_stream.avail_out;
+            out.resize(out.size() * 2);
+            m_stream.next_out = reinterpret_cast<Bytef *>(out.data() + used);
+            m_stream.avail_out = uInt(out.size() - used);
+        }
+        out.resize(out.size() - m_stream.avail_out);
+        return true;
+    }
+
+private:
+    z_stream m_stream = {};
+    int m_level;
+    bool m_initialized = false;
+};
+
+#ifdef ZIPEXTRACT_HAVE_ZSTD
+class ZstdEncoder : public EntryEncoder
+{
+public:
+    explicit ZstdEncoder(int level)
+        : m_context(ZSTD_createCCtx())
+    {
+        ZSTD_CCtx_setParameter(m_context, ZSTD_c_compressionLevel, level);
+    }
+
+    ~ZstdEncoder() override
+    {
+        ZSTD_freeCCtx(m_context);
+    }
+
+    bool encode(const uchar *data, qint64 size, qint64 dictionarySize, bool last, QByteArray &out) override
+    {
+        Q_UNUSED(dictionarySize)
+        Q_UNUSED(last)
+
+        // Frames cannot refer to each other, every block stands alone and
+        // decoders read the concatenated frames as one stream
+        if (!m_context) {
+            return fail("Cannot initialize Zstandard");
+        }
+        out.resize(qsizetype(ZSTD_compressBound(size_t(size))));
+        const size_t written = ZSTD_compress2(m_context, out.data(), size_t(out.size()), data, size_t(size));
+        if (ZSTD_isError(written)) {
+            return fail(QString("Zstandard failed: %1").arg(ZSTD_getErrorName(written)));
+        }
+        out.resize(qsizetype(written));
+        return true;
+    }
+
+private:
+    ZSTD_CCtx *m_context;
+};
+#endif // ZIPEXTRACT_HAVE_ZSTD
+
+}
+
+std::unique_ptr<EntryEncoder> EntryEncoder::create(quint16 method, int level)
+{
+    switch (method) {
+    case MethodDeflated:
+        return std::make_unique<DeflateEncoder>(level < 0 ? Z_DEFAULT_COMPRESSION : qMin(level, 9));
+#ifdef ZIPEXTRACT_HAVE_ZSTD
+    case MethodZstd:
+        return std::make_unique<ZstdEncoder>(level < 0 ? ZSTD_CLEVEL_DEFAULT : qMin(level, ZSTD_maxCLevel()));
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+bool EntryEncoder::isSupported(quint16 method)
+{
+#ifdef ZIPEXTRACT_HAVE_ZSTD
+    if (method == MethodZstd) {
+        return true;
+    }
+#endif
+    return method == MethodDeflated;
+}
@@ -0,0 +1,342 @@
+#include "entryfilter.h"
+#include "ziparchive.h"
+#include <cstring>
+
+namespace {
+
+constexpr quint16 FlagUtf8 = 0x0800;
+
+bool hasGlobSyntax(QByteArrayView text)
+{
+    for (const char c : text) {
+        if (c == '*' || c == '?' || c == '[' || c == '\\') {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool isAscii(QByteArrayView text)
+{
+    for (const char c : text) {
+        if (uchar(c) >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QByteArrayView fileNameOf(QByteArrayView path)
+{
+    const qsizetype slash = path.lastIndexOf('/');
+    return slash < 0 ? path : path.sliced(slash + 1);
+}
+
+}
+
+bool EntryFilter::set(const QStringList &includes, const QStringList &excludes, const QStringList &entries, QString *error)
+{
+    clear();
+    for (const QString &pattern : includes) {
+        if (!addInclude(pattern, error)) {
+            return false;
+        }
+    }
+    for (const QString &pattern : excludes) {
+        if (!addExclude(pattern, error)) {
+            return false;
+        }
+    }
+    for (const QString &name : entries) {
+        addEntry(name);
+    }
+    return true;
+}
+
+bool EntryFilter::addInclude(const QString &pattern, QString *error)
+{
+    Pattern compiled;
+    if (!compile(pattern, compiled, error)) {
+        return false;
+    }
+    m_includes.append(compiled);
+    return true;
+}
+
+bool EntryFilter::addExclude(const QString &pattern, QString *error)
+{
+    Pattern compiled;
+    if (!compile(pattern, compiled, error)) {
+        return false;
+    }
+    m_excludes.append(compiled);
+    return true;
+}
+
+void EntryFilter::addEntry(const QString &name)
+{
+    QByteArray key = name.toUtf8();
+    while (key.endsWith('/')) {
+        key.chop(1);
+    }
+    m_entries.insert(key);
+}
+
+void EntryFilter::clear()
+{
+    m_includes.clear();
+    m_excludes.clear();
+    m_entries.clear();
+}
+
+bool EntryFilter::isEmpty() const
+{
+    return m_includes.isEmpty() && m_excludes.isEmpty() && m_entries.isEmpty();
+}
+
+bool EntryFilter::matches(const ZipArchive &archive, qsizetype index) const
+{
+    // Patterns are UTF-8; names in a legacy code page are decoded first,
+    // which only matters for the rare ones outside ASCII
+    QByteArrayView path = archive.rawName(index);
+    QByteArray decoded;
+    if (!(archive.flags(index) & FlagUtf8) && !isAscii(path)) {
+        decoded = archive.name(index).toUtf8();
+        path = decoded;
+    }
+    while (path.endsWith('/')) {
+        path.chop(1);
+    }
+
+    bool selected = m_includes.isEmpty() && m_entries.isEmpty();
+    if (!selected && !m_entries.isEmpty()) {
+        // fromRawData avoids copying the name just to look it up
+        selected = m_entries.contains(QByteArray::fromRawData(path.data(), path.size()));
+    }
+    if (!selected) {
+        selected = matchesAny(m_includes, path, archive, index);
+    }
+    return selected && !matchesAny(m_excludes, path, archive, index);
+}
+
+QList<qsizetype> EntryFilter::select(const ZipArchive &archive) const
+{
+    QList<qsizetype> selection;
+    for (qsizetype i = 0; i < archive.entryCount(); ++i) {
+        if (matches(archive, i)) {
+            selection.append(i);
+        }
+    }
+    return selection;
+}
+
+bool EntryFilter::compile(const QString &pattern, Pattern &compiled, QString *error)
+{
+    if (pattern.startsWith("re:")) {
+        compiled.kind = Pattern::Regex;
+        compiled.regex.setPattern(pattern.mid(3));
+        if (!compiled.regex.isValid()) {
+            if (error) {
+                *error = QString("Invalid regular expression %1: %2").arg(pattern, compiled.regex.errorString());
+            }
+            return false;
+        }
+        compiled.regex.optimize();
+        return true;
+    }
+
+    QByteArray text = pattern.toUtf8();
+    bool subtree = false;
+    if (text.endsWith("/**")) {
+        text.chop(3);
+        subtree = true;
+    } else if (text.endsWith('/')) {
+        text.chop(1);
+        subtree = true;
+    }
+    // A leading slash only anchors the pattern to the archive root
+    const bool anchored = text.startsWith('/');
+    if (anchored) {
+        text.remove(0, 1);
+    }
+    if (text.isEmpty()) {
+        if (error) {
+            *error = "Empty pattern: " + pattern;
+        }
+        return false;
+    }
+
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        if (text[i] == '\\') {
+            ++i;
+        } else if (text[i] == '[' && text.indexOf(']', i + 2) < 0) {
+            if (error) {
+                *error = "Unterminated [ in pattern: " + pattern;
+            }
+            return false;
+        }
+    }
+
+    compiled.nameOnly = !anchored && !subtree && !text.contains('/');
+    if (!hasGlobSyntax(text)) {
+        compiled.kind = subtree ? Pattern::Prefix : Pattern::Exact;
+        compiled.text = text;
+    } else if (!subtree && compiled.nameOnly && text.startsWith('*') && !hasGlobSyntax(text.sliced(1))) {
+        compiled.kind = Pattern::Suffix;
+        compiled.text = text.sliced(1);
+    } else {
+        compiled.kind = Pattern::Glob;
+        compiled.text = subtree ? text + "/**" : text;
+    }
+    return true;
+}
+
+bool EntryFilter::matchesAny(const QList<Pattern> &patterns, QByteArrayView path, const ZipArchive &archive, qsizetype index)
+{
+    for (const Pattern &pattern : patterns) {
+        const QByteArrayView subject = pattern.nameOnly ? fileNameOf(path) : path;
+        bool matched = false;
+        switch (pattern.kind) {
+        case Pattern::Exact:
+            matched = subject == QByteArrayView(pattern.text);
+            break;
+        case Pattern::Prefix:
+            matched = subject.startsWith(pattern.text)
+                      && (subject.size() == pattern.text.size() || subject[pattern.text.size()] == '/');
+            break;
+        case Pattern::Suffix:
+            matched = subject.endsWith(pattern.text);
+            break;
+        case Pattern::Glob:
+            matched = globMatch(pattern.text.constData(), pattern.text.constData() + pattern.text.size(),
+                                subject.data(), subject.data() + subject.size());
+            // A subtree glob also takes the directory entry itself
+            if (!matched && pattern.text.endsWith("/**")) {
+                matched = globMatch(pattern.text.constData(), pattern.text.constData() + pattern.text.size() - 3,
+                                    subject.data(), subject.data() + subject.size());
+            }
+            break;
+        case Pattern::Regex:
+            matched = pattern.regex.match(archive.name(index)).hasMatch();
+            break;
+        }
+        if (matched) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool EntryFilter::globMatch(const char *pattern, const char *patternEnd, const char *text, const char *textEnd)
+{
+    // Iterative, keeping one restart point for the last "*" and one for the
+    // last "**". A mismatch first gives the "*" another byte of its component,
+    // then the "**" another byte (or, for "**/", another directory), and a new
+    // "**" drops both: the earliest place it can start covers all later ones.
+    const char *patternBegin = pattern;
+    const char *starPattern = nullptr;
+    const char *starText = nullptr;
+    const char *globstarPattern = nullptr;
+    const char *globstarText = nullptr;
+    bool globstarDirectories = false;
+
+    for (;;) {
+        if (pattern < patternEnd && *pattern == '*') {
+            const char *star = pattern;
+            if (pattern + 1 < patternEnd && pattern[1] == '*') {
+                pattern += 2;
+                if (pattern == patternEnd) {
+                    return true;
+                }
+                // "**/" starting a component also stands for no directory at
+                // all; right after "**" it adds nothing, elsewhere the "/" is
+                // just a character to match
+                const bool follows = star == globstarPattern;
+                const bool directories
+                    = *pattern == '/' && (follows || star == patternBegin || star[-1] == '/');
+                if (directories) {
+                    ++pattern;
+                }
+                globstarDirectories = directories && (!follows || globstarDirectories);
+                globstarPattern = pattern;
+                globstarText = text;
+                starPattern = nullptr;
+            } else {
+                starPattern = ++pattern;
+                starText = text;
+            }
+            continue;
+        }
+
+        if (pattern == patternEnd && text == textEnd) {
+            return true;
+        }
+        if (pattern < patternEnd && text < textEnd) {
+            const char *next = pattern;
+            bool matched;
+            if (*next == '?') {
+                matched = *text != '/';
+                ++next;
+            } else if (*next == '[') {
+                matched = classMatch(next, patternEnd, *text);
+            } else {
+                if (*next == '\\' && next + 1 < patternEnd) {
+                    ++next;
+                }
+                matched = *next++ == *text;
+            }
+            if (matched) {
+                pattern = next;
+                ++text;
+                continue;
+            }
+        }
+
+        if (starPattern && starText < textEnd && *starText != '/') {
+            pattern = starPattern;
+            text = ++starText;
+        } else if (globstarPattern && globstarText < textEnd) {
+            if (globstarDirectories) {
+                const void *slash = std::memchr(globstarText, '/', textEnd - globstarText);
+                if (!slash) {
+                    return false;
+                }
+                globstarText = static_cast<const char *>(slash) + 1;
+            } else {
+                ++globstarText;
+            }
+            pattern = globstarPattern;
+            text = globstarText;
+            starPattern = nullptr;
+        } else {
+            return false;
+        }
+    }
+}
+
+bool EntryFilter::classMatch(const char *&pattern, const char *patternEnd, char c)
+{
+    // pattern points at '[' and is left past the closing ']'
+    ++pattern;
+    const bool negated = pattern < patternEnd && (*pattern == '!' || *pattern == '^');
+    if (negated) {
+        ++pattern;
+    }
+
+    bool matched = false;
+    bool first = true;
+    while (pattern < patternEnd && (first || *pattern != ']')) {
+        first = false;
+        const uchar low = uchar(*pattern++);
+        uchar high = low;
+        if (pattern + 1 < patternEnd && *pattern == '-' && pattern[1] != ']') {
+            high = uchar(pattern[1]);
+            pattern += 2;
+        }
+        if (uchar(c) >= low && uchar(c) <= high) {
+            matched = true;
+        }
+    }
+    ++pattern;
+    return c != '/' && matched != negated;
+}
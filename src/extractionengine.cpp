@@ -0,0 +1,772 @@
+#include "extractionengine.h"
+#include "tracer.h"
+#include <QBuffer>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// What the central directory says about an entry's contents
+struct DuplicateKey
+{
+    quint32 crc;
+    quint16 method;
+    qint64 size;
+    qint64 compressedSize;
+
+    bool operator==(const DuplicateKey &other) const = default;
+};
+
+size_t qHash(const DuplicateKey &key, size_t seed = 0)
+{
+    return qHashMulti(seed, key.crc, key.method, key.size, key.compressedSize);
+}
+
+}
+
+ExtractionEngine::ExtractionEngine(QObject *parent)
+    : QObject(parent)
+    , m_archive(std::make_shared<ZipArchive>())
+{
+}
+
+ExtractionEngine::~ExtractionEngine()
+{
+    cancel();
+    waitForDone();
+}
+
+void ExtractionEngine::setThreadCount(int count)
+{
+    m_requestedThreads = count;
+    m_scheduler.setThreadCount(count);
+}
+
+int ExtractionEngine::threadCount() const
+{
+    return m_scheduler.threadCount();
+}
+
+bool ExtractionEngine::open(const QString &zipPath)
+{
+    waitForDone();
+    m_archive = std::make_shared<ZipArchive>();
+    m_selection.clear();
+    if (!m_archive->open(zipPath)) {
+        return false;
+    }
+    if (!m_filter.isEmpty()) {
+        m_selection = m_filter.select(*m_archive);
+    }
+    return true;
+}
+
+void ExtractionEngine::close()
+{
+    waitForDone();
+    m_archive->close();
+}
+
+void ExtractionEngine::start(const QString &destPath)
+{
+    beginRun(destPath);
+
+    auto job = std::make_shared<ArchiveJob>();
+    job->destinationPath = destPath;
+    job->archive = m_archive;
+    job->selective = !m_filter.isEmpty();
+    job->selection = m_selection;
+
+    addTotals(*job);
+
+    // Without a journal the run still works, it just cannot be resumed
+    m_journal.open(destPath, *m_archive, m_incremental, m_durability == OutputFile::SyncEachFile);
+
+    // Keep one task outstanding until everything is queued, so finished
+    // cannot fire while the root archive is still being submitted
+    m_outstandingTasks.fetch_add(1);
+    submitArchive(job);
+    finishTask();
+}
+
+void ExtractionEngine::startStream(QIODevice *input, const QString &destPath)
+{
+    // The previous reader signals the end of its run just before its thread
+    // returns, so it can still be running here
+    waitForDone();
+    beginRun(destPath);
+
+    // The reader counts as a task until the stream has been reconciled; it
+    // gets its own thread since it blocks on input the workers must not
+    m_outstandingTasks.fetch_add(1);
+    m_streamThread.reset(QThread::create([this, input, destPath]() {
+        readStream(input, destPath);
+        finishTask();
+    }));
+    m_streamThread->start();
+}
+
+void ExtractionEngine::beginRun(const QString &destPath)
+{
+    m_completedFiles = 0;
+    m_totalFiles = 0;
+    m_failedFiles = 0;
+    m_skippedFiles = 0;
+    for (std::atomic<qint64> &count : m_dedupedFiles) {
+        count = 0;
+    }
+    m_dedupedBytes = 0;
+    m_sparseBytes = 0;
+    m_cloner.reset();
+    m_completedBytes = 0;
+    m_totalBytes = 0;
+    m_completedCompressedBytes = 0;
+    m_totalCompressedBytes = 0;
+    m_token.reset();
+    m_currentFile.clear();
+    m_destinations.clear();
+    {
+        QMutexLocker locker(&m_failureMutex);
+        m_failures.clear();
+    }
+    {
+        QMutexLocker locker(&m_streamFilesMutex);
+        m_streamFiles.clear();
+    }
+
+    // Fixed per-worker buffers take at most a quarter of the budget, the rest
+    // is left for whole-entry buffers, dictionaries and nested archives
+    int threads = m_requestedThreads > 0 ? m_requestedThreads : QThread::idealThreadCount();
+    if (m_governor.budget() > 0) {
+        threads = qBound(1, int(m_governor.budget() / 4 / WorkerBaselineBytes), threads);
+    }
+    m_scheduler.setThreadCount(threads);
+    m_baselineMemory.reset();
+    m_governor.trimPool();
+    m_governor.resetPeak();
+    const qint64 baseline = m_scheduler.threadCount() * WorkerBaselineBytes;
+    m_baselineMemory = m_governor.force(baseline);
+
+    m_rootPath = destPath;
+}
+
+void ExtractionEngine::readStream(QIODevice *input, const QString &destPath)
+{
+    ZipStreamReader reader(input);
+    reader.setToken(&m_token);
+    reader.setGovernor(&m_governor);
+
+    // Entries the filter passes over are read through but not extracted, and
+    // the central directory is only checked for the ones that were
+    QSet<qint64> extracted;
+    ZipStreamReader::Entry entry;
+    while (reader.next(entry)) {
+        auto job = std::make_shared<ArchiveJob>();
+        job->destinationPath = destPath;
+        job->archive = std::move(entry.archive);
+        job->spillFile = std::move(entry.spillFile);
+        job->memory = std::move(entry.memory);
+        job->streamOffset = entry.offset;
+        if (!m_filter.isEmpty() && !m_filter.matches(*job->archive, 0)) {
+            continue;
+        }
+
+        extracted.insert(entry.offset);
+        addTotals(*job);
+        submitArchive(job);
+    }
+
+    if (m_token.isCancelled()) {
+        return;
+    }
+    if (!reader.errorString().isEmpty() || !reader.readCentralDirectory()) {
+        reportFailure(QString(), reader.errorString());
+        return;
+    }
+
+    // The directory can only overrule files once they are complete
+    m_scheduler.waitForDone();
+    reconcileStream(reader, extracted);
+}
+
+void ExtractionEngine::reconcileStream(const ZipStreamReader &reader, const QSet<qint64> &extracted)
+{
+    TraceSpan span(TracePhase::Finalize);
+    QMutexLocker locker(&m_streamFilesMutex);
+
+    // What the directory says wins: entries it does not vouch for are removed
+    for (const ZipStreamReader::Mismatch &mismatch : reader.mismatches()) {
+        switch (mismatch.kind) {
+        case ZipStreamReader::Mismatch::Missing:
+            if (m_filter.isEmpty()) {
+                reportFailure(mismatch.name, "Listed in the central directory but missing from the stream");
+            }
+            break;
+        case ZipStreamReader::Mismatch::Changed:
+        case ZipStreamReader::Mismatch::Unlisted:
+            if (extracted.contains(mismatch.offset)) {
+                // Only ever a file this run wrote, never a name from the stream
+                const QString path = m_streamFiles.value(mismatch.offset);
+                if (!path.isEmpty()) {
+                    QFile::remove(path);
+                }
+                reportFailure(mismatch.name, mismatch.kind == ZipStreamReader::Mismatch::Changed
+                                                 ? "Does not match the central directory"
+                                                 : "Not listed in the central directory");
+            }
+            break;
+        }
+    }
+
+    // Local headers carry no permissions, only the directory does
+    MetadataBatch metadata;
+    for (const ZipStreamReader::Mode &mode : reader.modes()) {
+        const QString path = m_streamFiles.value(mode.offset);
+        if (extracted.contains(mode.offset) && !path.isEmpty()) {
+            metadata.add(path, -1, mode.mode);
+        }
+    }
+    metadata.apply();
+}
+
+void ExtractionEngine::finishTask()
+{
+    if (m_outstandingTasks.fetch_sub(1) != 1) {
+        return;
+    }
+
+    // The journal only counts as complete when nothing is left to redo
+    const bool cancelled = m_token.isCancelled();
+    bool synced = m_durability == OutputFile::SyncEachFile;
+    if (m_durability == OutputFile::SyncAtEnd) {
+        TraceSpan span(TracePhase::Finalize);
+        synced = OutputFile::syncFileSystem(m_rootPath);
+    }
+    m_journal.close(!cancelled && m_failedFiles.load() == 0, synced);
+    m_baselineMemory.reset();
+    m_governor.trimPool();
+    emit finished(cancelled);
+}
+
+void ExtractionEngine::cancel()
+{
+    m_token.cancel();
+}
+
+void ExtractionEngine::pause()
+{
+    m_token.pause();
+}
+
+void ExtractionEngine::resume()
+{
+    m_token.resume();
+}
+
+void ExtractionEngine::waitForDone()
+{
+    // The reader submits work until it stops, so it is joined first
+    if (m_streamThread) {
+        m_streamThread->wait();
+        m_streamThread.reset();
+    }
+    m_scheduler.waitForDone();
+}
+
+ExtractionEngine::Progress ExtractionEngine::progress() const
+{
+    Progress progress;
+    progress.completedFiles = m_completedFiles.load(std::memory_order_relaxed);
+    progress.totalFiles = m_totalFiles.load(std::memory_order_relaxed);
+    progress.failedFiles = m_failedFiles.load(std::memory_order_relaxed);
+    progress.skippedFiles = m_skippedFiles.load(std::memory_order_relaxed);
+    progress.reflinkedFiles = m_dedupedFiles[FileCloner::Reflink].load(std::memory_order_relaxed);
+    progress.hardlinkedFiles = m_dedupedFiles[FileCloner::Hardlink].load(std::memory_order_relaxed);
+    progress.copiedFiles = m_dedupedFiles[FileCloner::Copy].load(std::memory_order_relaxed);
+    progress.dedupedBytes = m_dedupedBytes.load(std::memory_order_relaxed);
+    progress.sparseBytes = m_sparseBytes.load(std::memory_order_relaxed);
+    progress.completedBytes = m_completedBytes.load(std::memory_order_relaxed);
+    progress.totalBytes = m_totalBytes.load(std::memory_order_relaxed);
+    progress.completedCompressedBytes = m_completedCompressedBytes.load(std::memory_order_relaxed);
+    progress.totalCompressedBytes = m_totalCompressedBytes.load(std::memory_order_relaxed);
+
+    QMutexLocker locker(&m_currentFileMutex);
+    progress.currentFile = m_currentFile;
+    return progress;
+}
+
+QStringList ExtractionEngine::failures() const
+{
+    QMutexLocker locker(&m_failureMutex);
+    return m_failures;
+}
+
+void ExtractionEngine::reportFailure(const ArchiveJob &job, qsizetype index, const QString &reason)
+{
+    // Entries cut short by a cancel are not damaged, only unfinished
+    if (m_token.isCancelled()) {
+        return;
+    }
+
+    reportFailure(job.name.isEmpty() ? job.archive->name(index) : job.name + "/" + job.archive->name(index), reason);
+}
+
+void ExtractionEngine::reportFailure(const QString &name, const QString &reason)
+{
+    m_failedFiles.fetch_add(1, std::memory_order_relaxed);
+
+    QMutexLocker locker(&m_failureMutex);
+    m_failures.append(name.isEmpty() ? reason : name + ": " + reason);
+}
+
+void ExtractionEngine::addTotals(const ArchiveJob &job)
+{
+    const ZipArchive &archive = *job.archive;
+    qint64 bytes = 0;
+    qint64 compressedBytes = 0;
+    for (qsizetype position = 0; position < job.entryCount(); ++position) {
+        const qsizetype i = job.entryAt(position);
+        bytes += archive.uncompressedSize(i);
+        compressedBytes += archive.compressedSize(i);
+    }
+
+    m_totalFiles.fetch_add(job.entryCount());
+    m_totalBytes.fetch_add(bytes);
+    m_totalCompressedBytes.fetch_add(compressedBytes);
+}
+
+void ExtractionEngine::submitArchive(const std::shared_ptr<ArchiveJob> &job)
+{
+    // Directories are created once, up front, so workers never race on them
+    {
+        TraceSpan span(TracePhase::Directories);
+        m_destinations.prepare(*job->archive, job->destinationPath, job->selective ? &job->selection : nullptr);
+    }
+    // Sorted before duplicates are grouped, so the copy that is inflated is
+    // the one found first on the way through the archive
+    orderReads(*job);
+    if (m_deduplicate) {
+        findDuplicates(*job);
+    }
+    submitRange(job, 0, job->entryCount());
+}
+
+void ExtractionEngine::orderReads(ArchiveJob &job)
+{
+    const ZipArchive &archive = *job.archive;
+    job.dropBehind = archive.size() >= DropBehindThreshold;
+
+    const auto byOffset = [&archive](qsizetype a, qsizetype b) {
+        return archive.localHeaderOffset(a) < archive.localHeaderOffset(b);
+    };
+    QList<qsizetype> order(job.entryCount());
+    for (qsizetype position = 0; position < order.size(); ++position) {
+        order[position] = job.entryAt(position);
+    }
+    if (!std::is_sorted(order.cbegin(), order.cend(), byOffset)) {
+        std::stable_sort(order.begin(), order.end(), byOffset);
+        job.readOrder = std::move(order);
+    }
+}
+
+void ExtractionEngine::submitRange(const std::shared_ptr<ArchiveJob> &job, qsizetype first, qsizetype last)
+{
+    if (first >= last) {
+        return;
+    }
+
+    m_outstandingTasks.fetch_add(1);
+    m_scheduler.submit([this, job, first, last]() {
+        runRange(job, first, last);
+        finishTask();
+    });
+}
+
+void ExtractionEngine::runRange(const std::shared_ptr<ArchiveJob> &job, qsizetype first, qsizetype last)
+{
+    // Hand the upper half to whoever steals it, keep splitting the lower one
+    while (last - first > BatchSize && !m_token.isCancelled()) {
+        const qsizetype middle = first + (last - first) / 2;
+        submitRange(job, middle, last);
+        last = middle;
+    }
+
+    // Each worker thread reuses its own buffers for every range it runs
+    thread_local ZipEntryStream stream;
+    stream.setCounters(&m_completedCompressedBytes, &m_completedBytes);
+    stream.setToken(&m_token);
+    stream.setGovernor(&m_governor);
+    stream.setPassword(m_password);
+    RangeOutput output;
+
+    // Ranges cover neighbouring entries, so read-ahead and drop-behind both
+    // move front to back through one stretch of the archive
+    const ZipArchive &archive = *job->archive;
+    qint64 readAhead = 0;
+    qint64 consumed = -1;
+
+    for (qsizetype position = first; position < last && m_token.checkpoint(); ++position) {
+        const qsizetype i = job->entryAt(position);
+
+        const qint64 offset = archive.localHeaderOffset(i);
+        if (offset + ReadAheadBytes / 2 > readAhead) {
+            const qint64 from = qMax(readAhead, offset);
+            readAhead = offset + ReadAheadBytes;
+            archive.willNeed(from, readAhead - from);
+        }
+        if (consumed < 0) {
+            consumed = offset;
+        }
+        if (job->dropBehind && offset - consumed >= ReadAheadBytes) {
+            archive.dropBehind(consumed, offset - consumed);
+            consumed = offset;
+        }
+
+        // Publishing the name is best effort, never wait for the reader
+        if (m_currentFileMutex.tryLock()) {
+            const QString name = job->archive->name(i);
+            m_currentFile = job->name.isEmpty() ? name : job->name + "/" + name;
+            m_currentFileMutex.unlock();
+        }
+
+        // Duplicates are produced from their first copy once it is written
+        if (!job->copies.isEmpty() && job->copies.testBit(i)) {
+            continue;
+        }
+
+        bool written;
+        {
+            TraceSpan span(TracePhase::Entry, i);
+            span.addBytes(job->archive->uncompressedSize(i));
+            written = extractEntry(*job, i, stream, output);
+            m_completedFiles.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (job->duplicates.contains(i)) {
+            cloneDuplicates(*job, i, written, stream, output);
+        }
+    }
+
+    if (job->dropBehind && consumed >= 0 && first < last) {
+        const qint64 end = archive.dataEnd(job->entryAt(last - 1));
+        if (end > consumed) {
+            archive.dropBehind(consumed, end - consumed);
+        }
+    }
+
+    // Journaled per range: one write for up to BatchSize entries, and a crash
+    // only ever costs the range that was in flight. Records only go in once
+    // the files they describe carry their final timestamps.
+    output.metadata.apply();
+    m_journal.commit(output.journal);
+}
+
+bool ExtractionEngine::extractEntry(const ArchiveJob &job, qsizetype index, ZipEntryStream &stream, RangeOutput &output)
+{
+    const ZipArchive &archive = *job.archive;
+    const QString filePath = archive.safeName(index);
+    if (filePath.isEmpty()) {
+        reportFailure(job, index, "Unsafe path, not extracted");
+        return false;
+    }
+    if (archive.isDir(index)) {
+        return false;
+    }
+
+    const QString fullPath = job.destinationPath + "/" + filePath;
+
+    // Zip entries are extracted recursively without landing on disk first
+    if (m_extractNested && filePath.endsWith(".zip", Qt::CaseInsensitive) && extractNestedCandidate(job, index, fullPath, stream, output)) {
+        return false;
+    }
+
+    const QByteArray key = journalKey(job, filePath);
+    const ExtractionJournal::Record record = journalRecord(archive, index);
+    if (skipUnchanged(archive, index, key, record, fullPath, output.journal)) {
+        return true;
+    }
+
+    OutputFile outFile(fullPath);
+    bool opened;
+    {
+        TraceSpan span(TracePhase::Open);
+        opened = outFile.create(archive.uncompressedSize(index));
+    }
+    if (!opened) {
+        reportFailure(job, index, "Cannot create file: " + outFile.errorString());
+        return false;
+    }
+
+    // A damaged entry must not be left behind looking like a good file
+    if (!stream.extract(archive, index, &outFile)) {
+        outFile.discard();
+        reportFailure(job, index, stream.errorString());
+        return false;
+    }
+    return finishFile(job, index, key, record, outFile, output);
+}
+
+bool ExtractionEngine::finishFile(const ArchiveJob &job, qsizetype index, const QByteArray &key,
+                                  const ExtractionJournal::Record &record, OutputFile &outFile, RangeOutput &output)
+{
+    if (!outFile.finish(m_durability)) {
+        outFile.discard();
+        reportFailure(job, index, "Write failed: " + outFile.errorString());
+        return false;
+    }
+    m_sparseBytes.fetch_add(outFile.holeBytes(), std::memory_order_relaxed);
+
+    // The entry's timestamp is what later runs compare against
+    const QString fullPath = outFile.fileName();
+    output.metadata.add(fullPath, record.modified, job.archive->unixMode(index));
+    ExtractionJournal::append(output.journal, key, record);
+    if (job.streamOffset >= 0) {
+        QMutexLocker locker(&m_streamFilesMutex);
+        m_streamFiles.insert(job.streamOffset, fullPath);
+    }
+    return true;
+}
+
+QByteArray ExtractionEngine::journalKey(const ArchiveJob &job, const QString &filePath)
+{
+    // Entries are journaled under their path from the root archive
+    return (job.name.isEmpty() ? filePath : job.name + "/" + filePath).toUtf8();
+}
+
+ExtractionJournal::Record ExtractionEngine::journalRecord(const ZipArchive &archive, qsizetype index)
+{
+    const QDateTime modified = archive.lastModified(index);
+    ExtractionJournal::Record record;
+    record.crc = archive.crc(index);
+    record.size = archive.uncompressedSize(index);
+    record.modified = modified.isValid() ? modified.toMSecsSinceEpoch() : -1;
+    return record;
+}
+
+bool ExtractionEngine::skipUnchanged(const ZipArchive &archive, qsizetype index, const QByteArray &key,
+                                     const ExtractionJournal::Record &record, const QString &fullPath,
+                                     QByteArray &journalBatch)
+{
+    if (!m_journal.isOpen() || !m_journal.isUpToDate(key, record, fullPath)) {
+        return false;
+    }
+
+    m_skippedFiles.fetch_add(1, std::memory_order_relaxed);
+    m_completedBytes.fetch_add(record.size, std::memory_order_relaxed);
+    m_completedCompressedBytes.fetch_add(archive.compressedSize(index), std::memory_order_relaxed);
+    ExtractionJournal::append(journalBatch, key, record);
+    return true;
+}
+
+void ExtractionEngine::findDuplicates(ArchiveJob &job) const
+{
+    const ZipArchive &archive = *job.archive;
+    QHash<DuplicateKey, qsizetype> firstCopies;
+
+    for (qsizetype position = 0; position < job.entryCount(); ++position) {
+        const qsizetype i = job.entryAt(position);
+        if (archive.isDir(i) || archive.uncompressedSize(i) == 0 || (archive.flags(i) & 0x1)) {
+            continue;
+        }
+        // Nested archives take another path and never land as one file
+        const QByteArrayView name = archive.rawName(i);
+        if (m_extractNested && name.size() >= 4 && qstrnicmp(name.data() + name.size() - 4, ".zip", 4) == 0) {
+            continue;
+        }
+
+        const DuplicateKey key{archive.crc(i), archive.method(i), archive.uncompressedSize(i), archive.compressedSize(i)};
+        const auto first = firstCopies.constFind(key);
+        if (first == firstCopies.cend()) {
+            firstCopies.insert(key, i);
+            continue;
+        }
+
+        if (job.copies.isEmpty()) {
+            job.copies.resize(archive.entryCount());
+        }
+        job.copies.setBit(i);
+        job.duplicates[*first].append(i);
+    }
+}
+
+void ExtractionEngine::cloneDuplicates(const ArchiveJob &job, qsizetype index, bool written, ZipEntryStream &stream,
+                                       RangeOutput &output)
+{
+    const ZipArchive &archive = *job.archive;
+    const QString source = job.destinationPath + "/" + archive.safeName(index);
+
+    for (const qsizetype copy : job.duplicates.value(index)) {
+        if (!m_token.checkpoint()) {
+            return;
+        }
+
+        TraceSpan span(TracePhase::Entry, copy);
+        span.addBytes(archive.uncompressedSize(copy));
+
+        // The central directory only suggests a match, identical compressed
+        // bytes prove it without inflating anything
+        const uchar *first = archive.entryData(index);
+        const uchar *data = archive.entryData(copy);
+        const bool identical = written && first && data
+                               && std::memcmp(first, data, archive.compressedSize(copy)) == 0;
+        if (!identical || !cloneEntry(job, copy, source, output)) {
+            extractEntry(job, copy, stream, output);
+        }
+        m_completedFiles.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool ExtractionEngine::cloneEntry(const ArchiveJob &job, qsizetype index, const QString &source, RangeOutput &output)
+{
+    const ZipArchive &archive = *job.archive;
+    const QString filePath = archive.safeName(index);
+    if (filePath.isEmpty()) {
+        return false;
+    }
+    const QString fullPath = job.destinationPath + "/" + filePath;
+    const QByteArray key = journalKey(job, filePath);
+    const ExtractionJournal::Record record = journalRecord(archive, index);
+    if (skipUnchanged(archive, index, key, record, fullPath, output.journal)) {
+        return true;
+    }
+
+    FileCloner::Method method;
+    {
+        TraceSpan span(TracePhase::Write);
+        method = m_cloner.clone(source, fullPath);
+        span.addBytes(record.size);
+    }
+    if (method == FileCloner::Failed) {
+        return false;
+    }
+
+    // Copies are new data the journal must not get ahead of; a failed sync
+    // falls back to extracting the entry
+    if (m_durability == OutputFile::SyncEachFile && method != FileCloner::Hardlink) {
+        QFile file(fullPath);
+        if (!file.open(QIODevice::ReadWrite) || !OutputFile::sync(file)) {
+            return false;
+        }
+    }
+
+    // A hardlink shares the metadata of its source, reflinks and copies are
+    // new files
+    if (method != FileCloner::Hardlink) {
+        output.metadata.add(fullPath, record.modified, archive.unixMode(index));
+    }
+
+    m_dedupedFiles[method].fetch_add(1, std::memory_order_relaxed);
+    m_dedupedBytes.fetch_add(record.size, std::memory_order_relaxed);
+    m_completedBytes.fetch_add(record.size, std::memory_order_relaxed);
+    m_completedCompressedBytes.fetch_add(archive.compressedSize(index), std::memory_order_relaxed);
+    ExtractionJournal::append(output.journal, key, record);
+    return true;
+}
+
+bool ExtractionEngine::extractNestedCandidate(const ArchiveJob &job, qsizetype index, const QString &fullPath,
+                                              ZipEntryStream &stream, RangeOutput &output)
+{
+    const ZipArchive &archive = *job.archive;
+    TraceSpan span(TracePhase::Nested, index);
+    auto nestedArchive = std::make_shared<ZipArchive>();
+    auto nested = std::make_shared<ArchiveJob>();
+    nested->name = job.name.isEmpty() ? archive.safeName(index) : job.name + "/" + archive.safeName(index);
+
+    // Inner archives stay in memory only while the budget has room for them,
+    // the grant lives as long as their job
+    if (archive.uncompressedSize(index) <= InMemoryNestedLimit && m_governor.tryAcquire(archive.uncompressedSize(index))) {
+        nested->memory = MemoryGrant(&m_governor, archive.uncompressedSize(index));
+        QByteArray data;
+        data.reserve(archive.uncompressedSize(index));
+        QBuffer buffer(&data);
+        if (!buffer.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        if (!stream.extract(archive, index, &buffer)) {
+            reportFailure(job, index, stream.errorString());
+            return true;
+        }
+        buffer.close();
+
+        if (!ZipArchive::hasSignature(data) || !nestedArchive->open(data) || nestedArchive->entryCount() == 0) {
+            // Not an archive worth recursing into, keep it as a plain file
+            buffer.open(QIODevice::ReadOnly);
+            keepNestedFile(job, index, fullPath, &buffer, output);
+            return true;
+        }
+    } else {
+        auto spillFile = std::make_shared<QTemporaryFile>(QDir::tempPath() + "/zipextract-XXXXXX.zip");
+        if (!spillFile->open()) {
+            return false;
+        }
+        if (!stream.extract(archive, index, spillFile.get())) {
+            reportFailure(job, index, stream.errorString());
+            return true;
+        }
+        spillFile->flush();
+        spillFile->seek(0);
+        const QByteArray head = spillFile->read(4);
+
+        if (!ZipArchive::hasSignature(head) || !nestedArchive->open(spillFile->fileName()) || nestedArchive->entryCount() == 0) {
+            nestedArchive->close();
+            spillFile->seek(0);
+            keepNestedFile(job, index, fullPath, spillFile.get(), output);
+            return true;
+        }
+        nested->spillFile = spillFile;
+    }
+
+    nested->archive = nestedArchive;
+    nested->destinationPath = nestedDestination(job, fullPath);
+
+    // Queue the inner archive right away, this worker starts on it next
+    span.addBytes(archive.uncompressedSize(index));
+    addTotals(*nested);
+    submitArchive(nested);
+    return true;
+}
+
+void ExtractionEngine::keepNestedFile(const ArchiveJob &job, qsizetype index, const QString &fullPath, QIODevice *data,
+                                      RangeOutput &output)
+{
+    // Written like any other entry, the spill file is usually on another
+    // filesystem and renaming it would bypass durability and the journal
+    const ZipArchive &archive = *job.archive;
+    OutputFile outFile(fullPath);
+    if (!outFile.create(archive.uncompressedSize(index))) {
+        reportFailure(job, index, "Cannot create file: " + outFile.errorString());
+        return;
+    }
+
+    QByteArray chunk(256 * 1024, Qt::Uninitialized);
+    qint64 read;
+    while ((read = data->read(chunk.data(), chunk.size())) > 0) {
+        if (outFile.write(chunk.constData(), read) != read) {
+            break;
+        }
+    }
+    if (read != 0) {
+        outFile.discard();
+        reportFailure(job, index, "Write failed: " + (read < 0 ? data->errorString() : outFile.errorString()));
+        return;
+    }
+
+    finishFile(job, index, journalKey(job, archive.safeName(index)), journalRecord(archive, index), outFile, output);
+}
+
+QString ExtractionEngine::nestedDestination(const ArchiveJob &job, const QString &fullPath)
+{
+    QFileInfo nestedZipInfo(fullPath);
+    QFileInfo originalZipInfo(m_archive->fileName());
+
+    if (job.archive == m_archive && nestedZipInfo.baseName() == originalZipInfo.baseName() && m_archive->entryCount() > 1) {
+        // Pick another folder name to avoid conflict with the outer archive
+        return nestedZipInfo.absolutePath() + "/" + m_destinations.uniqueName(nestedZipInfo.absolutePath(), nestedZipInfo.baseName(), QString());
+    }
+
+    return nestedZipInfo.absolutePath() + "/" + nestedZipInfo.baseName();
+}
@@ -0,0 +1,225 @@
+#include "extractionjournal.h"
+#include "checksum.h"
+#include "outputfile.h"
+#include "ziparchive.h"
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QtEndian>
+
+namespace {
+
+constexpr char Magic[4] = {'Z', 'X', 'J', '1'};
+constexpr quint32 StateRunning = 0;
+constexpr quint32 StateComplete = 1;
+// Flag on either state: every recorded file was on disk before its record
+constexpr quint32 StateSynced = 2;
+
+// Magic, state, then the archive identity: size, mtime and entry count
+constexpr int StateOffset = 4;
+constexpr int IdentitySize = 24;
+constexpr int HeaderSize = 8 + IdentitySize;
+
+// CRC, size, mtime and name length, followed by the name
+constexpr int RecordHeaderSize = 4 + 8 + 8 + 2;
+
+template <typename T>
+void appendLittleEndian(QByteArray &out, T value)
+{
+    char bytes[sizeof(T)];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, sizeof(T));
+}
+
+}
+
+ExtractionJournal::~ExtractionJournal()
+{
+    m_file.close();
+}
+
+QString ExtractionJournal::journalPath(const QString &destinationPath)
+{
+    return destinationPath + ".zipextract-journal";
+}
+
+bool ExtractionJournal::open(const QString &destinationPath, const ZipArchive &archive, bool incremental, bool synced,
+                             QString *error)
+{
+    m_file.close();
+    m_previous.clear();
+    m_incremental = incremental;
+    m_resumed = false;
+    m_synced = synced;
+    m_previousSynced = false;
+
+    const QString path = journalPath(destinationPath);
+    const QByteArray identity = identityOf(archive);
+    load(path, identity);
+
+    // Entries that turn out to be up to date are recorded again as they are
+    // skipped, so the new journal is complete on its own
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (error) {
+            *error = m_file.errorString();
+        }
+        return false;
+    }
+
+    QByteArray header(Magic, sizeof(Magic));
+    appendLittleEndian<quint32>(header, StateRunning | (synced ? StateSynced : 0));
+    header.append(identity);
+    m_file.write(header);
+    m_file.flush();
+    return true;
+}
+
+void ExtractionJournal::close(bool complete, bool synced)
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    if (complete && !m_incremental) {
+        m_file.remove();
+    } else {
+        char state[4];
+        qToLittleEndian((complete ? StateComplete : StateRunning) | (synced ? StateSynced : 0), state);
+        m_file.seek(StateOffset);
+        m_file.write(state, sizeof(state));
+        if (synced) {
+            OutputFile::sync(m_file);
+        }
+        m_file.close();
+    }
+    m_previous.clear();
+}
+
+bool ExtractionJournal::isUpToDate(const QByteArray &key, const Record &entry, const QString &path) const
+{
+    // Nothing to compare against on a fresh run, not even worth a stat
+    if (!m_incremental && m_previous.isEmpty()) {
+        return false;
+    }
+
+    // One stat per entry, file contents are only read as a last resort
+    const QFileInfo info(path);
+    if (entry.modified < 0 || !info.isFile() || info.size() != entry.size
+        || info.lastModified().toMSecsSinceEpoch() != entry.modified) {
+        return false;
+    }
+
+    const auto it = m_previous.constFind(key);
+    if (it != m_previous.cend()) {
+        if (it->crc != entry.crc || it->size != entry.size || it->modified != entry.modified) {
+            return false;
+        }
+        // A crash can lose unsynced data after its size and mtime reached disk
+        return m_previousSynced || fileCrc(path, entry.size) == entry.crc;
+    }
+    return m_incremental && fileCrc(path, entry.size) == entry.crc;
+}
+
+void ExtractionJournal::append(QByteArray &batch, const QByteArray &key, const Record &entry)
+{
+    appendLittleEndian<quint32>(batch, entry.crc);
+    appendLittleEndian<qint64>(batch, entry.size);
+    appendLittleEndian<qint64>(batch, entry.modified);
+    appendLittleEndian<quint16>(batch, quint16(key.size()));
+    batch.append(key);
+}
+
+void ExtractionJournal::commit(QByteArray &batch)
+{
+    if (batch.isEmpty()) {
+        return;
+    }
+
+    // One write per batch; a record only lands after its file is complete,
+    // and when synced only after the file is on disk, so the records are
+    // forced to disk right behind it
+    QMutexLocker locker(&m_mutex);
+    if (m_file.isOpen()) {
+        m_file.write(batch);
+        if (m_synced) {
+            OutputFile::sync(m_file);
+        } else {
+            m_file.flush();
+        }
+    }
+    batch.clear();
+}
+
+bool ExtractionJournal::load(const QString &path, const QByteArray &identity)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    if (data.size() < HeaderSize || !data.startsWith(QByteArrayView(Magic, sizeof(Magic)))) {
+        return false;
+    }
+
+    // Resuming needs an unfinished run over the same archive; incremental
+    // runs take the records of any earlier one
+    const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+    const quint32 state = qFromLittleEndian<quint32>(bytes + StateOffset);
+    const bool sameRun = (state & ~StateSynced) == StateRunning && data.mid(8, IdentitySize) == identity;
+    if (!sameRun && !m_incremental) {
+        return false;
+    }
+
+    qsizetype pos = HeaderSize;
+    while (pos + RecordHeaderSize <= data.size()) {
+        Record record;
+        record.crc = qFromLittleEndian<quint32>(bytes + pos);
+        record.size = qFromLittleEndian<qint64>(bytes + pos + 4);
+        record.modified = qFromLittleEndian<qint64>(bytes + pos + 12);
+        const quint16 nameLength = qFromLittleEndian<quint16>(bytes + pos + 20);
+        if (pos + RecordHeaderSize + nameLength > data.size()) {
+            break;
+        }
+        m_previous.insert(data.mid(pos + RecordHeaderSize, nameLength), record);
+        pos += RecordHeaderSize + nameLength;
+    }
+
+    m_previousSynced = state & StateSynced;
+    m_resumed = sameRun && !m_previous.isEmpty();
+    return true;
+}
+
+QByteArray ExtractionJournal::identityOf(const ZipArchive &archive)
+{
+    const QFileInfo info(archive.fileName());
+    QByteArray identity;
+    appendLittleEndian<qint64>(identity, info.size());
+    appendLittleEndian<qint64>(identity, info.lastModified().toMSecsSinceEpoch());
+    appendLittleEndian<qint64>(identity, archive.entryCount());
+    return identity;
+}
+
+quint32 ExtractionJournal::fileCrc(const QString &path, qint64 size)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    if (size == 0) {
+        return 0;
+    }
+
+    if (const uchar *data = file.map(0, size)) {
+        const quint32 crc = Crc32::update(0, data, size);
+        file.unmap(const_cast<uchar *>(data));
+        return crc;
+    }
+
+    quint32 crc = 0;
+    QByteArray chunk(256 * 1024, Qt::Uninitialized);
+    qint64 read;
+    while ((read = file.read(chunk.data(), chunk.size())) > 0) {
+        crc = Crc32::update(crc, reinterpret_cast<const uchar *>(chunk.constData()), read);
+    }
+    return crc;
+}
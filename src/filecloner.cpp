@@ -0,0 +1,133 @@
+#include "filecloner.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#elif defined(Q_OS_UNIX)
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_WIN
+#include <QDir>
+#include <windows.h>
+#endif
+
+void FileCloner::reset()
+{
+    m_reflinkSupported = true;
+    m_hardlinkSupported = true;
+}
+
+FileCloner::Method FileCloner::clone(const QString &source, const QString &target)
+{
+    if (!QFileInfo(source).isFile()) {
+        return Failed;
+    }
+
+    // The clone is made under a name of its own and only then renamed over
+    // target, so a failed clone leaves target as it was and nothing is ever
+    // linked or copied through an existing file
+    const QString temporary = QString("%1.zipextract-%2").arg(target).arg(quintptr(QThread::currentThreadId()), 0, 16);
+    QFile::remove(temporary);
+
+    Method method = Failed;
+    if (m_reflinkSupported.load(std::memory_order_relaxed) && reflink(QFile::encodeName(source), QFile::encodeName(temporary))) {
+        method = Reflink;
+    } else if (m_hardlinkSupported.load(std::memory_order_relaxed) && hardlink(source, temporary)) {
+        method = Hardlink;
+    } else if (QFile::copy(source, temporary)) {
+        method = Copy;
+    }
+
+    if (method == Failed || !replace(temporary, target)) {
+        QFile::remove(temporary);
+        return Failed;
+    }
+    return method;
+}
+
+bool FileCloner::replace(const QString &from, const QString &to)
+{
+#ifdef Q_OS_UNIX
+    return ::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+#elif defined(Q_OS_WIN)
+    const QString nativeFrom = QDir::toNativeSeparators(from);
+    const QString nativeTo = QDir::toNativeSeparators(to);
+    return MoveFileExW(reinterpret_cast<LPCWSTR>(nativeFrom.utf16()), reinterpret_cast<LPCWSTR>(nativeTo.utf16()),
+                       MOVEFILE_REPLACE_EXISTING);
+#else
+    QFile::remove(to);
+    return QFile::rename(from, to);
+#endif
+}
+
+bool FileCloner::reflink(const QByteArray &source, const QByteArray &target)
+{
+#if defined(Q_OS_LINUX) && defined(FICLONE)
+    const int in = ::open(source.constData(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return false;
+    }
+    const int out = ::open(target.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (out < 0) {
+        ::close(in);
+        return false;
+    }
+
+    const bool cloned = ::ioctl(out, FICLONE, in) == 0;
+    const int error = errno;
+    ::close(out);
+    ::close(in);
+    if (!cloned) {
+        ::unlink(target.constData());
+        // Anything but a per-file problem means this filesystem cannot do it
+        if (error == EOPNOTSUPP || error == ENOTTY || error == EXDEV || error == EINVAL) {
+            m_reflinkSupported = false;
+        }
+    }
+    return cloned;
+#else
+    Q_UNUSED(source)
+    Q_UNUSED(target)
+    m_reflinkSupported = false;
+    return false;
+#endif
+}
+
+bool FileCloner::hardlink(const QString &source, const QString &target)
+{
+#ifdef Q_OS_UNIX
+    if (::link(QFile::encodeName(source).constData(), QFile::encodeName(target).constData()) == 0) {
+        return true;
+    }
+    if (errno == EPERM || errno == EXDEV || errno == ENOTSUP) {
+        m_hardlinkSupported = false;
+    }
+    return false;
+#elif defined(Q_OS_WIN)
+    const QString nativeSource = QDir::toNativeSeparators(source);
+    const QString nativeTarget = QDir::toNativeSeparators(target);
+    if (CreateHardLinkW(reinterpret_cast<LPCWSTR>(nativeTarget.utf16()), reinterpret_cast<LPCWSTR>(nativeSource.utf16()), nullptr)) {
+        return true;
+    }
+    const DWORD error = GetLastError();
+    if (error == ERROR_NOT_SUPPORTED || error == ERROR_INVALID_FUNCTION || error == ERROR_NOT_SAME_DEVICE) {
+        m_hardlinkSupported = false;
+    }
+    return false;
+#else
+    Q_UNUSED(source)
+    Q_UNUSED(target)
+    m_hardlinkSupported = false;
+    return false;
+#endif
+}
@@ -0,0 +1,473 @@
+#include "headlessrunner.h"
+#include "entrydecoder.h"
+#include "entrydecryptor.h"
+#include "tracer.h"
+#include "zipcreator.h"
+#include "ziparchive.h"
+#include "zipextractor.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <cstring>
+#include <limits>
+
+#ifdef Q_OS_LINUX
+#include <sys/resource.h>
+#endif
+
+#ifdef Q_OS_UNIX
+#include <QSocketNotifier>
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+namespace {
+
+#ifdef Q_OS_UNIX
+// Signal handlers only write the signal number here, the event loop reads it
+int s_signalFds[2] = {-1, -1};
+
+void forwardSignal(int signal)
+{
+    const char number = char(signal);
+    [[maybe_unused]] const ssize_t written = ::write(s_signalFds[0], &number, 1);
+}
+#endif
+
+// Whether signals go to ZipCreator rather than ZipExtractor
+bool s_creating = false;
+
+#ifdef Q_OS_WIN
+BOOL WINAPI consoleHandler(DWORD event)
+{
+    if (event == CTRL_C_EVENT || event == CTRL_BREAK_EVENT || event == CTRL_CLOSE_EVENT) {
+        if (s_creating) {
+            QMetaObject::invokeMethod(ZipCreator::instance(), &ZipCreator::cancelCreation, Qt::QueuedConnection);
+        } else {
+            QMetaObject::invokeMethod(ZipExtractor::instance(), &ZipExtractor::cancelExtraction, Qt::QueuedConnection);
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+#endif
+
+// QJsonDocument only serializes containers, strip the array around a string
+QByteArray jsonString(const QString &text)
+{
+    return QJsonDocument(QJsonArray{text}).toJson(QJsonDocument::Compact).sliced(1).chopped(1);
+}
+
+// Accepts a plain byte count or one with a K, M or G suffix (powers of 1024)
+qint64 parseSize(QString text, bool *ok)
+{
+    text = text.trimmed().toUpper();
+    if (text.endsWith('B')) {
+        text.chop(1);
+    }
+    qint64 multiplier = 1;
+    if (text.endsWith('K')) {
+        multiplier = qint64(1) << 10;
+    } else if (text.endsWith('M')) {
+        multiplier = qint64(1) << 20;
+    } else if (text.endsWith('G')) {
+        multiplier = qint64(1) << 30;
+    }
+    if (multiplier > 1) {
+        text.chop(1);
+    }
+    const qint64 value = text.toLongLong(ok);
+    if (*ok && (value < 0 || value > std::numeric_limits<qint64>::max() / multiplier)) {
+        *ok = false;
+    }
+    return value * multiplier;
+}
+
+}
+
+HeadlessRunner::HeadlessRunner(QObject *parent)
+    : QObject(parent)
+{
+}
+
+bool HeadlessRunner::isHeadless(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--headless") == 0 || std::strcmp(argv[i], "--list") == 0
+            || std::strcmp(argv[i], "--create") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HeadlessRunner::parse(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Extract or create a ZIP archive without a user interface.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("archive", "ZIP file to extract, - to read it from standard input. "
+                                            "With --create, the files and directories to archive.", "archive|sources...");
+
+    QCommandLineOption headlessOption("headless", "Run without a user interface.");
+    QCommandLineOption destOption({"o", "dest"}, "Destination directory.", "path");
+    QCommandLineOption threadsOption({"j", "threads"}, "Worker thread count, 0 for one per core.", "count", "0");
+    QCommandLineOption nestedOption("nested", "Nested zip policy: extract or keep.", "policy", "extract");
+    QCommandLineOption traceOption("trace", "Record spans and write them as a Chrome trace.", "file");
+    QCommandLineOption includeOption("include", "Only extract entries matching this glob, or regex after re:. Repeatable.", "pattern");
+    QCommandLineOption excludeOption("exclude", "Skip entries matching this glob, or regex after re:. Repeatable.", "pattern");
+    QCommandLineOption entryOption("entry", "Extract this exact entry. Repeatable.", "name");
+    QCommandLineOption entriesFromOption("entries-from", "Extract the entries named in this file, one per line.", "file");
+    QCommandLineOption incrementalOption("incremental", "Skip entries whose file in the destination is unchanged.");
+    QCommandLineOption dedupOption("dedup", "Clone entries with identical contents instead of inflating each copy.");
+    QCommandLineOption syncOption("sync", "When written files reach the disk: none, file (each file) or end (once).", "policy", "none");
+    QCommandLineOption maxMemoryOption("max-memory", "Memory budget for buffers and decoders, e.g. 512M; 0 for none.", "size", "0");
+    QCommandLineOption passwordOption("password", "Password for encrypted entries (ZipCrypto or WinZip AES).", "password");
+    QCommandLineOption passwordFileOption("password-file", "Read the password from the first line of this file.", "file");
+    QCommandLineOption listOption("list", "Print the central directory as JSON instead of extracting.");
+    QCommandLineOption createOption("create", "Create this archive from the files and directories given.", "archive");
+    QCommandLineOption methodOption("method", "Compression for --create: store, deflate or zstd.", "method", "deflate");
+    QCommandLineOption levelOption("level", "Compression level for --create, -1 for the method's default.", "level", "-1");
+    QCommandLineOption blockSizeOption("block-size", "Size of the blocks large files are compressed in, e.g. 1M.", "size", "1M");
+    parser.addOptions({headlessOption, destOption, threadsOption, nestedOption, traceOption,
+                       includeOption, excludeOption, entryOption, entriesFromOption, incrementalOption, dedupOption, syncOption, maxMemoryOption,
+                       passwordOption, passwordFileOption, listOption, createOption, methodOption, levelOption, blockSizeOption});
+
+    QTextStream err(stderr);
+    if (!parser.parse(arguments)) {
+        err << parser.errorText() << "\n" << parser.helpText();
+        return false;
+    }
+    if (parser.isSet("help")) {
+        err << parser.helpText();
+        return false;
+    }
+
+    bool ok = false;
+    m_threadCount = parser.value(threadsOption).toInt(&ok);
+    if (!ok || m_threadCount < 0) {
+        err << "Invalid thread count: " << parser.value(threadsOption) << "\n";
+        return false;
+    }
+    m_tracePath = parser.value(traceOption);
+
+    const QStringList positional = parser.positionalArguments();
+    if (parser.isSet(createOption)) {
+        if (positional.isEmpty()) {
+            err << "Expected the files and directories to archive.\n" << parser.helpText();
+            return false;
+        }
+        if (parser.isSet(listOption)) {
+            err << "--list and --create cannot be combined.\n";
+            return false;
+        }
+
+        m_method = parser.value(methodOption);
+        if (m_method != "store" && m_method != "deflate" && m_method != "zstd") {
+            err << "Unknown compression method: " << m_method << "\n";
+            return false;
+        }
+        m_level = parser.value(levelOption).toInt(&ok);
+        if (!ok || m_level < -1) {
+            err << "Invalid compression level: " << parser.value(levelOption) << "\n";
+            return false;
+        }
+        m_blockSize = parseSize(parser.value(blockSizeOption), &ok);
+        if (!ok || m_blockSize <= 0) {
+            err << "Invalid block size: " << parser.value(blockSizeOption) << "\n";
+            return false;
+        }
+        m_createPath = parser.value(createOption);
+        m_sources = positional;
+        return true;
+    }
+    if (positional.size() != 1) {
+        err << "Expected exactly one archive.\n" << parser.helpText();
+        return false;
+    }
+
+    const QString policy = parser.value(nestedOption);
+    if (policy != "extract" && policy != "keep") {
+        err << "Unknown nested policy: " << policy << "\n";
+        return false;
+    }
+
+    m_durability = parser.value(syncOption);
+    if (m_durability != "none" && m_durability != "file" && m_durability != "end") {
+        err << "Unknown sync policy: " << m_durability << "\n";
+        return false;
+    }
+
+    m_maxMemory = parseSize(parser.value(maxMemoryOption), &ok);
+    if (!ok) {
+        err << "Invalid memory budget: " << parser.value(maxMemoryOption) << "\n";
+        return false;
+    }
+
+    QStringList entries = parser.values(entryOption);
+    if (parser.isSet(entriesFromOption)) {
+        QFile list(parser.value(entriesFromOption));
+        if (!list.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            err << "Cannot read " << list.fileName() << ": " << list.errorString() << "\n";
+            return false;
+        }
+        while (!list.atEnd()) {
+            const QString name = QString::fromUtf8(list.readLine()).trimmed();
+            if (!name.isEmpty()) {
+                entries.append(name);
+            }
+        }
+    }
+
+    // A file keeps the password out of the process list and shell history
+    m_password = parser.value(passwordOption);
+    if (parser.isSet(passwordFileOption)) {
+        QFile file(parser.value(passwordFileOption));
+        if (!file.open(QIODevice::ReadOnly)) {
+            err << "Cannot read " << file.fileName() << ": " << file.errorString() << "\n";
+            return false;
+        }
+        QByteArray line = file.readLine();
+        while (line.endsWith('\n') || line.endsWith('\r')) {
+            line.chop(1);
+        }
+        m_password = QString::fromUtf8(line);
+    }
+
+    QString error;
+    if (!m_filter.set(parser.values(includeOption), parser.values(excludeOption), entries, &error)) {
+        err << error << "\n";
+        return false;
+    }
+
+    m_zipPath = positional.first();
+    if (m_zipPath == "-" && parser.isSet(listOption)) {
+        err << "--list needs a ZIP file, not standard input.\n";
+        return false;
+    }
+    m_listOnly = parser.isSet(listOption);
+    m_incremental = parser.isSet(incrementalOption);
+    m_deduplicate = parser.isSet(dedupOption);
+    m_destinationPath = parser.value(destOption);
+    m_extractNested = policy == "extract";
+    return true;
+}
+
+void HeadlessRunner::start()
+{
+    if (!m_createPath.isEmpty()) {
+        startCreation();
+        return;
+    }
+    if (m_listOnly) {
+        const bool ok = listArchive();
+        QMetaObject::invokeMethod(qApp, [ok]() { QCoreApplication::exit(ok ? 0 : 1); }, Qt::QueuedConnection);
+        return;
+    }
+
+    ZipExtractor *extractor = ZipExtractor::instance();
+    extractor->setThreadCount(m_threadCount);
+    extractor->setExtractNested(m_extractNested);
+    extractor->setTracing(!m_tracePath.isEmpty());
+    extractor->setIncremental(m_incremental);
+    extractor->setDeduplicate(m_deduplicate);
+    extractor->setMaxMemory(m_maxMemory);
+    extractor->setDurability(m_durability);
+    extractor->setPassword(m_password);
+
+    connect(extractor, &ZipExtractor::extractionFinished, this, &HeadlessRunner::onExtractionFinished);
+    installSignalHandlers();
+    extractor->startExtraction(m_zipPath, m_destinationPath, m_filter);
+}
+
+void HeadlessRunner::startCreation()
+{
+    ZipCreator *creator = ZipCreator::instance();
+    creator->setThreadCount(m_threadCount);
+    creator->setBlockSize(m_blockSize);
+    creator->setMethod(m_method);
+    creator->setLevel(m_level);
+    Tracer::instance().setEnabled(!m_tracePath.isEmpty());
+
+    // Builds without libzstd fall back to Deflate rather than failing
+    if (creator->method() != m_method) {
+        QTextStream(stderr) << "Compression method " << m_method << " is not available, using " << creator->method() << "\n";
+    }
+
+    connect(creator, &ZipCreator::creationFinished, this, &HeadlessRunner::onCreationFinished);
+    s_creating = true;
+    installSignalHandlers();
+    if (!creator->startCreation(m_sources, m_createPath)) {
+        onCreationFinished(false, "Nothing to archive");
+    }
+}
+
+void HeadlessRunner::onExtractionFinished(bool success, const QString &message)
+{
+    printSummary(QJsonObject::fromVariantMap(ZipExtractor::instance()->stats()), success, message);
+}
+
+void HeadlessRunner::onCreationFinished(bool success, const QString &message)
+{
+    printSummary(QJsonObject::fromVariantMap(ZipCreator::instance()->stats()), success, message);
+}
+
+void HeadlessRunner::printSummary(QJsonObject summary, bool success, const QString &message)
+{
+    summary["success"] = success;
+    summary["message"] = message;
+    summary["process"] = processStats();
+
+    if (!m_tracePath.isEmpty()) {
+        QString error;
+        if (Tracer::instance().exportChromeTrace(m_tracePath, &error)) {
+            summary["traceFile"] = m_tracePath;
+        } else {
+            QTextStream(stderr) << "Cannot write trace " << m_tracePath << ": " << error << "\n";
+        }
+    }
+
+    QTextStream out(stdout);
+    out << QJsonDocument(summary).toJson(QJsonDocument::Indented);
+    out.flush();
+
+    // Queued so the summary is written before the event loop unwinds
+    QMetaObject::invokeMethod(qApp, [success]() { QCoreApplication::exit(success ? 0 : 1); }, Qt::QueuedConnection);
+}
+
+void HeadlessRunner::installSignalHandlers()
+{
+#ifdef Q_OS_UNIX
+    // SIGINT and SIGTERM cancel cleanly, SIGUSR1 and SIGUSR2 pause and resume
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, s_signalFds) != 0) {
+        return;
+    }
+    m_signalNotifier = new QSocketNotifier(s_signalFds[1], QSocketNotifier::Read, this);
+    connect(m_signalNotifier, &QSocketNotifier::activated, this, &HeadlessRunner::onSignal);
+
+    struct sigaction action = {};
+    action.sa_handler = forwardSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    for (const int signal : {SIGINT, SIGTERM, SIGUSR1, SIGUSR2}) {
+        sigaction(signal, &action, nullptr);
+    }
+#elif defined(Q_OS_WIN)
+    SetConsoleCtrlHandler(consoleHandler, TRUE);
+#endif
+}
+
+void HeadlessRunner::onSignal()
+{
+#ifdef Q_OS_UNIX
+    char number = 0;
+    if (::read(s_signalFds[1], &number, 1) != 1) {
+        return;
+    }
+
+    QTextStream err(stderr);
+    if (s_creating) {
+        ZipCreator *creator = ZipCreator::instance();
+        switch (number) {
+        case SIGUSR1:
+            creator->pauseCreation();
+            err << "Paused\n";
+            break;
+        case SIGUSR2:
+            creator->resumeCreation();
+            err << "Resumed\n";
+            break;
+        default:
+            creator->cancelCreation();
+            break;
+        }
+        return;
+    }
+
+    ZipExtractor *extractor = ZipExtractor::instance();
+    switch (number) {
+    case SIGUSR1:
+        extractor->pauseExtraction();
+        err << "Paused\n";
+        break;
+    case SIGUSR2:
+        extractor->resumeExtraction();
+        err << "Resumed\n";
+        break;
+    default:
+        extractor->cancelExtraction();
+        break;
+    }
+#endif
+}
+
+bool HeadlessRunner::listArchive()
+{
+    ZipArchive archive;
+    if (!archive.open(m_zipPath)) {
+        QTextStream(stderr) << "Cannot read ZIP file " << m_zipPath << "\n";
+        return false;
+    }
+
+    // Written one entry at a time, an archive with a million entries should
+    // not need a million JSON objects in memory
+    QTextStream out(stdout);
+    const QList<qsizetype> selection = m_filter.select(archive);
+    out << "{\n    \"archive\": " << jsonString(m_zipPath)
+        << ",\n    \"totalEntries\": " << archive.entryCount()
+        << ",\n    \"entries\": [";
+    for (qsizetype position = 0; position < selection.size(); ++position) {
+        const qsizetype i = selection[position];
+        QJsonObject entry;
+        entry["name"] = archive.name(i);
+        entry["isDir"] = archive.isDir(i);
+        entry["size"] = archive.uncompressedSize(i);
+        entry["compressedSize"] = archive.compressedSize(i);
+        entry["method"] = EntryDecoder::methodName(EntryDecryptor::compressionMethod(archive, i));
+        entry["crc"] = qint64(archive.crc(i));
+        if (archive.flags(i) & EntryDecryptor::EncryptedFlag) {
+            entry["encryption"] = EntryDecryptor::schemeName(archive, i);
+        }
+        out << (position > 0 ? ",\n        " : "\n        ") << QJsonDocument(entry).toJson(QJsonDocument::Compact);
+    }
+    out << (selection.isEmpty() ? "]\n}\n" : "\n    ]\n}\n");
+    out.flush();
+    return true;
+}
+
+QJsonObject HeadlessRunner::processStats()
+{
+    QJsonObject stats;
+
+#ifdef Q_OS_LINUX
+    rusage usage = {};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        stats["peakRssKb"] = qint64(usage.ru_maxrss);
+        stats["userCpuMs"] = qint64(usage.ru_utime.tv_sec) * 1000 + usage.ru_utime.tv_usec / 1000;
+        stats["systemCpuMs"] = qint64(usage.ru_stime.tv_sec) * 1000 + usage.ru_stime.tv_usec / 1000;
+    }
+
+    // syscr/syscw count read- and write-class syscalls of the whole process
+    QFile io("/proc/self/io");
+    if (io.open(QIODevice::ReadOnly)) {
+        const QList<QByteArray> lines = io.readAll().split('\n');
+        for (const QByteArray &line : lines) {
+            if (line.startsWith("syscr:")) {
+                stats["readSyscalls"] = line.mid(6).trimmed().toLongLong();
+            } else if (line.startsWith("syscw:")) {
+                stats["writeSyscalls"] = line.mid(6).trimmed().toLongLong();
+            }
+        }
+    }
+#endif
+
+    return stats;
+}
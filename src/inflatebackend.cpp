@@ -0,0 +1,101 @@
+#include "inflatebackend.h"
+#include <zlib.h>
+
+#ifdef ZIPEXTRACT_HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+namespace {
+
+class ZlibBackend : public InflateBackend
+{
+public:
+    ~ZlibBackend() override
+    {
+        if (m_initialized) {
+            inflateEnd(&m_stream);
+        }
+    }
+
+    const char *name() const override { return "zlib"; }
+
+    bool inflateWhole(const uchar *input, qint64 inputSize, uchar *output, qint64 outputSize) override
+    {
+        if (inputSize > 0xffffffffLL || outputSize > 0xffffffffLL) {
+            return false;
+        }
+
+        // The stream is reset rather than reallocated for every entry
+        if (!m_initialized) {
+            if (inflateInit2(&m_stream, -MAX_WBITS) != Z_OK) {
+                return false;
+            }
+            m_initialized = true;
+        } else if (inflateReset(&m_stream) != Z_OK) {
+            return false;
+        }
+
+        m_stream.next_in = const_cast<Bytef *>(input);
+        m_stream.avail_in = uInt(inputSize);
+        m_stream.next_out = output;
+        m_stream.avail_out = uInt(outputSize);
+
+        const int status = inflate(&m_stream, Z_FINISH);
+        return status == Z_STREAM_END && m_stream.total_out == uLong(outputSize);
+    }
+
+private:
+    z_stream m_stream = {};
+    bool m_initialized = false;
+};
+
+#ifdef ZIPEXTRACT_HAVE_LIBDEFLATE
+
+class LibdeflateBackend : public InflateBackend
+{
+public:
+    explicit LibdeflateBackend(libdeflate_decompressor *decompressor)
+        : m_decompressor(decompressor)
+    {
+    }
+
+    ~LibdeflateBackend() override
+    {
+        libdeflate_free_decompressor(m_decompressor);
+    }
+
+    const char *name() const override { return "libdeflate"; }
+
+    bool inflateWhole(const uchar *input, qint64 inputSize, uchar *output, qint64 outputSize) override
+    {
+        // Passing no actual size asks libdeflate to require an exact fill
+        return libdeflate_deflate_decompress(m_decompressor, input, size_t(inputSize), output, size_t(outputSize), nullptr)
+               == LIBDEFLATE_SUCCESS;
+    }
+
+private:
+    libdeflate_decompressor *m_decompressor;
+};
+
+#endif
+
+}
+
+std::unique_ptr<InflateBackend> InflateBackend::create()
+{
+#ifdef ZIPEXTRACT_HAVE_LIBDEFLATE
+    if (libdeflate_decompressor *decompressor = libdeflate_alloc_decompressor()) {
+        return std::make_unique<LibdeflateBackend>(decompressor);
+    }
+#endif
+    return std::make_unique<ZlibBackend>();
+}
+
+const char *InflateBackend::preferredName()
+{
+#ifdef ZIPEXTRACT_HAVE_LIBDEFLATE
+    return "libdeflate";
+#else
+    return "zlib";
+#endif
+}
@@ -0,0 +1,86 @@
+#include "instanceserver.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+namespace {
+
+constexpr int ConnectTimeoutMs = 500;
+
+}
+
+InstanceServer::InstanceServer(QObject *parent)
+    : QObject(parent)
+    , m_server(new QLocalServer(this))
+{
+    // Anyone who can connect gets archives extracted in this session, so the
+    // socket is only open to the user who owns it
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(m_server, &QLocalServer::newConnection, this, &InstanceServer::onNewConnection);
+}
+
+QString InstanceServer::serverName()
+{
+    // One server per user, the home path keeps sessions of different users apart
+    const QByteArray user = QDir::homePath().toUtf8();
+    return "Odizinne.ZipExtract." + QCryptographicHash::hash(user, QCryptographicHash::Sha1).toHex().left(16);
+}
+
+bool InstanceServer::sendToRunningInstance(const QStringList &paths)
+{
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
+    if (!socket.waitForConnected(ConnectTimeoutMs)) {
+        return false;
+    }
+
+    QStringList absolutePaths;
+    for (const QString &path : paths) {
+        absolutePaths.append(QFileInfo(path).absoluteFilePath());
+    }
+
+    socket.write(absolutePaths.join('\n').toUtf8() + '\n');
+    const bool sent = socket.waitForBytesWritten(ConnectTimeoutMs);
+    socket.disconnectFromServer();
+    return sent;
+}
+
+bool InstanceServer::listen()
+{
+    if (m_server->listen(serverName())) {
+        return true;
+    }
+
+    // Another instance may have won the race, only a dead socket is removed
+    QLocalSocket probe;
+    probe.connectToServer(serverName());
+    if (probe.waitForConnected(ConnectTimeoutMs)) {
+        probe.disconnectFromServer();
+        return false;
+    }
+
+    // A crashed instance can leave a stale socket behind
+    QLocalServer::removeServer(serverName());
+    return m_server->listen(serverName());
+}
+
+void InstanceServer::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+            QStringList paths;
+            while (socket->canReadLine()) {
+                const QString path = QString::fromUtf8(socket->readLine()).trimmed();
+                if (!path.isEmpty()) {
+                    paths.append(path);
+                }
+            }
+            if (!paths.isEmpty()) {
+                emit archivesReceived(paths);
+            }
+        });
+    }
+}
@@ -1,11 +1,15 @@
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
+#include "headlessrunner.h"
+#include "instanceserver.h"
 #include "registryhelper.h"
+#include "zipextractor.h"
 
 #ifdef Q_OS_WIN
 #include <windows.h>
 #include <shellapi.h>
+#include <cstdio>
 #endif
 
 bool isRunningAsAdmin()
@@ -48,13 +52,88 @@ bool requestElevation()
 #endif
 }
 
+void attachParentConsole()
+{
+#ifdef Q_OS_WIN
+    // GUI subsystem binaries have no console, borrow the caller's one
+    if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+        freopen("CONOUT$", "w", stdout);
+        freopen("CONOUT$", "w", stderr);
+    }
+#endif
+}
+
+int runHeadless(int argc, char *argv[])
+{
+    attachParentConsole();
+
+    QCoreApplication app(argc, argv);
+
+    HeadlessRunner runner;
+    if (!runner.parse(app.arguments())) {
+        return 2;
+    }
+
+    runner.start();
+    return app.exec();
+}
+
 int main(int argc, char *argv[])
 {
+    // Command-line extraction never loads QML or touches the display
+    if (HeadlessRunner::isHeadless(argc, argv)) {
+        return runHeadless(argc, argv);
+    }
+
     QGuiApplication app(argc, argv);
 
-    QString zipFilePath;
-    if (argc > 1) {
-        zipFilePath = QString::fromLocal8Bit(argv[1]);
+    QStringList zipFilePaths;
+    for (int i = 1; i < argc; ++i) {
+        zipFilePaths.append(QString::fromLocal8Bit(argv[i]));
+    }
+    QString zipFilePath = zipFilePaths.value(0);
+
+    // The "Compress to ZIP" verb gets a progress window of its own; Explorer
+    // starts one instance per selected item, each makes its own archive
+    if (zipFilePath == "--compress") {
+        QQmlApplicationEngine engine;
+        engine.rootContext()->setContextProperty("initialSources", zipFilePaths.mid(1));
+        QObject::connect(
+            &engine,
+            &QQmlApplicationEngine::objectCreationFailed,
+            &app,
+            []() { QCoreApplication::exit(-1); },
+            Qt::QueuedConnection);
+        engine.loadFromModule("Odizinne.ZipExtract", "Compressor");
+        return app.exec();
+    }
+
+    // "--browse" opens an archive in the browser instead of extracting it
+    if (zipFilePath == "--browse") {
+        QQmlApplicationEngine engine;
+        engine.rootContext()->setContextProperty("initialZipPath", zipFilePaths.value(1));
+        QObject::connect(
+            &engine,
+            &QQmlApplicationEngine::objectCreationFailed,
+            &app,
+            []() { QCoreApplication::exit(-1); },
+            Qt::QueuedConnection);
+        engine.loadFromModule("Odizinne.ZipExtract", "Browser");
+        return app.exec();
+    }
+
+    // Later invocations hand their archives to the running instance and exit,
+    // so selecting many archives shares one process and one extraction queue
+    InstanceServer instanceServer;
+    if (!zipFilePath.isEmpty()) {
+        if (InstanceServer::sendToRunningInstance(zipFilePaths)) {
+            return 0;
+        }
+        if (!instanceServer.listen() && InstanceServer::sendToRunningInstance(zipFilePaths)) {
+            return 0;
+        }
+        QObject::connect(&instanceServer, &InstanceServer::archivesReceived,
+                         ZipExtractor::instance(), &ZipExtractor::enqueueExtractions);
     }
 
     // If no zip file provided, we're opening the main UI for context menu management
@@ -85,6 +164,7 @@ int main(int argc, char *argv[])
         engine.loadFromModule("Odizinne.ZipExtract", "Main");
     } else {
         engine.loadFromModule("Odizinne.ZipExtract", "Extractor");
+        ZipExtractor::instance()->enqueueExtractions(zipFilePaths.mid(1));
     }
 
     return app.exec();
@@ -0,0 +1,196 @@
+#include "memorygovernor.h"
+#include "canceltoken.h"
+#include <QMutexLocker>
+
+namespace {
+
+// Waiters poll the cancel token at this interval
+constexpr unsigned long WaitSliceMs = 20;
+
+}
+
+void MemoryGovernor::setBudget(qint64 bytes)
+{
+    m_budget = qMax<qint64>(0, bytes);
+    trimPool();
+}
+
+void MemoryGovernor::resetPeak()
+{
+    m_peak = m_inUse.load();
+}
+
+bool MemoryGovernor::tryAcquire(qint64 bytes)
+{
+    if (tryCharge(bytes)) {
+        return true;
+    }
+    // Pooled buffers are the first thing to give back
+    trimPool();
+    return tryCharge(bytes);
+}
+
+qint64 MemoryGovernor::acquire(qint64 bytes, const CancelToken *token)
+{
+    // The forced charges stay for the whole run, so nothing above what they
+    // leave could ever fit
+    if (m_budget > 0) {
+        bytes = qMin(bytes, qMax<qint64>(0, m_budget - m_forced.load()));
+    }
+
+    while (!tryAcquire(bytes)) {
+        if (token && token->isCancelled()) {
+            return -1;
+        }
+        QMutexLocker locker(&m_mutex);
+        m_released.wait(&m_mutex, WaitSliceMs);
+    }
+    return bytes;
+}
+
+MemoryGrant MemoryGovernor::force(qint64 bytes)
+{
+    m_forced.fetch_add(bytes);
+    updatePeak(m_inUse.fetch_add(bytes) + bytes);
+
+    MemoryGrant grant(this, bytes);
+    grant.m_forced = true;
+    return grant;
+}
+
+void MemoryGovernor::release(qint64 bytes)
+{
+    if (bytes <= 0) {
+        return;
+    }
+    m_inUse.fetch_sub(bytes);
+    if (m_budget > 0) {
+        QMutexLocker locker(&m_mutex);
+        m_released.wakeAll();
+    }
+}
+
+QByteArray MemoryGovernor::takeBuffer(qint64 size)
+{
+    {
+        // Smallest pooled buffer that is large enough
+        QMutexLocker locker(&m_mutex);
+        qsizetype best = -1;
+        for (qsizetype i = 0; i < m_pool.size(); ++i) {
+            if (m_pool[i].size() >= size && (best < 0 || m_pool[i].size() < m_pool[best].size())) {
+                best = i;
+            }
+        }
+        if (best >= 0) {
+            m_pooledBytes -= m_pool[best].size();
+            return m_pool.takeAt(best);
+        }
+    }
+
+    const qint64 rounded = qMax(BufferGranularity, (size + BufferGranularity - 1) / BufferGranularity * BufferGranularity);
+    if (!tryAcquire(rounded)) {
+        return QByteArray();
+    }
+    return QByteArray(rounded, Qt::Uninitialized);
+}
+
+void MemoryGovernor::returnBuffer(QByteArray &buffer)
+{
+    const qint64 size = buffer.size();
+    if (size == 0) {
+        return;
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        const qint64 limit = m_budget > 0 ? m_budget / 4 : UnlimitedPoolBytes;
+        if (m_pooledBytes + size <= limit) {
+            m_pooledBytes += size;
+            m_pool.append(std::move(buffer));
+            buffer = QByteArray();
+            return;
+        }
+    }
+
+    buffer = QByteArray();
+    release(size);
+}
+
+void MemoryGovernor::trimPool()
+{
+    qint64 freed;
+    {
+        QMutexLocker locker(&m_mutex);
+        freed = m_pooledBytes;
+        m_pool.clear();
+        m_pooledBytes = 0;
+    }
+    release(freed);
+}
+
+bool MemoryGovernor::tryCharge(qint64 bytes)
+{
+    if (m_budget == 0) {
+        updatePeak(m_inUse.fetch_add(bytes) + bytes);
+        return true;
+    }
+
+    qint64 used = m_inUse.load();
+    do {
+        if (used + bytes > m_budget) {
+            return false;
+        }
+    } while (!m_inUse.compare_exchange_weak(used, used + bytes));
+
+    updatePeak(used + bytes);
+    return true;
+}
+
+void MemoryGovernor::releaseForced(qint64 bytes)
+{
+    m_forced.fetch_sub(bytes);
+    release(bytes);
+}
+
+void MemoryGovernor::updatePeak(qint64 used)
+{
+    qint64 peak = m_peak.load(std::memory_order_relaxed);
+    while (used > peak && !m_peak.compare_exchange_weak(peak, used, std::memory_order_relaxed)) {
+    }
+}
+
+MemoryGrant::MemoryGrant(MemoryGrant &&other) noexcept
+    : m_governor(other.m_governor)
+    , m_bytes(other.m_bytes)
+    , m_forced(other.m_forced)
+{
+    other.m_governor = nullptr;
+    other.m_bytes = 0;
+    other.m_forced = false;
+}
+
+MemoryGrant &MemoryGrant::operator=(MemoryGrant &&other) noexcept
+{
+    if (this != &other) {
+        reset();
+        m_governor = other.m_governor;
+        m_bytes = other.m_bytes;
+        m_forced = other.m_forced;
+        other.m_governor = nullptr;
+        other.m_bytes = 0;
+        other.m_forced = false;
+    }
+    return *this;
+}
+
+void MemoryGrant::reset()
+{
+    if (m_governor && m_forced) {
+        m_governor->releaseForced(m_bytes);
+    } else if (m_governor) {
+        m_governor->release(m_bytes);
+    }
+    m_governor = nullptr;
+    m_bytes = 0;
+    m_forced = false;
+}
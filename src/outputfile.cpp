@@ -0,0 +1,246 @@
+#include "outputfile.h"
+#include <QDateTime>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#include <windows.h>
+#endif
+
+namespace {
+
+bool isZero(const char *data, qint64 size)
+{
+    static const char zeros[4096] = {};
+    while (size > 0) {
+        const qint64 chunk = qMin<qint64>(size, sizeof(zeros));
+        if (std::memcmp(data, zeros, size_t(chunk)) != 0) {
+            return false;
+        }
+        data += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool syncHandle(int handle)
+{
+#ifdef Q_OS_UNIX
+    return ::fsync(handle) == 0;
+#elif defined(Q_OS_WIN)
+    return FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(handle)));
+#else
+    Q_UNUSED(handle)
+    return true;
+#endif
+}
+
+}
+
+OutputFile::OutputFile(const QString &path)
+    : m_file(path)
+{
+}
+
+OutputFile::~OutputFile()
+{
+    m_file.close();
+}
+
+bool OutputFile::create(qint64 size)
+{
+    const QIODevice::OpenMode mode = QIODevice::WriteOnly | QIODevice::NewOnly | QIODevice::Unbuffered;
+    if (!m_file.open(mode) && !(QFile::remove(m_file.fileName()) && m_file.open(mode))) {
+        setErrorString(m_file.errorString());
+        return false;
+    }
+
+    m_offset = 0;
+    m_holeBytes = 0;
+    m_sparse = size >= SparseThreshold;
+    m_preallocated = false;
+    if (m_sparse) {
+        preallocate(size);
+    }
+    return QIODevice::open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+}
+
+void OutputFile::preallocate(qint64 size)
+{
+    // Reserving the whole file up front keeps it in few extents; where the
+    // filesystem cannot, it simply grows as it is written
+#ifdef Q_OS_LINUX
+    m_preallocated = ::fallocate(m_file.handle(), 0, 0, size) == 0;
+#elif defined(Q_OS_WIN)
+    m_preallocated = m_file.resize(size);
+#else
+    Q_UNUSED(size)
+#endif
+}
+
+bool OutputFile::finish(Durability durability)
+{
+    QIODevice::close();
+
+    // A file ending in a hole was never written up to its size
+    bool ok = m_file.size() >= m_offset || m_file.resize(m_offset);
+
+    // There is no unprivileged way to flush a whole volume on Windows, so
+    // syncing at the end there means syncing every file as it is closed
+#ifdef Q_OS_WIN
+    const bool syncNow = durability != NoSync;
+#else
+    const bool syncNow = durability == SyncEachFile;
+#endif
+    if (ok && syncNow) {
+        ok = syncHandle(m_file.handle());
+    }
+
+    m_file.close();
+    if (!ok || m_file.error() != QFileDevice::NoError) {
+        setErrorString(m_file.errorString());
+        return false;
+    }
+    return true;
+}
+
+void OutputFile::discard()
+{
+    QIODevice::close();
+    m_file.remove();
+}
+
+bool OutputFile::syncFileSystem(const QString &path)
+{
+#ifdef Q_OS_LINUX
+    const int handle = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (handle < 0) {
+        return false;
+    }
+    const bool ok = ::syncfs(handle) == 0;
+    ::close(handle);
+    return ok;
+#elif defined(Q_OS_UNIX)
+    Q_UNUSED(path)
+    ::sync();
+    return true;
+#else
+    Q_UNUSED(path)
+    return true;
+#endif
+}
+
+bool OutputFile::sync(QFile &file)
+{
+    return file.flush() && syncHandle(file.handle());
+}
+
+qint64 OutputFile::readData(char *data, qint64 maxSize)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(maxSize)
+    return -1;
+}
+
+qint64 OutputFile::writeData(const char *data, qint64 length)
+{
+    if (!m_sparse) {
+        return writeRange(data, length) ? length : -1;
+    }
+
+    // Scanned in filesystem-block steps; a zero run becomes a hole once it is
+    // long enough to be worth the extra seek
+    qint64 written = 0;
+    qint64 zeroStart = -1;
+    for (qint64 block = 0; block < length; block += ZeroBlockSize) {
+        if (isZero(data + block, qMin(ZeroBlockSize, length - block))) {
+            if (zeroStart < 0) {
+                zeroStart = block;
+            }
+            continue;
+        }
+        if (zeroStart >= 0 && block - zeroStart >= HoleBytes) {
+            if (!writeRange(data + written, zeroStart - written) || !skipRange(block - zeroStart)) {
+                return -1;
+            }
+            written = block;
+        }
+        zeroStart = -1;
+    }
+    if (zeroStart >= 0 && length - zeroStart >= HoleBytes) {
+        if (!writeRange(data + written, zeroStart - written) || !skipRange(length - zeroStart)) {
+            return -1;
+        }
+        written = length;
+    }
+    return writeRange(data + written, length - written) ? length : -1;
+}
+
+bool OutputFile::writeRange(const char *data, qint64 length)
+{
+    if (length > 0 && m_file.write(data, length) != length) {
+        setErrorString(m_file.errorString());
+        return false;
+    }
+    m_offset += length;
+    return true;
+}
+
+bool OutputFile::skipRange(qint64 length)
+{
+#ifdef Q_OS_LINUX
+    // Preallocated blocks read back as zeros either way; punching only gives
+    // the space back, where it is unsupported they simply stay allocated
+    if (m_preallocated) {
+        ::fallocate(m_file.handle(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, m_offset, length);
+    }
+#endif
+    if (!m_file.seek(m_offset + length)) {
+        setErrorString(m_file.errorString());
+        return false;
+    }
+    m_offset += length;
+    m_holeBytes += length;
+    return true;
+}
+
+void MetadataBatch::add(const QString &path, qint64 modified, quint16 mode)
+{
+    if (modified >= 0 || mode != 0) {
+        m_entries.append({ path, modified, mode });
+    }
+}
+
+void MetadataBatch::apply()
+{
+    for (const Entry &entry : std::as_const(m_entries)) {
+#ifdef Q_OS_UNIX
+        const QByteArray path = QFile::encodeName(entry.path);
+        if (entry.modified >= 0) {
+            const timespec times[2] = {
+                { 0, UTIME_OMIT },
+                { time_t(entry.modified / 1000), long(entry.modified % 1000) * 1000000 },
+            };
+            ::utimensat(AT_FDCWD, path.constData(), times, 0);
+        }
+        // Set-id and sticky bits from an archive are never applied
+        if (entry.mode != 0) {
+            ::chmod(path.constData(), entry.mode & 0777);
+        }
+#else
+        if (entry.modified >= 0) {
+            QFile file(entry.path);
+            if (file.open(QIODevice::Append)) {
+                file.setFileTime(QDateTime::fromMSecsSinceEpoch(entry.modified), QFileDevice::FileModificationTime);
+            }
+        }
+#endif
+    }
+    m_entries.clear();
+}
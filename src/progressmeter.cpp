@@ -0,0 +1,61 @@
+#include "progressmeter.h"
+#include <cmath>
+
+void ProgressMeter::reset()
+{
+    m_lastElapsed = -1;
+    m_lastWork = 0;
+    m_lastBytes = 0;
+    m_workRate = 0.0;
+    m_byteRate = 0.0;
+}
+
+void ProgressMeter::sample(qint64 elapsedMs, qint64 completedWork, qint64 completedBytes)
+{
+    if (m_lastElapsed < 0) {
+        m_lastElapsed = elapsedMs;
+        m_lastWork = completedWork;
+        m_lastBytes = completedBytes;
+        return;
+    }
+
+    const double seconds = (elapsedMs - m_lastElapsed) / 1000.0;
+    if (seconds <= 0.0) {
+        return;
+    }
+
+    const double workRate = (completedWork - m_lastWork) / seconds;
+    const double byteRate = (completedBytes - m_lastBytes) / seconds;
+
+    // The first real sample seeds the averages, later ones are blended in
+    // with a weight that depends on how much time they cover
+    if (m_workRate == 0.0 && m_byteRate == 0.0) {
+        m_workRate = workRate;
+        m_byteRate = byteRate;
+    } else {
+        const double alpha = 1.0 - std::exp(-seconds / SmoothingSeconds);
+        m_workRate += alpha * (workRate - m_workRate);
+        m_byteRate += alpha * (byteRate - m_byteRate);
+    }
+
+    m_lastElapsed = elapsedMs;
+    m_lastWork = completedWork;
+    m_lastBytes = completedBytes;
+}
+
+QString ProgressMeter::eta(qint64 remainingWork) const
+{
+    if (m_workRate <= 0.0) {
+        return m_lastElapsed < 0 ? QString("Calculating...") : QString("Unknown");
+    }
+
+    const int remainingSeconds = int(remainingWork / m_workRate);
+
+    if (remainingSeconds < 60) {
+        return QString("%1 seconds").arg(remainingSeconds);
+    }
+
+    int minutes = remainingSeconds / 60;
+    int seconds = remainingSeconds % 60;
+    return QString("%1:%2").arg(minutes).arg(seconds, 2, 10, QChar('0'));
+}
@@ -10,6 +10,13 @@
 RegistryHelper* RegistryHelper::s_instance = nullptr;
 
 const QString RegistryHelper::MENU_TEXT = "Extract Here";
+const QString RegistryHelper::COMPRESS_MENU_TEXT = "Compress to ZIP";
+
+// Files of any type and folders get the compress verb
+const QStringList RegistryHelper::COMPRESS_KEYS = {
+    "HKEY_CLASSES_ROOT\\*\\shell\\ZipExtractorCompress",
+    "HKEY_CLASSES_ROOT\\Directory\\shell\\ZipExtractorCompress",
+};
 
 RegistryHelper::RegistryHelper(QObject *parent)
     : QObject(parent)
@@ -93,6 +100,14 @@ bool RegistryHelper::registerContextMenu(const QString &appPath)
                    writeRegistryKey(baseKey, "Icon", QString("\"%1\",0").arg(normalizedAppPath)) &&
                    writeRegistryKey(commandKey, "", command);
 
+    QString compressCommand = QString("\"%1\" --compress \"%%1\"").arg(normalizedAppPath);
+    for (const QString &compressKey : COMPRESS_KEYS) {
+        success = success &&
+                  writeRegistryKey(compressKey, "", COMPRESS_MENU_TEXT) &&
+                  writeRegistryKey(compressKey, "Icon", QString("\"%1\",0").arg(normalizedAppPath)) &&
+                  writeRegistryKey(compressKey + "\\command", "", compressCommand);
+    }
+
     if (success)
         emit registrationChanged();
 
@@ -112,6 +127,9 @@ bool RegistryHelper::unregisterContextMenu()
 
     QString keyToDelete = QString("HKEY_CLASSES_ROOT\\%1\\shell\\ZipExtractor").arg(zipAssoc);
     bool success = deleteRegistryKey(keyToDelete);
+    for (const QString &compressKey : COMPRESS_KEYS) {
+        success = deleteRegistryKey(compressKey) && success;
+    }
 
     if (success)
         emit registrationChanged();
@@ -0,0 +1,154 @@
+#include "taskscheduler.h"
+#include <QMutexLocker>
+
+namespace {
+
+thread_local const void *t_scheduler = nullptr;
+thread_local int t_workerIndex = -1;
+
+}
+
+TaskScheduler::TaskScheduler(int threadCount)
+{
+    startThreads(threadCount);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    waitForDone();
+    stopThreads();
+}
+
+void TaskScheduler::setThreadCount(int count)
+{
+    if (count <= 0) {
+        count = QThread::idealThreadCount();
+    }
+    if (count == threadCount() || m_pending.load() > 0) {
+        return;
+    }
+
+    stopThreads();
+    startThreads(count);
+}
+
+void TaskScheduler::startThreads(int count)
+{
+    if (count <= 0) {
+        count = QThread::idealThreadCount();
+    }
+
+    m_stopping = false;
+    for (int i = 0; i < count; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < count; ++i) {
+        QThread *thread = QThread::create([this, i]() { run(i); });
+        thread->start();
+        m_threads.append(thread);
+    }
+}
+
+void TaskScheduler::stopThreads()
+{
+    {
+        QMutexLocker locker(&m_sleepMutex);
+        m_stopping = true;
+        m_wakeCondition.wakeAll();
+    }
+
+    for (QThread *thread : std::as_const(m_threads)) {
+        thread->wait();
+        delete thread;
+    }
+    m_threads.clear();
+    m_workers.clear();
+}
+
+void TaskScheduler::submit(Task task)
+{
+    m_pending.fetch_add(1);
+
+    // Workers keep their own spawn local, everybody else spreads round-robin
+    if (t_scheduler == this) {
+        Worker *worker = m_workers[t_workerIndex].get();
+        QMutexLocker locker(&worker->mutex);
+        worker->tasks.push_front(std::move(task));
+    } else {
+        Worker *worker = m_workers[m_nextWorker.fetch_add(1) % m_workers.size()].get();
+        QMutexLocker locker(&worker->mutex);
+        worker->tasks.push_back(std::move(task));
+    }
+
+    QMutexLocker locker(&m_sleepMutex);
+    m_queued.fetch_add(1);
+    m_wakeCondition.wakeOne();
+}
+
+void TaskScheduler::waitForDone()
+{
+    QMutexLocker locker(&m_sleepMutex);
+    while (m_pending.load() > 0) {
+        m_doneCondition.wait(&m_sleepMutex);
+    }
+}
+
+void TaskScheduler::run(int index)
+{
+    t_scheduler = this;
+    t_workerIndex = index;
+
+    Task task;
+    forever {
+        if (popLocal(index, task) || steal(index, task)) {
+            m_queued.fetch_sub(1);
+            task();
+            task = nullptr;
+
+            if (m_pending.fetch_sub(1) == 1) {
+                QMutexLocker locker(&m_sleepMutex);
+                m_doneCondition.wakeAll();
+            }
+            continue;
+        }
+
+        QMutexLocker locker(&m_sleepMutex);
+        if (m_stopping) {
+            break;
+        }
+        if (m_queued.load() == 0) {
+            m_wakeCondition.wait(&m_sleepMutex);
+        }
+    }
+
+    t_scheduler = nullptr;
+    t_workerIndex = -1;
+}
+
+bool TaskScheduler::popLocal(int index, Task &task)
+{
+    Worker *worker = m_workers[index].get();
+    QMutexLocker locker(&worker->mutex);
+    if (worker->tasks.empty()) {
+        return false;
+    }
+
+    task = std::move(worker->tasks.front());
+    worker->tasks.pop_front();
+    return true;
+}
+
+bool TaskScheduler::steal(int index, Task &task)
+{
+    const int count = int(m_workers.size());
+    for (int offset = 1; offset < count; ++offset) {
+        Worker *victim = m_workers[(index + offset) % count].get();
+        QMutexLocker locker(&victim->mutex);
+        if (!victim->tasks.empty()) {
+            task = std::move(victim->tasks.back());
+            victim->tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,282 @@
+#include "tracer.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <QVariantList>
+#include <algorithm>
+#include <chrono>
+
+std::atomic<bool> Tracer::s_enabled{false};
+thread_local Tracer::ThreadSlot Tracer::s_threadSlot;
+
+namespace {
+
+int bucketFor(qint64 durationNs)
+{
+    // Bucket n holds spans shorter than 2^n microseconds
+    const quint64 micros = quint64(durationNs / 1000);
+    int bucket = 0;
+    while (bucket < 31 && (quint64(1) << bucket) <= micros) {
+        ++bucket;
+    }
+    return bucket;
+}
+
+void addRelaxed(std::atomic<qint64> &counter, qint64 value)
+{
+    // Single writer, a plain load and store avoids a locked instruction
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+}
+
+Tracer &Tracer::instance()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+qint64 Tracer::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char *Tracer::phaseName(TracePhase phase)
+{
+    switch (phase) {
+    case TracePhase::Index:
+        return "index";
+    case TracePhase::Directories:
+        return "directories";
+    case TracePhase::Entry:
+        return "entry";
+    case TracePhase::Open:
+        return "open";
+    case TracePhase::Inflate:
+        return "inflate";
+    case TracePhase::Decrypt:
+        return "decrypt";
+    case TracePhase::Compress:
+        return "compress";
+    case TracePhase::Write:
+        return "write";
+    case TracePhase::Nested:
+        return "nested";
+    case TracePhase::Finalize:
+        return "finalize";
+    case TracePhase::Count:
+        break;
+    }
+    return "unknown";
+}
+
+void Tracer::setEnabled(bool enabled)
+{
+    if (enabled) {
+        reset();
+    }
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Tracer::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    m_epochNs = nowNs();
+    for (const auto &buffer : m_buffers) {
+        buffer->head.store(0, std::memory_order_relaxed);
+        for (PhaseStats &stats : buffer->phases) {
+            stats.count = 0;
+            stats.totalNs = 0;
+            stats.maxNs = 0;
+            stats.bytes = 0;
+            for (auto &bucket : stats.buckets) {
+                bucket = 0;
+            }
+        }
+    }
+}
+
+Tracer::ThreadBuffer *Tracer::threadBuffer()
+{
+    if (s_threadSlot.buffer) {
+        return s_threadSlot.buffer;
+    }
+
+    // First span on this thread, the only time recording takes the lock.
+    // Buffers outlive their threads so a finished run can still be exported,
+    // and a new thread carries on in one a finished thread left behind, so a
+    // pool that keeps replacing its workers holds as many rings as it ever
+    // ran threads at once.
+    QMutexLocker locker(&m_mutex);
+    if (!m_freeBuffers.empty()) {
+        s_threadSlot.buffer = m_freeBuffers.back();
+        m_freeBuffers.pop_back();
+        return s_threadSlot.buffer;
+    }
+    locker.unlock();
+
+    auto buffer = std::make_unique<ThreadBuffer>();
+    buffer->events.resize(RingCapacity);
+
+    locker.relock();
+    buffer->threadId = int(m_buffers.size()) + 1;
+    s_threadSlot.buffer = buffer.get();
+    m_buffers.push_back(std::move(buffer));
+    return s_threadSlot.buffer;
+}
+
+Tracer::ThreadSlot::~ThreadSlot()
+{
+    if (buffer) {
+        Tracer &tracer = Tracer::instance();
+        QMutexLocker locker(&tracer.m_mutex);
+        tracer.m_freeBuffers.push_back(buffer);
+    }
+}
+
+void Tracer::record(TracePhase phase, qint64 startNs, qint64 endNs, qint64 bytes, qint64 detail)
+{
+    ThreadBuffer *buffer = threadBuffer();
+    const qint64 durationNs = endNs - startNs;
+
+    const quint64 head = buffer->head.load(std::memory_order_relaxed);
+    buffer->events[head % RingCapacity] = { startNs, durationNs, bytes, detail, phase };
+    buffer->head.store(head + 1, std::memory_order_release);
+
+    PhaseStats &stats = buffer->phases[int(phase)];
+    addRelaxed(stats.count, 1);
+    addRelaxed(stats.totalNs, durationNs);
+    addRelaxed(stats.bytes, bytes);
+    addRelaxed(stats.buckets[bucketFor(durationNs)], 1);
+    if (durationNs > stats.maxNs.load(std::memory_order_relaxed)) {
+        stats.maxNs.store(durationNs, std::memory_order_relaxed);
+    }
+}
+
+QVariantMap Tracer::summary() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    QVariantMap phases;
+    qint64 droppedEvents = 0;
+    for (int phase = 0; phase < PhaseCount; ++phase) {
+        qint64 count = 0;
+        qint64 totalNs = 0;
+        qint64 maxNs = 0;
+        qint64 bytes = 0;
+        qint64 buckets[HistogramBuckets] = {};
+        for (const auto &buffer : m_buffers) {
+            const PhaseStats &stats = buffer->phases[phase];
+            count += stats.count.load(std::memory_order_relaxed);
+            totalNs += stats.totalNs.load(std::memory_order_relaxed);
+            maxNs = qMax(maxNs, stats.maxNs.load(std::memory_order_relaxed));
+            bytes += stats.bytes.load(std::memory_order_relaxed);
+            for (int i = 0; i < HistogramBuckets; ++i) {
+                buckets[i] += stats.buckets[i].load(std::memory_order_relaxed);
+            }
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        // Percentiles are the upper bound of the bucket they fall in
+        auto percentile = [&](double fraction) {
+            const qint64 rank = qint64(fraction * count);
+            qint64 seen = 0;
+            for (int i = 0; i < HistogramBuckets; ++i) {
+                seen += buckets[i];
+                if (seen > rank) {
+                    return qint64(1) << i;
+                }
+            }
+            return qint64(1) << (HistogramBuckets - 1);
+        };
+
+        int lastBucket = HistogramBuckets - 1;
+        while (lastBucket > 0 && buckets[lastBucket] == 0) {
+            --lastBucket;
+        }
+        QVariantList histogram;
+        for (int i = 0; i <= lastBucket; ++i) {
+            histogram.append(buckets[i]);
+        }
+
+        QVariantMap stats;
+        stats["count"] = count;
+        stats["totalMs"] = totalNs / 1e6;
+        stats["bytes"] = bytes;
+        stats["p50Us"] = percentile(0.50);
+        stats["p90Us"] = percentile(0.90);
+        stats["p99Us"] = percentile(0.99);
+        stats["maxUs"] = maxNs / 1000;
+        stats["histogramLog2Us"] = histogram;
+        phases[phaseName(TracePhase(phase))] = stats;
+    }
+
+    for (const auto &buffer : m_buffers) {
+        droppedEvents += qMax<qint64>(0, qint64(buffer->head.load(std::memory_order_acquire)) - RingCapacity);
+    }
+
+    QVariantMap summary;
+    summary["phases"] = phases;
+    summary["droppedEvents"] = droppedEvents;
+    return summary;
+}
+
+bool Tracer::exportChromeTrace(const QString &path, QString *error) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (error) {
+            *error = file.errorString();
+        }
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    // Written by hand, a QJsonDocument of a million spans would not fit the
+    // memory budget of the run being traced
+    QByteArray out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto &buffer : m_buffers) {
+        const quint64 head = buffer->head.load(std::memory_order_acquire);
+        if (head == 0) {
+            continue;
+        }
+
+        out += first ? "" : ",\n";
+        first = false;
+        out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + QByteArray::number(buffer->threadId)
+               + ",\"args\":{\"name\":\"thread " + QByteArray::number(buffer->threadId) + "\"}}";
+
+        // Only the newest RingCapacity spans survive on a busy thread
+        const quint64 begin = head > quint64(RingCapacity) ? head - RingCapacity : 0;
+        for (quint64 i = begin; i < head; ++i) {
+            const Event &event = buffer->events[i % RingCapacity];
+            out += ",\n{\"name\":\"";
+            out += phaseName(event.phase);
+            out += "\",\"cat\":\"extract\",\"ph\":\"X\",\"pid\":1,\"tid\":" + QByteArray::number(buffer->threadId);
+            out += ",\"ts\":" + QByteArray::number((event.startNs - m_epochNs) / 1000.0, 'f', 3);
+            out += ",\"dur\":" + QByteArray::number(event.durationNs / 1000.0, 'f', 3);
+            out += ",\"args\":{\"bytes\":" + QByteArray::number(event.bytes);
+            if (event.detail >= 0) {
+                out += ",\"entry\":" + QByteArray::number(event.detail);
+            }
+            out += "}}";
+
+            if (out.size() > 1024 * 1024) {
+                file.write(out);
+                out.clear();
+            }
+        }
+    }
+    out += "\n]}\n";
+
+    if (file.write(out) != out.size() || !file.flush()) {
+        if (error) {
+            *error = file.errorString();
+        }
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,423 @@
+#include "ziparchive.h"
+#include <QDir>
+#include <QtEndian>
+#include <limits>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr quint32 EndOfCentralDirSignature = 0x06054b50;
+constexpr quint32 Zip64EndOfCentralDirSignature = 0x06064b50;
+constexpr quint32 Zip64LocatorSignature = 0x07064b50;
+constexpr quint32 CentralHeaderSignature = 0x02014b50;
+constexpr quint32 LocalHeaderSignature = 0x04034b50;
+
+constexpr int EndOfCentralDirSize = 22;
+constexpr int CentralHeaderSize = 46;
+constexpr int LocalHeaderSize = 30;
+constexpr int Zip64EndOfCentralDirSize = 56;
+constexpr int Zip64LocatorSize = 20;
+
+constexpr quint16 Zip64ExtraId = 0x0001;
+
+constexpr quint16 FlagUtf8 = 0x0800;
+
+constexpr quint8 HostUnix = 3;
+
+quint16 readU16(const uchar *data)
+{
+    return qFromLittleEndian<quint16>(data);
+}
+
+quint32 readU32(const uchar *data)
+{
+    return qFromLittleEndian<quint32>(data);
+}
+
+quint64 readU64(const uchar *data)
+{
+    return qFromLittleEndian<quint64>(data);
+}
+
+#ifdef Q_OS_UNIX
+qint64 pageSize()
+{
+    static const qint64 size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+#endif
+
+}
+
+ZipArchive::~ZipArchive()
+{
+    close();
+}
+
+bool ZipArchive::open(const QString &path)
+{
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    m_size = m_file.size();
+    m_data = m_size > 0 ? m_file.map(0, m_size) : nullptr;
+    if (!m_data || !parseCentralDirectory()) {
+        close();
+        return false;
+    }
+
+#ifdef Q_OS_LINUX
+    // Entries are read in offset order, so a larger read-ahead window pays off
+    posix_fadvise(m_file.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return true;
+}
+
+bool ZipArchive::open(const QByteArray &data)
+{
+    close();
+
+    m_buffer = data;
+    m_data = reinterpret_cast<const uchar *>(m_buffer.constData());
+    m_size = m_buffer.size();
+    if (m_size == 0 || !parseCentralDirectory()) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void ZipArchive::close()
+{
+    if (m_data && m_file.isOpen()) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+    }
+    m_file.close();
+    m_buffer.clear();
+
+    m_data = nullptr;
+    m_size = 0;
+    m_centralDirectory = nullptr;
+
+    m_nameOffsets.clear();
+    m_nameLengths.clear();
+    m_methods.clear();
+    m_flags.clear();
+    m_crcs.clear();
+    m_modTimes.clear();
+    m_compressedSizes.clear();
+    m_uncompressedSizes.clear();
+    m_localHeaderOffsets.clear();
+}
+
+QByteArrayView ZipArchive::rawName(qsizetype index) const
+{
+    return QByteArrayView(m_centralDirectory + m_nameOffsets[index], m_nameLengths[index]);
+}
+
+QString ZipArchive::name(qsizetype index) const
+{
+    const QByteArrayView raw = rawName(index);
+    if (m_flags[index] & FlagUtf8) {
+        return QString::fromUtf8(raw);
+    }
+    return QString::fromLocal8Bit(raw);
+}
+
+QString ZipArchive::safePath(const QString &name)
+{
+    QString path = name;
+    path.replace('\\', '/');
+    if (path.size() >= 2 && path[1] == ':' && path[0].isLetter()) {
+        path.remove(0, 2);
+    }
+    while (path.startsWith('/')) {
+        path.remove(0, 1);
+    }
+
+    // What cleanPath cannot resolve is left as leading "..", and on Windows
+    // "a/../C:/x" only becomes absolute once it has been cleaned
+    path = QDir::cleanPath(path);
+    if (path.isEmpty() || path == "." || path == ".." || path.startsWith("../") || QDir::isAbsolutePath(path)) {
+        return QString();
+    }
+    return path;
+}
+
+bool ZipArchive::isDir(qsizetype index) const
+{
+    const QByteArrayView raw = rawName(index);
+    return !raw.isEmpty() && (raw.back() == '/' || raw.back() == '\\');
+}
+
+quint16 ZipArchive::unixMode(qsizetype index) const
+{
+    // Read from the central header, which ends right where the name starts
+    const uchar *header = m_centralDirectory + m_nameOffsets[index] - CentralHeaderSize;
+    if ((readU16(header + 4) >> 8) != HostUnix) {
+        return 0;
+    }
+    return quint16(readU32(header + 38) >> 16) & 07777;
+}
+
+QByteArrayView ZipArchive::extraField(qsizetype index, quint16 id) const
+{
+    const uchar *header = m_centralDirectory + m_nameOffsets[index] - CentralHeaderSize;
+    const uchar *extra = header + CentralHeaderSize + m_nameLengths[index];
+    const quint16 length = readU16(header + 30);
+
+    // Field lengths were not checked while indexing, a record running past
+    // the extra field ends the search
+    quint16 pos = 0;
+    while (pos + 4 <= length) {
+        const quint16 size = readU16(extra + pos + 2);
+        if (pos + 4 + size > length) {
+            break;
+        }
+        if (readU16(extra + pos) == id) {
+            return QByteArrayView(extra + pos + 4, size);
+        }
+        pos += 4 + size;
+    }
+    return QByteArrayView();
+}
+
+QDateTime ZipArchive::lastModified(qsizetype index) const
+{
+    // Time in the low half, date in the high half, two-second resolution
+    const quint32 dos = m_modTimes[index];
+    const QDate date(1980 + (dos >> 25), (dos >> 21) & 0xf, (dos >> 16) & 0x1f);
+    const QTime time((dos >> 11) & 0x1f, (dos >> 5) & 0x3f, (dos & 0x1f) * 2);
+    if (!date.isValid() || !time.isValid()) {
+        return QDateTime();
+    }
+    return QDateTime(date, time);
+}
+
+bool ZipArchive::hasSignature(QByteArrayView head)
+{
+    return head.startsWith("PK\x03\x04") || head.startsWith("PK\x05\x06");
+}
+
+const uchar *ZipArchive::entryData(qsizetype index) const
+{
+    const qint64 offset = m_localHeaderOffsets[index];
+    if (offset < 0 || offset + LocalHeaderSize > m_size) {
+        return nullptr;
+    }
+
+    const uchar *header = m_data + offset;
+    if (readU32(header) != LocalHeaderSignature) {
+        return nullptr;
+    }
+
+    const qint64 dataOffset = offset + LocalHeaderSize + readU16(header + 26) + readU16(header + 28);
+    if (dataOffset + m_compressedSizes[index] > m_size) {
+        return nullptr;
+    }
+
+    return m_data + dataOffset;
+}
+
+qint64 ZipArchive::dataEnd(qsizetype index) const
+{
+    const uchar *data = entryData(index);
+    return data ? data - m_data + m_compressedSizes[index] : -1;
+}
+
+void ZipArchive::willNeed(qint64 offset, qint64 length) const
+{
+#ifdef Q_OS_UNIX
+    if (!m_file.isOpen() || offset >= m_size) {
+        return;
+    }
+    // Widened to whole pages, the mapping starts on one
+    const qint64 start = offset & ~(pageSize() - 1);
+    const qint64 end = qMin(offset + length, m_size);
+    madvise(const_cast<uchar *>(m_data) + start, size_t(end - start), MADV_WILLNEED);
+#else
+    Q_UNUSED(offset)
+    Q_UNUSED(length)
+#endif
+}
+
+void ZipArchive::dropBehind(qint64 offset, qint64 length) const
+{
+#ifdef Q_OS_UNIX
+    if (!m_file.isOpen()) {
+        return;
+    }
+    // Narrowed to whole pages, so data next to the range that another worker
+    // may still be reading is kept
+    const qint64 page = pageSize();
+    const qint64 start = (offset + page - 1) & ~(page - 1);
+    const qint64 end = qMin(offset + length, m_size) & ~(page - 1);
+    if (end <= start) {
+        return;
+    }
+    // Pages stay cached while they are mapped, so unmap them from this
+    // process first; a later access simply faults them back in
+    madvise(const_cast<uchar *>(m_data) + start, size_t(end - start), MADV_DONTNEED);
+#ifdef Q_OS_LINUX
+    posix_fadvise(m_file.handle(), start, end - start, POSIX_FADV_DONTNEED);
+#endif
+#else
+    Q_UNUSED(offset)
+    Q_UNUSED(length)
+#endif
+}
+
+bool ZipArchive::parseCentralDirectory()
+{
+    if (m_size < EndOfCentralDirSize) {
+        return false;
+    }
+
+    // The end of central directory record sits in the last 64 KiB + 22 bytes
+    const uchar *eocd = nullptr;
+    qint64 eocdOffset = 0;
+    const qint64 lowest = qMax<qint64>(0, m_size - 0xffff - EndOfCentralDirSize);
+    for (qint64 pos = m_size - EndOfCentralDirSize; pos >= lowest; --pos) {
+        if (readU32(m_data + pos) == EndOfCentralDirSignature) {
+            eocd = m_data + pos;
+            eocdOffset = pos;
+            break;
+        }
+    }
+    if (!eocd) {
+        return false;
+    }
+
+    quint64 entryCount = readU16(eocd + 10);
+    quint64 directorySize = readU32(eocd + 12);
+    quint64 directoryOffset = readU32(eocd + 16);
+
+    // Zip64 archives put a locator right before the classic record, pointing
+    // at a second record with 64-bit counts, size and offset
+    const qint64 locatorOffset = eocdOffset - Zip64LocatorSize;
+    if (locatorOffset >= 0 && readU32(m_data + locatorOffset) == Zip64LocatorSignature) {
+        const quint64 recordOffset = readU64(m_data + locatorOffset + 8);
+        if (locatorOffset < Zip64EndOfCentralDirSize || recordOffset > quint64(locatorOffset - Zip64EndOfCentralDirSize)) {
+            return false;
+        }
+        const uchar *record = m_data + recordOffset;
+        if (readU32(record) != Zip64EndOfCentralDirSignature) {
+            return false;
+        }
+        entryCount = readU64(record + 32);
+        directorySize = readU64(record + 40);
+        directoryOffset = readU64(record + 48);
+    }
+
+    if (directoryOffset > quint64(m_size) || directorySize > quint64(m_size) - directoryOffset) {
+        return false;
+    }
+    // Every record takes at least CentralHeaderSize bytes, which bounds a
+    // forged entry count before anything is reserved
+    if (entryCount > directorySize / CentralHeaderSize) {
+        return false;
+    }
+
+    m_centralDirectory = m_data + directoryOffset;
+
+    m_nameOffsets.reserve(qsizetype(entryCount));
+    m_nameLengths.reserve(qsizetype(entryCount));
+    m_methods.reserve(qsizetype(entryCount));
+    m_flags.reserve(qsizetype(entryCount));
+    m_crcs.reserve(qsizetype(entryCount));
+    m_modTimes.reserve(qsizetype(entryCount));
+    m_compressedSizes.reserve(qsizetype(entryCount));
+    m_uncompressedSizes.reserve(qsizetype(entryCount));
+    m_localHeaderOffsets.reserve(qsizetype(entryCount));
+
+    quint64 pos = 0;
+    for (quint64 i = 0; i < entryCount; ++i) {
+        if (pos + CentralHeaderSize > directorySize) {
+            return false;
+        }
+
+        const uchar *header = m_centralDirectory + pos;
+        if (readU32(header) != CentralHeaderSignature) {
+            return false;
+        }
+
+        const quint16 nameLength = readU16(header + 28);
+        const quint16 extraLength = readU16(header + 30);
+        const quint32 recordSize = CentralHeaderSize + nameLength + extraLength + readU16(header + 32);
+        if (pos + recordSize > directorySize) {
+            return false;
+        }
+
+        quint64 compressedSize = readU32(header + 20);
+        quint64 uncompressedSize = readU32(header + 24);
+        quint64 localHeaderOffset = readU32(header + 42);
+
+        // Fields saturated at 0xffffffff continue in the Zip64 extra field,
+        // in a fixed order and only for the fields that overflowed
+        if (compressedSize == 0xffffffff || uncompressedSize == 0xffffffff || localHeaderOffset == 0xffffffff) {
+            if (!readZip64Extra(header + CentralHeaderSize + nameLength, extraLength,
+                                uncompressedSize, compressedSize, localHeaderOffset)) {
+                return false;
+            }
+        }
+        if (compressedSize > quint64(m_size) || localHeaderOffset > quint64(m_size)) {
+            return false;
+        }
+
+        m_nameOffsets.append(pos + CentralHeaderSize);
+        m_nameLengths.append(nameLength);
+        m_flags.append(readU16(header + 8));
+        m_methods.append(readU16(header + 10));
+        m_crcs.append(readU32(header + 16));
+        m_modTimes.append(readU32(header + 12));
+        m_compressedSizes.append(qint64(compressedSize));
+        m_uncompressedSizes.append(qint64(qMin<quint64>(uncompressedSize, std::numeric_limits<qint64>::max())));
+        m_localHeaderOffsets.append(qint64(localHeaderOffset));
+
+        pos += recordSize;
+    }
+
+    return true;
+}
+
+bool ZipArchive::readZip64Extra(const uchar *extra, quint16 length, quint64 &uncompressedSize,
+                                quint64 &compressedSize, quint64 &localHeaderOffset)
+{
+    quint16 pos = 0;
+    while (pos + 4 <= length) {
+        const quint16 id = readU16(extra + pos);
+        const quint16 size = readU16(extra + pos + 2);
+        if (pos + 4 + size > length) {
+            return false;
+        }
+
+        if (id == Zip64ExtraId) {
+            const uchar *field = extra + pos + 4;
+            quint16 used = 0;
+            for (quint64 *value : { &uncompressedSize, &compressedSize, &localHeaderOffset }) {
+                if (*value != 0xffffffff) {
+                    continue;
+                }
+                if (used + 8 > size) {
+                    return false;
+                }
+                *value = readU64(field + used);
+                used += 8;
+            }
+            return true;
+        }
+
+        pos += 4 + size;
+    }
+    return false;
+}
@@ -0,0 +1,335 @@
+#include "zipcreator.h"
+#include "checksum.h"
+#include "entryencoder.h"
+#include "tracer.h"
+#include <QDir>
+#include <QFileInfo>
+
+ZipCreator* ZipCreator::s_instance = nullptr;
+
+namespace {
+
+// Same weighting as extraction: a fixed cost per entry on top of its bytes
+constexpr qint64 EntryOverheadBytes = 32 * 1024;
+
+constexpr int RefreshIntervalMs = 100;
+
+constexpr quint16 MethodStored = 0;
+constexpr quint16 MethodDeflated = 8;
+constexpr quint16 MethodZstd = 93;
+
+}
+
+ZipCreator::ZipCreator(QObject *parent)
+    : QObject(parent)
+    , m_engine(new CompressionEngine(this))
+    , m_refreshTimer(new QTimer(this))
+    , m_etaTimer(new QTimer(this))
+{
+    connect(m_engine, &CompressionEngine::finished, this, &ZipCreator::onEngineFinished);
+
+    m_refreshTimer->setInterval(RefreshIntervalMs);
+    connect(m_refreshTimer, &QTimer::timeout, this, &ZipCreator::refreshProgress);
+
+    m_etaTimer->setInterval(1000);
+    connect(m_etaTimer, &QTimer::timeout, this, &ZipCreator::updateETA);
+}
+
+ZipCreator* ZipCreator::create(QQmlEngine *qmlEngine, QJSEngine *jsEngine)
+{
+    Q_UNUSED(qmlEngine)
+    Q_UNUSED(jsEngine)
+
+    if (!s_instance) {
+        s_instance = new ZipCreator();
+    }
+    return s_instance;
+}
+
+ZipCreator* ZipCreator::instance()
+{
+    if (!s_instance) {
+        s_instance = new ZipCreator();
+    }
+    return s_instance;
+}
+
+QString ZipCreator::defaultArchivePath(const QStringList &sources)
+{
+    if (sources.isEmpty()) {
+        return QString();
+    }
+
+    // One source names the archive, several take the name of their folder
+    const QFileInfo first(sources.first());
+    const QString folder = first.absolutePath();
+    QString name = sources.size() == 1 ? (first.isDir() ? first.fileName() : first.completeBaseName())
+                                       : QFileInfo(folder).fileName();
+    if (name.isEmpty()) {
+        name = "Archive";
+    }
+
+    // Never overwrite an existing archive by default
+    QString path = folder + "/" + name + ".zip";
+    for (int copy = 2; QFileInfo::exists(path); ++copy) {
+        path = QString("%1/%2 (%3).zip").arg(folder, name).arg(copy);
+    }
+    return path;
+}
+
+bool ZipCreator::startCreation(const QStringList &sources, const QString &zipPath)
+{
+    if (m_isCreating || sources.isEmpty()) {
+        return false;
+    }
+
+    resetProgress();
+    m_sources = sources;
+    m_zipPath = zipPath.isEmpty() ? defaultArchivePath(sources) : zipPath;
+    m_isCreating = true;
+    emit isCreatingChanged();
+
+    if (Tracer::isEnabled()) {
+        Tracer::instance().reset();
+    }
+
+    m_elapsedTimer.start();
+    m_refreshTimer->start();
+    m_etaTimer->start();
+    m_engine->start(m_sources, m_zipPath);
+    return true;
+}
+
+void ZipCreator::refreshProgress()
+{
+    if (!m_isCreating) {
+        return;
+    }
+
+    const CompressionEngine::Progress snapshot = m_engine->progress();
+
+    // Totals grow while the sources are being listed
+    if (snapshot.totalFiles != m_totalFiles) {
+        m_totalFiles = snapshot.totalFiles;
+        emit totalFilesChanged();
+    }
+
+    if (snapshot.completedFiles != m_currentFile) {
+        m_currentFile = snapshot.completedFiles;
+        emit currentFileChanged();
+    }
+
+    if (snapshot.currentFile != m_currentFileName) {
+        m_currentFileName = snapshot.currentFile;
+        emit currentFileNameChanged();
+    }
+
+    const qint64 totalWork = snapshot.totalBytes + snapshot.totalFiles * EntryOverheadBytes;
+    const qint64 completedWork = snapshot.completedBytes + snapshot.completedFiles * EntryOverheadBytes;
+    m_remainingWork = qMax<qint64>(0, totalWork - completedWork);
+
+    const double progress = totalWork > 0 ? qMin(100.0, (double)completedWork / totalWork * 100.0) : 0.0;
+    if (progress != m_progress) {
+        m_progress = progress;
+        emit progressChanged();
+    }
+
+    m_meter.sample(m_elapsedTimer.elapsed() - m_pausedMs, completedWork, snapshot.completedBytes);
+
+    const double throughput = m_meter.bytesPerSecond() / (1024.0 * 1024.0);
+    if (throughput != m_throughput) {
+        m_throughput = throughput;
+        emit throughputChanged();
+    }
+}
+
+void ZipCreator::onEngineFinished(bool success, bool cancelled)
+{
+    // A cancel has already been reported by cancelCreation()
+    if (!m_isCreating || cancelled) {
+        return;
+    }
+
+    m_engine->waitForDone();
+    refreshProgress();
+    m_finalProgress = m_engine->progress();
+    m_wallMs = m_elapsedTimer.elapsed();
+    m_error = m_engine->errorString();
+
+    if (!success) {
+        finishCreation(false, m_error.isEmpty() ? QString("Archive creation failed") : m_error);
+        return;
+    }
+
+    if (m_progress < 100.0) {
+        m_progress = 100.0;
+        emit progressChanged();
+    }
+    finishCreation(true, "Archive created successfully");
+}
+
+void ZipCreator::finishCreation(bool success, const QString &message)
+{
+    m_isCreating = false;
+    m_refreshTimer->stop();
+    m_etaTimer->stop();
+
+    emit isCreatingChanged();
+    emit creationFinished(success, message);
+}
+
+void ZipCreator::updateETA()
+{
+    m_eta = m_meter.eta(m_remainingWork);
+    emit etaChanged();
+}
+
+QVariantMap ZipCreator::stats() const
+{
+    const double seconds = m_wallMs / 1000.0;
+
+    QVariantMap phases;
+    phases["scanMs"] = m_engine->scanMs();
+    phases["compressMs"] = qMax<qint64>(0, m_wallMs - m_engine->scanMs());
+
+    QVariantMap stats;
+    stats["archive"] = m_zipPath;
+    stats["sources"] = m_sources;
+    stats["threads"] = m_engine->threadCount();
+    stats["method"] = method();
+    stats["level"] = m_engine->level();
+    stats["blockSize"] = m_engine->blockSize();
+    stats["entries"] = m_finalProgress.completedFiles;
+    stats["pausedMs"] = m_pausedMs;
+    if (m_cancelLatencyMs >= 0) {
+        stats["cancelLatencyMs"] = m_cancelLatencyMs;
+    }
+    if (!m_error.isEmpty()) {
+        stats["error"] = m_error;
+    }
+    stats["crc32"] = Crc32::implementation();
+    stats["bytesIn"] = m_finalProgress.completedBytes;
+    stats["bytesOut"] = m_finalProgress.writtenBytes;
+    stats["ratio"] = m_finalProgress.completedBytes > 0
+        ? double(m_finalProgress.writtenBytes) / m_finalProgress.completedBytes : 0.0;
+    stats["wallMs"] = m_wallMs;
+    stats["mbPerSecond"] = seconds > 0 ? m_finalProgress.completedBytes / (1024.0 * 1024.0) / seconds : 0.0;
+    stats["phases"] = phases;
+    if (Tracer::isEnabled()) {
+        stats["trace"] = Tracer::instance().summary();
+    }
+    return stats;
+}
+
+QString ZipCreator::method() const
+{
+    switch (m_engine->method()) {
+    case MethodStored:
+        return "store";
+    case MethodZstd:
+        return "zstd";
+    default:
+        return "deflate";
+    }
+}
+
+void ZipCreator::setMethod(const QString &method)
+{
+    quint16 value;
+    if (method == "store") {
+        value = MethodStored;
+    } else if (method == "deflate") {
+        value = MethodDeflated;
+    } else if (method == "zstd") {
+        value = MethodZstd;
+    } else {
+        return;
+    }
+
+    if (value != m_engine->method() && m_engine->setMethod(value)) {
+        emit methodChanged();
+    }
+}
+
+void ZipCreator::setLevel(int level)
+{
+    level = qMax(-1, level);
+    if (level != m_engine->level()) {
+        m_engine->setLevel(level);
+        emit levelChanged();
+    }
+}
+
+void ZipCreator::pauseCreation()
+{
+    if (m_isCreating && !m_isPaused) {
+        m_engine->pause();
+        m_pauseTimer.start();
+        m_refreshTimer->stop();
+        m_etaTimer->stop();
+        setPaused(true);
+    }
+}
+
+void ZipCreator::resumeCreation()
+{
+    if (m_isCreating && m_isPaused) {
+        m_pausedMs += m_pauseTimer.elapsed();
+        m_engine->resume();
+        m_refreshTimer->start();
+        m_etaTimer->start();
+        setPaused(false);
+    }
+}
+
+void ZipCreator::setPaused(bool paused)
+{
+    if (paused != m_isPaused) {
+        m_isPaused = paused;
+        emit isPausedChanged();
+    }
+}
+
+void ZipCreator::cancelCreation()
+{
+    if (m_isCreating) {
+        // The partial archive is discarded before this returns
+        QElapsedTimer latency;
+        latency.start();
+        m_engine->cancel();
+        m_engine->waitForDone();
+        m_cancelLatencyMs = latency.elapsed();
+
+        m_finalProgress = m_engine->progress();
+        m_wallMs = m_elapsedTimer.elapsed();
+        if (m_isPaused) {
+            m_pausedMs += m_pauseTimer.elapsed();
+            setPaused(false);
+        }
+        finishCreation(false, "Archive creation cancelled by user");
+    }
+}
+
+void ZipCreator::resetProgress()
+{
+    m_currentFile = 0;
+    m_totalFiles = 0;
+    m_currentFileName = "";
+    m_progress = 0.0;
+    m_eta = "Calculating...";
+    m_throughput = 0.0;
+    m_remainingWork = 0;
+    m_meter.reset();
+    m_wallMs = 0;
+    m_finalProgress = CompressionEngine::Progress();
+    m_error.clear();
+    m_pausedMs = 0;
+    m_cancelLatencyMs = -1;
+
+    emit currentFileChanged();
+    emit totalFilesChanged();
+    emit currentFileNameChanged();
+    emit progressChanged();
+    emit etaChanged();
+    emit throughputChanged();
+}
@@ -0,0 +1,237 @@
+#include "zipentrystream.h"
+#include "checksum.h"
+#include "tracer.h"
+#include <QScopeGuard>
+#include <optional>
+
+namespace {
+
+constexpr quint16 MethodStored = 0;
+constexpr quint16 MethodDeflated = 8;
+
+// Whole-buffer backends take 32-bit input sizes
+constexpr qint64 MaxInputSlice = 1 << 30;
+
+}
+
+ZipEntryStream::ZipEntryStream()
+    : m_output(OutputBufferSize, Qt::Uninitialized)
+    , m_backend(InflateBackend::create())
+{
+}
+
+ZipEntryStream::~ZipEntryStream() = default;
+
+void ZipEntryStream::setCounters(std::atomic<qint64> *inputBytes, std::atomic<qint64> *outputBytes)
+{
+    m_inputBytes = inputBytes;
+    m_outputBytes = outputBytes;
+}
+
+bool ZipEntryStream::extract(const ZipArchive &archive, qsizetype index, QIODevice *out)
+{
+    m_error.clear();
+    m_crc = 0;
+    m_produced = 0;
+
+    const uchar *data = archive.entryData(index);
+    if (!data) {
+        m_error = "Damaged local header";
+        return false;
+    }
+
+    qint64 compressedSize = archive.compressedSize(index);
+    const qint64 uncompressedSize = archive.uncompressedSize(index);
+    quint16 method = archive.method(index);
+
+    EntryInput plainInput(data, compressedSize);
+    std::optional<DecryptingInput> decryptingInput;
+    const bool encrypted = archive.flags(index) & EntryDecryptor::EncryptedFlag;
+    if (encrypted) {
+        if (!m_decryptor.begin(archive, index)) {
+            m_error = m_decryptor.errorString();
+            return false;
+        }
+        if (m_decrypted.isEmpty()) {
+            m_decrypted.resize(OutputBufferSize);
+        }
+        method = m_decryptor.method();
+        compressedSize = m_decryptor.payloadSize();
+        decryptingInput.emplace(m_decryptor, m_decrypted);
+    }
+    EntryInput &input = encrypted ? static_cast<EntryInput &>(*decryptingInput) : plainInput;
+
+    bool ok = false;
+    if (method == MethodStored) {
+        ok = copyStored(input, out);
+    } else if (!encrypted && method == MethodDeflated && uncompressedSize <= WholeBufferLimit
+               && compressedSize <= MaxInputSlice && reserveWholeBuffer(uncompressedSize)) {
+        ok = inflateWhole(data, compressedSize, uncompressedSize, out);
+    } else if (EntryDecoder *decoder = decoderFor(method)) {
+        // Dictionaries count against the budget for as long as they live
+        MemoryGrant grant;
+        if (m_governor) {
+            const QByteArray head = encrypted ? m_decryptor.peek(EstimateHeadSize) : QByteArray();
+            const qint64 estimate = encrypted
+                ? decoder->memoryEstimate(reinterpret_cast<const uchar *>(head.constData()), head.size())
+                : decoder->memoryEstimate(data, compressedSize);
+            const qint64 granted = m_governor->acquire(estimate, m_token);
+            if (granted < 0) {
+                m_error = "Cancelled";
+                return false;
+            }
+            grant = MemoryGrant(m_governor, granted);
+        }
+        ok = decodeStreaming(*decoder, input, uncompressedSize, archive.flags(index), out);
+    } else {
+        m_error = "Unsupported compression method: " + EntryDecoder::methodName(method);
+        return false;
+    }
+
+    if (!ok) {
+        return false;
+    }
+    if (encrypted) {
+        if (!m_decryptor.finish()) {
+            m_error = m_decryptor.errorString();
+            return false;
+        }
+        // Salts, verifiers and MACs are part of the compressed size too
+        if (m_inputBytes) {
+            m_inputBytes->fetch_add(m_decryptor.overhead(), std::memory_order_relaxed);
+        }
+    }
+    if (m_produced != uncompressedSize) {
+        m_error = "Size mismatch";
+        return false;
+    }
+    if (m_crc != archive.crc(index) && (!encrypted || m_decryptor.checksCrc())) {
+        m_error = "CRC mismatch";
+        return false;
+    }
+    return true;
+}
+
+bool ZipEntryStream::writeChunk(QIODevice *out, const char *data, qint64 size)
+{
+    // Every decode path comes through here at least once per output buffer,
+    // which bounds how long a cancel or pause waits
+    if (m_token && !m_token->checkpoint()) {
+        m_error = "Cancelled";
+        return false;
+    }
+
+    // The checksum runs on each chunk while it is still in cache
+    m_crc = Crc32::update(m_crc, reinterpret_cast<const uchar *>(data), size);
+    m_produced += size;
+
+    TraceSpan span(TracePhase::Write);
+    if (out->write(data, size) != size) {
+        m_error = "Write failed: " + out->errorString();
+        return false;
+    }
+    span.addBytes(size);
+    return true;
+}
+
+bool ZipEntryStream::copyStored(EntryInput &input, QIODevice *out)
+{
+    const uchar *chunk = nullptr;
+    qint64 size = 0;
+    while (input.next(m_output.size(), chunk, size)) {
+        if (!writeChunk(out, reinterpret_cast<const char *>(chunk), size)) {
+            return false;
+        }
+        if (m_outputBytes) {
+            m_inputBytes->fetch_add(size, std::memory_order_relaxed);
+            m_outputBytes->fetch_add(size, std::memory_order_relaxed);
+        }
+    }
+    return true;
+}
+
+bool ZipEntryStream::reserveWholeBuffer(qint64 size)
+{
+    if (!m_governor) {
+        if (m_wholeBuffer.size() < size) {
+            m_wholeBuffer.resize(qMax(size, qint64(OutputBufferSize)));
+        }
+        return true;
+    }
+    m_wholeBuffer = m_governor->takeBuffer(size);
+    return !m_wholeBuffer.isNull();
+}
+
+bool ZipEntryStream::inflateWhole(const uchar *data, qint64 compressedSize, qint64 uncompressedSize, QIODevice *out)
+{
+    // Back to the pool as soon as the entry is written, whatever happens
+    const auto returnBuffer = qScopeGuard([this]() {
+        if (m_governor) {
+            m_governor->returnBuffer(m_wholeBuffer);
+        }
+    });
+
+    {
+        TraceSpan span(TracePhase::Inflate);
+        if (!m_backend->inflateWhole(data, compressedSize, reinterpret_cast<uchar *>(m_wholeBuffer.data()), uncompressedSize)) {
+            m_error = "Damaged compressed data";
+            return false;
+        }
+        span.addBytes(uncompressedSize);
+    }
+
+    // One write per entry, which is most of the win for small files
+    if (uncompressedSize > 0 && !writeChunk(out, m_wholeBuffer.constData(), uncompressedSize)) {
+        return false;
+    }
+    if (m_outputBytes) {
+        m_inputBytes->fetch_add(compressedSize, std::memory_order_relaxed);
+        m_outputBytes->fetch_add(uncompressedSize, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+EntryDecoder *ZipEntryStream::decoderFor(quint16 method)
+{
+    // Decoders keep their state allocations between entries
+    auto it = m_decoders.find(method);
+    if (it == m_decoders.end()) {
+        it = m_decoders.emplace(method, EntryDecoder::create(method)).first;
+    }
+    return it->second.get();
+}
+
+bool ZipEntryStream::decodeStreaming(EntryDecoder &decoder, EntryInput &input, qint64 uncompressedSize,
+                                     quint16 flags, QIODevice *out)
+{
+    // Decoding happens between sink calls, that is what the inflate spans
+    // cover; for encrypted entries they include decrypting the input
+    const bool tracing = Tracer::isEnabled();
+    qint64 decodeStart = tracing ? Tracer::nowNs() : 0;
+
+    bool written = true;
+    const bool ok = decoder.decode(input, uncompressedSize, flags, m_output,
+                                   [&, this](const char *chunk, qint64 size, qint64 consumed) {
+        if (tracing) {
+            Tracer::instance().record(TracePhase::Inflate, decodeStart, Tracer::nowNs(), size, -1);
+        }
+        if (size > 0 && !writeChunk(out, chunk, size)) {
+            written = false;
+            return false;
+        }
+        if (m_outputBytes) {
+            m_inputBytes->fetch_add(consumed, std::memory_order_relaxed);
+            m_outputBytes->fetch_add(size, std::memory_order_relaxed);
+        }
+        if (tracing) {
+            decodeStart = Tracer::nowNs();
+        }
+        return true;
+    });
+
+    // A failed write already set the error, anything else is the decoder's
+    if (!ok && written) {
+        m_error = decoder.errorString();
+    }
+    return ok;
+}
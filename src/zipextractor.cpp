@@ -1,17 +1,37 @@
 #include "zipextractor.h"
+#include "checksum.h"
+#include "cipher.h"
+#include "entrydecryptor.h"
+#include "tracer.h"
 #include <QDir>
 #include <QFileInfo>
 
 ZipExtractor* ZipExtractor::s_instance = nullptr;
 
+namespace {
+
+// Fixed cost charged per entry on top of its bytes, so archives made of many
+// tiny files do not look almost free to the progress and ETA estimates
+constexpr qint64 EntryOverheadBytes = 32 * 1024;
+
+// Property notifications are coalesced to this rate whatever the entry count
+constexpr int RefreshIntervalMs = 100;
+
+// Archive path that reads from standard input
+constexpr QLatin1StringView StdinPath("-");
+
+}
+
 ZipExtractor::ZipExtractor(QObject *parent)
     : QObject(parent)
-    , m_extractTimer(new QTimer(this))
+    , m_engine(new ExtractionEngine(this))
+    , m_refreshTimer(new QTimer(this))
     , m_etaTimer(new QTimer(this))
 {
-    m_extractTimer->setSingleShot(true);
-    m_extractTimer->setInterval(1);
-    connect(m_extractTimer, &QTimer::timeout, this, &ZipExtractor::processNextFile);
+    connect(m_engine, &ExtractionEngine::finished, this, &ZipExtractor::onEngineFinished);
+
+    m_refreshTimer->setInterval(RefreshIntervalMs);
+    connect(m_refreshTimer, &QTimer::timeout, this, &ZipExtractor::refreshProgress);
 
     m_etaTimer->setInterval(1000);
     connect(m_etaTimer, &QTimer::timeout, this, &ZipExtractor::updateETA);
@@ -38,15 +58,156 @@ ZipExtractor* ZipExtractor::instance()
 
 void ZipExtractor::startExtraction(const QString &zipPath, const QString &destPath)
 {
-    if (m_isExtracting) return;
+    startExtraction(zipPath, destPath, EntryFilter());
+}
+
+bool ZipExtractor::startSelectiveExtraction(const QString &zipPath, const QString &destPath,
+                                            const QStringList &includes, const QStringList &excludes,
+                                            const QStringList &entries)
+{
+    EntryFilter filter;
+    if (!filter.set(includes, excludes, entries)) {
+        return false;
+    }
+    startExtraction(zipPath, destPath, filter);
+    return true;
+}
+
+void ZipExtractor::startExtraction(const QString &zipPath, const QString &destPath, const EntryFilter &filter)
+{
+    // Archives requested while busy join the queue instead of being dropped
+    enqueueArchive(zipPath, destPath, filter);
+    if (!m_isExtracting) {
+        startNextArchive();
+    }
+}
+
+QVariantList ZipExtractor::listEntries(const QString &zipPath, const QStringList &includes, const QStringList &excludes) const
+{
+    QVariantList list;
+    EntryFilter filter;
+    ZipArchive archive;
+    if (!filter.set(includes, excludes, {}) || !archive.open(zipPath)) {
+        return list;
+    }
+
+    const QList<qsizetype> selection = filter.select(archive);
+    list.reserve(selection.size());
+    for (const qsizetype i : selection) {
+        QVariantMap entry;
+        entry["name"] = archive.name(i);
+        entry["isDir"] = archive.isDir(i);
+        entry["size"] = archive.uncompressedSize(i);
+        entry["compressedSize"] = archive.compressedSize(i);
+        entry["method"] = EntryDecoder::methodName(EntryDecryptor::compressionMethod(archive, i));
+        entry["crc"] = archive.crc(i);
+        if (archive.flags(i) & EntryDecryptor::EncryptedFlag) {
+            entry["encryption"] = EntryDecryptor::schemeName(archive, i);
+        }
+        list.append(entry);
+    }
+    return list;
+}
+
+bool ZipExtractor::isEncrypted(const QString &zipPath) const
+{
+    ZipArchive archive;
+    if (!archive.open(zipPath)) {
+        return false;
+    }
+    for (qsizetype i = 0; i < archive.entryCount(); ++i) {
+        if (archive.flags(i) & EntryDecryptor::EncryptedFlag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ZipExtractor::enqueueExtractions(const QStringList &zipPaths)
+{
+    for (const QString &zipPath : zipPaths) {
+        enqueueArchive(zipPath, QString());
+    }
+    if (!m_isExtracting) {
+        startNextArchive();
+    }
+}
+
+void ZipExtractor::enqueueArchive(const QString &zipPath, const QString &destPath, const EntryFilter &filter)
+{
+    // A new batch starts whenever the previous one has drained
+    if (!m_isExtracting && m_queue.isEmpty()) {
+        m_totalArchives = 0;
+        m_completedArchives = 0;
+        m_batchTotalBytes = 0;
+        m_batchCompletedBytes = 0;
+    }
+
+    QueuedArchive archive;
+    archive.zipPath = zipPath;
+    archive.destPath = destPath;
+    archive.filter = filter;
+    archive.size = QFileInfo(zipPath).size();
+    m_queue.append(archive);
+
+    m_totalArchives++;
+    m_batchTotalBytes += archive.size;
+    emit queueChanged();
+}
+
+void ZipExtractor::startNextArchive()
+{
+    if (m_isExtracting || m_queue.isEmpty()) {
+        return;
+    }
+
+    // One archive at a time keeps reads sequential on the disk, while the
+    // engine spreads that archive over every core
+    const QueuedArchive next = m_queue.takeFirst();
+    m_currentArchiveSize = next.size;
+    emit queueChanged();
+
+    beginExtraction(next.zipPath, next.destPath, next.filter);
+}
+
+void ZipExtractor::finishArchive(bool success, const QString &message)
+{
+    m_isExtracting = false;
+    m_refreshTimer->stop();
+    m_etaTimer->stop();
+
+    m_completedArchives++;
+    m_batchCompletedBytes += m_currentArchiveSize;
+    m_currentArchiveSize = 0;
+    emit queueChanged();
 
-    resetProgress();
-    m_isExtracting = true;
     emit isExtractingChanged();
+    emit extractionFinished(success, message);
+
+    if (m_queue.isEmpty()) {
+        emit allExtractionsFinished();
+    } else {
+        QTimer::singleShot(0, this, &ZipExtractor::startNextArchive);
+    }
+}
+
+void ZipExtractor::beginExtraction(const QString &zipPath, const QString &destPath, const EntryFilter &filter)
+{
+    resetProgress();
+    m_wallTimer.start();
 
     // Store the current zip path
     m_currentZipPath = zipPath;
 
+    m_isExtracting = true;
+    emit isExtractingChanged();
+
+    // "-" streams the archive from stdin, extracting while it arrives
+    if (zipPath == StdinPath) {
+        beginStreamExtraction(destPath, filter);
+        return;
+    }
+
     // Set destination path
     if (destPath.isEmpty()) {
         QFileInfo zipInfo(zipPath);
@@ -58,246 +219,359 @@ void ZipExtractor::startExtraction(const QString &zipPath, const QString &destPa
     // Create destination directory
     QDir().mkpath(m_destinationPath);
 
-    // Open ZIP file
-    m_zipReader = new QZipReader(zipPath, QIODevice::ReadOnly);
-    if (!m_zipReader->isReadable()) {
-        delete m_zipReader;
-        m_zipReader = nullptr;
-        m_isExtracting = false;
-        emit isExtractingChanged();
-        emit extractionFinished(false, "Cannot read ZIP file");
+    // Each archive gets a fresh trace, like its stats
+    if (Tracer::isEnabled()) {
+        Tracer::instance().reset();
+    }
+
+    // Open ZIP file, the filter is resolved against its index right away
+    m_engine->setFilter(filter);
+    m_engine->setPassword(m_password);
+    bool opened;
+    {
+        TraceSpan span(TracePhase::Index);
+        opened = m_engine->open(zipPath);
+    }
+    m_indexMs = m_wallTimer.elapsed();
+    if (!opened) {
+        m_wallMs = m_wallTimer.elapsed();
+        finishArchive(false, "Cannot read ZIP file");
         return;
     }
 
-    // Get file list
-    m_fileList = m_zipReader->fileInfoList();
-    m_totalFiles = m_fileList.size();
+    // Get file count from the central directory index
+    m_totalFiles = m_engine->selectedCount();
     emit totalFilesChanged();
 
     if (m_totalFiles == 0) {
-        delete m_zipReader;
-        m_zipReader = nullptr;
-        m_isExtracting = false;
-        emit isExtractingChanged();
-        emit extractionFinished(true, "ZIP file is empty");
+        const bool empty = m_engine->archive().entryCount() == 0;
+        m_engine->close();
+        m_wallMs = m_wallTimer.elapsed();
+        finishArchive(true, empty ? "ZIP file is empty" : "No entries match the filter");
         return;
     }
 
     // Start timers
     m_elapsedTimer.start();
+    m_refreshTimer->start();
     m_etaTimer->start();
 
     // Start extraction
-    m_extractTimer->start();
+    m_engine->start(m_destinationPath);
 }
 
-void ZipExtractor::processNextFile()
+void ZipExtractor::beginStreamExtraction(const QString &destPath, const EntryFilter &filter)
 {
-    if (m_currentFile >= m_fileList.size()) {
-        // All files extracted, now handle nested zips
-        if (!m_nestedZipsToExtract.isEmpty()) {
-            QString nextZip = m_nestedZipsToExtract.takeFirst();
-            extractNestedZip(nextZip);
-            return;
-        }
+    m_destinationPath = destPath.isEmpty() ? QDir::currentPath() : destPath;
+    QDir().mkpath(m_destinationPath);
+    if (Tracer::isEnabled()) {
+        Tracer::instance().reset();
+    }
 
-        // Extraction complete
-        m_isExtracting = false;
-        m_etaTimer->stop();
-        emit isExtractingChanged();
-        emit extractionFinished(true, "Extraction completed successfully");
+    if (!m_stdin.isOpen() && !m_stdin.open(0, QIODevice::ReadOnly | QIODevice::Unbuffered, QFileDevice::DontCloseHandle)) {
+        m_wallMs = m_wallTimer.elapsed();
+        finishArchive(false, "Cannot read standard input");
         return;
     }
 
-    const QZipReader::FileInfo &fileInfo = m_fileList[m_currentFile];
-    m_currentFileName = fileInfo.filePath;
-    emit currentFileNameChanged();
+    // Nothing is known up front, totals grow as entries arrive
+    m_engine->setFilter(filter);
+    m_engine->setPassword(m_password);
+    m_indexMs = 0;
+    m_totalFiles = 0;
+    emit totalFilesChanged();
 
-    // Extract current file
-    QString fullPath = m_destinationPath + "/" + fileInfo.filePath;
+    m_elapsedTimer.start();
+    m_refreshTimer->start();
+    m_etaTimer->start();
+    m_engine->startStream(&m_stdin, m_destinationPath);
+}
 
-    if (fileInfo.isDir) {
-        QDir().mkpath(fullPath);
-    } else {
-        // Ensure parent directory exists
-        QDir().mkpath(QFileInfo(fullPath).absolutePath());
-
-        // Extract file data
-        QByteArray data = m_zipReader->fileData(fileInfo.filePath);
-        QFile outFile(fullPath);
-        if (outFile.open(QIODevice::WriteOnly)) {
-            outFile.write(data);
-        }
+void ZipExtractor::refreshProgress()
+{
+    if (!m_isExtracting) {
+        return;
+    }
 
-        // Check if this is a zip file that should be extracted recursively
-        if (fileInfo.filePath.endsWith(".zip", Qt::CaseInsensitive)) {
-            if (shouldExtractRecursively(fullPath)) {
-                // Handle naming conflict
-                QFileInfo extractedZipInfo(fullPath);
-                QFileInfo originalZipInfo(m_currentZipPath);  // Use stored path instead of m_zipReader->fileName()
-
-                if (extractedZipInfo.baseName() == originalZipInfo.baseName() && m_fileList.size() > 1) {
-                    // Rename the nested zip to avoid conflict
-                    QString newName = getUniqueFileName(
-                        extractedZipInfo.absolutePath(),
-                        extractedZipInfo.baseName(),
-                        extractedZipInfo.suffix()
-                        );
-                    QString newPath = extractedZipInfo.absolutePath() + "/" + newName;
-                    QFile::rename(fullPath, newPath);
-                    m_nestedZipsToExtract.append(newPath);
-                } else {
-                    m_nestedZipsToExtract.append(fullPath);
-                }
-            }
-        }
+    const ExtractionEngine::Progress snapshot = m_engine->progress();
+
+    // Nested archives add their entries to the total as they are found
+    if (snapshot.totalFiles != m_totalFiles) {
+        m_totalFiles = snapshot.totalFiles;
+        emit totalFilesChanged();
     }
 
-    // Update progress
-    m_currentFile++;
-    emit currentFileChanged();
+    if (snapshot.completedFiles != m_currentFile) {
+        m_currentFile = snapshot.completedFiles;
+        emit currentFileChanged();
+    }
 
-    m_progress = (double)m_currentFile / m_totalFiles * 100.0;
-    emit progressChanged();
+    if (snapshot.currentFile != m_currentFileName) {
+        m_currentFileName = snapshot.currentFile;
+        emit currentFileNameChanged();
+    }
 
-    // Schedule next file
-    m_extractTimer->start();
-}
+    // Weight progress by the bytes read and written, plus a fixed cost per entry
+    const qint64 totalWork = snapshot.totalBytes + snapshot.totalCompressedBytes
+                             + snapshot.totalFiles * EntryOverheadBytes;
+    const qint64 completedWork = snapshot.completedBytes + snapshot.completedCompressedBytes
+                                 + snapshot.completedFiles * EntryOverheadBytes;
+    m_remainingWork = qMax<qint64>(0, totalWork - completedWork);
+
+    const double progress = totalWork > 0 ? qMin(100.0, (double)completedWork / totalWork * 100.0) : 0.0;
+    if (progress != m_progress) {
+        m_progress = progress;
+        emit progressChanged();
+    }
 
-void ZipExtractor::extractNestedZip(const QString &zipPath)
-{
-    QFileInfo zipInfo(zipPath);
-    QString nestedDestPath = zipInfo.absolutePath() + "/" + zipInfo.baseName();
+    // Time spent paused would otherwise read as a stall in the rates
+    m_meter.sample(m_elapsedTimer.elapsed() - m_pausedMs, completedWork, snapshot.completedBytes);
 
-    // Update current file name to show nested extraction
-    m_currentFileName = "Extracting nested: " + zipInfo.fileName();
-    emit currentFileNameChanged();
+    // Archives of the batch are weighted by their size on disk
+    const double overallProgress = m_batchTotalBytes > 0
+        ? (m_batchCompletedBytes + m_currentArchiveSize * m_progress / 100.0) / m_batchTotalBytes * 100.0
+        : m_progress;
+    if (overallProgress != m_overallProgress) {
+        m_overallProgress = overallProgress;
+        emit overallProgressChanged();
+    }
 
-    // Create nested destination
-    QDir().mkpath(nestedDestPath);
-
-    // Open nested ZIP
-    QZipReader nestedReader(zipPath, QIODevice::ReadOnly);
-    if (!nestedReader.isReadable()) {
-        // Continue with remaining nested zips
-        if (!m_nestedZipsToExtract.isEmpty()) {
-            QString nextZip = m_nestedZipsToExtract.takeFirst();
-            extractNestedZip(nextZip);
-        } else {
-            m_isExtracting = false;
-            m_etaTimer->stop();
-            emit isExtractingChanged();
-            emit extractionFinished(true, "Extraction completed with some nested ZIP errors");
-        }
+    const double throughput = m_meter.bytesPerSecond() / (1024.0 * 1024.0);
+    if (throughput != m_throughput) {
+        m_throughput = throughput;
+        emit throughputChanged();
+    }
+}
+
+void ZipExtractor::onEngineFinished(bool cancelled)
+{
+    if (!m_isExtracting || cancelled) {
         return;
     }
 
-    // Extract all files from nested ZIP
-    QList<QZipReader::FileInfo> nestedFileList = nestedReader.fileInfoList();
-
-    for (const auto &fileInfo : nestedFileList) {
-        QString fullPath = nestedDestPath + "/" + fileInfo.filePath;
-
-        if (fileInfo.isDir) {
-            QDir().mkpath(fullPath);
-        } else {
-            QDir().mkpath(QFileInfo(fullPath).absolutePath());
-            QByteArray data = nestedReader.fileData(fileInfo.filePath);
-            QFile outFile(fullPath);
-            if (outFile.open(QIODevice::WriteOnly)) {
-                outFile.write(data);
-            }
-
-            // Check for more nested zips
-            if (fileInfo.filePath.endsWith(".zip", Qt::CaseInsensitive)) {
-                if (shouldExtractRecursively(fullPath)) {
-                    m_nestedZipsToExtract.append(fullPath);
-                }
-            }
-        }
+    m_extractMs = m_wallTimer.elapsed() - m_indexMs;
+    refreshProgress();
+    m_finalProgress = m_engine->progress();
+    m_failures = m_engine->failures();
+    m_resumed = m_engine->resumed();
+    {
+        TraceSpan span(TracePhase::Finalize);
+        m_engine->close();
     }
+    m_wallMs = m_wallTimer.elapsed();
+    m_finalizeMs = m_wallMs - m_indexMs - m_extractMs;
 
-    // Remove the extracted nested zip file
-    QFile::remove(zipPath);
+    if (m_progress < 100.0) {
+        m_progress = 100.0;
+        emit progressChanged();
+    }
 
-    // Continue with next nested zip or finish
-    if (!m_nestedZipsToExtract.isEmpty()) {
-        QString nextZip = m_nestedZipsToExtract.takeFirst();
-        extractNestedZip(nextZip);
-    } else {
-        m_isExtracting = false;
-        m_etaTimer->stop();
-        emit isExtractingChanged();
-        emit extractionFinished(true, "Extraction completed successfully");
+    // Damaged entries fail the archive, everything else is still extracted
+    if (m_finalProgress.failedFiles > 0) {
+        finishArchive(false, QString("Extraction finished, %1 damaged entries were skipped").arg(m_finalProgress.failedFiles));
+        return;
     }
+
+    // Extraction complete, nested archives included
+    finishArchive(true, "Extraction completed successfully");
 }
 
-bool ZipExtractor::shouldExtractRecursively(const QString &zipPath) const
+void ZipExtractor::updateETA()
 {
-    // Open the zip to check if it contains only another zip or has multiple files
-    QZipReader reader(zipPath, QIODevice::ReadOnly);
-    if (!reader.isReadable()) {
-        return false;
+    // Based on the smoothed throughput rather than the average since start
+    m_eta = m_meter.eta(m_remainingWork);
+    emit etaChanged();
+}
+
+QVariantMap ZipExtractor::stats() const
+{
+    const double seconds = m_wallMs / 1000.0;
+
+    QVariantMap phases;
+    phases["indexMs"] = m_indexMs;
+    phases["extractMs"] = m_extractMs;
+    phases["finalizeMs"] = m_finalizeMs;
+
+    QVariantMap stats;
+    stats["archive"] = m_currentZipPath;
+    stats["destination"] = m_destinationPath;
+    stats["threads"] = m_engine->threadCount();
+    stats["entries"] = m_finalProgress.completedFiles;
+    stats["failedEntries"] = m_failures;
+    stats["skippedEntries"] = m_finalProgress.skippedFiles;
+    stats["resumed"] = m_resumed;
+    stats["pausedMs"] = m_pausedMs;
+    if (m_cancelLatencyMs >= 0) {
+        stats["cancelLatencyMs"] = m_cancelLatencyMs;
+    }
+    if (m_engine->deduplicate()) {
+        QVariantMap dedup;
+        dedup["reflinks"] = m_finalProgress.reflinkedFiles;
+        dedup["hardlinks"] = m_finalProgress.hardlinkedFiles;
+        dedup["copies"] = m_finalProgress.copiedFiles;
+        dedup["bytes"] = m_finalProgress.dedupedBytes;
+        stats["dedup"] = dedup;
     }
+    stats["durability"] = durability();
+    stats["sparseBytes"] = m_finalProgress.sparseBytes;
+    QVariantMap memory;
+    memory["budget"] = m_engine->memoryBudget();
+    memory["peak"] = m_engine->peakMemory();
+    stats["memory"] = memory;
+    stats["crc32"] = Crc32::implementation();
+    stats["aes"] = AesCtr::implementation();
+    stats["sha1"] = HmacSha1::implementation();
+    stats["inflate"] = InflateBackend::preferredName();
+    stats["bytesIn"] = m_finalProgress.completedCompressedBytes;
+    stats["bytesOut"] = m_finalProgress.completedBytes;
+    stats["wallMs"] = m_wallMs;
+    stats["mbPerSecond"] = seconds > 0 ? m_finalProgress.completedBytes / (1024.0 * 1024.0) / seconds : 0.0;
+    stats["phases"] = phases;
+    if (Tracer::isEnabled()) {
+        stats["trace"] = traceSummary();
+    }
+    return stats;
+}
+
+QVariantMap ZipExtractor::traceSummary() const
+{
+    return Tracer::instance().summary();
+}
+
+bool ZipExtractor::exportTrace(const QString &path)
+{
+    return Tracer::instance().exportChromeTrace(path);
+}
 
-    QList<QZipReader::FileInfo> fileList = reader.fileInfoList();
+bool ZipExtractor::tracing() const
+{
+    return Tracer::isEnabled();
+}
+
+void ZipExtractor::setTracing(bool tracing)
+{
+    if (tracing != Tracer::isEnabled()) {
+        Tracer::instance().setEnabled(tracing);
+        emit tracingChanged();
+    }
+}
 
-    // Extract if it contains only one zip file, or if it's a zip among other files
-    return !fileList.isEmpty();
+void ZipExtractor::setIncremental(bool incremental)
+{
+    if (incremental != m_engine->incremental()) {
+        m_engine->setIncremental(incremental);
+        emit incrementalChanged();
+    }
 }
 
-QString ZipExtractor::getUniqueFileName(const QString &directory, const QString &baseName, const QString &extension) const
+void ZipExtractor::setDeduplicate(bool deduplicate)
 {
-    QString fileName;
-    int counter = 1;
+    if (deduplicate != m_engine->deduplicate()) {
+        m_engine->setDeduplicate(deduplicate);
+        emit deduplicateChanged();
+    }
+}
 
-    do {
-        fileName = QString("%1 (%2).%3").arg(baseName).arg(counter).arg(extension);
-        counter++;
-    } while (QFile::exists(directory + "/" + fileName));
+void ZipExtractor::setMaxMemory(qint64 bytes)
+{
+    bytes = qMax<qint64>(0, bytes);
+    if (bytes != m_engine->memoryBudget()) {
+        m_engine->setMemoryBudget(bytes);
+        emit maxMemoryChanged();
+    }
+}
 
-    return fileName;
+QString ZipExtractor::durability() const
+{
+    switch (m_engine->durability()) {
+    case OutputFile::SyncEachFile:
+        return "file";
+    case OutputFile::SyncAtEnd:
+        return "end";
+    default:
+        return "none";
+    }
 }
 
-void ZipExtractor::updateETA()
+void ZipExtractor::setDurability(const QString &durability)
 {
-    if (m_currentFile == 0) {
-        m_eta = "Calculating...";
-        emit etaChanged();
+    OutputFile::Durability value;
+    if (durability == "none") {
+        value = OutputFile::NoSync;
+    } else if (durability == "file") {
+        value = OutputFile::SyncEachFile;
+    } else if (durability == "end") {
+        value = OutputFile::SyncAtEnd;
+    } else {
         return;
     }
 
-    qint64 elapsed = m_elapsedTimer.elapsed();
-    double filesPerMs = (double)m_currentFile / elapsed;
-    int remainingFiles = m_totalFiles - m_currentFile;
+    if (value != m_engine->durability()) {
+        m_engine->setDurability(value);
+        emit durabilityChanged();
+    }
+}
+
+void ZipExtractor::setPassword(const QString &password)
+{
+    if (password != m_password) {
+        m_password = password;
+        emit passwordChanged();
+    }
+}
 
-    if (filesPerMs > 0) {
-        qint64 remainingMs = remainingFiles / filesPerMs;
-        int remainingSeconds = remainingMs / 1000;
+void ZipExtractor::pauseExtraction()
+{
+    if (m_isExtracting && !m_isPaused) {
+        m_engine->pause();
+        m_pauseTimer.start();
+        m_refreshTimer->stop();
+        m_etaTimer->stop();
+        setPaused(true);
+    }
+}
 
-        if (remainingSeconds < 60) {
-            m_eta = QString("%1 seconds").arg(remainingSeconds);
-        } else {
-            int minutes = remainingSeconds / 60;
-            int seconds = remainingSeconds % 60;
-            m_eta = QString("%1:%2").arg(minutes).arg(seconds, 2, 10, QChar('0'));
-        }
-    } else {
-        m_eta = "Unknown";
+void ZipExtractor::resumeExtraction()
+{
+    if (m_isExtracting && m_isPaused) {
+        m_pausedMs += m_pauseTimer.elapsed();
+        m_engine->resume();
+        m_refreshTimer->start();
+        m_etaTimer->start();
+        setPaused(false);
     }
+}
 
-    emit etaChanged();
+void ZipExtractor::setPaused(bool paused)
+{
+    if (paused != m_isPaused) {
+        m_isPaused = paused;
+        emit isPausedChanged();
+    }
 }
 
 void ZipExtractor::cancelExtraction()
 {
     if (m_isExtracting) {
-        m_extractTimer->stop();
-        m_etaTimer->stop();
-        m_isExtracting = false;
-        m_nestedZipsToExtract.clear();
-        emit isExtractingChanged();
-        emit extractionFinished(false, "Extraction cancelled by user");
+        // Workers stop at their next chunk, waiting for them means the disk
+        // is really released once this returns
+        QElapsedTimer latency;
+        latency.start();
+        m_engine->cancel();
+        m_engine->waitForDone();
+        m_cancelLatencyMs = latency.elapsed();
+
+        m_finalProgress = m_engine->progress();
+        m_wallMs = m_wallTimer.elapsed();
+        m_extractMs = m_wallMs - m_indexMs;
+        if (m_isPaused) {
+            m_pausedMs += m_pauseTimer.elapsed();
+            setPaused(false);
+        }
+
+        // Cancelling stops the whole batch, not just the current archive
+        m_queue.clear();
+        finishArchive(false, "Extraction cancelled by user");
     }
 }
 
@@ -308,17 +582,24 @@ void ZipExtractor::resetProgress()
     m_currentFileName = "";
     m_progress = 0.0;
     m_eta = "Calculating...";
+    m_throughput = 0.0;
+    m_remainingWork = 0;
+    m_meter.reset();
     m_currentZipPath = "";  // Clear the stored path
-    m_nestedZipsToExtract.clear();
-
-    if (m_zipReader) {
-        delete m_zipReader;
-        m_zipReader = nullptr;
-    }
+    m_wallMs = 0;
+    m_indexMs = 0;
+    m_extractMs = 0;
+    m_finalizeMs = 0;
+    m_finalProgress = ExtractionEngine::Progress();
+    m_failures.clear();
+    m_resumed = false;
+    m_pausedMs = 0;
+    m_cancelLatencyMs = -1;
 
     emit currentFileChanged();
     emit totalFilesChanged();
     emit currentFileNameChanged();
     emit progressChanged();
     emit etaChanged();
+    emit throughputChanged();
 }
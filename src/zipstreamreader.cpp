@@ -0,0 +1,553 @@
+#include "zipstreamreader.h"
+#include "canceltoken.h"
+#include <QDir>
+#include <QFile>
+#include <QSet>
+#include <QtEndian>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr quint32 LocalHeaderSignature = 0x04034b50;
+constexpr quint32 CentralHeaderSignature = 0x02014b50;
+constexpr quint32 EndOfCentralDirSignature = 0x06054b50;
+constexpr quint32 Zip64EndOfCentralDirSignature = 0x06064b50;
+constexpr quint32 Zip64LocatorSignature = 0x07064b50;
+constexpr quint32 DataDescriptorSignature = 0x08074b50;
+
+constexpr int LocalHeaderSize = 30;
+constexpr int CentralHeaderSize = 46;
+constexpr int EndOfCentralDirSize = 22;
+constexpr int Zip64EndOfCentralDirSize = 56;
+constexpr int Zip64LocatorSize = 20;
+
+constexpr quint16 FlagDataDescriptor = 0x0008;
+constexpr quint16 Zip64ExtraId = 0x0001;
+constexpr quint16 AesExtraId = 0x9901;
+constexpr quint16 Zip64Version = 45;
+constexpr quint8 HostUnix = 3;
+
+// Longest data descriptor: signature, CRC and two 64-bit sizes
+constexpr qint64 MaxDescriptorSize = 24;
+
+// What may follow the central directory: the Zip64 end record and its
+// locator, then the classic end record with a comment of up to 64 KiB
+constexpr qint64 MaxTrailerSize = Zip64EndOfCentralDirSize + Zip64LocatorSize + EndOfCentralDirSize + 0xffff;
+
+// Waits for input in slices so a cancel is noticed while the sender stalls
+constexpr int PollSliceMs = 100;
+
+quint16 readU16(const uchar *data)
+{
+    return qFromLittleEndian<quint16>(data);
+}
+
+quint32 readU32(const uchar *data)
+{
+    return qFromLittleEndian<quint32>(data);
+}
+
+quint64 readU64(const uchar *data)
+{
+    return qFromLittleEndian<quint64>(data);
+}
+
+void putU16(QByteArray &data, qsizetype at, quint16 value)
+{
+    qToLittleEndian(value, data.data() + at);
+}
+
+void putU32(QByteArray &data, qsizetype at, quint32 value)
+{
+    qToLittleEndian(value, data.data() + at);
+}
+
+void putU64(QByteArray &data, qsizetype at, quint64 value)
+{
+    qToLittleEndian(value, data.data() + at);
+}
+
+// The whole extra field record with the given id from a local header,
+// empty when it has none
+QByteArray localExtraField(const QByteArray &localHeader, quint16 id)
+{
+    const auto *header = reinterpret_cast<const uchar *>(localHeader.constData());
+    const qsizetype start = LocalHeaderSize + readU16(header + 26);
+    const qsizetype end = qMin(start + readU16(header + 28), localHeader.size());
+    for (qsizetype pos = start; pos + 4 <= end;) {
+        const qsizetype size = 4 + readU16(header + pos + 2);
+        if (pos + size > end) {
+            break;
+        }
+        if (readU16(header + pos) == id) {
+            return localHeader.sliced(pos, size);
+        }
+        pos += size;
+    }
+    return QByteArray();
+}
+
+bool isHeaderSignature(quint32 signature)
+{
+    return signature == LocalHeaderSignature || signature == CentralHeaderSignature
+           || signature == EndOfCentralDirSignature;
+}
+
+}
+
+ZipStreamReader::ZipStreamReader(QIODevice *input)
+    : m_input(input)
+{
+}
+
+bool ZipStreamReader::fill(qint64 bytes)
+{
+    while (available() < bytes && !m_eof) {
+        if (m_token && !m_token->checkpoint()) {
+            return fail("Cancelled");
+        }
+
+        // Consumed bytes are dropped once they make up half the buffer
+        if (m_pos > 0 && m_pos >= m_buffer.size() / 2) {
+            m_buffer.remove(0, m_pos);
+            m_offset += m_pos;
+            m_pos = 0;
+        }
+
+        const qsizetype size = m_buffer.size();
+        m_buffer.resize(size + ReadChunkSize);
+        qint64 got = -1;
+
+#ifdef Q_OS_UNIX
+        // Pipes and stdin are read with whatever has arrived, QFile would
+        // wait for the whole chunk
+        const QFile *file = qobject_cast<const QFile *>(m_input);
+        if (file && file->handle() >= 0) {
+            pollfd descriptor{ file->handle(), POLLIN, 0 };
+            int ready;
+            while ((ready = ::poll(&descriptor, 1, PollSliceMs)) == 0 || (ready < 0 && errno == EINTR)) {
+                if (m_token && m_token->isCancelled()) {
+                    m_buffer.resize(size);
+                    return fail("Cancelled");
+                }
+            }
+            do {
+                got = ::read(file->handle(), m_buffer.data() + size, size_t(ReadChunkSize));
+            } while (got < 0 && errno == EINTR);
+        } else
+#endif
+        {
+            got = m_input->read(m_buffer.data() + size, ReadChunkSize);
+        }
+
+        m_buffer.resize(size + qMax<qint64>(got, 0));
+        if (got < 0) {
+            return fail("Read failed: " + m_input->errorString());
+        }
+        m_eof = got == 0;
+    }
+    return available() >= bytes;
+}
+
+void ZipStreamReader::consume(qint64 bytes)
+{
+    m_pos += bytes;
+}
+
+bool ZipStreamReader::fail(const QString &error)
+{
+    if (m_error.isEmpty()) {
+        m_error = error;
+    }
+    return false;
+}
+
+bool ZipStreamReader::next(Entry &entry)
+{
+    if (!fill(4)) {
+        return fail("Unexpected end of stream");
+    }
+
+    const qint64 offset = m_offset + m_pos;
+    const quint32 signature = readU32(head());
+    if (signature == CentralHeaderSignature || signature == EndOfCentralDirSignature
+        || signature == Zip64EndOfCentralDirSignature) {
+        return false;
+    }
+    if (signature != LocalHeaderSignature) {
+        return fail(QString("Unexpected data at offset %1").arg(offset));
+    }
+
+    if (!fill(LocalHeaderSize)) {
+        return fail("Unexpected end of stream");
+    }
+    const quint16 flags = readU16(head() + 6);
+    const quint16 nameLength = readU16(head() + 26);
+    const quint16 extraLength = readU16(head() + 28);
+    const qint64 headerSize = LocalHeaderSize + nameLength + extraLength;
+    if (!fill(headerSize)) {
+        return fail("Unexpected end of stream");
+    }
+
+    quint32 crc = readU32(head() + 14);
+    quint64 compressed = readU32(head() + 18);
+    quint64 uncompressed = readU32(head() + 22);
+    quint64 unusedOffset = 0;
+    const bool zip64 = (compressed == 0xffffffff || uncompressed == 0xffffffff)
+                       && ZipArchive::readZip64Extra(head() + LocalHeaderSize + nameLength, extraLength,
+                                                     uncompressed, compressed, unusedOffset);
+
+    const QByteArray localHeader(reinterpret_cast<const char *>(head()), headerSize);
+    consume(headerSize);
+
+    beginEntry();
+    if (!write(localHeader.constData(), localHeader.size())) {
+        return false;
+    }
+
+    qint64 compressedSize = qint64(compressed);
+    qint64 uncompressedSize = qint64(uncompressed);
+    bool ok;
+    if ((flags & FlagDataDescriptor) && compressedSize == 0) {
+        // Written by a streaming archiver: the sizes only follow the data
+        ok = scanData(crc, compressedSize, uncompressedSize);
+    } else {
+        ok = copyData(compressedSize)
+             && (!(flags & FlagDataDescriptor) || skipDescriptor(zip64, crc, uncompressedSize));
+    }
+    if (!ok) {
+        return false;
+    }
+
+    entry.offset = offset;
+    return finishEntry(localHeader, crc, compressedSize, uncompressedSize, entry);
+}
+
+bool ZipStreamReader::copyData(qint64 size)
+{
+    while (size > 0) {
+        if (available() == 0 && !fill(1)) {
+            return fail("Unexpected end of stream");
+        }
+        const qint64 chunk = qMin(size, available());
+        if (!write(reinterpret_cast<const char *>(head()), chunk)) {
+            return false;
+        }
+        consume(chunk);
+        size -= chunk;
+    }
+    return true;
+}
+
+bool ZipStreamReader::skipDescriptor(bool zip64, quint32 &crc, qint64 &uncompressedSize)
+{
+    if (!fill(4)) {
+        return fail("Unexpected end of stream");
+    }
+    const qint64 start = readU32(head()) == DataDescriptorSignature ? 4 : 0;
+    const qint64 size = start + (zip64 ? 20 : 12);
+    if (!fill(size)) {
+        return fail("Unexpected end of stream");
+    }
+
+    // Sizes in the local header win, some writers fill in both
+    if (crc == 0) {
+        crc = readU32(head() + start);
+    }
+    if (uncompressedSize == 0) {
+        uncompressedSize = zip64 ? qint64(readU64(head() + start + 12)) : readU32(head() + start + 8);
+    }
+    consume(size);
+    return true;
+}
+
+bool ZipStreamReader::scanData(quint32 &crc, qint64 &compressedSize, qint64 &uncompressedSize)
+{
+    // Descriptor layouts, those with the optional signature first since the
+    // signature makes a false match even less likely
+    struct Layout
+    {
+        qint64 size;
+        bool signature;
+        bool wide;
+    };
+    static constexpr Layout layouts[] = { { 24, true, true }, { 16, true, false }, { 20, false, true }, { 12, false, false } };
+
+    // Data passed on to the entry so far, and the first position in the
+    // lookahead not checked for a header signature yet
+    qint64 emitted = 0;
+    qint64 scanFrom = 0;
+
+    forever {
+        const uchar *data = head();
+        const qint64 size = available();
+        for (qint64 q = scanFrom; q + 4 <= size; ++q) {
+            const void *found = std::memchr(data + q, 'P', size_t(size - q - 3));
+            if (!found) {
+                break;
+            }
+            q = static_cast<const uchar *>(found) - data;
+            if (!isHeaderSignature(readU32(data + q))) {
+                continue;
+            }
+
+            // A header signature only ends the data when a descriptor that
+            // counts exactly the bytes before it sits right in front of it
+            for (const Layout &layout : layouts) {
+                if (q < layout.size) {
+                    continue;
+                }
+                const uchar *descriptor = data + q - layout.size;
+                if (layout.signature && readU32(descriptor) != DataDescriptorSignature) {
+                    continue;
+                }
+                const uchar *fields = descriptor + (layout.signature ? 4 : 0);
+                const qint64 dataSize = emitted + q - layout.size;
+                const quint64 recorded = layout.wide ? readU64(fields + 4) : readU32(fields + 4);
+                if (recorded != (layout.wide ? quint64(dataSize) : quint64(quint32(dataSize)))) {
+                    continue;
+                }
+
+                if (!write(reinterpret_cast<const char *>(data), q - layout.size)) {
+                    return false;
+                }
+                crc = readU32(fields);
+                compressedSize = dataSize;
+                uncompressedSize = layout.wide ? qint64(readU64(fields + 12)) : readU32(fields + 8);
+                consume(q);
+                return true;
+            }
+        }
+
+        // Everything but a possible descriptor and the start of a signature
+        // can be passed on already
+        const qint64 keep = MaxDescriptorSize + 3;
+        if (size > keep) {
+            if (!write(reinterpret_cast<const char *>(data), size - keep)) {
+                return false;
+            }
+            emitted += size - keep;
+            consume(size - keep);
+        }
+        scanFrom = qMax<qint64>(0, qMin(size, keep) - 3);
+
+        if (!fill(available() + 1)) {
+            return fail("Unexpected end of stream");
+        }
+    }
+}
+
+void ZipStreamReader::beginEntry()
+{
+    m_entryBuffer.clear();
+    m_spillFile.reset();
+    m_entryMemory = MemoryGrant(m_governor, 0);
+    m_entrySize = 0;
+}
+
+bool ZipStreamReader::write(const char *data, qint64 size)
+{
+    if (!m_spillFile) {
+        const qint64 needed = m_entryBuffer.size() + size;
+        if (needed > InMemoryLimit) {
+            if (!spill()) {
+                return false;
+            }
+        } else if (m_governor && needed > m_entryMemory.bytes()) {
+            // Charged in steps of one read, an entry the budget cannot hold
+            // any more goes to disk
+            const qint64 more = qMax(needed - m_entryMemory.bytes(), ReadChunkSize);
+            if (m_governor->tryAcquire(more)) {
+                m_entryMemory.add(more);
+            } else if (!spill()) {
+                return false;
+            }
+        }
+    }
+
+    if (m_spillFile) {
+        if (m_spillFile->write(data, size) != size) {
+            return fail("Cannot write temporary file: " + m_spillFile->errorString());
+        }
+    } else {
+        m_entryBuffer.append(data, size);
+    }
+    m_entrySize += size;
+    return true;
+}
+
+bool ZipStreamReader::spill()
+{
+    m_spillFile = std::make_shared<QTemporaryFile>(QDir::tempPath() + "/zipextract-XXXXXX.zip");
+    if (!m_spillFile->open()) {
+        return fail("Cannot create temporary file: " + m_spillFile->errorString());
+    }
+    if (m_spillFile->write(m_entryBuffer) != m_entryBuffer.size()) {
+        return fail("Cannot write temporary file: " + m_spillFile->errorString());
+    }
+    m_entryBuffer = QByteArray();
+    m_entryMemory = MemoryGrant(m_governor, 0);
+    return true;
+}
+
+bool ZipStreamReader::finishEntry(const QByteArray &localHeader, quint32 crc, qint64 compressedSize,
+                                  qint64 uncompressedSize, Entry &entry)
+{
+    // A central directory for the one entry turns what was streamed into an
+    // archive the engine can open like any other
+    const auto *local = reinterpret_cast<const uchar *>(localHeader.constData());
+    const quint16 nameLength = readU16(local + 26);
+    const qint64 directoryOffset = m_entrySize;
+    const bool zip64 = compressedSize >= 0xffffffff || uncompressedSize >= 0xffffffff || directoryOffset >= 0xffffffff;
+
+    QByteArray central(CentralHeaderSize, '\0');
+    putU32(central, 0, CentralHeaderSignature);
+    putU16(central, 4, Zip64Version);
+    putU16(central, 6, readU16(local + 4));
+    putU16(central, 8, readU16(local + 6));
+    putU16(central, 10, readU16(local + 8));
+    putU32(central, 12, readU32(local + 10));
+    putU32(central, 16, crc);
+    putU32(central, 20, zip64 ? 0xffffffff : quint32(compressedSize));
+    putU32(central, 24, zip64 ? 0xffffffff : quint32(uncompressedSize));
+    putU16(central, 28, nameLength);
+    central.append(localHeader.constData() + LocalHeaderSize, nameLength);
+    QByteArray extra;
+    if (zip64) {
+        extra = QByteArray(20, '\0');
+        putU16(extra, 0, Zip64ExtraId);
+        putU16(extra, 2, 16);
+        putU64(extra, 4, quint64(uncompressedSize));
+        putU64(extra, 12, quint64(compressedSize));
+    }
+    // AES entries keep their key strength and actual method in an extra
+    // field, which the decryptor reads from the central header
+    extra.append(localExtraField(localHeader, AesExtraId));
+    putU16(central, 30, quint16(extra.size()));
+    central.append(extra);
+
+    QByteArray end;
+    if (zip64) {
+        QByteArray record(Zip64EndOfCentralDirSize + Zip64LocatorSize, '\0');
+        putU32(record, 0, Zip64EndOfCentralDirSignature);
+        putU64(record, 4, Zip64EndOfCentralDirSize - 12);
+        putU16(record, 12, Zip64Version);
+        putU16(record, 14, Zip64Version);
+        putU64(record, 24, 1);
+        putU64(record, 32, 1);
+        putU64(record, 40, quint64(central.size()));
+        putU64(record, 48, quint64(directoryOffset));
+        putU32(record, Zip64EndOfCentralDirSize, Zip64LocatorSignature);
+        putU64(record, Zip64EndOfCentralDirSize + 8, quint64(directoryOffset + central.size()));
+        putU32(record, Zip64EndOfCentralDirSize + 16, 1);
+        end = record;
+    }
+    QByteArray record(EndOfCentralDirSize, '\0');
+    putU32(record, 0, EndOfCentralDirSignature);
+    putU16(record, 8, 1);
+    putU16(record, 10, 1);
+    putU32(record, 12, quint32(central.size()));
+    putU32(record, 16, zip64 ? 0xffffffff : quint32(directoryOffset));
+    end.append(record);
+
+    if (!write(central.constData(), central.size()) || !write(end.constData(), end.size())) {
+        return false;
+    }
+
+    auto archive = std::make_shared<ZipArchive>();
+    bool opened;
+    if (m_spillFile) {
+        opened = m_spillFile->flush() && archive->open(m_spillFile->fileName());
+    } else {
+        opened = archive->open(m_entryBuffer);
+        m_entryBuffer = QByteArray();
+    }
+    if (!opened || archive->entryCount() != 1) {
+        return fail(QString("Damaged entry at offset %1").arg(entry.offset));
+    }
+
+    m_streamed.insert(entry.offset, { archive->name(0), crc, compressedSize, uncompressedSize });
+    entry.archive = std::move(archive);
+    entry.spillFile = std::move(m_spillFile);
+    entry.memory = std::move(m_entryMemory);
+    return true;
+}
+
+bool ZipStreamReader::readCentralDirectory()
+{
+    // Read one record at a time, so only the current one is buffered. A
+    // stream that keeps going past what a directory for its entries can hold
+    // is refused rather than read into memory.
+    QSet<qint64> listed;
+    qsizetype records = 0;
+    while (fill(4) && readU32(head()) == CentralHeaderSignature) {
+        if (++records > m_streamed.size()) {
+            return fail("Central directory lists more entries than the stream holds");
+        }
+        if (!fill(CentralHeaderSize)) {
+            return fail("Truncated central directory");
+        }
+        const uchar *header = head();
+        const quint16 nameLength = readU16(header + 28);
+        const quint16 extraLength = readU16(header + 30);
+        const qint64 recordSize = CentralHeaderSize + nameLength + extraLength + readU16(header + 32);
+        if (!fill(recordSize)) {
+            return fail("Truncated central directory");
+        }
+        header = head();
+        consume(recordSize);
+
+        quint64 compressed = readU32(header + 20);
+        quint64 uncompressed = readU32(header + 24);
+        quint64 offset = readU32(header + 42);
+        if (compressed == 0xffffffff || uncompressed == 0xffffffff || offset == 0xffffffff) {
+            ZipArchive::readZip64Extra(header + CentralHeaderSize + nameLength, extraLength,
+                                       uncompressed, compressed, offset);
+        }
+        listed.insert(qint64(offset));
+
+        const auto streamed = m_streamed.constFind(qint64(offset));
+        if (streamed == m_streamed.cend()) {
+            const QByteArray name(reinterpret_cast<const char *>(header + CentralHeaderSize), nameLength);
+            m_mismatches.append({ Mismatch::Missing, qint64(offset), QString::fromUtf8(name) });
+            continue;
+        }
+        if (streamed->crc != readU32(header + 16) || streamed->compressedSize != qint64(compressed)
+            || streamed->uncompressedSize != qint64(uncompressed)) {
+            m_mismatches.append({ Mismatch::Changed, qint64(offset), streamed->name });
+            continue;
+        }
+        if ((readU16(header + 4) >> 8) == HostUnix) {
+            const quint16 mode = quint16(readU32(header + 38) >> 16) & 07777;
+            if (mode != 0) {
+                m_modes.append({ qint64(offset), streamed->name, mode });
+            }
+        }
+    }
+
+    // The end records are read through and dropped
+    qint64 trailer = 0;
+    do {
+        trailer += available();
+        consume(available());
+        if (trailer > MaxTrailerSize) {
+            return fail("Unexpected data after the central directory");
+        }
+    } while (fill(1));
+    if (!m_error.isEmpty()) {
+        return false;
+    }
+
+    for (auto it = m_streamed.cbegin(); it != m_streamed.cend(); ++it) {
+        if (!listed.contains(it.key())) {
+            m_mismatches.append({ Mismatch::Unlisted, it.key(), it->name });
+        }
+    }
+    return true;
+}
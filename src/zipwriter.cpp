@@ -0,0 +1,245 @@
+#include "zipwriter.h"
+#include <QtEndian>
+
+namespace {
+
+constexpr quint32 LocalHeaderSignature = 0x04034b50;
+constexpr quint32 CentralHeaderSignature = 0x02014b50;
+constexpr quint32 EndOfCentralDirSignature = 0x06054b50;
+constexpr quint32 Zip64EndOfCentralDirSignature = 0x06064b50;
+constexpr quint32 Zip64LocatorSignature = 0x07064b50;
+
+constexpr quint16 Zip64ExtraId = 0x0001;
+constexpr quint16 FlagUtf8 = 0x0800;
+constexpr quint16 MethodZstd = 93;
+
+// APPNOTE 4.4.3: 2.0 for Deflate, 4.5 for Zip64, 6.3 for Zstandard
+constexpr quint16 VersionDefault = 20;
+constexpr quint16 VersionZip64 = 45;
+constexpr quint16 VersionZstd = 63;
+
+constexpr quint8 HostUnix = 3;
+constexpr quint32 DosDirectoryAttribute = 0x10;
+
+constexpr quint32 Max32 = 0xffffffff;
+constexpr quint16 Max16 = 0xffff;
+
+// Entries this large get a Zip64 local header up front, with room to spare
+// for Deflate output that ends up larger than its input
+constexpr qint64 Zip64HeaderThreshold = 0xf0000000;
+
+void appendU16(QByteArray &out, quint16 value)
+{
+    char bytes[2];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, 2);
+}
+
+void appendU32(QByteArray &out, quint32 value)
+{
+    char bytes[4];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, 4);
+}
+
+void appendU64(QByteArray &out, quint64 value)
+{
+    char bytes[8];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, 8);
+}
+
+quint16 versionNeeded(const ZipWriter::Entry &entry, bool zip64)
+{
+    if (entry.method == MethodZstd) {
+        return VersionZstd;
+    }
+    return zip64 ? VersionZip64 : VersionDefault;
+}
+
+}
+
+ZipWriter::ZipWriter(QFileDevice *device)
+    : m_device(device)
+    , m_position(device->pos())
+{
+}
+
+quint32 ZipWriter::dosTime(const QDateTime &time)
+{
+    const QDateTime local = time.toLocalTime();
+    const QDate date = local.date();
+    if (!local.isValid() || date.year() < 1980) {
+        return (1 << 21) | (1 << 16);
+    }
+    if (date.year() > 2107) {
+        return (127u << 25) | (12 << 21) | (31 << 16) | (23 << 11) | (59 << 5) | 29;
+    }
+    const QTime clock = local.time();
+    return (quint32(date.year() - 1980) << 25) | (quint32(date.month()) << 21) | (quint32(date.day()) << 16)
+           | (quint32(clock.hour()) << 11) | (quint32(clock.minute()) << 5) | quint32(clock.second() / 2);
+}
+
+QByteArray ZipWriter::localHeader(const Record &record) const
+{
+    const Entry &entry = record.entry;
+    QByteArray header;
+    header.reserve(30 + entry.name.size() + 20);
+    appendU32(header, LocalHeaderSignature);
+    appendU16(header, versionNeeded(entry, record.zip64Header));
+    appendU16(header, FlagUtf8);
+    appendU16(header, entry.method);
+    appendU32(header, entry.dosTime);
+    appendU32(header, entry.crc);
+    appendU32(header, record.zip64Header ? Max32 : quint32(entry.compressedSize));
+    appendU32(header, record.zip64Header ? Max32 : quint32(entry.uncompressedSize));
+    appendU16(header, quint16(entry.name.size()));
+    appendU16(header, record.zip64Header ? 20 : 0);
+    header.append(entry.name);
+
+    // Both sizes, whatever their value, so patching never moves the data
+    if (record.zip64Header) {
+        appendU16(header, Zip64ExtraId);
+        appendU16(header, 16);
+        appendU64(header, quint64(entry.uncompressedSize));
+        appendU64(header, quint64(entry.compressedSize));
+    }
+    return header;
+}
+
+bool ZipWriter::beginEntry(const Entry &entry)
+{
+    if (entry.name.size() > Max16) {
+        return fail("Entry name too long: " + QString::fromUtf8(entry.name));
+    }
+
+    Record record;
+    record.entry = entry;
+    record.localHeaderOffset = m_position;
+    record.zip64Header = entry.uncompressedSize >= Zip64HeaderThreshold || entry.compressedSize >= Zip64HeaderThreshold;
+    m_records.append(record);
+    return write(localHeader(record));
+}
+
+bool ZipWriter::writeData(const char *data, qint64 size)
+{
+    const qint64 written = m_device->write(data, size);
+    if (written != size) {
+        return fail("Write failed: " + m_device->errorString());
+    }
+    m_position += written;
+    return true;
+}
+
+bool ZipWriter::finishEntry(const Entry &entry)
+{
+    Record &record = m_records.last();
+    const bool changed = entry.crc != record.entry.crc || entry.compressedSize != record.entry.compressedSize
+                         || entry.uncompressedSize != record.entry.uncompressedSize || entry.method != record.entry.method;
+    if (!record.zip64Header && (entry.compressedSize >= Max32 || entry.uncompressedSize >= Max32)) {
+        return fail("Entry grew past 4 GiB while it was read: " + QString::fromUtf8(entry.name));
+    }
+
+    record.entry = entry;
+    if (!changed) {
+        return true;
+    }
+
+    const QByteArray header = localHeader(record);
+    if (!m_device->seek(record.localHeaderOffset) || m_device->write(header) != header.size() || !m_device->seek(m_position)) {
+        return fail("Write failed: " + m_device->errorString());
+    }
+    return true;
+}
+
+bool ZipWriter::finish()
+{
+    const qint64 directoryOffset = m_position;
+    QByteArray directory;
+    for (const Record &record : std::as_const(m_records)) {
+        const Entry &entry = record.entry;
+
+        // Only the fields that overflow move to the Zip64 extra, in this order
+        QByteArray zip64;
+        if (entry.uncompressedSize >= Max32) {
+            appendU64(zip64, quint64(entry.uncompressedSize));
+        }
+        if (entry.compressedSize >= Max32) {
+            appendU64(zip64, quint64(entry.compressedSize));
+        }
+        if (record.localHeaderOffset >= Max32) {
+            appendU64(zip64, quint64(record.localHeaderOffset));
+        }
+
+#ifdef Q_OS_UNIX
+        const quint16 madeBy = (HostUnix << 8) | VersionZstd;
+#else
+        const quint16 madeBy = VersionZstd;
+#endif
+        appendU32(directory, CentralHeaderSignature);
+        appendU16(directory, madeBy);
+        appendU16(directory, versionNeeded(entry, !zip64.isEmpty()));
+        appendU16(directory, FlagUtf8);
+        appendU16(directory, entry.method);
+        appendU32(directory, entry.dosTime);
+        appendU32(directory, entry.crc);
+        appendU32(directory, quint32(qMin<qint64>(entry.compressedSize, Max32)));
+        appendU32(directory, quint32(qMin<qint64>(entry.uncompressedSize, Max32)));
+        appendU16(directory, quint16(entry.name.size()));
+        appendU16(directory, quint16(zip64.isEmpty() ? 0 : zip64.size() + 4));
+        appendU16(directory, 0);
+        appendU16(directory, 0);
+        appendU16(directory, 0);
+        appendU32(directory, (entry.unixMode << 16) | (entry.isDir ? DosDirectoryAttribute : 0));
+        appendU32(directory, quint32(qMin<qint64>(record.localHeaderOffset, Max32)));
+        directory.append(entry.name);
+        if (!zip64.isEmpty()) {
+            appendU16(directory, Zip64ExtraId);
+            appendU16(directory, quint16(zip64.size()));
+            directory.append(zip64);
+        }
+    }
+
+    const qint64 directorySize = directory.size();
+    const qint64 entryCount = m_records.size();
+    const bool zip64 = entryCount >= Max16 || directoryOffset >= Max32 || directorySize >= Max32;
+    if (zip64) {
+        const qint64 recordOffset = directoryOffset + directorySize;
+        appendU32(directory, Zip64EndOfCentralDirSignature);
+        appendU64(directory, 44);
+        appendU16(directory, VersionZip64);
+        appendU16(directory, VersionZip64);
+        appendU32(directory, 0);
+        appendU32(directory, 0);
+        appendU64(directory, quint64(entryCount));
+        appendU64(directory, quint64(entryCount));
+        appendU64(directory, quint64(directorySize));
+        appendU64(directory, quint64(directoryOffset));
+
+        appendU32(directory, Zip64LocatorSignature);
+        appendU32(directory, 0);
+        appendU64(directory, quint64(recordOffset));
+        appendU32(directory, 1);
+    }
+
+    appendU32(directory, EndOfCentralDirSignature);
+    appendU16(directory, 0);
+    appendU16(directory, 0);
+    appendU16(directory, quint16(qMin<qint64>(entryCount, Max16)));
+    appendU16(directory, quint16(qMin<qint64>(entryCount, Max16)));
+    appendU32(directory, quint32(qMin<qint64>(directorySize, Max32)));
+    appendU32(directory, quint32(qMin<qint64>(directoryOffset, Max32)));
+    appendU16(directory, 0);
+    return write(directory);
+}
+
+bool ZipWriter::write(const QByteArray &data)
+{
+    return writeData(data.constData(), data.size());
+}
+
+bool ZipWriter::fail(const QString &error)
+{
+    m_error = error;
+    return false;
+}
@@ -0,0 +1,208 @@
+#include "cipher.h"
+#include <QTest>
+
+namespace {
+
+const uchar *bytes(const QByteArray &data)
+{
+    return reinterpret_cast<const uchar *>(data.constData());
+}
+
+QByteArray hmac(const QByteArray &key, const QByteArray &data, qsizetype sliceSize)
+{
+    HmacSha1 mac;
+    mac.setKey(key);
+    for (qsizetype offset = 0; offset < data.size(); offset += sliceSize) {
+        mac.addData(bytes(data) + offset, qMin(sliceSize, data.size() - offset));
+    }
+    QByteArray digest(HmacSha1::DigestSize, Qt::Uninitialized);
+    mac.result(reinterpret_cast<uchar *>(digest.data()));
+    return digest;
+}
+
+}
+
+// Built twice: tst_cipher runs whatever the CPU supports, tst_cipher_portable
+// has ZIPEXTRACT_CIPHER_PORTABLE set so the table-driven AES and portable
+// SHA-1 run on every machine
+class TestCipher : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void implementation();
+    void aesCtr_data();
+    void aesCtr();
+    void aesCtrRejectsKeySize();
+    void hmacSha1_data();
+    void hmacSha1();
+    void pbkdf2_data();
+    void pbkdf2();
+};
+
+void TestCipher::implementation()
+{
+#ifdef ZIPEXTRACT_CIPHER_PORTABLE
+    QCOMPARE(QByteArray(AesCtr::implementation()), QByteArray("tables"));
+    QCOMPARE(QByteArray(HmacSha1::implementation()), QByteArray("portable"));
+#else
+    qInfo("aes: %s, sha1: %s", AesCtr::implementation(), HmacSha1::implementation());
+#endif
+}
+
+void TestCipher::aesCtr_data()
+{
+    QTest::addColumn<QByteArray>("key");
+    QTest::addColumn<QByteArray>("keyStream");
+
+    // AES of the little-endian counters 1, 2, ... under the FIPS-197 example
+    // keys, from OpenSSL's ECB mode. Ten blocks take the eight block batch of
+    // the hardware paths and then single blocks.
+    QTest::newRow("AES-128") << QByteArray::fromHex("000102030405060708090a0b0c0d0e0f")
+                             << QByteArray::fromHex("e37cd363dd7c87a09aff0e3e60e09c82"
+                                                    "fb8ae31ba5db9cad97364d8722d47326");
+    QTest::newRow("AES-192") << QByteArray::fromHex("000102030405060708090a0b0c0d0e0f1011121314151617")
+                             << QByteArray::fromHex("094a723ceaf7f7b732e05b90d35b8cf1"
+                                                    "a8fd516dfc09cbb9b38b8527ff25bbe4");
+    QTest::newRow("AES-256") << QByteArray::fromHex("000102030405060708090a0b0c0d0e0f"
+                                                    "101112131415161718191a1b1c1d1e1f")
+                             << QByteArray::fromHex("c7b519846a11411cd6ac07cb03f801a8"
+                                                    "4ef4b88bebd54953c37ffaf66efaca7b"
+                                                    "80c3017e8f89ab315ede32b11e48ab50"
+                                                    "d5786900334bbaad31a868ca3c29221b"
+                                                    "99ebccc0117949cd663c44c06a1c58b0"
+                                                    "5daad7132f80983dae88ecf9ce714a1b"
+                                                    "600411a4cb4d0da02e107f8d0bcfdab8"
+                                                    "64009471a3394f76374e38bfdc9fe26c"
+                                                    "62ac2e4b9ec5049108dccdb6488f325c"
+                                                    "f3297d5a71a5d1734dd46661023ea39f");
+}
+
+void TestCipher::aesCtr()
+{
+    QFETCH(QByteArray, key);
+    QFETCH(QByteArray, keyStream);
+
+    AesCtr aes;
+    QVERIFY(aes.setKey(bytes(key), int(key.size())));
+    QByteArray output(keyStream.size(), '\0');
+    aes.apply(bytes(output), reinterpret_cast<uchar *>(output.data()), output.size());
+    QCOMPARE(output, keyStream);
+
+    // Calls of odd sizes continue the key stream mid-block, and a new key
+    // starts the counter over
+    QVERIFY(aes.setKey(bytes(key), int(key.size())));
+    QByteArray message(keyStream.size(), Qt::Uninitialized);
+    for (qsizetype i = 0; i < message.size(); ++i) {
+        message[i] = char(i * 7);
+    }
+    QByteArray encrypted = message;
+    uchar *data = reinterpret_cast<uchar *>(encrypted.data());
+    for (qsizetype offset = 0, size = 5; offset < encrypted.size(); offset += size, size += 6) {
+        size = qMin(size, encrypted.size() - offset);
+        aes.apply(data + offset, data + offset, size);
+    }
+    for (qsizetype i = 0; i < message.size(); ++i) {
+        QCOMPARE(encrypted[i], char(message[i] ^ keyStream[i]));
+    }
+}
+
+void TestCipher::aesCtrRejectsKeySize()
+{
+    const QByteArray key(20, 'k');
+    AesCtr aes;
+    QVERIFY(!aes.setKey(bytes(key), int(key.size())));
+}
+
+void TestCipher::hmacSha1_data()
+{
+    QTest::addColumn<QByteArray>("key");
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<QByteArray>("digest");
+
+    // RFC 2202, the truncation case with its full digest
+    QTest::newRow("RFC 2202 1") << QByteArray(20, '\x0b') << QByteArray("Hi There")
+                                << QByteArray::fromHex("b617318655057264e28bc0b6fb378c8ef146be00");
+    QTest::newRow("RFC 2202 2") << QByteArray("Jefe") << QByteArray("what do ya want for nothing?")
+                                << QByteArray::fromHex("effcdf6ae5eb2fa2d27416d5f184df9c259a7c79");
+    QTest::newRow("RFC 2202 3") << QByteArray(20, '\xaa') << QByteArray(50, '\xdd')
+                                << QByteArray::fromHex("125d7342b9ac11cd91a39af48aa17b4f63f175d3");
+    QTest::newRow("RFC 2202 4") << QByteArray::fromHex("0102030405060708090a0b0c0d0e0f10111213141516171819")
+                                << QByteArray(50, '\xcd')
+                                << QByteArray::fromHex("4c9007f4026250c6bc8414f9bf50c86c2d7235da");
+    QTest::newRow("RFC 2202 5") << QByteArray(20, '\x0c') << QByteArray("Test With Truncation")
+                                << QByteArray::fromHex("4c1a03424b55e07fe7f27be1d58bb9324a9a5a04");
+    QTest::newRow("RFC 2202 6") << QByteArray(80, '\xaa')
+                                << QByteArray("Test Using Larger Than Block-Size Key - Hash Key First")
+                                << QByteArray::fromHex("aa4ae5e15272d00e95705637ce8a3b55ed402112");
+    QTest::newRow("RFC 2202 7")
+        << QByteArray(80, '\xaa')
+        << QByteArray("Test Using Larger Than Block-Size Key and Larger Than One Block-Size Data")
+        << QByteArray::fromHex("e8e99d0f45237d786d6bbaa7965c7808bbff1a91");
+
+    // Several whole blocks, from Python's hmac module
+    QByteArray message(1000, Qt::Uninitialized);
+    for (qsizetype i = 0; i < message.size(); ++i) {
+        message[i] = char(i * 7);
+    }
+    QTest::newRow("1000 bytes") << QByteArray("key") << message
+                                << QByteArray::fromHex("35ec7a2d42491c4439bd79b95b8ba40585e8c475");
+}
+
+void TestCipher::hmacSha1()
+{
+    QFETCH(QByteArray, key);
+    QFETCH(QByteArray, data);
+    QFETCH(QByteArray, digest);
+
+    QCOMPARE(hmac(key, data, qMax<qsizetype>(data.size(), 1)), digest);
+    // Slices that split blocks go through the partial block buffer
+    QCOMPARE(hmac(key, data, 1), digest);
+    QCOMPARE(hmac(key, data, 63), digest);
+    QCOMPARE(hmac(key, data, 130), digest);
+}
+
+void TestCipher::pbkdf2_data()
+{
+    QTest::addColumn<QByteArray>("password");
+    QTest::addColumn<QByteArray>("salt");
+    QTest::addColumn<int>("iterations");
+    QTest::addColumn<QByteArray>("key");
+
+    // RFC 6070
+    QTest::newRow("RFC 6070 1") << QByteArray("password") << QByteArray("salt") << 1
+                                << QByteArray::fromHex("0c60c80f961f0e71f3a9b524af6012062fe037a6");
+    QTest::newRow("RFC 6070 2") << QByteArray("password") << QByteArray("salt") << 2
+                                << QByteArray::fromHex("ea6c014dc72d6f8ccd1ed92ace1d41f0d8de8957");
+    QTest::newRow("RFC 6070 3") << QByteArray("password") << QByteArray("salt") << 4096
+                                << QByteArray::fromHex("4b007901b765489abead49d926f721d065a429c1");
+    QTest::newRow("RFC 6070 5") << QByteArray("passwordPASSWORDpassword")
+                                << QByteArray("saltSALTsaltSALTsaltSALTsaltSALTsalt") << 4096
+                                << QByteArray::fromHex("3d2eec4fe41c849b80c8d83662c0e44a8b291a964cf2f07038");
+    QTest::newRow("RFC 6070 6") << QByteArray("pass\0word", 9) << QByteArray("sa\0lt", 5) << 4096
+                                << QByteArray::fromHex("56fa6aa75548099dcc37d7f03425e0c3");
+
+    // What WinZip AES-256 derives: two keys and the verifier from a 16 byte
+    // salt, from Python's hashlib
+    QTest::newRow("WinZip AES-256") << QByteArray("password")
+                                    << QByteArray::fromHex("0102030405060708090a0b0c0d0e0f10") << 1000
+                                    << QByteArray::fromHex("eafb91255ee68040515b11fa8982ab1c"
+                                                           "a7ed0438b26a29b958f9cc2e77152f35"
+                                                           "24068691cca360608c0a209391097e92"
+                                                           "83e5f3fc055a2749f42895181012b5c1"
+                                                           "4738");
+}
+
+void TestCipher::pbkdf2()
+{
+    QFETCH(QByteArray, password);
+    QFETCH(QByteArray, salt);
+    QFETCH(int, iterations);
+    QFETCH(QByteArray, key);
+
+    QCOMPARE(HmacSha1::pbkdf2(password, salt, iterations, int(key.size())), key);
+}
+
+QTEST_APPLESS_MAIN(TestCipher)
+
+#include "tst_cipher.moc"
@@ -0,0 +1,236 @@
+#include "deflate64decoder.h"
+#include <QTest>
+
+namespace {
+
+constexpr qint64 KiB = 1024;
+
+// Deflate bit stream writer: header fields and extra bits go least
+// significant bit first, Huffman codes most significant bit first
+class BitWriter
+{
+public:
+    void bits(quint32 value, int count)
+    {
+        for (int i = 0; i < count; ++i) {
+            bit((value >> i) & 1);
+        }
+    }
+
+    void code(quint32 code, int length)
+    {
+        for (int i = length - 1; i >= 0; --i) {
+            bit((code >> i) & 1);
+        }
+    }
+
+    // Fixed Huffman codes of RFC 1951 3.2.6
+    void literal(int symbol)
+    {
+        if (symbol < 144) {
+            code(0x30 + symbol, 8);
+        } else if (symbol < 256) {
+            code(0x190 + symbol - 144, 9);
+        } else if (symbol < 280) {
+            code(symbol - 256, 7);
+        } else {
+            code(0xc0 + symbol - 280, 8);
+        }
+    }
+
+    void storedBlock(const QByteArray &data, bool final)
+    {
+        bits(final, 1);
+        bits(0, 2);
+        align();
+        m_out.append(char(data.size() & 0xff)).append(char(data.size() >> 8));
+        m_out.append(char(~data.size() & 0xff)).append(char((~data.size() >> 8) & 0xff));
+        m_out.append(data);
+    }
+
+    QByteArray finish()
+    {
+        align();
+        return m_out;
+    }
+
+private:
+    void bit(quint32 value)
+    {
+        m_byte |= value << m_count;
+        if (++m_count == 8) {
+            m_out.append(char(m_byte));
+            m_byte = 0;
+            m_count = 0;
+        }
+    }
+
+    void align()
+    {
+        if (m_count > 0) {
+            m_out.append(char(m_byte));
+            m_byte = 0;
+            m_count = 0;
+        }
+    }
+
+    QByteArray m_out;
+    quint32 m_byte = 0;
+    int m_count = 0;
+};
+
+// Incompressible bytes for the stored blocks
+QByteArray noise(qsizetype size)
+{
+    QByteArray data(size, Qt::Uninitialized);
+    quint32 state = 0x12345678;
+    for (char &c : data) {
+        state = state * 1664525 + 1013904223;
+        c = char(state >> 24);
+    }
+    return data;
+}
+
+// Hands the input out in small slices so codes straddle slice boundaries
+class SlicedInput : public EntryInput
+{
+public:
+    SlicedInput(const QByteArray &data, qint64 sliceSize)
+        : EntryInput(reinterpret_cast<const uchar *>(data.constData()), data.size())
+        , m_sliceSize(sliceSize)
+    {
+    }
+
+    bool next(qint64 maxSize, const uchar *&slice, qint64 &sliceSize) override
+    {
+        return EntryInput::next(qMin(maxSize, m_sliceSize), slice, sliceSize);
+    }
+
+private:
+    qint64 m_sliceSize;
+};
+
+bool decode(EntryDecoder &decoder, const QByteArray &stream, qint64 windowSize, qint64 sliceSize,
+            QByteArray &output)
+{
+    SlicedInput input(stream, sliceSize);
+    QByteArray window(windowSize, Qt::Uninitialized);
+    output.clear();
+    return decoder.decode(input, -1, 0, window, [&output](const char *data, qint64 size, qint64) {
+        output.append(data, size);
+        return true;
+    });
+}
+
+// 64 KiB of stored data followed by a fixed block with matches reaching
+// back the whole 64 KiB: a length 258 match (code 284 with all five extra
+// bits set, as Deflate64 has no fixed 258), a 65538 byte match through code
+// 285's 16 extra bits that overlaps its own output, and one literal
+void deflate64Stream(QByteArray &stream, QByteArray &expected)
+{
+    const QByteArray data = noise(64 * KiB);
+    BitWriter writer;
+    writer.storedBlock(data.first(65535), false);
+    writer.storedBlock(data.sliced(65535), false);
+
+    writer.bits(1, 1);
+    writer.bits(1, 2);
+    writer.literal(284);
+    writer.bits(31, 5);
+    writer.code(31, 5);
+    writer.bits(16383, 14);
+    writer.literal(285);
+    writer.bits(65535, 16);
+    writer.code(31, 5);
+    writer.bits(16383, 14);
+    writer.literal('Z');
+    writer.literal(256);
+    stream = writer.finish();
+
+    expected = data;
+    for (qint64 i = 0; i < 258 + 65538; ++i) {
+        expected.append(expected[expected.size() - 64 * KiB]);
+    }
+    expected.append('Z');
+}
+
+}
+
+class TestDeflate64Decoder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void longMatches_data();
+    void longMatches();
+    void plainDeflateLength258();
+    void rejectsSmallWindow();
+};
+
+void TestDeflate64Decoder::longMatches_data()
+{
+    QTest::addColumn<qint64>("windowSize");
+    QTest::addColumn<qint64>("sliceSize");
+
+    QTest::newRow("64 KiB window") << 64 * KiB << (qint64(1) << 30);
+    QTest::newRow("64 KiB window, 7 byte slices") << 64 * KiB << qint64(7);
+    QTest::newRow("256 KiB window") << 256 * KiB << (qint64(1) << 30);
+}
+
+void TestDeflate64Decoder::longMatches()
+{
+    QFETCH(qint64, windowSize);
+    QFETCH(qint64, sliceSize);
+
+    QByteArray stream;
+    QByteArray expected;
+    deflate64Stream(stream, expected);
+
+    Deflate64Decoder decoder;
+    QByteArray output;
+    QVERIFY2(decode(decoder, stream, windowSize, sliceSize, output), qPrintable(decoder.errorString()));
+    QCOMPARE(output.size(), expected.size());
+    QVERIFY(output == expected);
+
+    // The same decoder is reused for the next entry
+    QVERIFY(decode(decoder, stream, windowSize, sliceSize, output));
+    QVERIFY(output == expected);
+}
+
+void TestDeflate64Decoder::plainDeflateLength258()
+{
+    // In plain deflate code 285 is a fixed 258 without extra bits, and the
+    // window ends at 32 KiB
+    const QByteArray data = noise(32 * KiB);
+    BitWriter writer;
+    writer.storedBlock(data, false);
+    writer.bits(1, 1);
+    writer.bits(1, 2);
+    writer.literal(285);
+    writer.code(29, 5);
+    writer.bits(8191, 13);
+    writer.literal(256);
+    const QByteArray stream = writer.finish();
+
+    QByteArray expected = data + data.first(258);
+
+    Deflate64Decoder decoder(false);
+    QByteArray output;
+    QVERIFY2(decode(decoder, stream, 64 * KiB, qint64(1) << 30, output), qPrintable(decoder.errorString()));
+    QVERIFY(output == expected);
+}
+
+void TestDeflate64Decoder::rejectsSmallWindow()
+{
+    QByteArray stream;
+    QByteArray expected;
+    deflate64Stream(stream, expected);
+
+    Deflate64Decoder decoder;
+    QByteArray output;
+    QVERIFY(!decode(decoder, stream, 32 * KiB, qint64(1) << 30, output));
+}
+
+QTEST_APPLESS_MAIN(TestDeflate64Decoder)
+
+#include "tst_deflate64decoder.moc"
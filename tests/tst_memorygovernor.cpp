@@ -0,0 +1,115 @@
+#include "canceltoken.h"
+#include "memorygovernor.h"
+#include <QElapsedTimer>
+#include <QTest>
+#include <QThread>
+#include <atomic>
+
+namespace {
+
+constexpr qint64 MiB = 1024 * 1024;
+
+}
+
+class TestMemoryGovernor : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void acquireFits();
+    void acquireAboveBudget();
+    void acquireAboveWhatForcedLeaves();
+    void acquireWaitsForRelease();
+    void acquireCancelled();
+};
+
+void TestMemoryGovernor::acquireFits()
+{
+    MemoryGovernor governor;
+    governor.setBudget(1024);
+    QCOMPARE(governor.acquire(512, nullptr), qint64(512));
+    QCOMPARE(governor.inUse(), qint64(512));
+    governor.release(512);
+    QCOMPARE(governor.inUse(), qint64(0));
+}
+
+void TestMemoryGovernor::acquireAboveBudget()
+{
+    MemoryGovernor governor;
+    governor.setBudget(1024);
+    QCOMPARE(governor.acquire(4096, nullptr), qint64(1024));
+    governor.release(1024);
+}
+
+void TestMemoryGovernor::acquireAboveWhatForcedLeaves()
+{
+    // The per-worker baseline stays charged for the whole run, so a decoder
+    // estimate at or above the budget has to fit next to it
+    MemoryGovernor governor;
+    governor.setBudget(64 * MiB);
+    MemoryGrant baseline = governor.force(2 * MiB);
+
+    // Cancelled after a while so a regression fails instead of hanging
+    CancelToken token;
+    std::atomic<bool> done = false;
+    QThread *canceller = QThread::create([&token, &done] {
+        QElapsedTimer timer;
+        timer.start();
+        while (!done && timer.elapsed() < 2000) {
+            QThread::msleep(10);
+        }
+        token.cancel();
+    });
+    canceller->start();
+
+    const qint64 granted = governor.acquire(64 * MiB, &token);
+    done = true;
+    canceller->wait();
+    delete canceller;
+
+    QCOMPARE(granted, 62 * MiB);
+    QCOMPARE(governor.inUse(), 64 * MiB);
+
+    governor.release(granted);
+    baseline.reset();
+    QCOMPARE(governor.inUse(), qint64(0));
+
+    // Once the baseline is gone the whole budget is available again
+    QCOMPARE(governor.acquire(64 * MiB, nullptr), 64 * MiB);
+    governor.release(64 * MiB);
+}
+
+void TestMemoryGovernor::acquireWaitsForRelease()
+{
+    MemoryGovernor governor;
+    governor.setBudget(1024);
+    MemoryGrant held(&governor, governor.acquire(768, nullptr));
+
+    QThread *releaser = QThread::create([&held] {
+        QThread::msleep(50);
+        held.reset();
+    });
+    releaser->start();
+    QCOMPARE(governor.acquire(512, nullptr), qint64(512));
+    releaser->wait();
+    delete releaser;
+
+    QCOMPARE(governor.inUse(), qint64(512));
+    governor.release(512);
+}
+
+void TestMemoryGovernor::acquireCancelled()
+{
+    MemoryGovernor governor;
+    governor.setBudget(1024);
+    MemoryGrant held(&governor, governor.acquire(1024, nullptr));
+
+    CancelToken token;
+    token.cancel();
+    QCOMPARE(governor.acquire(512, &token), qint64(-1));
+    QCOMPARE(governor.inUse(), qint64(1024));
+}
+
+QTEST_APPLESS_MAIN(TestMemoryGovernor)
+
+#include "tst_memorygovernor.moc"
@@ -0,0 +1,188 @@
+#include "ziparchive.h"
+#include <QTest>
+#include <QtEndian>
+
+namespace {
+
+struct TestEntry
+{
+    QByteArray name;
+    QByteArray data;
+    quint32 crc;
+};
+
+// How the Zip64 records of a test archive are laid out or damaged
+struct Layout
+{
+    quint64 declaredCount = 0;
+    quint16 firstExtraSize = 16;
+    qint64 locatorShift = 0;
+};
+
+template<typename T>
+void append(QByteArray &out, T value)
+{
+    char bytes[sizeof(T)];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, sizeof(T));
+}
+
+// Stored entries behind a Zip64 end record. The classic end record only
+// holds saturated fields; the first entry keeps its sizes and the second
+// its offset in the Zip64 extra field, as writers do once they overflow.
+QByteArray zip64Archive(const QList<TestEntry> &entries, const Layout &layout = Layout())
+{
+    QByteArray archive;
+    QList<quint64> offsets;
+    for (const TestEntry &entry : entries) {
+        offsets.append(quint64(archive.size()));
+        append<quint32>(archive, 0x04034b50);
+        append<quint16>(archive, 45);
+        append<quint16>(archive, 0);
+        append<quint16>(archive, 0);
+        append<quint16>(archive, 0);
+        append<quint16>(archive, 0x21);
+        append<quint32>(archive, entry.crc);
+        append<quint32>(archive, quint32(entry.data.size()));
+        append<quint32>(archive, quint32(entry.data.size()));
+        append<quint16>(archive, quint16(entry.name.size()));
+        append<quint16>(archive, 0);
+        archive.append(entry.name);
+        archive.append(entry.data);
+    }
+
+    const quint64 directoryOffset = quint64(archive.size());
+    for (qsizetype i = 0; i < entries.size(); ++i) {
+        const TestEntry &entry = entries[i];
+        const bool sizesInExtra = i == 0;
+        QByteArray extra;
+        append<quint16>(extra, 0x0001);
+        if (sizesInExtra) {
+            append<quint16>(extra, layout.firstExtraSize);
+            append<quint64>(extra, quint64(entry.data.size()));
+            append<quint64>(extra, quint64(entry.data.size()));
+            extra.truncate(4 + layout.firstExtraSize);
+        } else {
+            append<quint16>(extra, 8);
+            append<quint64>(extra, offsets[i]);
+        }
+
+        append<quint32>(archive, 0x02014b50);
+        append<quint16>(archive, 45);
+        append<quint16>(archive, 45);
+        append<quint16>(archive, 0);
+        append<quint16>(archive, 0);
+        append<quint16>(archive, 0);
+        append<quint16>(archive, 0x21);
+        append<quint32>(archive, entry.crc);
+        append<quint32>(archive, sizesInExtra ? 0xffffffff : quint32(entry.data.size()));
+        append<quint32>(archive, sizesInExtra ? 0xffffffff : quint32(entry.data.size()));
+        append<quint16>(archive, quint16(entry.name.size()));
+        append<quint16>(archive, quint16(extra.size()));
+        append<quint16>(archive, 0);
+        append<quint16>(archive, 0);
+        append<quint16>(archive, 0);
+        append<quint32>(archive, 0);
+        append<quint32>(archive, sizesInExtra ? quint32(offsets[i]) : 0xffffffff);
+        archive.append(entry.name);
+        archive.append(extra);
+    }
+    const quint64 directorySize = quint64(archive.size()) - directoryOffset;
+    const quint64 count = layout.declaredCount ? layout.declaredCount : quint64(entries.size());
+
+    const quint64 recordOffset = quint64(archive.size());
+    append<quint32>(archive, 0x06064b50);
+    append<quint64>(archive, 44);
+    append<quint16>(archive, 45);
+    append<quint16>(archive, 45);
+    append<quint32>(archive, 0);
+    append<quint32>(archive, 0);
+    append<quint64>(archive, count);
+    append<quint64>(archive, count);
+    append<quint64>(archive, directorySize);
+    append<quint64>(archive, directoryOffset);
+
+    append<quint32>(archive, 0x07064b50);
+    append<quint32>(archive, 0);
+    append<quint64>(archive, recordOffset + quint64(layout.locatorShift));
+    append<quint32>(archive, 1);
+
+    append<quint32>(archive, 0x06054b50);
+    append<quint16>(archive, 0);
+    append<quint16>(archive, 0);
+    append<quint16>(archive, 0xffff);
+    append<quint16>(archive, 0xffff);
+    append<quint32>(archive, 0xffffffff);
+    append<quint32>(archive, 0xffffffff);
+    append<quint16>(archive, 0);
+    return archive;
+}
+
+const QList<TestEntry> TwoEntries = {
+    { "hello.txt", "hello\n", 0x363a3020 },
+    { "dir/second.txt", "second entry\n", 0x8de7d86e },
+};
+
+}
+
+class TestZipArchive : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void readsZip64EndRecord();
+    void rejectsForgedZip64Count();
+    void rejectsShortZip64Extra();
+    void rejectsLocatorPastRecord();
+};
+
+void TestZipArchive::readsZip64EndRecord()
+{
+    ZipArchive archive;
+    QVERIFY(archive.open(zip64Archive(TwoEntries)));
+    QCOMPARE(archive.entryCount(), qsizetype(2));
+
+    for (qsizetype i = 0; i < TwoEntries.size(); ++i) {
+        const TestEntry &entry = TwoEntries[i];
+        QCOMPARE(archive.name(i), QString::fromLatin1(entry.name));
+        QCOMPARE(archive.crc(i), entry.crc);
+        QCOMPARE(archive.compressedSize(i), qint64(entry.data.size()));
+        QCOMPARE(archive.uncompressedSize(i), qint64(entry.data.size()));
+
+        const uchar *data = archive.entryData(i);
+        QVERIFY(data);
+        QCOMPARE(QByteArray(reinterpret_cast<const char *>(data), entry.data.size()), entry.data);
+    }
+    QCOMPARE(archive.localHeaderOffset(0), qint64(0));
+    QCOMPARE(archive.localHeaderOffset(1), qint64(30 + 9 + 6));
+}
+
+void TestZipArchive::rejectsForgedZip64Count()
+{
+    // More entries than the directory has room for
+    Layout layout;
+    layout.declaredCount = quint64(1) << 40;
+    ZipArchive archive;
+    QVERIFY(!archive.open(zip64Archive(TwoEntries, layout)));
+}
+
+void TestZipArchive::rejectsShortZip64Extra()
+{
+    // Both sizes are saturated but the extra field only carries one
+    Layout layout;
+    layout.firstExtraSize = 8;
+    ZipArchive archive;
+    QVERIFY(!archive.open(zip64Archive(TwoEntries, layout)));
+}
+
+void TestZipArchive::rejectsLocatorPastRecord()
+{
+    Layout layout;
+    layout.locatorShift = 8;
+    ZipArchive archive;
+    QVERIFY(!archive.open(zip64Archive(TwoEntries, layout)));
+}
+
+QTEST_APPLESS_MAIN(TestZipArchive)
+
+#include "tst_ziparchive.moc"